@@ -170,3 +170,95 @@ GLuint GLUtils::CreateProgram(const char *pVertexShaderSource, const char *pFrag
     GLuint vertexShaderHandle, fragShaderHandle;
     return CreateProgram(pVertexShaderSource, pFragShaderSource, vertexShaderHandle, fragShaderHandle);
 }
+
+static const char *TEXTURE_FORMAT_NAMES[TEXTURE_FORMAT_COUNT] = {"rgba8", "r8", "rg8", "rgba16f", "rgb565"};
+
+int GLUtils::getTextureFormatByName(const std::string &name) {
+    for (int i = 0; i < TEXTURE_FORMAT_COUNT; i++) {
+        if (name == TEXTURE_FORMAT_NAMES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *GLUtils::getTextureFormatName(int format) {
+    return format >= 0 && format < TEXTURE_FORMAT_COUNT ? TEXTURE_FORMAT_NAMES[format] : "unknown";
+}
+
+static void texImageForFormat(int format, int width, int height) {
+    switch (format) {
+        case TEXTURE_FORMAT_R8:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+            break;
+        case TEXTURE_FORMAT_RG8:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, width, height, 0, GL_RG, GL_UNSIGNED_BYTE, nullptr);
+            break;
+        case TEXTURE_FORMAT_RGBA16F:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+            break;
+        case TEXTURE_FORMAT_RGB565:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB565, width, height, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, nullptr);
+            break;
+        default:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            break;
+    }
+    // 单通道的亮度纹理采样成灰度，后面的滤镜不用知道它是R8
+    GLint green = format == TEXTURE_FORMAT_R8 ? GL_RED : GL_GREEN;
+    GLint blue = format == TEXTURE_FORMAT_R8 ? GL_RED : GL_BLUE;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, green);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, blue);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ALPHA);
+}
+
+int GLUtils::AllocFramebufferTexture(GLuint framebuffer, GLuint texture, int format, int width, int height) {
+    static bool unsupported[TEXTURE_FORMAT_COUNT] = {false};
+    if (format < 0 || format >= TEXTURE_FORMAT_COUNT || unsupported[format]) {
+        format = TEXTURE_FORMAT_RGBA8;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    texImageForFormat(format, width, height);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    if (format != TEXTURE_FORMAT_RGBA8 && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        // 比如没有EXT_color_buffer_half_float时的RGBA16F，只提示一次
+        std::cout << "GLUtils::AllocFramebufferTexture " << getTextureFormatName(format)
+                  << " is not renderable, using rgba8" << std::endl;
+        unsupported[format] = true;
+        format = TEXTURE_FORMAT_RGBA8;
+        texImageForFormat(format, width, height);
+    }
+    return format;
+}
+
+void GLUtils::InvalidateFramebuffer(bool color, bool depthStencil) {
+    // glInvalidateFramebuffer是ES3的，ES2的驱动上什么都不做
+    static int isES3 = -1;
+    if (isES3 < 0) {
+        const char *version = (const char *) glGetString(GL_VERSION);
+        isES3 = version != nullptr && strncmp(version, "OpenGL ES ", 10) == 0 && version[10] >= '3';
+    }
+    if (!isES3 || (!color && !depthStencil)) {
+        return;
+    }
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    // 默认帧缓冲和FBO的附件名字不一样
+    GLenum attachments[3];
+    int count = 0;
+    if (color) {
+        attachments[count++] = framebuffer == 0 ? GL_COLOR : GL_COLOR_ATTACHMENT0;
+    }
+    if (depthStencil) {
+        attachments[count++] = framebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+        attachments[count++] = framebuffer == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+    }
+    glInvalidateFramebuffer(GL_FRAMEBUFFER, count, attachments);
+}
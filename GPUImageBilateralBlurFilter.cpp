@@ -124,11 +124,17 @@ void GPUImageBilateralBlurFilter::setDistanceNormalizationFactor(const GLfloat n
 }
 
 void GPUImageBilateralBlurFilter::setTexelSize(const int w, const int h) {
-    whVal[0] = w;
-    whVal[1] = h;
+    // 步长是一个像素，之前直接传宽高，所有采样点都被夹到了边上
+    whVal[0] = 1.0f / w;
+    whVal[1] = 1.0f / h;
     setFloatVec2(singleStepOffsetLocation, (float *)&whVal);
 }
 
+int GPUImageBilateralBlurFilter::getSamplingRadius() {
+    // 沿对角线最远4步
+    return 4;
+}
+
 void GPUImageBilateralBlurFilter::onOutputSizeChanged(int width, int height) {
     GPUImageFilter::onOutputSizeChanged(width, height);
 
@@ -0,0 +1,368 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <cmath>
+#include <cstring>
+#include "GPUImageCompositorFilter.h"
+#include "TextureRotationUtil.h"
+
+#define MATH_PI 3.1415926535897932384626433832802
+#define LAYER_VERTEX_FLOATS 6 // <vec2 pos, vec2 tex, float opacity, float texture slot>
+
+const char GPUImageCompositorFilter::COMPOSITOR_VERTEX_SHADER[] = "attribute vec4 position;\n"
+                                                                  "attribute vec2 inputTextureCoordinate;\n"
+                                                                  "attribute vec2 layerParams;\n"
+                                                                  " \n"
+                                                                  "varying vec2 textureCoordinate;\n"
+                                                                  "varying vec2 v_layerParams;\n"
+                                                                  " \n"
+                                                                  "void main()\n"
+                                                                  "{\n"
+                                                                  "    gl_Position = position;\n"
+                                                                  "    textureCoordinate = inputTextureCoordinate;\n"
+                                                                  "    v_layerParams = layerParams;\n"
+                                                                  "}";
+
+// 一次绘制最多混合8张纹理，GLES2里sampler数组只能用常量下标，所以按槽位逐个判断
+const char GPUImageCompositorFilter::COMPOSITOR_FRAGMENT_SHADER[] = "varying highp vec2 textureCoordinate;\n"
+                                                                    "varying highp vec2 v_layerParams;// opacity, texture slot\n"
+                                                                    " \n"
+                                                                    "uniform sampler2D s_layerTextures[8];\n"
+                                                                    " \n"
+                                                                    "void main()\n"
+                                                                    "{\n"
+                                                                    "    highp float slot = v_layerParams.y;\n"
+                                                                    "    lowp vec4 color;\n"
+                                                                    "    if (slot < 0.5) color = texture2D(s_layerTextures[0], textureCoordinate);\n"
+                                                                    "    else if (slot < 1.5) color = texture2D(s_layerTextures[1], textureCoordinate);\n"
+                                                                    "    else if (slot < 2.5) color = texture2D(s_layerTextures[2], textureCoordinate);\n"
+                                                                    "    else if (slot < 3.5) color = texture2D(s_layerTextures[3], textureCoordinate);\n"
+                                                                    "    else if (slot < 4.5) color = texture2D(s_layerTextures[4], textureCoordinate);\n"
+                                                                    "    else if (slot < 5.5) color = texture2D(s_layerTextures[5], textureCoordinate);\n"
+                                                                    "    else if (slot < 6.5) color = texture2D(s_layerTextures[6], textureCoordinate);\n"
+                                                                    "    else color = texture2D(s_layerTextures[7], textureCoordinate);\n"
+                                                                    "    // Premultiplied output, the blend mode is selected with glBlendFunc\n"
+                                                                    "    lowp float alpha = color.a * v_layerParams.x;\n"
+                                                                    "    gl_FragColor = vec4(color.rgb * alpha, alpha);\n"
+                                                                    "}";
+
+GPUImageCompositorFilter::GPUImageCompositorFilter() :
+        GPUImageFilter(NO_FILTER_VERTEX_SHADER, NO_FILTER_FRAGMENT_SHADER) {
+}
+
+GPUImageCompositorFilter::~GPUImageCompositorFilter() {
+    if (m_LayerProgramId != GL_NONE) {
+        glDeleteProgram(m_LayerProgramId);
+        glDeleteBuffers(1, &m_VboId);
+    }
+    for (CompositorLayer &layer : m_Layers) {
+        if (layer.ownsTexture) {
+            glDeleteTextures(1, &layer.textureId);
+        }
+    }
+}
+
+void GPUImageCompositorFilter::onInit() {
+    GPUImageFilter::onInit();
+
+    m_LayerProgramId = GLUtils::CreateProgram(COMPOSITOR_VERTEX_SHADER, COMPOSITOR_FRAGMENT_SHADER);
+    if (!m_LayerProgramId) {
+        return;
+    }
+    m_AttribLayerPosition = glGetAttribLocation(m_LayerProgramId, "position");
+    m_AttribLayerTexCoord = glGetAttribLocation(m_LayerProgramId, "inputTextureCoordinate");
+    m_AttribLayerParams = glGetAttribLocation(m_LayerProgramId, "layerParams");
+
+    // 槽位i固定对应纹理单元i
+    GLint units[MAX_COMPOSITOR_BATCH_TEXTURES];
+    for (int i = 0; i < MAX_COMPOSITOR_BATCH_TEXTURES; i++) {
+        units[i] = i;
+    }
+    glUseProgram(m_LayerProgramId);
+    glUniform1iv(glGetUniformLocation(m_LayerProgramId, "s_layerTextures"), MAX_COMPOSITOR_BATCH_TEXTURES, units);
+    glUseProgram(GL_NONE);
+
+    glGenBuffers(1, &m_VboId);
+}
+
+int GPUImageCompositorFilter::addLayer(RenderImage *image) {
+    int layerId;
+    {
+        std::lock_guard<std::mutex> guard(m_LayerIdLock);
+        layerId = m_NextLayerId++;
+    }
+    runOnDraw([this, layerId, image]() {
+        CompositorLayer layer = {layerId, GL_NONE, true, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f,
+                                 COMPOSITOR_BLEND_NORMAL, true};
+        glGenTextures(1, &layer.textureId);
+        glBindTexture(GL_TEXTURE_2D, layer.textureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, GL_NONE);
+        uploadLayerImage(layer, image);
+        m_Layers.push_back(layer);
+        m_LayersDirty = true;
+    });
+    return layerId;
+}
+
+int GPUImageCompositorFilter::addLayer(GLuint textureId) {
+    int layerId;
+    {
+        std::lock_guard<std::mutex> guard(m_LayerIdLock);
+        layerId = m_NextLayerId++;
+    }
+    runOnDraw([this, layerId, textureId]() {
+        CompositorLayer layer = {layerId, textureId, false, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f,
+                                 COMPOSITOR_BLEND_NORMAL, true};
+        m_Layers.push_back(layer);
+        m_LayersDirty = true;
+    });
+    return layerId;
+}
+
+void GPUImageCompositorFilter::removeLayer(int layerId) {
+    runOnDraw([this, layerId]() {
+        for (std::vector<CompositorLayer>::iterator iter = m_Layers.begin(); iter != m_Layers.end(); ++iter) {
+            if (iter->id == layerId) {
+                if (iter->ownsTexture) {
+                    glDeleteTextures(1, &iter->textureId);
+                }
+                m_Layers.erase(iter);
+                m_LayersDirty = true;
+                break;
+            }
+        }
+    });
+}
+
+void GPUImageCompositorFilter::setLayerImage(int layerId, RenderImage *image) {
+    runOnDraw([this, layerId, image]() {
+        CompositorLayer *layer = findLayer(layerId);
+        if (layer != nullptr && layer->ownsTexture) {
+            uploadLayerImage(*layer, image);
+        }
+    });
+}
+
+void GPUImageCompositorFilter::setLayerTransform(int layerId, float x, float y, float scaleX, float scaleY,
+                                                 float rotation) {
+    runOnDraw([this, layerId, x, y, scaleX, scaleY, rotation]() {
+        CompositorLayer *layer = findLayer(layerId);
+        if (layer != nullptr) {
+            layer->x = x;
+            layer->y = y;
+            layer->scaleX = scaleX;
+            layer->scaleY = scaleY;
+            layer->rotation = rotation;
+            m_LayersDirty = true;
+        }
+    });
+}
+
+void GPUImageCompositorFilter::setLayerOpacity(int layerId, float opacity) {
+    runOnDraw([this, layerId, opacity]() {
+        CompositorLayer *layer = findLayer(layerId);
+        if (layer != nullptr) {
+            layer->opacity = opacity;
+            m_LayersDirty = true;
+        }
+    });
+}
+
+void GPUImageCompositorFilter::setLayerBlendMode(int layerId, CompositorBlendMode blendMode) {
+    runOnDraw([this, layerId, blendMode]() {
+        CompositorLayer *layer = findLayer(layerId);
+        if (layer != nullptr) {
+            layer->blendMode = blendMode;
+            m_LayersDirty = true;
+        }
+    });
+}
+
+void GPUImageCompositorFilter::setLayerVisible(int layerId, bool visible) {
+    runOnDraw([this, layerId, visible]() {
+        CompositorLayer *layer = findLayer(layerId);
+        if (layer != nullptr) {
+            layer->visible = visible;
+            m_LayersDirty = true;
+        }
+    });
+}
+
+GPUImageCompositorFilter::CompositorLayer *GPUImageCompositorFilter::findLayer(int layerId) {
+    for (CompositorLayer &layer : m_Layers) {
+        if (layer.id == layerId) {
+            return &layer;
+        }
+    }
+    return nullptr;
+}
+
+void GPUImageCompositorFilter::uploadLayerImage(CompositorLayer &layer, RenderImage *image) {
+    if (image == nullptr || image->format != IMAGE_FORMAT_RGBA) {
+        std::cout << "GPUImageCompositorFilter::uploadLayerImage only RGBA layers are supported" << std::endl;
+        return;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, layer.textureId);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 image->planes[0]);
+    glBindTexture(GL_TEXTURE_2D, GL_NONE);
+}
+
+void GPUImageCompositorFilter::buildBatches(const float *textureBuffer) {
+    m_Vertices.clear();
+    m_Batches.clear();
+    if (m_ViewWidth <= 0 || m_ViewHeight <= 0) {
+        return;
+    }
+    float halfWidth = m_ViewWidth * 0.5f;
+    float halfHeight = m_ViewHeight * 0.5f;
+    for (const CompositorLayer &layer : m_Layers) {
+        if (!layer.visible || layer.opacity <= 0.0f) {
+            continue;
+        }
+        // 混合模式变化或者纹理槽位用完时开始新的一批
+        LayerBatch *batch = m_Batches.empty() ? nullptr : &m_Batches.back();
+        int slot = -1;
+        if (batch != nullptr && batch->blendMode == layer.blendMode) {
+            for (int i = 0; i < batch->textureCount; i++) {
+                if (batch->textureIds[i] == layer.textureId) {
+                    slot = i;
+                }
+            }
+            if (slot < 0 && batch->textureCount < MAX_COMPOSITOR_BATCH_TEXTURES) {
+                slot = batch->textureCount++;
+                batch->textureIds[slot] = layer.textureId;
+            }
+        }
+        if (slot < 0) {
+            LayerBatch newBatch;
+            newBatch.firstVertex = m_Vertices.size() / LAYER_VERTEX_FLOATS;
+            newBatch.vertexCount = 0;
+            newBatch.blendMode = layer.blendMode;
+            newBatch.textureCount = 1;
+            newBatch.textureIds[0] = layer.textureId;
+            m_Batches.push_back(newBatch);
+            batch = &m_Batches.back();
+            slot = 0;
+        }
+
+        // 在像素空间里旋转，避免非正方形输出时图层被拉伸
+        float radians = static_cast<float>(MATH_PI / 180.0f * layer.rotation);
+        float cosR = cosf(radians);
+        float sinR = sinf(radians);
+        GLfloat corners[4][LAYER_VERTEX_FLOATS];
+        for (int i = 0; i < 4; i++) {
+            float px = TextureRotationUtil::CUBE[i * 2] * layer.scaleX * halfWidth;
+            float py = TextureRotationUtil::CUBE[i * 2 + 1] * layer.scaleY * halfHeight;
+            corners[i][0] = layer.x + (px * cosR - py * sinR) / halfWidth;
+            corners[i][1] = layer.y + (px * sinR + py * cosR) / halfHeight;
+            corners[i][2] = textureBuffer[i * 2];
+            corners[i][3] = textureBuffer[i * 2 + 1];
+            corners[i][4] = layer.opacity;
+            corners[i][5] = slot;
+        }
+        // Triangle strip corners 0 1 2 3 as two triangles
+        const int order[6] = {0, 1, 2, 2, 1, 3};
+        for (int i = 0; i < 6; i++) {
+            m_Vertices.insert(m_Vertices.end(), corners[order[i]], corners[order[i]] + LAYER_VERTEX_FLOATS);
+        }
+        batch->vertexCount += 6;
+    }
+
+    int vertexCount = m_Vertices.size() / LAYER_VERTEX_FLOATS;
+    if (vertexCount == 0) {
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_VboId);
+    if (vertexCount > m_VboVertexCapacity) {
+        m_VboVertexCapacity = vertexCount * 2;
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * LAYER_VERTEX_FLOATS * m_VboVertexCapacity, nullptr,
+                     GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * m_Vertices.size(), m_Vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, GL_NONE);
+}
+
+void GPUImageCompositorFilter::drawLayers() {
+    glUseProgram(m_LayerProgramId);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VboId);
+    glEnableVertexAttribArray(m_AttribLayerPosition);
+    glVertexAttribPointer(m_AttribLayerPosition, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * LAYER_VERTEX_FLOATS,
+                          (const void *) 0);
+    glEnableVertexAttribArray(m_AttribLayerTexCoord);
+    glVertexAttribPointer(m_AttribLayerTexCoord, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * LAYER_VERTEX_FLOATS,
+                          (const void *) (sizeof(GLfloat) * 2));
+    glEnableVertexAttribArray(m_AttribLayerParams);
+    glVertexAttribPointer(m_AttribLayerParams, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * LAYER_VERTEX_FLOATS,
+                          (const void *) (sizeof(GLfloat) * 4));
+
+    glEnable(GL_BLEND);
+    for (const LayerBatch &batch : m_Batches) {
+        // 片元着色器输出的是预乘alpha的颜色
+        switch (batch.blendMode) {
+            case COMPOSITOR_BLEND_ADD:
+                glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+                break;
+            case COMPOSITOR_BLEND_MULTIPLY:
+                glBlendFuncSeparate(GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+                break;
+            case COMPOSITOR_BLEND_SCREEN:
+                glBlendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC_COLOR, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+                break;
+            case COMPOSITOR_BLEND_NORMAL:
+            default:
+                glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+                break;
+        }
+        for (int i = 0; i < batch.textureCount; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, batch.textureIds[i]);
+        }
+        glDrawArrays(GL_TRIANGLES, batch.firstVertex, batch.vertexCount);
+    }
+    glDisable(GL_BLEND);
+
+    for (int i = MAX_COMPOSITOR_BATCH_TEXTURES - 1; i >= 0; i--) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glDisableVertexAttribArray(m_AttribLayerPosition);
+    glDisableVertexAttribArray(m_AttribLayerTexCoord);
+    glDisableVertexAttribArray(m_AttribLayerParams);
+    glBindBuffer(GL_ARRAY_BUFFER, GL_NONE);
+}
+
+void GPUImageCompositorFilter::onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer) {
+    runPendingOnDrawTasks();
+    GPUImageFilter::onDraw(textureId, cubeBuffer, textureBuffer);
+    if (!m_IsInitialized || !m_LayerProgramId) {
+        return;
+    }
+
+    // 图层没有变化时复用上一帧的顶点数据
+    if (m_LayersDirty || memcmp(m_LayerTextureBuffer, textureBuffer, sizeof(m_LayerTextureBuffer)) != 0) {
+        memcpy(m_LayerTextureBuffer, textureBuffer, sizeof(m_LayerTextureBuffer));
+        buildBatches(textureBuffer);
+        m_LayersDirty = false;
+    }
+    if (!m_Batches.empty()) {
+        drawLayers();
+    }
+}
+
+int GPUImageCompositorFilter::getSamplingRadius() {
+    return -1;
+}
+
+void GPUImageCompositorFilter::onOutputSizeChanged(int width, int height) {
+    GPUImageFilter::onOutputSizeChanged(width, height);
+    m_ViewWidth = width;
+    m_ViewHeight = height;
+    m_LayersDirty = true;
+}
@@ -86,6 +86,30 @@ void GPUImageFilter::onOutputSizeChanged(int width, int height) {
     m_Height = height;
 }
 
+int GPUImageFilter::getInputCount() {
+    return 1;
+}
+
+void GPUImageFilter::setInputTexture(int /* index */, GLuint /* textureId */, const float * /* textureBuffer */) {}
+
+void GPUImageFilter::setInternalScale(float /* scale */) {}
+
+void GPUImageFilter::setProfiler(GPUImageProfiler *profiler) {
+    m_Profiler = profiler;
+}
+
+int GPUImageFilter::getSamplingRadius() {
+    return 0;
+}
+
+int GPUImageFilter::getOutputTextureFormat() {
+    return m_OutputTextureFormat;
+}
+
+void GPUImageFilter::setOutputTextureFormat(int format) {
+    m_OutputTextureFormat = format;
+}
+
 bool GPUImageFilter::isInitialized() const {
     return m_IsInitialized;
 }
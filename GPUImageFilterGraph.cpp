@@ -0,0 +1,396 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <cmath>
+#include <algorithm>
+#include "TextureRotationUtil.h"
+#include "GPUImageFilterGraph.h"
+#include "GPUImageProfiler.h"
+#include "GPUImageTracer.h"
+
+#define GRAPH_INPUT_UNCONNECTED (-2)
+
+GPUImageFilterGraph::GPUImageFilterGraph() : GPUImageFilter() {
+}
+
+GPUImageFilterGraph::~GPUImageFilterGraph() {
+    destroyTextureSlots();
+    for (GraphNode &node : m_Nodes) {
+        delete node.filter;
+    }
+    m_Nodes.clear();
+}
+
+int GPUImageFilterGraph::addFilter(GPUImageFilter *filter) {
+    if (filter == nullptr) {
+        return -1;
+    }
+    GraphNode node;
+    node.filter = filter;
+    node.inputs.assign(filter->getInputCount(), GRAPH_INPUT_UNCONNECTED);
+    node.textureSlot = -1;
+    node.traceName = nullptr;
+    if (m_Profiler != nullptr) {
+        filter->setProfiler(m_Profiler);
+    }
+    m_Nodes.push_back(node);
+    m_Compiled = false;
+    return m_Nodes.size() - 1;
+}
+
+bool GPUImageFilterGraph::connect(int fromNode, int toNode, int toInput) {
+    if (fromNode < GRAPH_INPUT_NODE || fromNode >= (int) m_Nodes.size() ||
+        toNode < 0 || toNode >= (int) m_Nodes.size() || fromNode == toNode) {
+        std::cout << "GPUImageFilterGraph::connect invalid nodes " << fromNode << " -> " << toNode << std::endl;
+        return false;
+    }
+    std::vector<int> &inputs = m_Nodes[toNode].inputs;
+    if (toInput < 0 || toInput >= (int) inputs.size()) {
+        std::cout << "GPUImageFilterGraph::connect node " << toNode << " has no input " << toInput << std::endl;
+        return false;
+    }
+    inputs[toInput] = fromNode;
+    m_Compiled = false;
+    return true;
+}
+
+void GPUImageFilterGraph::setProfiler(GPUImageProfiler *profiler) {
+    GPUImageFilter::setProfiler(profiler);
+    for (GraphNode &node : m_Nodes) {
+        node.filter->setProfiler(profiler);
+    }
+}
+
+void GPUImageFilterGraph::setOutputNode(int node) {
+    m_OutputNode = node;
+    m_Compiled = false;
+}
+
+int GPUImageFilterGraph::getNodeCount() const {
+    return m_Nodes.size();
+}
+
+int GPUImageFilterGraph::getTextureSlotCount() const {
+    return (int) m_SlotFormats.size();
+}
+
+GPUImageFilter *GPUImageFilterGraph::getNodeFilter(int node) {
+    if (node < 0 || node >= (int) m_Nodes.size()) {
+        return nullptr;
+    }
+    return m_Nodes[node].filter;
+}
+
+bool GPUImageFilterGraph::compile() {
+    m_Compiled = true;
+    m_Valid = false;
+    m_Schedule.clear();
+    int nodeCount = m_Nodes.size();
+    if (m_OutputNode < 0 || m_OutputNode >= nodeCount) {
+        std::cout << "GPUImageFilterGraph::compile no output node" << std::endl;
+        return false;
+    }
+
+    // 从输出节点反向遍历，到达不了输出的节点不参与调度
+    std::vector<bool> needed(nodeCount, false);
+    std::vector<int> stack(1, m_OutputNode);
+    needed[m_OutputNode] = true;
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        for (int i = 0; i < (int) m_Nodes[node].inputs.size(); i++) {
+            int source = m_Nodes[node].inputs[i];
+            if (source == GRAPH_INPUT_UNCONNECTED) {
+                std::cout << "GPUImageFilterGraph::compile input " << i << " of node " << node
+                          << " is not connected" << std::endl;
+                return false;
+            }
+            if (source != GRAPH_INPUT_NODE && !needed[source]) {
+                needed[source] = true;
+                stack.push_back(source);
+            }
+        }
+    }
+
+    // Kahn拓扑排序，同一个源接到多个输入时只算一条边
+    std::vector<std::vector<int>> consumers(nodeCount);
+    std::vector<int> pendingInputs(nodeCount, 0);
+    for (int node = 0; node < nodeCount; node++) {
+        if (!needed[node]) {
+            continue;
+        }
+        std::vector<int> sources = m_Nodes[node].inputs;
+        std::sort(sources.begin(), sources.end());
+        sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+        for (int source : sources) {
+            if (source != GRAPH_INPUT_NODE) {
+                consumers[source].push_back(node);
+                pendingInputs[node]++;
+            }
+        }
+    }
+    std::vector<int> ready;
+    for (int node = nodeCount - 1; node >= 0; node--) {
+        if (needed[node] && pendingInputs[node] == 0) {
+            ready.push_back(node);
+        }
+    }
+    while (!ready.empty()) {
+        int node = ready.back();
+        ready.pop_back();
+        m_Schedule.push_back(node);
+        for (std::vector<int>::reverse_iterator iter = consumers[node].rbegin(); iter != consumers[node].rend(); ++iter) {
+            if (--pendingInputs[*iter] == 0) {
+                ready.push_back(*iter);
+            }
+        }
+    }
+    int neededCount = std::count(needed.begin(), needed.end(), true);
+    if ((int) m_Schedule.size() != neededCount) {
+        std::cout << "GPUImageFilterGraph::compile the graph has a cycle" << std::endl;
+        m_Schedule.clear();
+        return false;
+    }
+
+    // 按存活区间分配中间纹理，最后一个使用者执行完后纹理立即回收
+    std::vector<int> position(nodeCount, -1);
+    for (int i = 0; i < (int) m_Schedule.size(); i++) {
+        position[m_Schedule[i]] = i;
+    }
+    std::vector<int> lastUse(nodeCount, -1);
+    for (int node : m_Schedule) {
+        for (int consumer : consumers[node]) {
+            lastUse[node] = std::max(lastUse[node], position[consumer]);
+        }
+    }
+    // 空闲纹理按格式分开，只有同格式的节点才能复用
+    std::vector<std::vector<int>> freeSlots(TEXTURE_FORMAT_COUNT);
+    m_SlotFormats.clear();
+    for (int i = 0; i < (int) m_Schedule.size(); i++) {
+        GraphNode &node = m_Nodes[m_Schedule[i]];
+        node.textureSlot = -1;
+        node.releasedSlots.clear();
+        // 输出节点直接画到调用者的FBO上，除非还有别的节点要读它
+        if (m_Schedule[i] != m_OutputNode || !consumers[m_OutputNode].empty()) {
+            int format = node.filter->getOutputTextureFormat();
+            if (format < 0 || format >= TEXTURE_FORMAT_COUNT) {
+                format = TEXTURE_FORMAT_RGBA8;
+            }
+            if (freeSlots[format].empty()) {
+                node.textureSlot = (int) m_SlotFormats.size();
+                m_SlotFormats.push_back(format);
+            } else {
+                node.textureSlot = freeSlots[format].back();
+                freeSlots[format].pop_back();
+            }
+        }
+        for (int source : node.inputs) {
+            // 输出节点的纹理要保留到最后拷贝
+            if (source != GRAPH_INPUT_NODE && source != m_OutputNode && lastUse[source] == i) {
+                lastUse[source] = -1;
+                int slot = m_Nodes[source].textureSlot;
+                freeSlots[m_SlotFormats[slot]].push_back(slot);
+                node.releasedSlots.push_back(slot);
+            }
+        }
+    }
+    for (int node = 0; node < nodeCount; node++) {
+        if (!needed[node]) {
+            m_Nodes[node].textureSlot = -1;
+        }
+    }
+
+    m_Valid = true;
+    if (m_Width > 0 && m_Height > 0 && m_InternalScale < 1.0f) {
+        // 输出节点是否画进中间纹理现在才知道
+        updateNodeSizes();
+    }
+    if (m_Width > 0 && m_Height > 0 && m_SlotFormats != m_AllocatedSlotFormats) {
+        allocTextureSlots();
+    }
+    return true;
+}
+
+int GPUImageFilterGraph::getSamplingRadius() {
+    if (!m_Compiled) {
+        compile();
+    }
+    if (!m_Valid) {
+        return -1;
+    }
+    // 按拓扑序累加，每个节点取它所有输入里最大的半径
+    std::vector<int> radius(m_Nodes.size(), 0);
+    for (int node : m_Schedule) {
+        int nodeRadius = m_Nodes[node].filter->getSamplingRadius();
+        if (nodeRadius < 0) {
+            return -1;
+        }
+        int inputRadius = 0;
+        for (int source : m_Nodes[node].inputs) {
+            if (source != GRAPH_INPUT_NODE) {
+                inputRadius = std::max(inputRadius, radius[source]);
+            }
+        }
+        radius[node] = inputRadius + nodeRadius;
+    }
+    return radius[m_OutputNode];
+}
+
+void GPUImageFilterGraph::onInit() {
+    GPUImageFilter::onInit();
+    for (GraphNode &node : m_Nodes) {
+        node.filter->ifNeedInit();
+    }
+}
+
+void GPUImageFilterGraph::allocTextureSlots() {
+    destroyTextureSlots();
+    int slotCount = (int) m_SlotFormats.size();
+    m_Framebuffers.resize(slotCount);
+    m_FramebufferTextures.resize(slotCount);
+    if (slotCount == 0) {
+        return;
+    }
+    glGenFramebuffers(slotCount, m_Framebuffers.data());
+    glGenTextures(slotCount, m_FramebufferTextures.data());
+    for (int i = 0; i < slotCount; i++) {
+        GLUtils::AllocFramebufferTexture(m_Framebuffers[i], m_FramebufferTextures[i], m_SlotFormats[i],
+                                         m_InternalWidth, m_InternalHeight);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_AllocatedSlotFormats = m_SlotFormats;
+}
+
+void GPUImageFilterGraph::destroyTextureSlots() {
+    if (!m_FramebufferTextures.empty()) {
+        glDeleteTextures(m_FramebufferTextures.size(), m_FramebufferTextures.data());
+        m_FramebufferTextures.clear();
+    }
+    if (!m_Framebuffers.empty()) {
+        glDeleteFramebuffers(m_Framebuffers.size(), m_Framebuffers.data());
+        m_Framebuffers.clear();
+    }
+    m_AllocatedSlotFormats.clear();
+}
+
+void GPUImageFilterGraph::setInternalScale(float scale) {
+    scale = std::min(std::max(scale, 0.1f), 1.0f);
+    if (scale == m_InternalScale) {
+        return;
+    }
+    m_InternalScale = scale;
+    if (m_Width > 0 && m_Height > 0) {
+        onOutputSizeChanged(m_Width, m_Height);
+    }
+}
+
+void GPUImageFilterGraph::updateNodeSizes() {
+    for (int i = 0; i < (int) m_Nodes.size(); i++) {
+        // 只有直接画到调用者FBO的输出节点是全尺寸
+        bool full = i == m_OutputNode && (!m_Valid || m_Nodes[i].textureSlot < 0);
+        m_Nodes[i].filter->onOutputSizeChanged(full ? m_Width : m_InternalWidth, full ? m_Height : m_InternalHeight);
+    }
+}
+
+void GPUImageFilterGraph::onOutputSizeChanged(int width, int height) {
+    GPUImageFilter::onOutputSizeChanged(width, height);
+    m_Width = width;
+    m_Height = height;
+    bool scaled = m_InternalScale < 1.0f;
+    m_InternalWidth = scaled ? std::max(1, (int) std::lround(width * m_InternalScale)) : width;
+    m_InternalHeight = scaled ? std::max(1, (int) std::lround(height * m_InternalScale)) : height;
+    updateNodeSizes();
+    if (m_Compiled && m_Valid) {
+        allocTextureSlots();
+    } else {
+        destroyTextureSlots();
+    }
+}
+
+void GPUImageFilterGraph::onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer) {
+    runPendingOnDrawTasks();
+    if (!isInitialized()) {
+        return;
+    }
+    if (!m_Compiled) {
+        compile();
+    }
+    if (!m_Valid || m_AllocatedSlotFormats != m_SlotFormats) {
+        return;
+    }
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    bool scaled = m_InternalWidth != m_Width || m_InternalHeight != m_Height;
+    GLint viewport[4];
+    if (scaled) {
+        glGetIntegerv(GL_VIEWPORT, viewport);
+    }
+    for (int nodeId : m_Schedule) {
+        GraphNode &node = m_Nodes[nodeId];
+        int stage = -1;
+        uint64_t span = GPUImageTracer::beginSpan();
+        if ((m_Profiler != nullptr || span != 0) && node.stageName.empty()) {
+            node.stageName = "node" + std::to_string(nodeId) + ":" + GPUImageProfiler::getFilterName(node.filter);
+            node.traceName = GPUImageTracer::intern(node.stageName);
+        }
+        if (m_Profiler != nullptr) {
+            stage = m_Profiler->beginStage(node.stageName);
+        }
+        // 中间纹理是按GL坐标画的，读取时用和滤镜组一样的纹理坐标
+        for (int i = 1; i < (int) node.inputs.size(); i++) {
+            int source = node.inputs[i];
+            if (source == GRAPH_INPUT_NODE) {
+                node.filter->setInputTexture(i, textureId, textureBuffer);
+            } else {
+                node.filter->setInputTexture(i, m_FramebufferTextures[m_Nodes[source].textureSlot],
+                                             TextureRotationUtil::TEXTURE_ROTATED_180);
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, node.textureSlot < 0 ? previousFramebuffer
+                                                               : m_Framebuffers[node.textureSlot]);
+        if (scaled) {
+            if (node.textureSlot < 0) {
+                glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            } else {
+                glViewport(0, 0, m_InternalWidth, m_InternalHeight);
+            }
+        }
+        if (node.textureSlot >= 0) {
+            // 节点会画满整个中间纹理，之前的内容不用加载
+            GLUtils::InvalidateFramebuffer(true, true);
+        }
+        int source = node.inputs.empty() ? GRAPH_INPUT_NODE : node.inputs[0];
+        if (source == GRAPH_INPUT_NODE) {
+            node.filter->onDraw(textureId, cubeBuffer, textureBuffer);
+        } else {
+            node.filter->onDraw(m_FramebufferTextures[m_Nodes[source].textureSlot], TextureRotationUtil::CUBE,
+                                TextureRotationUtil::TEXTURE_ROTATED_180);
+        }
+        // 最后一个读者执行完的中间纹理不再需要写回内存
+        for (int slot : node.releasedSlots) {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffers[slot]);
+            GLUtils::InvalidateFramebuffer(true, false);
+        }
+        if (m_Profiler != nullptr) {
+            m_Profiler->endStage(stage);
+        }
+        GPUImageTracer::endSpan(node.traceName, span);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    if (scaled) {
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+    // 输出节点还被其它节点读取时它画在中间纹理里，最后拷贝到调用者的FBO
+    int outputSlot = m_Nodes[m_OutputNode].textureSlot;
+    if (outputSlot >= 0) {
+        GPUImageFilter::onDraw(m_FramebufferTextures[outputSlot], TextureRotationUtil::CUBE,
+                               TextureRotationUtil::TEXTURE_ROTATED_180);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffers[outputSlot]);
+        GLUtils::InvalidateFramebuffer(true, false);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    }
+}
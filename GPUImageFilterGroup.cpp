@@ -2,8 +2,12 @@
 // Created by liyang on 21-6-25.
 //
 
+#include <cmath>
+#include <algorithm>
 #include "TextureRotationUtil.h"
 #include "GPUImageFilterGroup.h"
+#include "GPUImageProfiler.h"
+#include "GPUImageTracer.h"
 
 GPUImageFilterGroup::GPUImageFilterGroup()
         : GPUImageFilter(true),
@@ -11,6 +15,8 @@ GPUImageFilterGroup::GPUImageFilterGroup()
           m_FramebufferTexturesLen(0),
           m_Framebuffers(nullptr),
           m_FramebufferTextures(nullptr) {
+    // 没设置格式时跟随最后一个滤镜
+    m_OutputTextureFormat = -1;
 }
 
 GPUImageFilterGroup::GPUImageFilterGroup(const std::vector<GPUImageFilter *> filters)
@@ -19,6 +25,7 @@ GPUImageFilterGroup::GPUImageFilterGroup(const std::vector<GPUImageFilter *> fil
           m_FramebufferTexturesLen(0),
           m_Framebuffers(nullptr),
           m_FramebufferTextures(nullptr) {
+    m_OutputTextureFormat = -1;
     m_Filters.assign(filters.begin(), filters.end());
     if (m_Filters.size() != 0) {
         updateMergedFilters();
@@ -38,9 +45,42 @@ void GPUImageFilterGroup::addFilter(GPUImageFilter *filter) {
         return;
     }
     m_Filters.push_back(filter);
+    if (m_Profiler != nullptr) {
+        filter->setProfiler(m_Profiler);
+    }
     updateMergedFilters();
 }
 
+void GPUImageFilterGroup::setProfiler(GPUImageProfiler *profiler) {
+    GPUImageFilter::setProfiler(profiler);
+    for (auto filter : m_Filters) {
+        filter->setProfiler(profiler);
+    }
+}
+
+int GPUImageFilterGroup::getSamplingRadius() {
+    int radius = 0;
+    for (auto filter : m_Filters) {
+        int filterRadius = filter->getSamplingRadius();
+        if (filterRadius < 0) {
+            return -1;
+        }
+        radius += filterRadius;
+    }
+    // 缩小渲染时中间结果的一个像素对应输出的多个像素
+    return m_InternalScale < 1.0f ? (int) std::ceil(radius / m_InternalScale) + 1 : radius;
+}
+
+int GPUImageFilterGroup::getOutputTextureFormat() {
+    if (m_OutputTextureFormat >= 0) {
+        return m_OutputTextureFormat;
+    }
+    if (m_Filters.empty()) {
+        return TEXTURE_FORMAT_RGBA8;
+    }
+    return m_Filters.back()->getOutputTextureFormat();
+}
+
 void GPUImageFilterGroup::onInit() {
     GPUImageFilter::onInit();
     for (auto filter : m_Filters) {
@@ -64,39 +104,40 @@ void GPUImageFilterGroup::onOutputSizeChanged(const int width, const int height)
     if (m_Framebuffers != nullptr) {
         destroyFramebuffers();
     }
+    m_OutputWidth = width;
+    m_OutputHeight = height;
+    // 缩放时除了最后一个滤镜都画在缩小的尺寸上，最后一个直接从小图画到输出尺寸
+    bool scaled = m_InternalScale < 1.0f;
+    m_InternalWidth = scaled ? std::max(1, (int) std::lround(width * m_InternalScale)) : width;
+    m_InternalHeight = scaled ? std::max(1, (int) std::lround(height * m_InternalScale)) : height;
     int size = m_Filters.size();
-
+    // 最后一个滤镜自己有多个pass(滤镜图)时按同样的比例缩小它内部的pass，前面的已经在小图上了
+    for (int i = 0; i < (int) m_MergedFilters.size(); i++) {
+        m_MergedFilters[i]->setInternalScale(i + 1 == (int) m_MergedFilters.size() ? m_InternalScale : 1.0f);
+    }
     for (int i = 0; i < size; i++) {
-        m_Filters[i]->onOutputSizeChanged(width, height);
+        m_Filters[i]->onOutputSizeChanged(m_InternalWidth, m_InternalHeight);
+    }
+    if (scaled && !m_MergedFilters.empty()) {
+        m_MergedFilters.back()->onOutputSizeChanged(width, height);
     }
     if (m_MergedFilters.size() > 0) {
         int size = m_MergedFilters.size();
         m_FramebuffersLen = size - 1;
-        m_FramebufferTexturesLen = size - 1;
+        m_FramebufferTexturesLen = m_FramebuffersLen;
         if (m_FramebuffersLen > 0) {
             m_Framebuffers = (GLuint *) malloc(sizeof(GLuint) * m_FramebuffersLen);
         }
         if (m_FramebufferTexturesLen > 0) {
             m_FramebufferTextures = (GLuint *) malloc(sizeof(GLuint) * m_FramebufferTexturesLen);
         }
-        for (int i = 0; i < size - 1; i++) {
+        for (int i = 0; i < m_FramebuffersLen; i++) {
             glGenFramebuffers(1, &m_Framebuffers[i]);
             glGenTextures(1, &m_FramebufferTextures[i]);
-            glBindTexture(GL_TEXTURE_2D, m_FramebufferTextures[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-                         GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-            glTexParameterf(GL_TEXTURE_2D,
-                            GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameterf(GL_TEXTURE_2D,
-                            GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameterf(GL_TEXTURE_2D,
-                            GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameterf(GL_TEXTURE_2D,
-                            GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-            glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffers[i]);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                                   GL_TEXTURE_2D, m_FramebufferTextures[i], 0);
+            // 第i个中间纹理由第i个滤镜写，格式由它决定，它是嵌套组的最后一个pass时由那个组决定
+            GLUtils::AllocFramebufferTexture(m_Framebuffers[i], m_FramebufferTextures[i],
+                                             m_MergedOutputs[i]->getOutputTextureFormat(),
+                                             m_InternalWidth, m_InternalHeight);
 
             glBindTexture(GL_TEXTURE_2D, 0);
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -104,6 +145,21 @@ void GPUImageFilterGroup::onOutputSizeChanged(const int width, const int height)
     }
 }
 
+void GPUImageFilterGroup::setInternalScale(float scale) {
+    scale = std::min(std::max(scale, 0.1f), 1.0f);
+    if (scale == m_InternalScale) {
+        return;
+    }
+    m_InternalScale = scale;
+    if (m_OutputWidth > 0 && m_OutputHeight > 0) {
+        onOutputSizeChanged(m_OutputWidth, m_OutputHeight);
+    }
+}
+
+float GPUImageFilterGroup::getInternalScale() const {
+    return m_InternalScale;
+}
+
 void GPUImageFilterGroup::onInitialized() {
     GPUImageFilter::onInitialized();
 }
@@ -127,13 +183,39 @@ GPUImageFilterGroup::onDraw(int textureId, const float *cubeBuffer, const float
     if (m_MergedFilters.size() != 0) {
         size = m_MergedFilters.size();
     }
+    // 最后一个滤镜画到调用者绑定的FBO上，组被嵌在滤镜图里时不一定是0
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    bool tracing = GPUImageTracer::isEnabled();
+    if ((m_Profiler != nullptr || tracing) && (int) m_StageNames.size() != size) {
+        m_StageNames.clear();
+        m_TraceNames.clear();
+        std::string groupName = GPUImageProfiler::getFilterName(this);
+        for (int i = 0; i < size; i++) {
+            m_StageNames.push_back(groupName + "/" + std::to_string(i) + ":" +
+                                   GPUImageProfiler::getFilterName(m_MergedFilters[i]));
+            m_TraceNames.push_back(GPUImageTracer::intern(m_StageNames.back()));
+        }
+    }
+    bool scaled = m_InternalScale < 1.0f && size > 1;
+    GLint viewport[4];
+    if (scaled) {
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glViewport(0, 0, m_InternalWidth, m_InternalHeight);
+    }
     int previousTexture = textureId;
     for (int i = 0; i < size; i++) {
         GPUImageFilter *filter = m_MergedFilters[i];
         bool isNotLast = i < size - 1;
+        if (scaled && !isNotLast) {
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        }
+        int stage = m_Profiler != nullptr ? m_Profiler->beginStage(m_StageNames[i]) : -1;
+        uint64_t span = tracing ? GPUImageTracer::beginSpan() : 0;
         if (isNotLast) {
             glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffers[i]);
-            glClearColor(0, 0, 0, 0);
+            // 滤镜会画满整个中间纹理，不用清，也不用加载上一帧的内容
+            GLUtils::InvalidateFramebuffer(true, true);
         }
         if (i == 0) {
             filter->onDraw(previousTexture, cubeBuffer, textureBuffer);
@@ -146,19 +228,35 @@ GPUImageFilterGroup::onDraw(int textureId, const float *cubeBuffer, const float
             filter->onDraw(previousTexture, TextureRotationUtil::CUBE,
                            TextureRotationUtil::TEXTURE_ROTATED_180);
         }
+        if (m_Profiler != nullptr) {
+            m_Profiler->endStage(stage);
+        }
+        if (span != 0) {
+            GPUImageTracer::endSpan(m_TraceNames[i], span);
+        }
+        if (i > 0) {
+            // 上一个中间纹理只有这个滤镜读，读完就可以丢掉
+            glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffers[i - 1]);
+            GLUtils::InvalidateFramebuffer(true, false);
+        }
+        if (isNotLast || i > 0) {
+            glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        }
         if (isNotLast) {
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
             previousTexture = m_FramebufferTextures[i];
         }
     }
 }
 
 void GPUImageFilterGroup::updateMergedFilters() {
+    m_StageNames.clear();
+    m_TraceNames.clear();
     if (m_Filters.size() == 0) {
         return;
     }
     if (m_MergedFilters.size() != 0)
         m_MergedFilters.clear();
+    m_MergedOutputs.clear();
 
     for (auto tmpFilter : m_Filters) {
         if (tmpFilter->isMIsGroupFilter()) {
@@ -170,9 +268,15 @@ void GPUImageFilterGroup::updateMergedFilters() {
                 for (auto filter : filters) {
                     m_MergedFilters.push_back(filter);
                 }
+                if (!filters.empty()) {
+                    m_MergedOutputs.insert(m_MergedOutputs.end(), filterGroup->m_MergedOutputs.begin(),
+                                           filterGroup->m_MergedOutputs.end() - 1);
+                    m_MergedOutputs.push_back(filterGroup);
+                }
             }
         } else {
             m_MergedFilters.push_back(tmpFilter);
+            m_MergedOutputs.push_back(tmpFilter);
         }
     }
 }
\ No newline at end of file
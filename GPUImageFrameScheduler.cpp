@@ -0,0 +1,297 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+#include "GPUImageFrameScheduler.h"
+#include "GPUImagePipelineParser.h"
+#include "GPUImageTracer.h"
+
+GPUImageFrameScheduler::GPUImageFrameScheduler(GPUImageRenderer *renderer, int capacity, int windowSize)
+        : m_Renderer(renderer),
+          m_Capacity(std::max(capacity, 1)),
+          m_WindowSize(std::max(windowSize, 1)),
+          m_MaxLatenessUs(DEFAULT_SCHEDULER_MAX_LATENESS_US) {
+    memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+GPUImageFrameScheduler::~GPUImageFrameScheduler() {
+    close();
+}
+
+int64_t GPUImageFrameScheduler::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void GPUImageFrameScheduler::submit(RenderImage *image, int64_t deadlineUs) {
+    RenderImage *dropped = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Stats.submitted++;
+        if (m_Closed) {
+            dropped = image;
+        } else {
+            // 直播源不能阻塞生产者，队列满了扔最旧的
+            if ((int) m_Frames.size() >= m_Capacity) {
+                dropped = m_Frames.front().image;
+                m_Frames.pop_front();
+                m_Stats.droppedOverflow++;
+            }
+            m_Frames.push_back({image, deadlineUs, m_NextId++});
+            m_FrameReady.notify_one();
+        }
+    }
+    if (dropped != nullptr) {
+        release(dropped);
+    }
+}
+
+void GPUImageFrameScheduler::submit(RenderImageHandle image, int64_t deadlineUs) {
+    if (image.empty()) {
+        return;
+    }
+    // 句柄放到堆上，队列里的指针在帧释放前一直有效
+    RenderImageHandle *owned = new RenderImageHandle(std::move(image));
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_OwnedImages[owned->get()] = owned;
+    }
+    submit(owned->get(), deadlineUs);
+}
+
+void GPUImageFrameScheduler::close() {
+    std::deque<ScheduledFrame> frames;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Closed = true;
+        frames.swap(m_Frames);
+        m_FrameReady.notify_all();
+    }
+    for (const ScheduledFrame &frame : frames) {
+        release(frame.image);
+    }
+}
+
+int64_t GPUImageFrameScheduler::estimatedCost() const {
+    return m_CostKnown ? (int64_t) m_CostUs : 0;
+}
+
+bool GPUImageFrameScheduler::isOverdue(const ScheduledFrame &frame, int64_t now, const ScheduledFrame *next) const {
+    // 后面那帧也已经该画了，这帧不如直接跳过，延迟更低
+    if (next != nullptr && next->deadlineUs - estimatedCost() <= now) {
+        return true;
+    }
+    // 只按已经迟到的时间算，估计偏大时不会把帧全扔掉
+    return now - frame.deadlineUs > m_MaxLatenessUs;
+}
+
+bool GPUImageFrameScheduler::renderNext(int64_t timeoutUs) {
+    std::vector<RenderImage *> dropped;
+    ScheduledFrame frame = {nullptr, 0, 0};
+    int64_t waitEnd = now() + timeoutUs;
+    {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        while (!m_Closed) {
+            int64_t current = now();
+            while (!m_Frames.empty() && isOverdue(m_Frames.front(), current, m_Frames.size() > 1 ? &m_Frames[1] : nullptr)) {
+                dropped.push_back(m_Frames.front().image);
+                m_Frames.pop_front();
+                m_Stats.droppedLate++;
+            }
+            if (!m_Frames.empty()) {
+                // 提前估计的耗时开始画，正好在截止时间呈现
+                int64_t start = m_Frames.front().deadlineUs - estimatedCost();
+                if (start <= current) {
+                    frame = m_Frames.front();
+                    m_Frames.pop_front();
+                    break;
+                }
+                if (start > waitEnd) {
+                    break;
+                }
+            } else if (current >= waitEnd) {
+                break;
+            }
+            // 等待期间来了新帧要重新挑选
+            int64_t until = m_Frames.empty() ? waitEnd : std::min(waitEnd, m_Frames.front().deadlineUs - estimatedCost());
+            m_FrameReady.wait_for(lock, std::chrono::microseconds(std::max<int64_t>(until - current, 0)));
+        }
+    }
+    for (RenderImage *image : dropped) {
+        release(image);
+    }
+    if (frame.image == nullptr) {
+        if (!dropped.empty()) {
+            updateQuality(m_CostUs, true);
+        }
+        return false;
+    }
+
+    uint64_t span = GPUImageTracer::beginSpan();
+    int64_t start = now();
+    m_Renderer->setRenderImage(frame.image);
+    m_Renderer->onDrawFrame();
+    if (m_PresentCallback) {
+        m_PresentCallback(frame);
+    }
+    int64_t done = now();
+    GPUImageTracer::endSpan("scheduled_frame", span);
+    release(frame.image);
+
+    double costUs = (double) (done - start);
+    // 切换质量后第一帧包含着色器编译，不计入耗时估计，之后的估计从新的滤镜重新开始
+    bool settling = m_SettleFrames > 0;
+    if (settling) {
+        m_SettleFrames--;
+    } else if (!m_CostKnown) {
+        m_CostUs = costUs;
+        m_CostKnown = true;
+    } else {
+        m_CostUs += (costUs - m_CostUs) * SCHEDULER_COST_SMOOTHING;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        double lateMs = (done - frame.deadlineUs) / 1000.0;
+        m_Stats.presented++;
+        if (lateMs > 0) {
+            m_Stats.presentedLate++;
+        }
+        m_Lateness.push_back(lateMs);
+        if ((int) m_Lateness.size() > m_WindowSize) {
+            m_Lateness.pop_front();
+        }
+        m_Stats.costMs = m_CostUs / 1000.0;
+    }
+    if (!settling) {
+        updateQuality(m_CostUs, !dropped.empty());
+    }
+    return true;
+}
+
+void GPUImageFrameScheduler::updateQuality(double costUs, bool droppedLate) {
+    if (m_QualityLevels.size() < 2) {
+        return;
+    }
+    int level;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        level = m_Stats.qualityLevel;
+    }
+    if (droppedLate || costUs > m_FrameBudgetUs) {
+        m_OverloadedFrames++;
+        m_RelaxedFrames = 0;
+    } else if (costUs < m_FrameBudgetUs * SCHEDULER_RECOVER_RATIO) {
+        m_RelaxedFrames++;
+        m_OverloadedFrames = 0;
+    } else {
+        m_OverloadedFrames = 0;
+        m_RelaxedFrames = 0;
+    }
+    if (m_OverloadedFrames >= SCHEDULER_DEGRADE_FRAMES && level + 1 < (int) m_QualityLevels.size()) {
+        setQualityLevel(level + 1);
+    } else if (m_RelaxedFrames >= SCHEDULER_RECOVER_FRAMES && level > 0) {
+        setQualityLevel(level - 1);
+    }
+}
+
+void GPUImageFrameScheduler::setQualityLevel(int level) {
+    const std::string &description = m_QualityLevels[level];
+    GPUImageFilter *filter = nullptr;
+    if (!description.empty()) {
+        filter = GPUImagePipelineParser::parse(description);
+        if (filter == nullptr) {
+            std::cout << "GPUImageFrameScheduler: quality level " << level << " is invalid, keeping the current one" << std::endl;
+            return;
+        }
+    }
+    m_Renderer->setFilter(filter);
+    m_OverloadedFrames = 0;
+    m_RelaxedFrames = 0;
+    m_SettleFrames = 1;
+    m_CostKnown = false;
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Stats.qualityLevel = level;
+    m_Stats.qualitySwitches++;
+}
+
+void GPUImageFrameScheduler::release(RenderImage *image) {
+    RenderImageHandle *owned = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        std::map<RenderImage *, RenderImageHandle *>::iterator iter = m_OwnedImages.find(image);
+        if (iter != m_OwnedImages.end()) {
+            owned = iter->second;
+            m_OwnedImages.erase(iter);
+        }
+    }
+    if (owned != nullptr) {
+        delete owned;
+        return;
+    }
+    if (m_ReleaseCallback) {
+        m_ReleaseCallback(image);
+    }
+}
+
+void GPUImageFrameScheduler::setPresentCallback(const std::function<void(const ScheduledFrame &frame)> &callback) {
+    m_PresentCallback = callback;
+}
+
+void GPUImageFrameScheduler::setReleaseCallback(const std::function<void(RenderImage *image)> &callback) {
+    m_ReleaseCallback = callback;
+}
+
+void GPUImageFrameScheduler::setMaxLateness(int64_t lateUs) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_MaxLatenessUs = lateUs;
+}
+
+void GPUImageFrameScheduler::setQualityLevels(const std::vector<std::string> &descriptions, int64_t frameBudgetUs) {
+    m_QualityLevels = descriptions;
+    m_FrameBudgetUs = frameBudgetUs;
+    if (!m_QualityLevels.empty()) {
+        setQualityLevel(0);
+    }
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Stats.qualitySwitches = 0;
+}
+
+SchedulerStats GPUImageFrameScheduler::getStats() const {
+    std::lock_guard<std::mutex> lock(m_Lock);
+    SchedulerStats stats = m_Stats;
+    std::vector<double> lateness(m_Lateness.begin(), m_Lateness.end());
+    stats.latenessP50 = stats.latenessP95 = stats.latenessP99 = stats.latenessMax = 0;
+    if (!lateness.empty()) {
+        std::sort(lateness.begin(), lateness.end());
+        size_t last = lateness.size() - 1;
+        stats.latenessP50 = lateness[last * 50 / 100];
+        stats.latenessP95 = lateness[last * 95 / 100];
+        stats.latenessP99 = lateness[last * 99 / 100];
+        stats.latenessMax = lateness[last];
+    }
+    return stats;
+}
+
+void GPUImageFrameScheduler::dump() const {
+    SchedulerStats stats = getStats();
+    std::cout << std::fixed << std::setprecision(3)
+              << "frames: submitted " << stats.submitted << " presented " << stats.presented
+              << " (late " << stats.presentedLate << ") dropped late " << stats.droppedLate
+              << " overflow " << stats.droppedOverflow << std::endl
+              << "lateness ms p50/p95/p99/max: " << stats.latenessP50 << " " << stats.latenessP95 << " "
+              << stats.latenessP99 << " " << stats.latenessMax << std::endl
+              << "cost ms: " << stats.costMs << " quality level: " << stats.qualityLevel
+              << " switches: " << stats.qualitySwitches << std::endl;
+    std::cout << std::defaultfloat;
+}
+
+void GPUImageFrameScheduler::reset() {
+    std::lock_guard<std::mutex> lock(m_Lock);
+    int level = m_Stats.qualityLevel;
+    memset(&m_Stats, 0, sizeof(m_Stats));
+    m_Stats.qualityLevel = level;
+    m_Lateness.clear();
+}
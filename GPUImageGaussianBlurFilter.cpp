@@ -24,7 +24,7 @@ const char *GPUImageGaussianBlurFilter::VERTEX_SHADER  =
         "	// Calculate the positions for the blur\n"
         "	int multiplier = 0;\n"
         "	vec2 blurStep;\n"
-        "   vec2 singleStepOffset = vec2(texelHeightOffset, texelWidthOffset);\n"
+        "   vec2 singleStepOffset = vec2(texelWidthOffset, texelHeightOffset);\n"
         "    \n"
         "	for (int i = 0; i < GAUSSIAN_SAMPLES; i++)\n"
         "   {\n"
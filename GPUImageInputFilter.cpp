@@ -4,6 +4,8 @@
 
 #include "TextureRotationUtil.h"
 #include "GPUImageInputFilter.h"
+#include "GPUImageProfiler.h"
+#include "GPUImageTracer.h"
 
 const char GPUImageInputFilter::VERTEX_SHADER_STR[] =
         "#version 300 es\n"
@@ -76,62 +78,87 @@ const char GPUImageInputFilter::FRAGMENT_SHADER_STR[] =
 void GPUImageInputFilter::setRenderImage(RenderImage *image) {
     m_RenderImageFormat = image->format;
     runOnDraw([this, image]() {
-        switch (image->format) {
-            case IMAGE_FORMAT_RGBA:
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[0]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->width,
-                             image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-                             image->planes[0]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-                break;
-            case IMAGE_FORMAT_NV12:
-            case IMAGE_FORMAT_NV21:
-                //upload Y plane data
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[0]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, image->width,
-                             image->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                             image->planes[0]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-                //update UV plane data
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[1]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, image->width >> 1,
-                             image->height >> 1, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
-                             image->planes[1]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-                break;
-            case IMAGE_FORMAT_I420:
-                //upload Y plane data
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[0]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, image->width,
-                             image->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                             image->planes[0]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-                //update U plane data
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[1]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, image->width >> 1,
-                             image->height >> 1, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                             image->planes[1]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-                //update V plane data
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[2]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, image->width >> 1,
-                             image->height >> 1, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                             image->planes[2]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-                break;
+        int stage = m_Profiler != nullptr ? m_Profiler->beginStage("upload") : -1;
+        uint64_t span = GPUImageTracer::beginSpan();
+        uploadRenderImage(image, m_TextureIds);
+        m_UseExternalTextures = false;
+        if (m_Profiler != nullptr) {
+            m_Profiler->endStage(stage);
         }
+        GPUImageTracer::endSpan("upload", span);
     });
 }
 
+void GPUImageInputFilter::setInputTextures(int format, const GLuint *textureIds) {
+    m_RenderImageFormat = format;
+    GLuint ids[TEXTURE_NUM] = {GL_NONE, GL_NONE, GL_NONE};
+    int count = format == IMAGE_FORMAT_RGBA ? 1 : (format == IMAGE_FORMAT_I420 ? 3 : 2);
+    for (int i = 0; i < count; i++) {
+        ids[i] = textureIds[i];
+    }
+    runOnDraw([this, ids]() {
+        memcpy(m_ExternalTextureIds, ids, sizeof(m_ExternalTextureIds));
+        m_UseExternalTextures = true;
+    });
+}
+
+void GPUImageInputFilter::genInputTextures(GLuint *textureIds) {
+    glGenTextures(TEXTURE_NUM, textureIds);
+    for (int i = 0; i < TEXTURE_NUM ; ++i) {
+        glBindTexture(GL_TEXTURE_2D, textureIds[i]);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, GL_NONE);
+    }
+}
+
+void GPUImageInputFilter::uploadPlane(GLuint textureId, GLenum format, int width, int height, int bytesPerPixel,
+                                      int linesize, const uint8_t *data) {
+    // 解码器给的平面行尾常有对齐填充，用GL_UNPACK_ROW_LENGTH直接跳过，不用先拷成紧凑的
+    bool padded = linesize > 0 && linesize != width * bytesPerPixel;
+    if (padded) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, linesize / bytesPerPixel);
+    }
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glBindTexture(GL_TEXTURE_2D, GL_NONE);
+    if (padded) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+}
+
+void GPUImageInputFilter::uploadRenderImage(const RenderImage *image, const GLuint *textureIds) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    switch (image->format) {
+        case IMAGE_FORMAT_RGBA:
+            uploadPlane(textureIds[0], GL_RGBA, image->width, image->height, 4, image->linesize[0],
+                        image->planes[0]);
+            break;
+        case IMAGE_FORMAT_NV12:
+        case IMAGE_FORMAT_NV21:
+            //upload Y plane data
+            uploadPlane(textureIds[0], GL_LUMINANCE, image->width, image->height, 1, image->linesize[0],
+                        image->planes[0]);
+            //update UV plane data
+            uploadPlane(textureIds[1], GL_LUMINANCE_ALPHA, image->width >> 1, image->height >> 1, 2,
+                        image->linesize[1], image->planes[1]);
+            break;
+        case IMAGE_FORMAT_I420:
+            //upload Y plane data
+            uploadPlane(textureIds[0], GL_LUMINANCE, image->width, image->height, 1, image->linesize[0],
+                        image->planes[0]);
+            //update U plane data
+            uploadPlane(textureIds[1], GL_LUMINANCE, image->width >> 1, image->height >> 1, 1,
+                        image->linesize[1], image->planes[1]);
+            //update V plane data
+            uploadPlane(textureIds[2], GL_LUMINANCE, image->width >> 1, image->height >> 1, 1,
+                        image->linesize[2], image->planes[2]);
+            break;
+    }
+}
+
 void GPUImageInputFilter::onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer) {
     glUseProgram(m_ProgramId);
     runPendingOnDrawTasks();
@@ -146,7 +173,7 @@ void GPUImageInputFilter::onDraw(int textureId, const float *cubeBuffer, const f
     glVertexAttribPointer(m_AttribTextureCoordinate, 2, GL_FLOAT, false, 8, textureBuffer);
     for (int i = 0; i < TEXTURE_NUM; ++i) {
         glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, m_TextureIds[i]);
+        glBindTexture(GL_TEXTURE_2D, m_UseExternalTextures ? m_ExternalTextureIds[i] : m_TextureIds[i]);
         char samplerName[64] = {0};
         sprintf(samplerName, "s_texture%d", i);
         GLUtils::setInt(m_ProgramId, samplerName, i);
@@ -167,16 +194,7 @@ void GPUImageInputFilter::onInitialized() {
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    glGenTextures(TEXTURE_NUM, m_TextureIds);
-    for (int i = 0; i < TEXTURE_NUM ; ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, m_TextureIds[i]);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, GL_NONE);
-    }
+    genInputTextures(m_TextureIds);
 }
 
 void GPUImageInputFilter::onInit() {
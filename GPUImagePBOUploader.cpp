@@ -0,0 +1,91 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <algorithm>
+#include "GPUImagePBOUploader.h"
+#include "GPUImageInputFilter.h"
+#include "RenderImagePool.h"
+
+GPUImagePBOUploader::GPUImagePBOUploader(int slots) {
+    // 缓冲区第一次prefetch时才创建，构造时可以还没有上下文
+    Slot slot;
+    slot.buffer = GL_NONE;
+    slot.capacity = 0;
+    m_Slots.resize(std::max(slots, 1), slot);
+}
+
+GPUImagePBOUploader::~GPUImagePBOUploader() {
+    for (Slot &slot : m_Slots) {
+        if (slot.buffer != GL_NONE) {
+            glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+}
+
+int GPUImagePBOUploader::getPrefetchedCount() const {
+    return m_Count;
+}
+
+bool GPUImagePBOUploader::prefetch(const RenderImage *image) {
+    if (image == nullptr || m_Count == (int) m_Slots.size()) {
+        return false;
+    }
+    Slot &slot = m_Slots[(m_Head + m_Count) % m_Slots.size()];
+    RenderImage view;
+    view.width = image->width;
+    view.height = image->height;
+    view.format = image->format;
+    size_t size = RenderImagePool::layoutRenderImage(&view, nullptr);
+    if (size == 0) {
+        return false;
+    }
+    if (slot.buffer == GL_NONE) {
+        glGenBuffers(1, &slot.buffer);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    if (slot.capacity < size) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        slot.capacity = size;
+    }
+    // INVALIDATE让驱动在上一次上传还没完成时换一块存储，不用等
+    uint8_t *data = (uint8_t *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (data == nullptr) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
+        std::cout << "GPUImagePBOUploader::prefetch glMapBufferRange failed" << std::endl;
+        return false;
+    }
+    RenderImagePool::layoutRenderImage(&view, data);
+    RenderImageUtil::copyRenderImage(const_cast<RenderImage *>(image), &view);
+    bool unmapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
+    if (!unmapped) {
+        // 映射期间存储被系统回收了，内容无效
+        return false;
+    }
+
+    slot.layout = view;
+    for (int i = 0; i < 3; i++) {
+        slot.layout.planes[i] = view.planes[i] != nullptr ? (uint8_t *) (uintptr_t) (view.planes[i] - data) : nullptr;
+    }
+    m_Count++;
+    return true;
+}
+
+bool GPUImagePBOUploader::upload(const GLuint *textureIds, int *format, int *width, int *height) {
+    if (m_Count == 0) {
+        return false;
+    }
+    Slot &slot = m_Slots[m_Head];
+    // 绑定了解包缓冲区时，平面指针就是缓冲区里的偏移
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    GPUImageInputFilter::uploadRenderImage(&slot.layout, textureIds);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
+    m_Head = (m_Head + 1) % (int) m_Slots.size();
+    m_Count--;
+    *format = slot.layout.format;
+    *width = slot.layout.width;
+    *height = slot.layout.height;
+    return true;
+}
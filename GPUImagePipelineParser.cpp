@@ -0,0 +1,362 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "GPUImagePipelineParser.h"
+#include "GPUImageRGBFilter.h"
+#include "GPUImageGaussianBlurFilter.h"
+#include "GPUImageSharpenFilter.h"
+#include "GPUImageBilateralBlurFilter.h"
+#include "GPUImageNormalBlendFilter.h"
+#include "GPUImageTextFilter.h"
+
+namespace {
+
+class PipelineScanner {
+public:
+    PipelineScanner(const std::string &text) : m_Text(text), m_Pos(0) {}
+
+    void skipSpaces() {
+        while (m_Pos < m_Text.size() && isspace((unsigned char) m_Text[m_Pos])) {
+            m_Pos++;
+        }
+    }
+
+    bool atEnd() {
+        skipSpaces();
+        return m_Pos >= m_Text.size();
+    }
+
+    char peek() {
+        skipSpaces();
+        return m_Pos < m_Text.size() ? m_Text[m_Pos] : '\0';
+    }
+
+    bool consume(char c) {
+        if (peek() == c) {
+            m_Pos++;
+            return true;
+        }
+        return false;
+    }
+
+    std::string readName() {
+        skipSpaces();
+        size_t start = m_Pos;
+        while (m_Pos < m_Text.size() && (isalnum((unsigned char) m_Text[m_Pos]) || m_Text[m_Pos] == '_')) {
+            m_Pos++;
+        }
+        return m_Text.substr(start, m_Pos - start);
+    }
+
+    // Quoted with '' or raw up to one of the stop characters, raw values are trimmed
+    bool readValue(const char *stops, std::string *value) {
+        skipSpaces();
+        value->clear();
+        if (m_Pos < m_Text.size() && m_Text[m_Pos] == '\'') {
+            m_Pos++;
+            while (m_Pos < m_Text.size() && m_Text[m_Pos] != '\'') {
+                if (m_Text[m_Pos] == '\\' && m_Pos + 1 < m_Text.size()) {
+                    m_Pos++;
+                }
+                value->push_back(m_Text[m_Pos++]);
+            }
+            if (m_Pos >= m_Text.size()) {
+                return false;
+            }
+            m_Pos++;
+            return true;
+        }
+        while (m_Pos < m_Text.size() && strchr(stops, m_Text[m_Pos]) == nullptr) {
+            value->push_back(m_Text[m_Pos++]);
+        }
+        while (!value->empty() && isspace((unsigned char) value->back())) {
+            value->pop_back();
+        }
+        return true;
+    }
+
+    size_t position() const {
+        return m_Pos;
+    }
+
+private:
+    const std::string &m_Text;
+    size_t m_Pos;
+};
+
+struct PendingInput {
+    std::string label;
+    int node;
+    int input;
+};
+
+bool parseError(const PipelineScanner &scanner, const std::string &message) {
+    std::cout << "GPUImagePipelineParser::parse " << message << " at " << scanner.position() << std::endl;
+    return false;
+}
+
+bool readLabels(PipelineScanner &scanner, std::vector<std::string> *labels) {
+    while (scanner.consume('[')) {
+        std::string label = scanner.readName();
+        if (label.empty() || !scanner.consume(']')) {
+            return parseError(scanner, "invalid label");
+        }
+        labels->push_back(label);
+    }
+    return true;
+}
+
+}
+
+std::map<std::string, GPUImagePipelineParser::FilterEntry> &GPUImagePipelineParser::registry() {
+    static std::map<std::string, FilterEntry> filters;
+    if (filters.empty()) {
+        filters["null"] = {{}, [](const PipelineFilterParams &) -> GPUImageFilter * {
+            return new GPUImageFilter();
+        }};
+        filters["rgb"] = {{"red", "green", "blue"}, [](const PipelineFilterParams &params) -> GPUImageFilter * {
+            float red, green, blue;
+            if (!getFloat(params, "red", 1.0f, &red) || !getFloat(params, "green", 1.0f, &green) ||
+                !getFloat(params, "blue", 1.0f, &blue)) {
+                return nullptr;
+            }
+            return new GPUImageRGBFilter(red, green, blue);
+        }};
+        filters["gaussianblur"] = {{"size"}, [](const PipelineFilterParams &params) -> GPUImageFilter * {
+            float size;
+            if (!getFloat(params, "size", 6.0f, &size)) {
+                return nullptr;
+            }
+            return new GPUImageGaussianBlurFilter(size);
+        }};
+        filters["sharpen"] = {{"sharpness"}, [](const PipelineFilterParams &params) -> GPUImageFilter * {
+            float sharpness;
+            if (!getFloat(params, "sharpness", 1.0f, &sharpness)) {
+                return nullptr;
+            }
+            return new GPUImageSharpenFilter(sharpness);
+        }};
+        filters["bilateral"] = {{"factor"}, [](const PipelineFilterParams &params) -> GPUImageFilter * {
+            float factor;
+            if (!getFloat(params, "factor", 1.0f, &factor)) {
+                return nullptr;
+            }
+            return new GPUImageBilateralBlurFilter(factor);
+        }};
+        filters["normalblend"] = {{}, [](const PipelineFilterParams &) -> GPUImageFilter * {
+            return new GPUImageNormalBlendFilter();
+        }};
+        filters["text"] = {{"text", "size", "mode", "font"}, [](const PipelineFilterParams &params) -> GPUImageFilter * {
+            float size;
+            std::string mode = getString(params, "mode", "bitmap");
+            if (!getFloat(params, "size", DEFAULT_GLYPH_PIXEL_SIZE, &size)) {
+                return nullptr;
+            }
+            if (mode != "bitmap" && mode != "sdf") {
+                std::cout << "GPUImagePipelineParser text mode must be bitmap or sdf, got " << mode << std::endl;
+                return nullptr;
+            }
+            GPUImageTextFilter *filter = new GPUImageTextFilter(
+                    getString(params, "font", std::string(DEFAULT_OGL_ASSETS_DIR) + "/Antonio-Regular.ttf"),
+                    mode == "sdf" ? GLYPH_RENDER_SDF : GLYPH_RENDER_BITMAP);
+            filter->setMString(getString(params, "text", ""));
+            filter->setTextSize(size);
+            return filter;
+        }};
+    }
+    return filters;
+}
+
+void GPUImagePipelineParser::registerFilter(const std::string &name, const std::vector<std::string> &paramNames,
+                                            const PipelineFilterFactory &factory) {
+    registry()[name] = {paramNames, factory};
+}
+
+bool GPUImagePipelineParser::getFloat(const PipelineFilterParams &params, const std::string &name,
+                                      float defaultValue, float *value) {
+    PipelineFilterParams::const_iterator iter = params.find(name);
+    if (iter == params.end()) {
+        *value = defaultValue;
+        return true;
+    }
+    char *end = nullptr;
+    *value = strtof(iter->second.c_str(), &end);
+    // nan和inf也能被strtof解析，滤镜参数不接受
+    if (iter->second.empty() || *end != '\0' || !std::isfinite(*value)) {
+        std::cout << "GPUImagePipelineParser parameter " << name << " is not a finite number: " << iter->second
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string GPUImagePipelineParser::getString(const PipelineFilterParams &params, const std::string &name,
+                                              const std::string &defaultValue) {
+    PipelineFilterParams::const_iterator iter = params.find(name);
+    return iter == params.end() ? defaultValue : iter->second;
+}
+
+GPUImageFilterGraph *GPUImagePipelineParser::parse(const std::string &description) {
+    GPUImageFilterGraph *graph = new GPUImageFilterGraph();
+    PipelineScanner scanner(description);
+    std::map<std::string, int> outputLabels;
+    std::vector<PendingInput> pendingInputs;
+    int lastChainEnd = -1;
+    bool ok = true;
+
+    while (ok) {
+        // 一条滤镜链
+        int previous = -1;
+        bool chainEndLabeled = false;
+        do {
+            std::vector<std::string> inputs;
+            std::vector<std::string> outputs;
+            if (!readLabels(scanner, &inputs)) {
+                ok = false;
+                break;
+            }
+            std::string name = scanner.readName();
+            std::map<std::string, FilterEntry>::iterator entry = registry().find(name);
+            if (entry == registry().end()) {
+                ok = parseError(scanner, "unknown filter '" + name + "'");
+                break;
+            }
+
+            // 参数：key=value 或者按声明顺序的位置参数
+            PipelineFilterParams params;
+            if (scanner.consume('=')) {
+                int index = 0;
+                do {
+                    std::string key;
+                    std::string value;
+                    if (!scanner.readValue("=:,;[", &value)) {
+                        ok = parseError(scanner, "unterminated quote");
+                        break;
+                    }
+                    if (scanner.consume('=')) {
+                        key = value;
+                        if (!scanner.readValue(":,;[", &value)) {
+                            ok = parseError(scanner, "unterminated quote");
+                            break;
+                        }
+                    } else if (index < (int) entry->second.paramNames.size()) {
+                        key = entry->second.paramNames[index];
+                    } else {
+                        ok = parseError(scanner, "too many parameters for " + name);
+                        break;
+                    }
+                    bool known = key == PIPELINE_FORMAT_PARAM;
+                    for (const std::string &paramName : entry->second.paramNames) {
+                        known = known || paramName == key;
+                    }
+                    if (!known) {
+                        ok = parseError(scanner, "unknown parameter '" + key + "' for " + name);
+                        break;
+                    }
+                    params[key] = value;
+                    index++;
+                } while (scanner.consume(':'));
+                if (!ok) {
+                    break;
+                }
+            }
+            if (!readLabels(scanner, &outputs)) {
+                ok = false;
+                break;
+            }
+
+            GPUImageFilter *filter = entry->second.factory(params);
+            if (filter == nullptr) {
+                ok = parseError(scanner, "invalid parameters for " + name);
+                break;
+            }
+            if (params.count(PIPELINE_FORMAT_PARAM) > 0) {
+                int format = GLUtils::getTextureFormatByName(params[PIPELINE_FORMAT_PARAM]);
+                if (format < 0) {
+                    delete filter;
+                    ok = parseError(scanner, "unknown texture format '" + params[PIPELINE_FORMAT_PARAM] + "'");
+                    break;
+                }
+                filter->setOutputTextureFormat(format);
+                // 格式要由滤镜自己的输出决定，不接受的滤镜直接报错，不要悄悄画成rgba8
+                if (filter->getOutputTextureFormat() != format) {
+                    delete filter;
+                    ok = parseError(scanner, name + " does not support format=" + params[PIPELINE_FORMAT_PARAM]);
+                    break;
+                }
+            }
+            int node = graph->addFilter(filter);
+            int inputCount = filter->getInputCount();
+            int input = 0;
+            if (previous >= 0) {
+                graph->connect(previous, node, input++);
+            } else if (inputs.empty()) {
+                pendingInputs.push_back({PIPELINE_INPUT_LABEL, node, input++});
+            }
+            for (const std::string &label : inputs) {
+                pendingInputs.push_back({label, node, input++});
+            }
+            if (input != inputCount) {
+                ok = parseError(scanner, name + " takes " + std::to_string(inputCount) + " inputs, got " +
+                                         std::to_string(input));
+                break;
+            }
+            for (const std::string &label : outputs) {
+                if (label == PIPELINE_INPUT_LABEL || outputLabels.count(label) != 0) {
+                    ok = parseError(scanner, "label [" + label + "] is already defined");
+                    break;
+                }
+                outputLabels[label] = node;
+            }
+            chainEndLabeled = !outputs.empty();
+            previous = node;
+        } while (ok && scanner.consume(','));
+        if (!ok) {
+            break;
+        }
+        lastChainEnd = chainEndLabeled ? -1 : previous;
+        if (!scanner.consume(';')) {
+            break;
+        }
+    }
+    if (ok && !scanner.atEnd()) {
+        ok = parseError(scanner, std::string("unexpected '") + scanner.peek() + "'");
+    }
+
+    // 标签可以先使用后定义，全部解析完再连接
+    for (const PendingInput &pending : pendingInputs) {
+        if (!ok) {
+            break;
+        }
+        if (pending.label == PIPELINE_INPUT_LABEL) {
+            ok = graph->connect(GRAPH_INPUT_NODE, pending.node, pending.input);
+        } else if (outputLabels.count(pending.label) != 0) {
+            ok = graph->connect(outputLabels[pending.label], pending.node, pending.input);
+        } else {
+            ok = parseError(scanner, "label [" + pending.label + "] is never defined");
+        }
+    }
+    if (ok) {
+        if (outputLabels.count(PIPELINE_OUTPUT_LABEL) != 0) {
+            graph->setOutputNode(outputLabels[PIPELINE_OUTPUT_LABEL]);
+        } else if (lastChainEnd >= 0) {
+            graph->setOutputNode(lastChainEnd);
+        } else {
+            ok = parseError(scanner, "no [out] label and the last chain has a labeled output");
+        }
+    }
+    if (ok) {
+        ok = graph->compile();
+    }
+    if (!ok) {
+        delete graph;
+        return nullptr;
+    }
+    return graph;
+}
@@ -0,0 +1,277 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <chrono>
+#include <string.h>
+#include "GPUImagePlayerHook.h"
+#include "GPUImageRenderer.h"
+#include "GPUImagePipelineParser.h"
+
+#define PLAYER_HOOK_SAVED_UNITS 4
+#define PLAYER_HOOK_SAVED_ATTRIBS 8
+
+static_assert(GPU_PLAYER_FORMAT_RGBA == IMAGE_FORMAT_RGBA && GPU_PLAYER_FORMAT_NV21 == IMAGE_FORMAT_NV21 &&
+              GPU_PLAYER_FORMAT_NV12 == IMAGE_FORMAT_NV12 && GPU_PLAYER_FORMAT_I420 == IMAGE_FORMAT_I420,
+              "GPU_PLAYER_FORMAT_* must match IMAGE_FORMAT_*");
+
+struct GPUImagePlayerHook {
+    GPUImageFilter *filter = nullptr;      // Owned by renderer once it exists
+    GPUImageRenderer *renderer = nullptr;
+    GLuint textureIds[TEXTURE_NUM] = {GL_NONE, GL_NONE, GL_NONE};
+    GLuint framebuffer = GL_NONE;
+    int width = 0;
+    int height = 0;
+    int format = 0;
+    bool profiling = false;
+    bool failed = false;
+    GPUImagePlayerStats stats;
+};
+
+static bool isES3Context() {
+    const char *version = (const char *) glGetString(GL_VERSION);
+    if (version == nullptr || strncmp(version, "OpenGL ES ", 10) != 0) {
+        return false;
+    }
+    return version[10] >= '3';
+}
+
+// 播放器(SDL)自己缓存了GL状态，滤镜改过的都要还原
+struct PlayerGLState {
+    GLint program;
+    GLint framebuffer;
+    bool es3;
+    GLint vertexArray;
+    GLint arrayBuffer;
+    GLint viewport[4];
+    GLint activeTexture;
+    GLint textures[PLAYER_HOOK_SAVED_UNITS];
+    GLint unpackAlignment;
+    GLboolean blend;
+    GLboolean scissor;
+    GLboolean depth;
+    GLint blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha;
+    GLfloat clearColor[4];
+    GLint attribEnabled[PLAYER_HOOK_SAVED_ATTRIBS];
+
+    void save() {
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+        // VAO是ES3的，ES2上查询会产生GL_INVALID_ENUM
+        es3 = isES3Context();
+        vertexArray = 0;
+        if (es3) {
+            glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertexArray);
+        }
+        glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+        for (int i = 0; i < PLAYER_HOOK_SAVED_UNITS; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glGetIntegerv(GL_TEXTURE_BINDING_2D, &textures[i]);
+        }
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+        blend = glIsEnabled(GL_BLEND);
+        scissor = glIsEnabled(GL_SCISSOR_TEST);
+        depth = glIsEnabled(GL_DEPTH_TEST);
+        glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrcRGB);
+        glGetIntegerv(GL_BLEND_DST_RGB, &blendDstRGB);
+        glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendSrcAlpha);
+        glGetIntegerv(GL_BLEND_DST_ALPHA, &blendDstAlpha);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+        // 属性开关属于当前绑定的VAO
+        for (int i = 0; i < PLAYER_HOOK_SAVED_ATTRIBS; i++) {
+            glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &attribEnabled[i]);
+        }
+    }
+
+    void restore() const {
+        glUseProgram(program);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        if (es3) {
+            glBindVertexArray(vertexArray);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
+        for (int i = 0; i < PLAYER_HOOK_SAVED_ATTRIBS; i++) {
+            if (attribEnabled[i]) {
+                glEnableVertexAttribArray(i);
+            } else {
+                glDisableVertexAttribArray(i);
+            }
+        }
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        for (int i = 0; i < PLAYER_HOOK_SAVED_UNITS; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        glActiveTexture(activeTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+        blend ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+        scissor ? glEnable(GL_SCISSOR_TEST) : glDisable(GL_SCISSOR_TEST);
+        depth ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+        glBlendFuncSeparate(blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha);
+        glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    }
+};
+
+static bool setupRenderer(GPUImagePlayerHook *hook, int width, int height) {
+    if (hook->renderer == nullptr) {
+        if (!isES3Context()) {
+            const char *version = (const char *) glGetString(GL_VERSION);
+            std::cout << "GPUImagePlayerHook: disabled, the filters need an OpenGL ES 3.0 context, current is "
+                      << (version != nullptr ? version : "none") << std::endl;
+            return false;
+        }
+        hook->renderer = new GPUImageRenderer(hook->filter);
+        hook->filter = nullptr;
+        hook->renderer->setProfilingEnabled(hook->profiling);
+        hook->renderer->onSurfaceCreated();
+        GPUImageInputFilter::genInputTextures(hook->textureIds);
+        glGenFramebuffers(1, &hook->framebuffer);
+    }
+    if (hook->width != width || hook->height != height) {
+        hook->width = width;
+        hook->height = height;
+        hook->format = 0;
+        hook->renderer->onSurfaceChanged(width, height);
+    }
+    return true;
+}
+
+GPUImagePlayerHook *gpu_player_hook_create(const char *description) {
+    GPUImageFilterGraph *graph = GPUImagePipelineParser::parse(description != nullptr ? description : "");
+    if (graph == nullptr) {
+        return nullptr;
+    }
+    GPUImagePlayerHook *hook = new GPUImagePlayerHook();
+    hook->filter = graph;
+    memset(&hook->stats, 0, sizeof(hook->stats));
+    hook->stats.gpuMs = -1;
+    return hook;
+}
+
+void gpu_player_hook_destroy(GPUImagePlayerHook *hook) {
+    if (hook == nullptr) {
+        return;
+    }
+    if (hook->renderer != nullptr) {
+        if (hook->profiling && hook->renderer->getProfiler() != nullptr) {
+            hook->renderer->getProfiler()->dump();
+        }
+        glDeleteTextures(TEXTURE_NUM, hook->textureIds);
+        glDeleteFramebuffers(1, &hook->framebuffer);
+        delete hook->renderer;
+    }
+    delete hook->filter;
+    delete hook;
+}
+
+void gpu_player_hook_set_profiling(GPUImagePlayerHook *hook, int enabled) {
+    hook->profiling = enabled != 0;
+    if (hook->renderer != nullptr) {
+        hook->renderer->setProfilingEnabled(hook->profiling);
+    }
+}
+
+int gpu_player_hook_supports(int format, int width, int height, const int linesize[3]) {
+    int planes;
+    switch (format) {
+        case IMAGE_FORMAT_RGBA:
+            planes = 1;
+            break;
+        case IMAGE_FORMAT_NV12:
+        case IMAGE_FORMAT_NV21:
+            planes = 2;
+            break;
+        case IMAGE_FORMAT_I420:
+            planes = 3;
+            break;
+        default:
+            return 0;
+    }
+    if (width <= 0 || height <= 0 || (planes > 1 && ((width & 1) || (height & 1)))) {
+        return 0;
+    }
+    for (int i = 1; i < planes; i++) {
+        if ((linesize[i] < 0) != (linesize[0] < 0)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int gpu_player_hook_process(GPUImagePlayerHook *hook, int format, int width, int height,
+                            uint8_t *const planes[3], const int linesize[3], unsigned int target) {
+    if (hook->failed) {
+        return -1;
+    }
+    if (!gpu_player_hook_supports(format, width, height, linesize)) {
+        return -1;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    PlayerGLState state;
+    state.save();
+    if (!setupRenderer(hook, width, height)) {
+        hook->failed = true;
+        state.restore();
+        return -1;
+    }
+
+    // 直接用解码器的平面，负linesize时从最后一行开始正着传
+    RenderImage image;
+    image.width = width;
+    image.height = height;
+    image.format = format;
+    for (int i = 0; i < 3; i++) {
+        int rows = i == 0 ? height : height / 2;
+        image.planes[i] = planes[i];
+        image.linesize[i] = linesize[i];
+        if (planes[i] != nullptr && linesize[i] < 0) {
+            image.planes[i] = planes[i] + linesize[i] * (rows - 1);
+            image.linesize[i] = -linesize[i];
+        }
+    }
+    glBindVertexArray(0);
+    GPUImageInputFilter::uploadRenderImage(&image, hook->textureIds);
+    if (format != hook->format) {
+        hook->format = format;
+        hook->renderer->setRenderTextures(format, width, height, hook->textureIds);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, hook->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+    int ret = 0;
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "GPUImagePlayerHook: target texture " << target << " is not renderable" << std::endl;
+        ret = -1;
+    } else {
+        glViewport(0, 0, width, height);
+        glDisable(GL_BLEND);
+        glDisable(GL_SCISSOR_TEST);
+        hook->renderer->onDrawFrame();
+    }
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, GL_NONE, 0);
+    state.restore();
+    if (ret < 0) {
+        return ret;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    GPUImagePlayerStats &stats = hook->stats;
+    stats.frames++;
+    stats.lastMs = ms;
+    stats.avgMs += (ms - stats.avgMs) / stats.frames;
+    stats.maxMs = std::max(stats.maxMs, ms);
+    if (hook->profiling) {
+        for (const ProfilerSample &sample : hook->renderer->getLastFrameProfile()) {
+            if (sample.name == "frame") {
+                stats.gpuMs = sample.gpuMs;
+            }
+        }
+    }
+    return 0;
+}
+
+void gpu_player_hook_get_stats(const GPUImagePlayerHook *hook, GPUImagePlayerStats *stats) {
+    *stats = hook->stats;
+}
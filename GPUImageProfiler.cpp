@@ -0,0 +1,345 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <cstring>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <typeinfo>
+#include <EGL/egl.h>
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+#include "GPUImageFilter.h"
+#include "GPUImageProfiler.h"
+
+GPUImageProfiler::GPUImageProfiler(int windowSize) : m_WindowSize(windowSize) {
+}
+
+GPUImageProfiler::~GPUImageProfiler() {
+    if (m_GpuTiming && !m_AllQueries.empty()) {
+        m_DeleteQueries(m_AllQueries.size(), m_AllQueries.data());
+    }
+}
+
+void GPUImageProfiler::initGpuTiming() {
+    m_GpuChecked = true;
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    if (extensions == nullptr || strstr(extensions, "GL_EXT_disjoint_timer_query") == nullptr) {
+        return;
+    }
+    m_GenQueries = (PFNGLGENQUERIESEXTPROC) eglGetProcAddress("glGenQueriesEXT");
+    m_DeleteQueries = (PFNGLDELETEQUERIESEXTPROC) eglGetProcAddress("glDeleteQueriesEXT");
+    m_BeginQuery = (PFNGLBEGINQUERYEXTPROC) eglGetProcAddress("glBeginQueryEXT");
+    m_EndQuery = (PFNGLENDQUERYEXTPROC) eglGetProcAddress("glEndQueryEXT");
+    m_QueryCounter = (PFNGLQUERYCOUNTEREXTPROC) eglGetProcAddress("glQueryCounterEXT");
+    m_GetQueryiv = (PFNGLGETQUERYIVEXTPROC) eglGetProcAddress("glGetQueryivEXT");
+    m_GetQueryObjectuiv = (PFNGLGETQUERYOBJECTUIVEXTPROC) eglGetProcAddress("glGetQueryObjectuivEXT");
+    m_GetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC) eglGetProcAddress("glGetQueryObjectui64vEXT");
+    if (!m_GenQueries || !m_DeleteQueries || !m_BeginQuery || !m_EndQuery || !m_GetQueryiv ||
+        !m_GetQueryObjectuiv || !m_GetQueryObjectui64v) {
+        return;
+    }
+    m_GpuTiming = true;
+
+    // 有时间戳计数器时可以嵌套计时，否则同一时间只能有一个TIME_ELAPSED查询
+    GLint timestampBits = 0;
+    if (m_QueryCounter != nullptr) {
+        m_GetQueryiv(GL_TIMESTAMP_EXT, GL_QUERY_COUNTER_BITS_EXT, &timestampBits);
+    }
+    m_UseTimestamps = m_TimestampsEnabled && timestampBits > 0;
+}
+
+GLuint GPUImageProfiler::allocQuery() {
+    if (m_FreeQueries.empty()) {
+        GLuint query = 0;
+        m_GenQueries(1, &query);
+        m_AllQueries.push_back(query);
+        return query;
+    }
+    GLuint query = m_FreeQueries.back();
+    m_FreeQueries.pop_back();
+    return query;
+}
+
+void GPUImageProfiler::beginFrame() {
+    if (!m_GpuChecked) {
+        initGpuTiming();
+    }
+    collectFrames();
+}
+
+void GPUImageProfiler::endFrame() {
+    while (!m_OpenStages.empty()) {
+        endStage(m_OpenStages.size() - 1);
+    }
+    m_PendingFrames.push_back(m_CurrentFrame);
+    m_CurrentFrame.stages.clear();
+    // GPU落后太多时丢掉最老的一帧，而不是等它
+    if ((int) m_PendingFrames.size() > MAX_PROFILER_PENDING_FRAMES) {
+        for (PendingStage &stage : m_PendingFrames.front().stages) {
+            releaseQueries(stage);
+        }
+        m_PendingFrames.pop_front();
+    }
+    if (!m_GpuTiming) {
+        collectFrames();
+    }
+}
+
+int GPUImageProfiler::beginStage(const std::string &name) {
+    OpenStage stage;
+    stage.name = name;
+    stage.queries[0] = 0;
+    stage.queries[1] = 0;
+    stage.index = m_CurrentFrame.stages.size();
+    int parent = m_OpenStages.empty() ? -1 : m_OpenStages.back().index;
+    m_CurrentFrame.stages.push_back({name, 0.0, {0, 0}, {}, parent});
+    if (m_GpuTiming) {
+        if (m_UseTimestamps) {
+            stage.queries[0] = allocQuery();
+            m_QueryCounter(stage.queries[0], GL_TIMESTAMP_EXT);
+        } else {
+            // TIME_ELAPSED不能嵌套，父阶段的查询先停下，由最内层的阶段计时
+            endSegment();
+            beginSegment(stage.index);
+        }
+    }
+    stage.start = std::chrono::steady_clock::now();
+    m_OpenStages.push_back(stage);
+    return m_OpenStages.size() - 1;
+}
+
+void GPUImageProfiler::endStage(int stage) {
+    // 内层没有关闭的阶段一起结束
+    bool closed = false;
+    while ((int) m_OpenStages.size() > stage && stage >= 0) {
+        OpenStage &open = m_OpenStages.back();
+        PendingStage &pending = m_CurrentFrame.stages[open.index];
+        pending.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open.start).count();
+        pending.queries[0] = open.queries[0];
+        if (open.queries[0] != 0) {
+            pending.queries[1] = allocQuery();
+            m_QueryCounter(pending.queries[1], GL_TIMESTAMP_EXT);
+        }
+        endSegment();
+        m_OpenStages.pop_back();
+        closed = true;
+    }
+    // 父阶段接着用一个新的查询计时
+    if (closed && m_GpuTiming && !m_UseTimestamps && !m_OpenStages.empty()) {
+        beginSegment(m_OpenStages.back().index);
+    }
+}
+
+void GPUImageProfiler::beginSegment(int index) {
+    if (m_ElapsedQueryActive) {
+        return;
+    }
+    GLuint query = allocQuery();
+    m_BeginQuery(GL_TIME_ELAPSED_EXT, query);
+    m_CurrentFrame.stages[index].segments.push_back(query);
+    m_ElapsedQueryActive = true;
+}
+
+void GPUImageProfiler::endSegment() {
+    if (m_ElapsedQueryActive) {
+        m_EndQuery(GL_TIME_ELAPSED_EXT);
+        m_ElapsedQueryActive = false;
+    }
+}
+
+void GPUImageProfiler::releaseQueries(PendingStage &stage) {
+    for (GLuint &query : stage.queries) {
+        if (query != 0) {
+            m_FreeQueries.push_back(query);
+            query = 0;
+        }
+    }
+    m_FreeQueries.insert(m_FreeQueries.end(), stage.segments.begin(), stage.segments.end());
+    stage.segments.clear();
+}
+
+void GPUImageProfiler::collectFrames() {
+    if (m_GpuTiming && !m_PendingFrames.empty()) {
+        GLint disjoint = 0;
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+        if (disjoint) {
+            // 频率变化等原因导致计时无效，丢掉在途帧的GPU结果
+            for (PendingFrame &frame : m_PendingFrames) {
+                for (PendingStage &stage : frame.stages) {
+                    releaseQueries(stage);
+                }
+            }
+        }
+    }
+
+    while (!m_PendingFrames.empty()) {
+        PendingFrame &frame = m_PendingFrames.front();
+        bool available = true;
+        for (PendingStage &stage : frame.stages) {
+            GLuint last = !stage.segments.empty() ? stage.segments.back() : stage.queries[1];
+            if (last != 0) {
+                GLuint ready = 0;
+                m_GetQueryObjectuiv(last, GL_QUERY_RESULT_AVAILABLE_EXT, &ready);
+                if (!ready) {
+                    available = false;
+                    break;
+                }
+            }
+        }
+        if (!available) {
+            break;
+        }
+
+        // 子阶段排在父阶段后面，倒着算时子阶段的时间可以直接加到父阶段上
+        std::vector<double> gpuMs(frame.stages.size(), -1.0);
+        for (int i = (int) frame.stages.size() - 1; i >= 0; i--) {
+            PendingStage &stage = frame.stages[i];
+            if (stage.queries[0] != 0 && stage.queries[1] != 0) {
+                GLuint64 begin = 0;
+                GLuint64 end = 0;
+                m_GetQueryObjectui64v(stage.queries[0], GL_QUERY_RESULT_EXT, &begin);
+                m_GetQueryObjectui64v(stage.queries[1], GL_QUERY_RESULT_EXT, &end);
+                gpuMs[i] = (end - begin) / 1000000.0;
+            } else if (!stage.segments.empty()) {
+                double elapsed = std::max(gpuMs[i], 0.0);
+                for (GLuint query : stage.segments) {
+                    GLuint64 time = 0;
+                    m_GetQueryObjectui64v(query, GL_QUERY_RESULT_EXT, &time);
+                    elapsed += time / 1000000.0;
+                }
+                gpuMs[i] = elapsed;
+                if (stage.parent >= 0) {
+                    gpuMs[stage.parent] = std::max(gpuMs[stage.parent], 0.0) + elapsed;
+                }
+            }
+            releaseQueries(stage);
+        }
+        std::vector<ProfilerSample> samples;
+        for (size_t i = 0; i < frame.stages.size(); i++) {
+            samples.push_back({frame.stages[i].name, frame.stages[i].cpuMs, gpuMs[i]});
+        }
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            for (ProfilerSample &sample : samples) {
+                addSample(sample.name, sample.cpuMs, sample.gpuMs);
+            }
+            m_LastFrame = samples;
+            m_CompletedFrames++;
+        }
+        m_PendingFrames.pop_front();
+    }
+}
+
+void GPUImageProfiler::addSample(const std::string &name, double cpuMs, double gpuMs) {
+    std::deque<double> &cpu = m_CpuSamples[name];
+    cpu.push_back(cpuMs);
+    if ((int) cpu.size() > m_WindowSize) {
+        cpu.pop_front();
+    }
+    if (gpuMs >= 0.0) {
+        std::deque<double> &gpu = m_GpuSamples[name];
+        gpu.push_back(gpuMs);
+        if ((int) gpu.size() > m_WindowSize) {
+            gpu.pop_front();
+        }
+    }
+}
+
+void GPUImageProfiler::percentiles(std::vector<double> values, double *p50, double *p95, double *p99) {
+    if (values.empty()) {
+        *p50 = *p95 = *p99 = -1.0;
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    int count = values.size();
+    // Nearest rank
+    *p50 = values[std::min(count - 1, (int) (0.50 * count))];
+    *p95 = values[std::min(count - 1, (int) (0.95 * count))];
+    *p99 = values[std::min(count - 1, (int) (0.99 * count))];
+}
+
+bool GPUImageProfiler::isGpuTimingAvailable() const {
+    return m_GpuTiming;
+}
+
+void GPUImageProfiler::setTimestampsEnabled(bool enabled) {
+    m_TimestampsEnabled = enabled;
+}
+
+bool GPUImageProfiler::isUsingTimestamps() const {
+    return m_UseTimestamps;
+}
+
+std::vector<ProfilerSample> GPUImageProfiler::getLastFrame() const {
+    std::lock_guard<std::mutex> guard(m_Lock);
+    return m_LastFrame;
+}
+
+uint64_t GPUImageProfiler::getCompletedFrameCount() const {
+    std::lock_guard<std::mutex> guard(m_Lock);
+    return m_CompletedFrames;
+}
+
+std::vector<ProfilerStageStats> GPUImageProfiler::getStats() const {
+    std::lock_guard<std::mutex> guard(m_Lock);
+    std::vector<ProfilerStageStats> stats;
+    for (const std::pair<const std::string, std::deque<double>> &cpu : m_CpuSamples) {
+        ProfilerStageStats stage;
+        stage.name = cpu.first;
+        stage.count = cpu.second.size();
+        percentiles(std::vector<double>(cpu.second.begin(), cpu.second.end()),
+                    &stage.cpuP50, &stage.cpuP95, &stage.cpuP99);
+        std::map<std::string, std::deque<double>>::const_iterator gpu = m_GpuSamples.find(cpu.first);
+        if (gpu != m_GpuSamples.end()) {
+            percentiles(std::vector<double>(gpu->second.begin(), gpu->second.end()),
+                        &stage.gpuP50, &stage.gpuP95, &stage.gpuP99);
+        } else {
+            stage.gpuP50 = stage.gpuP95 = stage.gpuP99 = -1.0;
+        }
+        stats.push_back(stage);
+    }
+    return stats;
+}
+
+void GPUImageProfiler::reset() {
+    std::lock_guard<std::mutex> guard(m_Lock);
+    m_CpuSamples.clear();
+    m_GpuSamples.clear();
+    m_LastFrame.clear();
+}
+
+void GPUImageProfiler::dump() const {
+    std::vector<ProfilerStageStats> stats = getStats();
+    std::cout << std::left << std::setw(48) << "stage" << std::right << std::setw(7) << "count"
+              << "   cpu p50/p95/p99 ms      gpu p50/p95/p99 ms" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const ProfilerStageStats &stage : stats) {
+        std::cout << std::left << std::setw(48) << stage.name << std::right << std::setw(7) << stage.count
+                  << std::setw(9) << stage.cpuP50 << std::setw(8) << stage.cpuP95 << std::setw(8) << stage.cpuP99;
+        if (stage.gpuP50 >= 0.0) {
+            std::cout << std::setw(9) << stage.gpuP50 << std::setw(8) << stage.gpuP95 << std::setw(8) << stage.gpuP99;
+        } else {
+            std::cout << "        -";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+
+std::string GPUImageProfiler::getFilterName(GPUImageFilter *filter) {
+    const char *name = typeid(*filter).name();
+#if defined(__GNUC__)
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status == 0 && demangled != nullptr) {
+        std::string result(demangled);
+        free(demangled);
+        return result;
+    }
+#endif
+    return name;
+}
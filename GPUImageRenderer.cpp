@@ -3,6 +3,7 @@
 //
 
 #include <math.h>
+#include <algorithm>
 #include "TextureRotationUtil.h"
 #include "GPUImageRenderer.h"
 
@@ -29,6 +30,14 @@ GPUImageRenderer::~GPUImageRenderer() {
         delete m_Filter;
         m_Filter = nullptr;
     }
+    if(m_Profiler) {
+        delete m_Profiler;
+        m_Profiler = nullptr;
+    }
+    if(m_FrameTimer) {
+        delete m_FrameTimer;
+        m_FrameTimer = nullptr;
+    }
 }
 
 void GPUImageRenderer::UpdateMVPMatrix(int angleX, int angleY, float scaleX, float scaleY)
@@ -79,7 +88,7 @@ void GPUImageRenderer::runAll(std::queue <std::function<void()>> &queue) {
     {
         std::lock_guard <std::mutex> guard(m_Lock);
         while (!queue.empty()) {
-            std::function<void()> f = m_RunOnDraw.front();
+            std::function<void()> f = queue.front();
             f();
             queue.pop();
         }
@@ -107,6 +116,17 @@ void GPUImageRenderer::setRenderImage(RenderImage *image) {
     }
 }
 
+void GPUImageRenderer::setRenderTextures(int format, int width, int height, const GLuint *textureIds) {
+    if (imageWidth != width) {
+        imageWidth = width;
+        imageHeight = height;
+        adjustImageScaling();
+    }
+    if(m_GPUImageInputFilter != nullptr) {
+        m_GPUImageInputFilter->setInputTextures(format, textureIds);
+    }
+}
+
 float GPUImageRenderer::addDistance(float coordinate, float distance) {
     return coordinate == 0.0f ? distance : 1 - distance;
 }
@@ -136,14 +156,48 @@ void GPUImageRenderer::adjustImageScaling() {
 }
 
 void GPUImageRenderer::onDrawFrame() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // 没有深度缓冲，只在没有滤镜会画满输出时才清颜色，否则告诉驱动旧内容不用加载
+    if(m_ClearEnabled || !surfaceCreated || m_Filter == nullptr) {
+        glClear(GL_COLOR_BUFFER_BIT);
+    } else {
+        GLUtils::InvalidateFramebuffer(true, true);
+    }
     if(!surfaceCreated)
         return;
+    uint64_t span = GPUImageTracer::beginSpan();
+    GPUImageTracer::setFrameId(++m_FrameCount);
     runAll(m_RunOnDraw);
+    int stage = -1;
+    GPUImageProfiler *frameTimer = m_ProfilingEnabled ? m_Profiler : (m_DynamicResolution ? m_FrameTimer : nullptr);
+    if(frameTimer != nullptr) {
+        // 上一帧没有回读时在这里结束
+        endProfilerFrame();
+        frameTimer->beginFrame();
+        stage = frameTimer->beginStage("frame");
+    }
     if(m_Filter != nullptr) {
         m_Filter->onDraw(glTextureId, glCubeBuffer, glTextureBuffer);
     }
+    if(frameTimer != nullptr) {
+        frameTimer->endStage(stage);
+        if(frameTimer == m_Profiler) {
+            // 回读也算在这一帧里，等readRenderImage或下一帧再结束
+            m_ProfilerFrameOpen = true;
+        } else {
+            frameTimer->endFrame();
+        }
+    }
+    if(m_DynamicResolution) {
+        updateDynamicResolution(frameTimer);
+    }
+    // 深度和模板从来不用，不写回内存
+    GLUtils::InvalidateFramebuffer(false, true);
     runAll(m_RunOnDrawEnd);
+    GPUImageTracer::endSpan("frame", span);
+}
+
+void GPUImageRenderer::setClearEnabled(bool enabled) {
+    m_ClearEnabled = enabled;
 }
 
 void GPUImageRenderer::onSurfaceChanged(int width, int height) {
@@ -157,12 +211,25 @@ void GPUImageRenderer::onSurfaceChanged(int width, int height) {
 
 void GPUImageRenderer::setFilter(GPUImageFilter *filter) {
     runOnDraw([this, filter](){
+        // 输入滤镜(上传和YUV转换)留给新的组继续用，旧组里只删处理用的滤镜
+        GPUImageFilter *inputFilter = (GPUImageFilter *)m_GPUImageInputFilter;
         GPUImageFilter *oldFilter = m_Filter;
-        m_Filter = filter;
-        if(oldFilter != nullptr) {
+        if(oldFilter != nullptr && oldFilter != inputFilter) {
+            std::vector<GPUImageFilter *> &filters = ((GPUImageFilterGroup *)oldFilter)->getFilters();
+            filters.erase(std::remove(filters.begin(), filters.end(), inputFilter), filters.end());
             delete oldFilter;
         }
+        if(filter != nullptr) {
+            GPUImageFilterGroup *filterGroup = new GPUImageFilterGroup();
+            filterGroup->addFilter(inputFilter);
+            filterGroup->addFilter(filter);
+            filterGroup->setInternalScale(m_InternalScale);
+            m_Filter = (GPUImageFilter *)filterGroup;
+        } else {
+            m_Filter = inputFilter;
+        }
         m_Filter->ifNeedInit();
+        m_Filter->setProfiler(m_ProfilingEnabled ? m_Profiler : nullptr);
         glUseProgram(m_Filter->getProgram());
         m_Filter->onOutputSizeChanged(outputWidth, outputHeight);
     });
@@ -171,3 +238,123 @@ void GPUImageRenderer::setFilter(GPUImageFilter *filter) {
 void GPUImageRenderer::setTexture(GLuint texture) {
     glTextureId = texture;
 }
+
+void GPUImageRenderer::setProfilingEnabled(bool enabled) {
+    runOnDraw([this, enabled](){
+        if(enabled && m_Profiler == nullptr) {
+            m_Profiler = new GPUImageProfiler();
+        }
+        if(!enabled) {
+            endProfilerFrame();
+        }
+        m_ProfilingEnabled = enabled;
+        if(m_Filter != nullptr) {
+            m_Filter->setProfiler(enabled ? m_Profiler : nullptr);
+        }
+    });
+}
+
+bool GPUImageRenderer::isProfilingEnabled() const {
+    return m_ProfilingEnabled;
+}
+
+GPUImageProfiler *GPUImageRenderer::getProfiler() {
+    return m_Profiler;
+}
+
+void GPUImageRenderer::endProfilerFrame() {
+    if(m_ProfilerFrameOpen && m_Profiler != nullptr) {
+        m_Profiler->endFrame();
+    }
+    m_ProfilerFrameOpen = false;
+}
+
+std::vector<ProfilerStageStats> GPUImageRenderer::getProfilerStats() const {
+    if(m_Profiler == nullptr) {
+        return std::vector<ProfilerStageStats>();
+    }
+    return m_Profiler->getStats();
+}
+
+std::vector<ProfilerSample> GPUImageRenderer::getLastFrameProfile() const {
+    if(m_Profiler == nullptr) {
+        return std::vector<ProfilerSample>();
+    }
+    return m_Profiler->getLastFrame();
+}
+
+void GPUImageRenderer::setDynamicResolution(bool enabled, double targetFrameMs) {
+    runOnDraw([this, enabled, targetFrameMs](){
+        m_DynamicResolution = enabled;
+        m_TargetFrameMs = targetFrameMs;
+        m_FrameCostMs = -1;
+        m_OverTargetFrames = 0;
+        m_UnderTargetFrames = 0;
+        if(enabled && m_FrameTimer == nullptr) {
+            m_FrameTimer = new GPUImageProfiler();
+        }
+        m_SettleFrames = DYNAMIC_RESOLUTION_SETTLE_FRAMES;
+        if(!enabled) {
+            applyInternalScale(1.0f);
+        }
+    });
+}
+
+float GPUImageRenderer::getInternalScale() const {
+    return m_InternalScale;
+}
+
+void GPUImageRenderer::applyInternalScale(float scale) {
+    m_InternalScale = scale;
+    if(m_Filter != nullptr && m_Filter != (GPUImageFilter *)m_GPUImageInputFilter) {
+        ((GPUImageFilterGroup *)m_Filter)->setInternalScale(scale);
+    }
+    m_FrameCostMs = -1;
+    m_OverTargetFrames = 0;
+    m_UnderTargetFrames = 0;
+    m_SettleFrames = DYNAMIC_RESOLUTION_SETTLE_FRAMES;
+}
+
+void GPUImageRenderer::updateDynamicResolution(GPUImageProfiler *frameTimer) {
+    // GPU计时有延迟，只处理新拿到结果的帧
+    uint64_t completed = frameTimer->getCompletedFrameCount();
+    if(completed == m_TimedFrames) {
+        return;
+    }
+    m_TimedFrames = completed;
+    if(m_SettleFrames > 0) {
+        m_SettleFrames--;
+        return;
+    }
+    double costMs = -1;
+    for(const ProfilerSample &sample : frameTimer->getLastFrame()) {
+        if(sample.name == "frame") {
+            // 帧率受CPU和GPU里慢的那个限制
+            costMs = std::max(sample.gpuMs, sample.cpuMs);
+        }
+    }
+    if(costMs < 0) {
+        return;
+    }
+    m_FrameCostMs = m_FrameCostMs < 0 ? costMs : m_FrameCostMs + (costMs - m_FrameCostMs) * DYNAMIC_RESOLUTION_SMOOTHING;
+
+    float scale = m_InternalScale;
+    float larger = std::min(1.0f, scale + DYNAMIC_RESOLUTION_STEP);
+    // 滤镜耗时大致和像素数成正比，按面积估计放大后的耗时
+    double largerCostMs = m_FrameCostMs * (larger * larger) / (scale * scale);
+    if(m_FrameCostMs > m_TargetFrameMs) {
+        m_OverTargetFrames++;
+        m_UnderTargetFrames = 0;
+    } else if(scale < 1.0f && largerCostMs < m_TargetFrameMs * DYNAMIC_RESOLUTION_UP_HEADROOM) {
+        m_UnderTargetFrames++;
+        m_OverTargetFrames = 0;
+    } else {
+        m_OverTargetFrames = 0;
+        m_UnderTargetFrames = 0;
+    }
+    if(m_OverTargetFrames >= DYNAMIC_RESOLUTION_DOWN_FRAMES && scale > DYNAMIC_RESOLUTION_MIN_SCALE) {
+        applyInternalScale(std::max(DYNAMIC_RESOLUTION_MIN_SCALE, scale - DYNAMIC_RESOLUTION_STEP));
+    } else if(m_UnderTargetFrames >= DYNAMIC_RESOLUTION_UP_FRAMES) {
+        applyInternalScale(larger);
+    }
+}
@@ -81,6 +81,10 @@ void GPUImageSharpenFilter::setSharpness(const GLfloat _sharpness) {
     setFloat(sharpnessLocation, sharpness);
 }
 
+int GPUImageSharpenFilter::getSamplingRadius() {
+    return 1;
+}
+
 void GPUImageSharpenFilter::onOutputSizeChanged(int width, int height) {
     GPUImageFilter::onOutputSizeChanged(width, height);
 
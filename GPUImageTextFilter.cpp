@@ -2,6 +2,8 @@
 // Created by liyang on 21-7-2.
 //
 
+#include <cstring>
+#include <algorithm>
 #include "GPUImageTextFilter.h"
 #include "glm/vec2.hpp"
 
@@ -39,27 +41,56 @@ const char *GPUImageTextFilter::TEXT_VERTEX_SHADER = "attribute vec4 position;//
                                                        "  }\n";
 ;
 
-GPUImageTextFilter::GPUImageTextFilter() :
-        GPUImageFilter(NO_FILTER_VERTEX_SHADER, NO_FILTER_FRAGMENT_SHADER) {
+// 距离场0.5处是字形边缘，u_smoothing是一个屏幕像素对应的距离值的一半
+const char *GPUImageTextFilter::TEXT_SDF_FRAGMENT_SHADER = ""
+                                                          " varying highp vec2 textureCoordinate;\n"
+                                                          " \n"
+                                                          " uniform sampler2D s_textTexture;\n"
+                                                          " uniform highp vec3 u_textColor;\n"
+                                                          " uniform highp float u_smoothing;\n"
+                                                          " \n"
+                                                          "  void main()\n"
+                                                          "  {\n"
+                                                          "      highp float dist = texture2D(s_textTexture, textureCoordinate).r;\n"
+                                                          "      highp float alpha = smoothstep(0.5 - u_smoothing, 0.5 + u_smoothing, dist);\n"
+                                                          "      \n"
+                                                          "      gl_FragColor = vec4(u_textColor, alpha);\n"
+                                                          "  }\n";
+
+GPUImageTextFilter::GPUImageTextFilter(const std::string &fontPath, GlyphRenderMode renderMode) :
+        GPUImageFilter(NO_FILTER_VERTEX_SHADER, NO_FILTER_FRAGMENT_SHADER),
+        m_FontPath(fontPath), m_RenderMode(renderMode) {
+    // 缓存在构造时就建好(不需要GL)，onInit之前LoadFacesBy*请求的字形在init后开始光栅化
+    if (m_RenderMode == GLYPH_RENDER_SDF) {
+        m_GlyphCache = new GlyphCache(m_FontPath, DEFAULT_SDF_PIXEL_SIZE, DEFAULT_GLYPH_ATLAS_SIZE, GLYPH_RENDER_SDF);
+    } else {
+        m_GlyphCache = new GlyphCache(m_FontPath);
+    }
 }
 
 void GPUImageTextFilter::onInit() {
     GPUImageFilter::onInit();
 
-    m_TextProgramId = GLUtils::CreateProgram(TEXT_VERTEX_SHADER, TEXT_FRAGMENT_SHADER);
+    // Glyphs are rasterized in the background the first time a string uses them
+    m_GlyphCache->init();
+
+    bool sdf = m_GlyphCache->getRenderMode() == GLYPH_RENDER_SDF;
+    m_TextProgramId = GLUtils::CreateProgram(TEXT_VERTEX_SHADER, sdf ? TEXT_SDF_FRAGMENT_SHADER : TEXT_FRAGMENT_SHADER);
     if (m_TextProgramId) {
         m_SamplerLoc = glGetUniformLocation(m_TextProgramId, "s_textTexture");
+        m_TextColorLoc = glGetUniformLocation(m_TextProgramId, "u_textColor");
+        m_SmoothingLoc = sdf ? glGetUniformLocation(m_TextProgramId, "u_smoothing") : -1;
     }
 
-    LoadFacesByASCII();
     // Generate VAO Id
     glGenVertexArrays(1, &m_VaoId);
     // Generate VBO Ids and load the VBOs with data
     glGenBuffers(1, &m_VboId);
 
+    m_VboGlyphCapacity = 64;
     glBindVertexArray(m_VaoId);
     glBindBuffer(GL_ARRAY_BUFFER, m_VboId);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, nullptr, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4 * m_VboGlyphCapacity, nullptr, GL_DYNAMIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
     glBindBuffer(GL_ARRAY_BUFFER, GL_NONE);
@@ -71,154 +102,204 @@ GPUImageTextFilter::~GPUImageTextFilter() {
         glDeleteProgram(m_TextProgramId);
         glDeleteBuffers(1, &m_VboId);
         glDeleteVertexArrays(1, &m_VaoId);
-
-        std::map<GLint, Character>::const_iterator iter;
-        for (iter = m_Characters.begin(); iter != m_Characters.end(); iter++) {
-            glDeleteTextures(1, &m_Characters[iter->first].textureID);
-        }
+    }
+    if (m_GlyphCache != nullptr) {
+        delete m_GlyphCache;
+        m_GlyphCache = nullptr;
     }
 }
 
 void GPUImageTextFilter::RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale,
                                     glm::vec3 color, glm::vec2 viewport) {
+    if (m_GlyphCache == nullptr) {
+        return;
+    }
+    m_GlyphCache->beginFrame();
+    x *= viewport.x;
+    y *= viewport.y;
+    glm::vec4 params(x, y, scale, viewport.x);
+    if (params.x != m_LayoutParams.x || params.y != m_LayoutParams.y || params.z != m_LayoutParams.z ||
+        params.w != m_LayoutParams.w || viewport.y != m_LayoutViewHeight) {
+        m_TextLayouts.clear();
+        m_TextLayoutOrder.clear();
+        m_LayoutParams = params;
+        m_LayoutViewHeight = viewport.y;
+    }
+
+    // 同一个字符串直接复用排版结果，VBO里只改写变化了的字形
+    const TextLayout &layout = getTextLayout(text);
+    int glyphCount = uploadVertices(layout.vertices);
+    if (glyphCount == 0) {
+        return;
+    }
+
     // 激活合适的渲染状态
     glUseProgram(m_TextProgramId);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //禁用byte-alignment限制
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glUniform3f(glGetUniformLocation(m_TextProgramId, "u_textColor"), color.x, color.y, color.z);
+    glUniform3f(m_TextColorLoc, color.x, color.y, color.z);
+    if (m_SmoothingLoc >= 0) {
+        // 顶点坐标除以视口尺寸后只占半个NDC空间，一个字形像素在屏幕上是scale/2个像素
+        GLfloat screenScale = std::max(scale * 0.5f, 0.01f);
+        glUniform1f(m_SmoothingLoc, 0.5f / (2.0f * m_GlyphCache->getSpread() * screenScale));
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_GlyphCache->getTexture());
+    glUniform1i(m_SamplerLoc, 0);
+
     glBindVertexArray(m_VaoId);
+    glDrawArrays(GL_TRIANGLES, 0, 6 * glyphCount);
 
-    // 对文本中的所有字符迭代
-    std::string::const_iterator c;
-    x *= viewport.x;
-    y *= viewport.y;
-    for (c = text.begin(); c != text.end(); c++)
-    {
-        Character ch = m_Characters[*c];
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_BLEND);
+}
 
-        GLfloat xpos = x + ch.bearing.x * scale;
-        GLfloat ypos = y - (ch.size.y - ch.bearing.y) * scale;
+const GPUImageTextFilter::TextLayout &GPUImageTextFilter::getTextLayout(const std::string &text) {
+    uint32_t generation = m_GlyphCache->getGeneration();
+    std::unordered_map<std::string, TextLayout>::iterator iter = m_TextLayouts.find(text);
+    if (iter != m_TextLayouts.end()) {
+        // 命中就挪到最近使用的一端，淘汰从另一端开始
+        m_TextLayoutOrder.splice(m_TextLayoutOrder.begin(), m_TextLayoutOrder, iter->second.lruIter);
+    }
+    if (iter != m_TextLayouts.end() && iter->second.generation == generation) {
+        for (uint32_t codePoint : iter->second.codePoints) {
+            m_GlyphCache->markUsed(codePoint);
+        }
+        m_LastText = text;
+        return iter->second;
+    }
 
-        xpos /= viewport.x;
-        ypos /= viewport.y;
+    TextLayout layout;
+    GlyphCache::decodeUTF8(text, layout.codePoints);
+    int count = layout.codePoints.size();
+    layout.penX.resize(count + 1);
+    layout.firstQuad.resize(count + 1);
+    layout.generation = generation;
 
-        GLfloat w = ch.size.x * scale;
-        GLfloat h = ch.size.y * scale;
+    // 和上一个字符串相同的前缀直接拷贝字形方块，只排版后面变化的部分
+    int prefix = 0;
+    GLfloat x = m_LayoutParams.x;
+    std::unordered_map<std::string, TextLayout>::iterator last = m_TextLayouts.find(m_LastText);
+    if (last != m_TextLayouts.end() && last->second.generation == generation) {
+        const TextLayout &previous = last->second;
+        int maxPrefix = std::min(count, (int) previous.codePoints.size());
+        while (prefix < maxPrefix && previous.codePoints[prefix] == layout.codePoints[prefix]) {
+            m_GlyphCache->markUsed(layout.codePoints[prefix]);
+            prefix++;
+        }
+        std::copy(previous.penX.begin(), previous.penX.begin() + prefix, layout.penX.begin());
+        std::copy(previous.firstQuad.begin(), previous.firstQuad.begin() + prefix, layout.firstQuad.begin());
+        layout.vertices.assign(previous.vertices.begin(),
+                               previous.vertices.begin() + previous.firstQuad[prefix] * 6 * 4);
+        x = previous.penX[prefix];
+    }
 
-        w /= viewport.x;
-        h /= viewport.y;
+    GLfloat y = m_LayoutParams.y;
+    GLfloat scale = m_LayoutParams.z;
+    glm::vec2 viewport(m_LayoutParams.w, m_LayoutViewHeight);
+    for (int i = prefix; i < count; i++)
+    {
+        layout.penX[i] = x;
+        layout.firstQuad[i] = layout.vertices.size() / (6 * 4);
+        const Character *glyph = m_GlyphCache->getGlyph(layout.codePoints[i]);
+        if (glyph == nullptr) {
+            continue;
+        }
+        const Character &ch = *glyph;
 
-        // std::cout << "TextRenderSample::RenderText [xpos,ypos,w,h]=[" << xpos << ", " << ypos << ", " << w << ", " << h << "]" << std::endl;
+        if (ch.size.x > 0 && ch.size.y > 0) {
+            GLfloat xpos = (x + ch.bearing.x * scale) / viewport.x;
+            GLfloat ypos = (y - (ch.size.y - ch.bearing.y) * scale) / viewport.y;
+            GLfloat w = ch.size.x * scale / viewport.x;
+            GLfloat h = ch.size.y * scale / viewport.y;
+            const glm::vec4 &uv = ch.texCoord;
 
-        // 当前字符的VBO
-//        GLfloat vertices[24] = {
-//                xpos,     ypos + h,   0.0, 0.0,
-//                xpos,     ypos,       0.0, 1.0,
-//                xpos + w, ypos,       1.0, 1.0,
-//
-//                xpos,     ypos + h,   0.0, 0.0,
-//                xpos + w, ypos,       1.0, 1.0,
-//                xpos + w, ypos + h,   1.0, 0.0
-//        };
-        // 当前字符的VBO
-        GLfloat vertices[6][4] = {
-                { xpos,     ypos + h,   0.0, 0.0 },
-                { xpos,     ypos,       0.0, 1.0 },
-                { xpos + w, ypos,       1.0, 1.0 },
-
-                { xpos,     ypos + h,   0.0, 0.0 },
-                { xpos + w, ypos,       1.0, 1.0 },
-                { xpos + w, ypos + h,   1.0, 0.0 }
-        };
-
-        // 在方块上绘制字形纹理
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, ch.textureID);
-        glUniform1i(m_SamplerLoc, 0);
-        // 更新当前字符的VBO
-        glBindBuffer(GL_ARRAY_BUFFER, m_VboId);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        // 绘制方块
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+            GLfloat vertices[6][4] = {
+                    { xpos,     ypos + h,   uv.x, uv.y },
+                    { xpos,     ypos,       uv.x, uv.w },
+                    { xpos + w, ypos,       uv.z, uv.w },
+
+                    { xpos,     ypos + h,   uv.x, uv.y },
+                    { xpos + w, ypos,       uv.z, uv.w },
+                    { xpos + w, ypos + h,   uv.z, uv.y }
+            };
+            layout.vertices.insert(layout.vertices.end(), &vertices[0][0], &vertices[0][0] + 6 * 4);
+        }
         // 更新位置到下一个字形的原点，注意单位是1/64像素
         x += (ch.advance >> 6) * scale; //(2^6 = 64)
     }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
-
-void GPUImageTextFilter::LoadFacesByASCII() {
-    // FreeType
-    FT_Library ft;
-    // All functions return a value different than 0 whenever an error occurred
-    if (FT_Init_FreeType(&ft))
-        std::cout << "TextRenderSample::LoadFacesByASCII FREETYPE: Could not init FreeType Library" << std::endl;
+    layout.penX[count] = x;
+    layout.firstQuad[count] = layout.vertices.size() / (6 * 4);
 
-    // Load font as face
-    FT_Face face;
-    std::string path(DEFAULT_OGL_ASSETS_DIR);
-    if (FT_New_Face(ft, (path + "/Antonio-Regular.ttf").c_str(), 0, &face)) {
-        std::cout << "TextRenderSample::LoadFacesByASCII FREETYPE: Failed to load font" << std::endl;
+    if (iter == m_TextLayouts.end()) {
+        if ((int) m_TextLayoutOrder.size() >= MAX_TEXT_LAYOUTS) {
+            m_TextLayouts.erase(m_TextLayoutOrder.back());
+            m_TextLayoutOrder.pop_back();
+        }
+        m_TextLayoutOrder.push_front(text);
+        layout.lruIter = m_TextLayoutOrder.begin();
+    } else {
+        layout.lruIter = iter->second.lruIter;
     }
+    m_LastText = text;
+    TextLayout &cached = m_TextLayouts[text];
+    cached = std::move(layout);
+    return cached;
+}
 
-    // Set size to load glyphs as
-    FT_Set_Pixel_Sizes(face, 0, 96);
-
-    // Disable byte-alignment restriction
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    // Load first 128 characters of ASCII set
-    for (unsigned char c = 0; c < 128; c++)
-    {
-        // Load character glyph
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
-        {
-            std::cout << "TextRenderSample::LoadFacesByASCII FREETYTPE: Failed to load Glyph" << std::endl;
-            continue;
+int GPUImageTextFilter::uploadVertices(const std::vector<GLfloat> &vertices) {
+    const int quadFloats = 6 * 4;
+    int quadCount = vertices.size() / quadFloats;
+    glBindBuffer(GL_ARRAY_BUFFER, m_VboId);
+    if (quadCount > m_VboGlyphCapacity) {
+        m_VboGlyphCapacity = quadCount * 2;
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * quadFloats * m_VboGlyphCapacity, nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * vertices.size(), vertices.data());
+    } else {
+        // 只上传和VBO里现有内容不同的连续字形区间
+        int uploadedCount = m_UploadedVertices.size() / quadFloats;
+        int runStart = -1;
+        for (int i = 0; i <= quadCount; i++) {
+            bool dirty = i < quadCount &&
+                         (i >= uploadedCount ||
+                          memcmp(&vertices[i * quadFloats], &m_UploadedVertices[i * quadFloats],
+                                 sizeof(GLfloat) * quadFloats) != 0);
+            if (dirty && runStart < 0) {
+                runStart = i;
+            } else if (!dirty && runStart >= 0) {
+                glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * quadFloats * runStart,
+                                sizeof(GLfloat) * quadFloats * (i - runStart), &vertices[runStart * quadFloats]);
+                runStart = -1;
+            }
         }
-        // Generate texture
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-                GL_TEXTURE_2D,
-                0,
-                GL_LUMINANCE,
-                face->glyph->bitmap.width,
-                face->glyph->bitmap.rows,
-                0,
-                GL_LUMINANCE,
-                GL_UNSIGNED_BYTE,
-                face->glyph->bitmap.buffer
-        );
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // Now store character for later use
-        Character character = {
-                texture,
-                glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-                glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-                static_cast<GLuint>(face->glyph->advance.x)
-        };
-        m_Characters.insert(std::pair<GLint, Character>(c, character));
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    // Destroy FreeType once we're finished
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_UploadedVertices = vertices;
+    return quadCount;
 }
 
-void GPUImageTextFilter::LoadFacesByUnicode(int *unicodeArr, int size) {
+void GPUImageTextFilter::LoadFacesByASCII() {
+    // Printable ASCII glyphs, rasterized ahead of their first use
+    for (int c = ' '; c < ASCII_CHAR_NUM - 1; c++) {
+        m_GlyphCache->requestGlyph(c);
+    }
+}
 
+void GPUImageTextFilter::LoadFacesByUnicode(int *unicodeArr, int size) {
+    for (int i = 0; i < size; i++) {
+        m_GlyphCache->requestGlyph(unicodeArr[i]);
+    }
 }
 
 void GPUImageTextFilter::onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer) {
     GPUImageFilter::onDraw(textureId, cubeBuffer, textureBuffer);
-    RenderText(m_String, -0.95f, -0.7f, 1.0f, glm::vec3(1.0, 1.0, 1.0), glm::vec2(m_ViewWidth, m_ViewHeight));
+    GLfloat scale = m_GlyphCache != nullptr ? m_TextSize / m_GlyphCache->getPixelSize() : 1.0f;
+    RenderText(m_String, -0.95f, -0.7f, scale, glm::vec3(1.0, 1.0, 1.0), glm::vec2(m_ViewWidth, m_ViewHeight));
+}
+
+int GPUImageTextFilter::getSamplingRadius() {
+    return -1;
 }
 
 void GPUImageTextFilter::onOutputSizeChanged(int width, int height) {
@@ -229,3 +310,11 @@ void GPUImageTextFilter::onOutputSizeChanged(int width, int height) {
 void GPUImageTextFilter::setMString(const std::string &mString) {
     m_String = mString;
 }
+
+GlyphCache *GPUImageTextFilter::getGlyphCache() {
+    return m_GlyphCache;
+}
+
+void GPUImageTextFilter::setTextSize(float textSize) {
+    m_TextSize = textSize;
+}
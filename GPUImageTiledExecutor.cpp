@@ -0,0 +1,205 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <algorithm>
+#include "GPUImageTiledExecutor.h"
+#include "GPUImagePipelineParser.h"
+#include "GPUImageTracer.h"
+
+GPUImageTiledExecutor::GPUImageTiledExecutor(const std::string &description, int tileSize)
+        : m_TileSize(std::max(tileSize, 16)) {
+    m_Filter = GPUImagePipelineParser::parse(description);
+    if (m_Filter == nullptr) {
+        return;
+    }
+    m_Halo = m_Filter->getSamplingRadius();
+    if (m_Halo < 0) {
+        std::cout << "GPUImageTiledExecutor: \"" << description
+                  << "\" depends on the whole image or on pixel positions and can not be tiled" << std::endl;
+        delete m_Filter;
+        m_Filter = nullptr;
+    }
+}
+
+GPUImageTiledExecutor::~GPUImageTiledExecutor() {
+    // PixelBuffer删除renderer，renderer删除滤镜
+    if (m_PixelBuffer != nullptr) {
+        delete m_PixelBuffer;
+    } else {
+        delete m_Filter;
+    }
+}
+
+bool GPUImageTiledExecutor::isValid() const {
+    return m_Halo >= 0;
+}
+
+int GPUImageTiledExecutor::getHalo() const {
+    return m_Halo;
+}
+
+bool GPUImageTiledExecutor::setupContext() {
+    if (m_Renderer != nullptr) {
+        return true;
+    }
+    // YUV的区域对齐到偶数坐标，两边各可能多出一个像素
+    int size = m_TileSize + 2 * m_Halo + 2;
+    m_PixelBuffer = new PixelBuffer(size, size);
+    if (eglGetCurrentContext() == EGL_NO_CONTEXT) {
+        std::cout << "GPUImageTiledExecutor: no GL context" << std::endl;
+        return false;
+    }
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (size > maxSize) {
+        if (maxSize - 2 * m_Halo - 2 < 16) {
+            std::cout << "GPUImageTiledExecutor: halo " << m_Halo << " does not fit the maximum texture size "
+                      << maxSize << std::endl;
+            return false;
+        }
+        std::cout << "GPUImageTiledExecutor: tile size " << m_TileSize << " exceeds the maximum texture size "
+                  << maxSize << ", using " << maxSize - 2 * m_Halo - 2 << std::endl;
+        m_TileSize = maxSize - 2 * m_Halo - 2;
+        size = maxSize;
+        delete m_PixelBuffer;
+        m_PixelBuffer = new PixelBuffer(size, size);
+    }
+    m_Renderer = new GPUImageRenderer(m_Filter);
+    m_Filter = nullptr;
+    m_PixelBuffer->setRenderer(m_Renderer);
+    m_RegionWidth = size;
+    m_RegionHeight = size;
+    m_TileBuffer.resize((size_t) m_TileSize * m_TileSize * 4);
+    return true;
+}
+
+std::vector<GPUImageTiledExecutor::TileRegion> GPUImageTiledExecutor::planTiles(const RenderImage *input) const {
+    int align = input->format == IMAGE_FORMAT_RGBA ? 1 : 2;
+    std::vector<TileRegion> tiles;
+    for (int y = 0; y < input->height; y += m_TileSize) {
+        for (int x = 0; x < input->width; x += m_TileSize) {
+            TileRegion tile;
+            tile.x = x;
+            tile.y = y;
+            tile.width = std::min(m_TileSize, input->width - x);
+            tile.height = std::min(m_TileSize, input->height - y);
+            tile.regionX = std::max(0, x - m_Halo) / align * align;
+            tile.regionY = std::max(0, y - m_Halo) / align * align;
+            int right = std::min(input->width, (x + tile.width + m_Halo + align - 1) / align * align);
+            int bottom = std::min(input->height, (y + tile.height + m_Halo + align - 1) / align * align);
+            tile.regionWidth = right - tile.regionX;
+            tile.regionHeight = bottom - tile.regionY;
+            tiles.push_back(tile);
+        }
+    }
+    // 同样大小的区域连着画，中间纹理只在大小变化时重新分配
+    std::stable_sort(tiles.begin(), tiles.end(), [](const TileRegion &a, const TileRegion &b) {
+        return a.regionWidth != b.regionWidth ? a.regionWidth > b.regionWidth : a.regionHeight > b.regionHeight;
+    });
+    return tiles;
+}
+
+void GPUImageTiledExecutor::cropRenderImage(const RenderImage *input, const TileRegion &tile, RenderImage *region) const {
+    // 不拷贝，直接指向原图里的子区域，上传时用linesize跳过区域外的像素
+    region->format = input->format;
+    region->width = tile.regionWidth;
+    region->height = tile.regionHeight;
+    switch (input->format) {
+        case IMAGE_FORMAT_RGBA: {
+            int linesize = input->linesize[0] > 0 ? input->linesize[0] : input->width * 4;
+            region->planes[0] = input->planes[0] + (size_t) tile.regionY * linesize + tile.regionX * 4;
+            region->linesize[0] = linesize;
+        }
+            break;
+        case IMAGE_FORMAT_NV12:
+        case IMAGE_FORMAT_NV21: {
+            int linesize0 = input->linesize[0] > 0 ? input->linesize[0] : input->width;
+            int linesize1 = input->linesize[1] > 0 ? input->linesize[1] : input->width;
+            region->planes[0] = input->planes[0] + (size_t) tile.regionY * linesize0 + tile.regionX;
+            region->planes[1] = input->planes[1] + (size_t) (tile.regionY / 2) * linesize1 + tile.regionX;
+            region->linesize[0] = linesize0;
+            region->linesize[1] = linesize1;
+        }
+            break;
+        case IMAGE_FORMAT_I420: {
+            int linesize0 = input->linesize[0] > 0 ? input->linesize[0] : input->width;
+            region->planes[0] = input->planes[0] + (size_t) tile.regionY * linesize0 + tile.regionX;
+            region->linesize[0] = linesize0;
+            for (int i = 1; i < 3; i++) {
+                int linesize = input->linesize[i] > 0 ? input->linesize[i] : input->width / 2;
+                region->planes[i] = input->planes[i] + (size_t) (tile.regionY / 2) * linesize + tile.regionX / 2;
+                region->linesize[i] = linesize;
+            }
+        }
+            break;
+    }
+}
+
+bool GPUImageTiledExecutor::processTiles(const RenderImage *input,
+                                         const std::function<void(int x, int y, int width, int height,
+                                                                  const uint8_t *rgba, int linesize)> &callback) {
+    if (!isValid() || input == nullptr || input->planes[0] == nullptr || input->width <= 0 || input->height <= 0) {
+        return false;
+    }
+    if (input->format != IMAGE_FORMAT_RGBA && input->format != IMAGE_FORMAT_NV12 &&
+        input->format != IMAGE_FORMAT_NV21 && input->format != IMAGE_FORMAT_I420) {
+        std::cout << "GPUImageTiledExecutor: unsupported format " << input->format << std::endl;
+        return false;
+    }
+    if (input->format != IMAGE_FORMAT_RGBA && ((input->width & 1) || (input->height & 1))) {
+        std::cout << "GPUImageTiledExecutor: YUV input needs an even size, got "
+                  << input->width << "x" << input->height << std::endl;
+        return false;
+    }
+    if (!setupContext()) {
+        return false;
+    }
+
+    for (const TileRegion &tile : planTiles(input)) {
+        uint64_t span = GPUImageTracer::beginSpan();
+        if (tile.regionWidth != m_RegionWidth || tile.regionHeight != m_RegionHeight) {
+            m_RegionWidth = tile.regionWidth;
+            m_RegionHeight = tile.regionHeight;
+            m_Renderer->onSurfaceChanged(m_RegionWidth, m_RegionHeight);
+        }
+        cropRenderImage(input, tile, &m_Region);
+        m_Renderer->setRenderImage(&m_Region);
+        m_Renderer->onDrawFrame();
+
+        // 帧缓冲第0行是区域的最下面一行，只读回去掉光晕后的部分
+        int left = tile.x - tile.regionX;
+        int top = tile.y - tile.regionY;
+        glReadPixels(left, m_RegionHeight - top - tile.height, tile.width, tile.height,
+                     GL_RGBA, GL_UNSIGNED_BYTE, m_TileBuffer.data());
+        GPUImageTracer::endSpan("tile", span);
+        int linesize = tile.width * 4;
+        callback(tile.x, tile.y, tile.width, tile.height,
+                 m_TileBuffer.data() + (size_t) (tile.height - 1) * linesize, -linesize);
+    }
+    return true;
+}
+
+bool GPUImageTiledExecutor::process(const RenderImage *input, RenderImage *output) {
+    if (input == nullptr || output == nullptr) {
+        return false;
+    }
+    if (output->planes[0] == nullptr) {
+        output->format = IMAGE_FORMAT_RGBA;
+        output->width = input->width;
+        output->height = input->height;
+        RenderImageUtil::allocRenderImage(output);
+    }
+    if (output->format != IMAGE_FORMAT_RGBA || output->width != input->width || output->height != input->height) {
+        std::cout << "GPUImageTiledExecutor: output must be RGBA " << input->width << "x" << input->height << std::endl;
+        return false;
+    }
+    int outputLinesize = output->linesize[0] > 0 ? output->linesize[0] : output->width * 4;
+    return processTiles(input, [output, outputLinesize](int x, int y, int width, int height,
+                                                         const uint8_t *rgba, int linesize) {
+        for (int row = 0; row < height; row++) {
+            memcpy(output->planes[0] + (size_t) (y + row) * outputLinesize + x * 4,
+                   rgba + (ptrdiff_t) row * linesize, (size_t) width * 4);
+        }
+    });
+}
@@ -0,0 +1,179 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+#include "GPUImageTracer.h"
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+    uint64_t frameId;
+};
+
+// 单生产者环形缓冲区，只有所属线程写入
+struct TraceBuffer {
+    TraceBuffer(int threadId) : threadId(threadId), events(DEFAULT_TRACE_BUFFER_EVENTS), count(0) {}
+
+    int threadId;
+    std::string threadName;
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> count;
+};
+
+std::mutex &registryLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+std::vector<std::unique_ptr<TraceBuffer>> &registry() {
+    static std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    return buffers;
+}
+
+thread_local uint64_t t_FrameId = 0;
+thread_local TraceBuffer *t_Buffer = nullptr;
+
+TraceBuffer *threadBuffer() {
+    if (t_Buffer == nullptr) {
+        std::lock_guard<std::mutex> guard(registryLock());
+        std::vector<std::unique_ptr<TraceBuffer>> &buffers = registry();
+        buffers.emplace_back(new TraceBuffer(buffers.size() + 1));
+        t_Buffer = buffers.back().get();
+    }
+    return t_Buffer;
+}
+
+void appendEscaped(std::ostringstream &out, const char *text) {
+    for (const char *c = text; *c != '\0'; c++) {
+        switch (*c) {
+            case '"':
+                out << "\\\"";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            default:
+                if ((unsigned char) *c < 0x20) {
+                    out << ' ';
+                } else {
+                    out << *c;
+                }
+                break;
+        }
+    }
+}
+
+}
+
+std::atomic<bool> GPUImageTracer::s_Enabled(false);
+
+void GPUImageTracer::setEnabled(bool enabled) {
+    s_Enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void GPUImageTracer::setFrameId(uint64_t frameId) {
+    t_FrameId = frameId;
+}
+
+uint64_t GPUImageTracer::getFrameId() {
+    return t_FrameId;
+}
+
+void GPUImageTracer::setThreadName(const std::string &name) {
+    TraceBuffer *buffer = threadBuffer();
+    std::lock_guard<std::mutex> guard(registryLock());
+    buffer->threadName = name;
+}
+
+const char *GPUImageTracer::intern(const std::string &name) {
+    static std::mutex lock;
+    static std::unordered_set<std::string> names;
+    std::lock_guard<std::mutex> guard(lock);
+    return names.insert(name).first->c_str();
+}
+
+uint64_t GPUImageTracer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void GPUImageTracer::record(const char *name, uint64_t begin, uint64_t end) {
+    TraceBuffer *buffer = threadBuffer();
+    uint64_t index = buffer->count.load(std::memory_order_relaxed);
+    TraceEvent &event = buffer->events[index % buffer->events.size()];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    event.frameId = t_FrameId;
+    // 写完事件再发布计数，读者只看计数以内的事件
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+std::string GPUImageTracer::toJSON() {
+    std::ostringstream out;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::lock_guard<std::mutex> guard(registryLock());
+    for (std::unique_ptr<TraceBuffer> &buffer : registry()) {
+        uint64_t count = buffer->count.load(std::memory_order_acquire);
+        uint64_t capacity = buffer->events.size();
+        uint64_t start = count > capacity ? count - capacity : 0;
+        std::vector<TraceEvent> events;
+        for (uint64_t i = start; i < count; i++) {
+            events.push_back(buffer->events[i % capacity]);
+        }
+        // 拷贝期间被写线程覆盖掉的事件丢弃
+        uint64_t after = buffer->count.load(std::memory_order_acquire);
+        uint64_t valid = after > capacity ? after - capacity : 0;
+        size_t skip = valid > start ? std::min<uint64_t>(valid - start, events.size()) : 0;
+
+        if (!buffer->threadName.empty()) {
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << buffer->threadId << ",\"args\":{\"name\":\"";
+            appendEscaped(out, buffer->threadName.c_str());
+            out << "\"}}";
+            first = false;
+        }
+        for (size_t i = skip; i < events.size(); i++) {
+            const TraceEvent &event = events[i];
+            out << (first ? "" : ",") << "\n{\"name\":\"";
+            appendEscaped(out, event.name);
+            out << "\",\"cat\":\"gpu_filter\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                << ",\"ts\":" << event.begin / 1000 << "." << (event.begin % 1000) / 100
+                << ",\"dur\":" << (event.end - event.begin) / 1000 << "." << ((event.end - event.begin) % 1000) / 100
+                << ",\"args\":{\"frame\":" << event.frameId << "}}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+bool GPUImageTracer::writeJSON(const std::string &path) {
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cout << "GPUImageTracer::writeJSON failed to open " << path << std::endl;
+        return false;
+    }
+    file << toJSON();
+    return file.good();
+}
+
+void GPUImageTracer::clear() {
+    // 只在没有线程记录时调用
+    std::lock_guard<std::mutex> guard(registryLock());
+    for (std::unique_ptr<TraceBuffer> &buffer : registry()) {
+        buffer->count.store(0, std::memory_order_release);
+    }
+}
@@ -3,6 +3,9 @@
 //
 
 #include "GPUImageTwoInputFilter.h"
+#include "GPUImageInputFilter.h"
+#include <cmath>
+#include <cstring>
 #include <glm/vec3.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -116,11 +119,30 @@ GPUImageTwoInputFilter::setRotation(Rotation rotation, bool filpHorizontal, bool
 void GPUImageTwoInputFilter::onDrawArraysPre() {
     glEnableVertexAttribArray(filterSecondTextureCoordinateAttribute);
     glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, glTextureId);
+    bool hasInput2 = m_InputTexture2 != GL_NONE;
+    glBindTexture(GL_TEXTURE_2D, hasInput2 ? m_InputTexture2 : glTextureId);
     glUniform1i(filterInputTextureUniform2, 4);
 
     glVertexAttribPointer(filterSecondTextureCoordinateAttribute, 2, GL_FLOAT, false, 0,
-                          texture2CoordinatesBuffer);
+                          hasInput2 ? m_InputTexture2CoordinatesBuffer : texture2CoordinatesBuffer);
+}
+
+int GPUImageTwoInputFilter::getInputCount() {
+    return 2;
+}
+
+void GPUImageTwoInputFilter::setInputTexture(int index, GLuint textureId, const float *textureBuffer) {
+    if (index != 1) {
+        return;
+    }
+    m_InputTexture2 = textureId;
+    if (textureBuffer != nullptr) {
+        memcpy(m_InputTexture2CoordinatesBuffer, textureBuffer, sizeof(m_InputTexture2CoordinatesBuffer));
+    }
+}
+
+int GPUImageTwoInputFilter::getSamplingRadius() {
+    return m_ImageLoaded && m_InputTexture2 == GL_NONE ? -1 : 0;
 }
 
 void GPUImageTwoInputFilter::onInit() {
@@ -147,6 +169,17 @@ void GPUImageTwoInputFilter::genTextures() {
 
     m_AttribPositionObj = glGetAttribLocation(m_ProgramObj, "a_position");
     m_AttribTextureCoordinateObj = glGetAttribLocation(m_ProgramObj, "a_texCoord");
+    m_MVPMatrixLoc = glGetUniformLocation(m_ProgramObj, "u_MVPMatrix");
+    m_ImgTypeLoc = glGetUniformLocation(m_ProgramObj, "u_nImgType");
+
+    // The samplers always read texture units 4..4+TEXTURE_NUM
+    glUseProgram(m_ProgramObj);
+    for (int i = 0; i < TEXTURE_NUM; ++i) {
+        char samplerName[64] = {0};
+        sprintf(samplerName, "s_texture%d", i);
+        glUniform1i(glGetUniformLocation(m_ProgramObj, samplerName), 4 + i);
+    }
+    glUseProgram(GL_NONE);
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
@@ -171,66 +204,33 @@ void GPUImageTwoInputFilter::setRenderImage(RenderImage *image) {
     runOnDraw([this, image]() {
         genFBTextures(image);
 
-        switch (image->format) {
-            case IMAGE_FORMAT_RGBA:
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[0]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->width,
-                             image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-                             image->planes[0]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-                break;
-            case IMAGE_FORMAT_NV12:
-            case IMAGE_FORMAT_NV21:
-                //upload Y plane data
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[0]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, image->width,
-                             image->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                             image->planes[0]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-                //update UV plane data
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[1]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, image->width >> 1,
-                             image->height >> 1, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
-                             image->planes[1]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-                break;
-            case IMAGE_FORMAT_I420:
-                //upload Y plane data
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[0]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, image->width,
-                             image->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                             image->planes[0]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-                //update U plane data
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[1]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, image->width >> 1,
-                             image->height >> 1, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                             image->planes[1]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-                //update V plane data
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, m_TextureIds[2]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, image->width >> 1,
-                             image->height >> 1, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                             image->planes[2]);
-                glBindTexture(GL_TEXTURE_2D, GL_NONE);
-                break;
-        }
+        GPUImageInputFilter::uploadRenderImage(image, m_TextureIds);
+        m_OverlayDirty = true;
     });
 }
 
 void GPUImageTwoInputFilter::renderTexture(const float *cubeBuffer, const float *textureBuffer) {
+    if (!m_OverlayDirty && memcmp(m_OverlayCubeBuffer, cubeBuffer, sizeof(m_OverlayCubeBuffer)) == 0 &&
+        memcmp(m_OverlayTextureBuffer, textureBuffer, sizeof(m_OverlayTextureBuffer)) == 0) {
+        return;
+    }
+    memcpy(m_OverlayCubeBuffer, cubeBuffer, sizeof(m_OverlayCubeBuffer));
+    memcpy(m_OverlayTextureBuffer, textureBuffer, sizeof(m_OverlayTextureBuffer));
+    m_OverlayDirty = false;
+
+    // 在滤镜组里时当前绑定的是组的FBO，画完叠加纹理后要切回去
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
     glUseProgram(m_ProgramObj);
     glBindFramebuffer(GL_FRAMEBUFFER, glFrameBufferId);
-    glClear(GL_COLOR_BUFFER_BIT);
+    // 叠加图盖满整个纹理时不用清，露出来的部分要清成透明
+    if (coversOutput(cubeBuffer)) {
+        GLUtils::InvalidateFramebuffer(true, true);
+    } else {
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
 //    glClear(GL_DEPTH_BUFFER_BIT);
 //    glClearColor(0, 0, 0, 1);
 //    glDisable(GL_DEPTH_TEST);
@@ -241,30 +241,32 @@ void GPUImageTwoInputFilter::renderTexture(const float *cubeBuffer, const float
     glVertexAttribPointer(m_AttribPositionObj, 2, GL_FLOAT, false, 8, cubeBuffer);
     glEnableVertexAttribArray(m_AttribTextureCoordinateObj);
     glVertexAttribPointer(m_AttribTextureCoordinateObj, 2, GL_FLOAT, false, 8, textureBuffer);
-    GLUtils::setMat4(m_ProgramObj, "u_MVPMatrix", m_MVPMatrix);
+    glUniformMatrix4fv(m_MVPMatrixLoc, 1, GL_FALSE, &m_MVPMatrix[0][0]);
     for (int i = 0; i < TEXTURE_NUM; ++i) {
         glActiveTexture(GL_TEXTURE4 + i);
         glBindTexture(GL_TEXTURE_2D, m_TextureIds[i]);
-        char samplerName[64] = {0};
-        sprintf(samplerName, "s_texture%d", i);
-        GLUtils::setInt(m_ProgramObj, samplerName, 4 + i);
     }
-    GLUtils::setInt(m_ProgramObj, "u_nImgType", m_RenderImageFormat);
+    glUniform1i(m_ImgTypeLoc, m_RenderImageFormat);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
     glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
 }
 
 void
 GPUImageTwoInputFilter::onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer) {
     GPUImageFilter::runPendingOnDrawTasks();
 
-    if (!m_ImageLoaded || !m_IsInitialized) {
+    if (!m_IsInitialized) {
         return;
     }
-    renderTexture(cubeBuffer, textureBuffer);
+    if (m_InputTexture2 == GL_NONE) {
+        if (!m_ImageLoaded) {
+            return;
+        }
+        renderTexture(cubeBuffer, textureBuffer);
+    }
     GPUImageFilter::onDraw(textureId, cubeBuffer, textureBuffer);
 }
 
@@ -273,21 +275,8 @@ void GPUImageTwoInputFilter::genFBTextures(RenderImage *image) {
         glGenFramebuffers(1, &glFrameBufferId);
         glGenTextures(1, &glTextureId);
 
-        glBindTexture(GL_TEXTURE_2D, glTextureId);
-        glTexParameterf(GL_TEXTURE_2D,
-                        GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameterf(GL_TEXTURE_2D,
-                        GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameterf(GL_TEXTURE_2D,
-                        GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameterf(GL_TEXTURE_2D,
-                        GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, textureWidth, textureHeight,
-                     0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, glFrameBufferId);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                               GL_TEXTURE_2D, glTextureId, 0);
+        GLUtils::AllocFramebufferTexture(glFrameBufferId, glTextureId, m_OverlayTextureFormat,
+                                         textureWidth, textureHeight);
 
         glBindTexture(GL_TEXTURE_2D, GL_NONE);
         glBindFramebuffer(GL_FRAMEBUFFER, GL_NONE);
@@ -297,8 +286,55 @@ void GPUImageTwoInputFilter::genFBTextures(RenderImage *image) {
 
 void GPUImageTwoInputFilter::onOutputSizeChanged(int width, int height) {
     GPUImageFilter::onOutputSizeChanged(width, height);
+    if (textureWidth == width && textureHeight == height) {
+        return;
+    }
     textureWidth = width;
     textureHeight = height;
+    if (glTextureId != 0xFFFFFFFF) {
+        GLUtils::AllocFramebufferTexture(glFrameBufferId, glTextureId, m_OverlayTextureFormat,
+                                         textureWidth, textureHeight);
+        glBindTexture(GL_TEXTURE_2D, GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, GL_NONE);
+    }
+    m_OverlayDirty = true;
+}
+
+bool GPUImageTwoInputFilter::coversOutput(const float *cubeBuffer) {
+    // 三角形带的顶点顺序是0,1,3,2绕一圈，凸四边形包含输出的四个角就盖满了
+    static const int order[4] = {0, 1, 3, 2};
+    glm::vec2 corners[4];
+    for (int i = 0; i < 4; i++) {
+        glm::vec4 position = m_MVPMatrix * glm::vec4(cubeBuffer[order[i] * 2], cubeBuffer[order[i] * 2 + 1], 0.0f, 1.0f);
+        // 写成取反的形式，矩阵没初始化出现NaN时也当作没盖满
+        if (!(position.w > 0.0f && std::fabs(position.z) <= position.w)) {
+            return false;
+        }
+        corners[i] = glm::vec2(position.x / position.w, position.y / position.w);
+    }
+    float area = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        area += corners[i].x * corners[(i + 1) % 4].y - corners[(i + 1) % 4].x * corners[i].y;
+    }
+    float sign = area < 0.0f ? -1.0f : 1.0f;
+    for (int i = 0; i < 4; i++) {
+        float edgeX = corners[(i + 1) % 4].x - corners[i].x;
+        float edgeY = corners[(i + 1) % 4].y - corners[i].y;
+        for (float x = -1.0f; x <= 1.0f; x += 2.0f) {
+            for (float y = -1.0f; y <= 1.0f; y += 2.0f) {
+                // 角正好落在边上也算盖住，留一点浮点误差
+                float cross = edgeX * (y - corners[i].y) - edgeY * (x - corners[i].x);
+                if (!(cross * sign >= -1e-5f)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void GPUImageTwoInputFilter::setOverlayTextureFormat(int format) {
+    m_OverlayTextureFormat = format;
 }
 
 void GPUImageTwoInputFilter::UpdateMVPMatrix(float x, float y, int angleX, int angleY, float scaleX,
@@ -331,5 +367,9 @@ void GPUImageTwoInputFilter::UpdateMVPMatrix(float x, float y, int angleX, int a
     float fixY = imageHeight * 1.0f / textureHeight;
 //    Model = glm::translate(Model, glm::vec3(-0.5, -0.5, 0.0f));
 
-    m_MVPMatrix = Projection * View * Model;
+    glm::mat4 mvpMatrix = Projection * View * Model;
+    if (mvpMatrix != m_MVPMatrix) {
+        m_MVPMatrix = mvpMatrix;
+        m_OverlayDirty = true;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,339 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include "GlyphCache.h"
+
+GlyphCache::GlyphCache(const std::string &fontPath, int pixelSize, int atlasSize,
+                       GlyphRenderMode renderMode) :
+        m_PixelSize(pixelSize), m_AtlasSize(atlasSize), m_RenderMode(renderMode) {
+    // All functions return a value different than 0 whenever an error occurred
+    if (FT_Init_FreeType(&m_Library)) {
+        std::cout << "GlyphCache::GlyphCache FREETYPE: Could not init FreeType Library" << std::endl;
+        m_Library = nullptr;
+        return;
+    }
+    if (FT_New_Face(m_Library, fontPath.c_str(), 0, &m_Face)) {
+        std::cout << "GlyphCache::GlyphCache FREETYPE: Failed to load font " << fontPath << std::endl;
+        m_Face = nullptr;
+        return;
+    }
+    FT_Set_Pixel_Sizes(m_Face, 0, m_PixelSize);
+
+    if (m_RenderMode == GLYPH_RENDER_SDF) {
+#ifdef GLYPH_SDF_SUPPORTED
+        FT_UInt spread = DEFAULT_SDF_SPREAD;
+        FT_Property_Set(m_Library, "sdf", "spread", &spread);
+        m_Spread = spread;
+#else
+        std::cout << "GlyphCache::GlyphCache FREETYPE: SDF rendering needs FreeType 2.11, using bitmaps" << std::endl;
+        m_RenderMode = GLYPH_RENDER_BITMAP;
+#endif
+    }
+
+    // Every cell is big enough for the tallest and widest glyph of the face at this size,
+    // distance fields extend by the spread on every side
+    int lineHeight = (int) ((m_Face->size->metrics.ascender - m_Face->size->metrics.descender + 63) >> 6);
+    int maxAdvance = (int) ((m_Face->size->metrics.max_advance + 63) >> 6);
+    m_CellSize = std::max(m_PixelSize, std::max(lineHeight, maxAdvance)) + 2 * (m_Spread + GLYPH_ATLAS_PADDING);
+    m_CellsPerRow = m_AtlasSize / m_CellSize;
+}
+
+GlyphCache::~GlyphCache() {
+    {
+        std::lock_guard<std::mutex> guard(m_Lock);
+        m_Stop = true;
+    }
+    m_Cond.notify_all();
+    if (m_Worker.joinable()) {
+        m_Worker.join();
+    }
+    if (m_AtlasTextureId != GL_NONE) {
+        glDeleteTextures(1, &m_AtlasTextureId);
+        m_AtlasTextureId = GL_NONE;
+    }
+    if (m_Face != nullptr) {
+        FT_Done_Face(m_Face);
+    }
+    if (m_Library != nullptr) {
+        FT_Done_FreeType(m_Library);
+    }
+}
+
+bool GlyphCache::init() {
+    if (m_Face == nullptr || m_CellsPerRow == 0) {
+        return false;
+    }
+
+    std::vector<unsigned char> empty(m_AtlasSize * m_AtlasSize, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenTextures(1, &m_AtlasTextureId);
+    glBindTexture(GL_TEXTURE_2D, m_AtlasTextureId);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, m_AtlasSize, m_AtlasSize, 0,
+                 GL_LUMINANCE, GL_UNSIGNED_BYTE, empty.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, GL_NONE);
+
+    int slotCount = m_CellsPerRow * m_CellsPerRow;
+    m_FreeSlots.clear();
+    for (int i = slotCount - 1; i >= 0; i--) {
+        m_FreeSlots.push_back(i);
+    }
+
+    // FreeType is only used by the worker thread from now on
+    m_Worker = std::thread(&GlyphCache::workerLoop, this);
+    return true;
+}
+
+void GlyphCache::beginFrame() {
+    m_Frame++;
+    uploadRasterizedGlyphs();
+}
+
+const Character *GlyphCache::getGlyph(uint32_t codePoint) {
+    std::unordered_map<uint32_t, GlyphEntry>::iterator iter = m_Glyphs.find(codePoint);
+    if (iter == m_Glyphs.end()) {
+        requestGlyph(codePoint);
+        return nullptr;
+    }
+    GlyphEntry &entry = iter->second;
+    if (entry.state != GLYPH_READY) {
+        return nullptr;
+    }
+    if (entry.slot >= 0) {
+        touch(entry);
+    }
+    return &entry.character;
+}
+
+void GlyphCache::requestGlyph(uint32_t codePoint) {
+    if (m_Face == nullptr || m_Glyphs.find(codePoint) != m_Glyphs.end()) {
+        return;
+    }
+    GlyphEntry entry;
+    entry.state = GLYPH_PENDING;
+    entry.slot = -1;
+    entry.lastUsedFrame = m_Frame;
+    m_Glyphs[codePoint] = entry;
+    {
+        std::lock_guard<std::mutex> guard(m_Lock);
+        m_Requests.push_back(codePoint);
+    }
+    m_Cond.notify_one();
+}
+
+void GlyphCache::markUsed(uint32_t codePoint) {
+    std::unordered_map<uint32_t, GlyphEntry>::iterator iter = m_Glyphs.find(codePoint);
+    if (iter != m_Glyphs.end() && iter->second.slot >= 0) {
+        touch(iter->second);
+    }
+}
+
+void GlyphCache::waitForPendingGlyphs() {
+    if (m_Worker.joinable()) {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_IdleCond.wait(lock, [this]() { return m_Requests.empty() && !m_Busy; });
+    }
+    uploadRasterizedGlyphs();
+}
+
+GLuint GlyphCache::getTexture() const {
+    return m_AtlasTextureId;
+}
+
+uint32_t GlyphCache::getGeneration() const {
+    return m_Generation;
+}
+
+int GlyphCache::getPixelSize() const {
+    return m_PixelSize;
+}
+
+GlyphRenderMode GlyphCache::getRenderMode() const {
+    return m_RenderMode;
+}
+
+int GlyphCache::getSpread() const {
+    return m_Spread;
+}
+
+void GlyphCache::workerLoop() {
+    int maxBitmapSize = m_CellSize - 2 * GLYPH_ATLAS_PADDING;
+    while (true) {
+        uint32_t codePoint;
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_Cond.wait(lock, [this]() { return m_Stop || !m_Requests.empty(); });
+            if (m_Stop) {
+                break;
+            }
+            codePoint = m_Requests.front();
+            m_Requests.pop_front();
+            m_Busy = true;
+        }
+
+        RasterizedGlyph glyph;
+        glyph.codePoint = codePoint;
+        glyph.character = Character();
+        int error;
+#ifdef GLYPH_SDF_SUPPORTED
+        if (m_RenderMode == GLYPH_RENDER_SDF) {
+            error = FT_Load_Char(m_Face, codePoint, FT_LOAD_DEFAULT);
+            if (!error && m_Face->glyph->format == FT_GLYPH_FORMAT_OUTLINE && m_Face->glyph->outline.n_points > 0) {
+                error = FT_Render_Glyph(m_Face->glyph, FT_RENDER_MODE_SDF);
+            }
+        } else
+#endif
+        {
+            error = FT_Load_Char(m_Face, codePoint, FT_LOAD_RENDER);
+        }
+        if (error) {
+            std::cout << "GlyphCache::workerLoop FREETYTPE: Failed to load Glyph " << codePoint << std::endl;
+        } else {
+            FT_Bitmap &bitmap = m_Face->glyph->bitmap;
+            int width = std::min((int) bitmap.width, maxBitmapSize);
+            int rows = std::min((int) bitmap.rows, maxBitmapSize);
+            glyph.bitmap.resize(width * rows);
+            for (int row = 0; row < rows; row++) {
+                memcpy(&glyph.bitmap[row * width], bitmap.buffer + row * bitmap.pitch, width);
+            }
+            glyph.character.size = glm::ivec2(width, rows);
+            glyph.character.bearing = glm::ivec2(m_Face->glyph->bitmap_left, m_Face->glyph->bitmap_top);
+            glyph.character.advance = static_cast<GLuint>(m_Face->glyph->advance.x);
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            m_Results.push_back(std::move(glyph));
+            m_Busy = false;
+            if (m_Requests.empty()) {
+                m_IdleCond.notify_all();
+            }
+        }
+    }
+}
+
+void GlyphCache::uploadRasterizedGlyphs() {
+    std::vector<RasterizedGlyph> results;
+    {
+        std::lock_guard<std::mutex> guard(m_Lock);
+        if (m_Results.empty()) {
+            return;
+        }
+        results.swap(m_Results);
+    }
+
+    std::vector<unsigned char> cell(m_CellSize * m_CellSize);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, m_AtlasTextureId);
+    for (RasterizedGlyph &glyph : results) {
+        std::unordered_map<uint32_t, GlyphEntry>::iterator iter = m_Glyphs.find(glyph.codePoint);
+        if (iter == m_Glyphs.end()) {
+            continue;
+        }
+        GlyphEntry &entry = iter->second;
+        entry.character = glyph.character;
+        m_Generation++;
+        if (glyph.bitmap.empty()) {
+            // Blank glyphs like spaces only carry metrics and never occupy a cell
+            entry.state = GLYPH_READY;
+            continue;
+        }
+        int slot = allocSlot();
+        if (slot < 0) {
+            // Every cell is used by the current frame, try again once it is over
+            m_Glyphs.erase(iter);
+            continue;
+        }
+
+        // Upload the whole cell so nothing of an evicted glyph is left around this one
+        Character &ch = entry.character;
+        std::fill(cell.begin(), cell.end(), 0);
+        for (int row = 0; row < ch.size.y; row++) {
+            memcpy(&cell[(row + GLYPH_ATLAS_PADDING) * m_CellSize + GLYPH_ATLAS_PADDING],
+                   &glyph.bitmap[row * ch.size.x], ch.size.x);
+        }
+        int cellX = (slot % m_CellsPerRow) * m_CellSize;
+        int cellY = (slot / m_CellsPerRow) * m_CellSize;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, cellX, cellY, m_CellSize, m_CellSize,
+                        GL_LUMINANCE, GL_UNSIGNED_BYTE, cell.data());
+
+        float left = cellX + GLYPH_ATLAS_PADDING;
+        float top = cellY + GLYPH_ATLAS_PADDING;
+        ch.texCoord = glm::vec4(left / m_AtlasSize, top / m_AtlasSize,
+                                (left + ch.size.x) / m_AtlasSize, (top + ch.size.y) / m_AtlasSize);
+        entry.state = GLYPH_READY;
+        entry.slot = slot;
+        m_Lru.push_front(glyph.codePoint);
+        entry.lruIter = m_Lru.begin();
+        entry.lastUsedFrame = m_Frame;
+    }
+    glBindTexture(GL_TEXTURE_2D, GL_NONE);
+}
+
+int GlyphCache::allocSlot() {
+    if (!m_FreeSlots.empty()) {
+        int slot = m_FreeSlots.back();
+        m_FreeSlots.pop_back();
+        return slot;
+    }
+    // The back of the list is the least recently used glyph, if even that one was
+    // used in this frame every cell is pinned
+    if (m_Lru.empty()) {
+        return -1;
+    }
+    uint32_t codePoint = m_Lru.back();
+    std::unordered_map<uint32_t, GlyphEntry>::iterator iter = m_Glyphs.find(codePoint);
+    if (iter->second.lastUsedFrame == m_Frame) {
+        return -1;
+    }
+    int slot = iter->second.slot;
+    m_Lru.pop_back();
+    m_Glyphs.erase(iter);
+    m_Generation++;
+    return slot;
+}
+
+void GlyphCache::touch(GlyphEntry &entry) {
+    entry.lastUsedFrame = m_Frame;
+    m_Lru.splice(m_Lru.begin(), m_Lru, entry.lruIter);
+}
+
+void GlyphCache::decodeUTF8(const std::string &text, std::vector<uint32_t> &codePoints) {
+    codePoints.clear();
+    const unsigned char *p = (const unsigned char *) text.data();
+    const unsigned char *end = p + text.size();
+    while (p < end) {
+        uint32_t codePoint;
+        int extra;
+        if (*p < 0x80) {
+            codePoint = *p;
+            extra = 0;
+        } else if ((*p & 0xE0) == 0xC0) {
+            codePoint = *p & 0x1F;
+            extra = 1;
+        } else if ((*p & 0xF0) == 0xE0) {
+            codePoint = *p & 0x0F;
+            extra = 2;
+        } else if ((*p & 0xF8) == 0xF0) {
+            codePoint = *p & 0x07;
+            extra = 3;
+        } else {
+            codePoints.push_back(0xFFFD);
+            p++;
+            continue;
+        }
+        p++;
+        int i = 0;
+        for (; i < extra && p < end && (*p & 0xC0) == 0x80; i++, p++) {
+            codePoint = (codePoint << 6) | (*p & 0x3F);
+        }
+        codePoints.push_back(i == extra ? codePoint : 0xFFFD);
+    }
+}
@@ -2,9 +2,12 @@
 // Created by liyang on 21-6-28.
 //
 
+#include <cstring>
+#include <algorithm>
 #include "PixelBuffer.h"
+#include "GPUImageTracer.h"
 
-PixelBuffer::PixelBuffer(int width, int height) : m_Width(width), m_Height(height){
+PixelBuffer::PixelBuffer(int width, int height, PixelBuffer *shareWith) : m_Width(width), m_Height(height){
     int version[2] = {0};
     int attribList[] = {
         EGL_WIDTH, m_Width,
@@ -12,23 +15,45 @@ PixelBuffer::PixelBuffer(int width, int height) : m_Width(width), m_Height(heigh
         EGL_NONE
     };
 
-    eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-    bool ret = eglInitialize(eglDisplay, &version[0], &version[1]);
-    if(ret == false) {
-        std::cout << "eglInitialize() ret false" << std::endl;
+    if(shareWith != nullptr) {
+        // 共享对方已经初始化的display和config，display由对方负责terminate
+        eglDisplay = shareWith->eglDisplay;
+        eglConfig = shareWith->eglConfig;
+        m_ClientVersion = shareWith->m_ClientVersion;
+        m_OwnsDisplay = false;
+    } else {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        bool ret = eglInitialize(eglDisplay, &version[0], &version[1]);
+        if(ret == false) {
+            // 没有窗口系统时(服务器, CI)退回到Mesa的surfaceless平台
+            eglDisplay = getSurfacelessDisplay();
+            ret = eglDisplay != EGL_NO_DISPLAY && eglInitialize(eglDisplay, &version[0], &version[1]);
+        }
+        if(ret == false) {
+            std::cout << "eglInitialize() ret false" << std::endl;
+            return ;
+        }
+        eglConfig = chooseConfig(); // Choosing a config is a little more
+        // complicated
+    }
+    if(eglConfig == nullptr) {
+        std::cout << "PixelBuffer: no pbuffer capable OpenGL ES 3.0 config" << std::endl;
         return ;
     }
-    eglConfig = chooseConfig(); // Choosing a config is a little more
-    // complicated
 
     // eglContext = eglCreateContext(eglDisplay, eglConfig,
     // EGL_NO_CONTEXT, null);
 //    int EGL_CONTEXT_CLIENT_VERSION = 0x3098;
     int attrib_list[] = {
-            EGL_CONTEXT_CLIENT_VERSION, 2,
+            EGL_CONTEXT_CLIENT_VERSION, m_ClientVersion,
             EGL_NONE
     };
-    eglContext = eglCreateContext(eglDisplay, eglConfig, EGL_NO_CONTEXT, attrib_list);
+    eglContext = eglCreateContext(eglDisplay, eglConfig,
+                                  shareWith != nullptr ? shareWith->eglContext : EGL_NO_CONTEXT, attrib_list);
+    if(eglContext == EGL_NO_CONTEXT) {
+        std::cout << "eglCreateContext() failed: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+        return ;
+    }
     eglSurface = eglCreatePbufferSurface(eglDisplay, eglConfig, attribList);
     eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext);
     m_ThreadId = std::this_thread::get_id();
@@ -44,7 +69,30 @@ PixelBuffer::~PixelBuffer() {
                    EGL_NO_SURFACE, EGL_NO_CONTEXT);
     eglDestroySurface(eglDisplay, eglSurface);
     eglDestroyContext(eglDisplay, eglContext);
-    eglTerminate(eglDisplay);
+    if(m_OwnsDisplay) {
+        eglTerminate(eglDisplay);
+    }
+    if(eglConfigs != nullptr) {
+        free(eglConfigs);
+        eglConfigs = nullptr;
+    }
+}
+
+EGLDisplay PixelBuffer::getSurfacelessDisplay() {
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if(extensions == nullptr || strstr(extensions, "EGL_MESA_platform_surfaceless") == nullptr) {
+        return EGL_NO_DISPLAY;
+    }
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(getPlatformDisplay == nullptr) {
+        return EGL_NO_DISPLAY;
+    }
+    return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+}
+
+bool PixelBuffer::isValid() const {
+    return eglSurface != EGL_NO_SURFACE;
 }
 
 void PixelBuffer::setRenderer(GPUImageRenderer *renderer) {
@@ -72,23 +120,37 @@ void PixelBuffer::getRenderImage(RenderImage *image) {
     // work if this is only called once)
     m_Renderer->onDrawFrame();
     m_Renderer->onDrawFrame();
+    readRenderImage(image);
+}
 
+void PixelBuffer::readRenderImage(RenderImage *image) {
     image->format = IMAGE_FORMAT_RGBA;
     image->width = m_Width;
     image->height = m_Height;
 
+    GPUImageProfiler *profiler = m_Renderer != nullptr && m_Renderer->isProfilingEnabled() ? m_Renderer->getProfiler() : nullptr;
+    int stage = profiler != nullptr ? profiler->beginStage("readback") : -1;
+    uint64_t span = GPUImageTracer::beginSpan();
+    // 池里分配的图行尾有对齐填充，按linesize读
+    int linesize = image->linesize[0] > 0 ? image->linesize[0] : m_Width * 4;
+    if (linesize != m_Width * 4) {
+        glPixelStorei(GL_PACK_ROW_LENGTH, linesize / 4);
+    }
     glReadPixels(0, 0, m_Width, m_Height, GL_RGBA, GL_UNSIGNED_BYTE, image->planes[0]);
-    int *pIntBuffer = (int *) image->planes[0];
-
-    int width = image->width;
-    int height = image->height;
-
-    for (int i = 0; i < height / 2; i++) {
-        for (int j = 0; j < width; j++) {
-            int temp = pIntBuffer[(height - i - 1) * width + j];
-            pIntBuffer[(height - i - 1) * width + j] = pIntBuffer[i * width + j];
-            pIntBuffer[i * width + j] = temp;
-        }
+    if (linesize != m_Width * 4) {
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    }
+    GPUImageTracer::endSpan("readback", span);
+    span = GPUImageTracer::beginSpan();
+    for (int i = 0; i < m_Height / 2; i++) {
+        uint8_t *top = image->planes[0] + (size_t) i * linesize;
+        uint8_t *bottom = image->planes[0] + (size_t) (m_Height - i - 1) * linesize;
+        std::swap_ranges(top, top + m_Width * 4, bottom);
+    }
+    GPUImageTracer::endSpan("flip", span);
+    if (profiler != nullptr) {
+        profiler->endStage(stage);
+        m_Renderer->endProfilerFrame();
     }
 }
 
@@ -100,11 +162,16 @@ EGLConfig PixelBuffer::chooseConfig() {
             EGL_GREEN_SIZE, 8,
             EGL_BLUE_SIZE, 8,
             EGL_ALPHA_SIZE, 8,
-            EGL_RENDERABLE_TYPE, 4,
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
             EGL_NONE
     };
     int numConfig = 0;
     eglChooseConfig(eglDisplay, attribList, nullptr, 0, &numConfig);
+    if(numConfig == 0) {
+        // 着色器都是#version 300 es，只支持ES2的驱动上什么都编译不了，不退回ES2
+        return nullptr;
+    }
     eglConfigs = (EGLConfig *)malloc(sizeof(EGLConfig) * numConfig);
     eglChooseConfig(eglDisplay, attribList, eglConfigs, numConfig, &numConfig);
 
@@ -0,0 +1,355 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <atomic>
+#include <algorithm>
+#include "RenderImageConverter.h"
+#include "RenderImageConverterKernels.h"
+#include "WorkerPool.h"
+
+// R, G, B byte offsets and bytes per pixel of the packed layouts, alpha -1 when it is filled with 255
+struct PackedLayoutInfo {
+    int r, g, b, a;
+    int bytesPerPixel;
+};
+
+static const PackedLayoutInfo PACKED_LAYOUTS[] = {
+        {0, 1, 2, -1, 3},   // PACKED_RGB24
+        {2, 1, 0, -1, 3},   // PACKED_BGR24
+        {0, 1, 2, 3,  4},   // PACKED_RGBA
+        {2, 1, 0, 3,  4},   // PACKED_BGRA
+        {0, 1, 2, -1, 4},   // PACKED_RGBX
+        {2, 1, 0, -1, 4},   // PACKED_BGRX
+};
+
+static const YuvToRgbCoeffs YUV_TO_RGB_COEFFS[2][2] = {
+        // limited range, full range
+        {{16, 75, 102, 25, 52, 129}, {0, 64, 90, 22, 46, 113}},    // BT.601
+        {{16, 75, 115, 14, 34, 135}, {0, 64, 101, 12, 30, 119}},   // BT.709
+};
+
+static const RgbToYuvCoeffs RGB_TO_YUV_COEFFS[2][2] = {
+        {{{66, 129, 25, 0}, {-19, -37, 56, 0}, {56, -47, -9, 0}, 16},
+         {{77, 150, 29, 0}, {-22, -42, 64, 0}, {64, -54, -10, 0}, 0}},
+        {{{47, 157, 16, 0}, {-13, -43, 56, 0}, {56, -51, -5, 0}, 16},
+         {{54, 183, 19, 0}, {-15, -49, 64, 0}, {64, -58, -6, 0}, 0}},
+};
+
+static inline uint8_t clampByte(int value) {
+    return (uint8_t) (value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline int average(int a, int b) {
+    return (a + b + 1) >> 1;
+}
+
+void scalarPackedToRgba(const uint8_t *src, uint8_t *dst, int width, PackedPixelLayout layout) {
+    const PackedLayoutInfo &info = PACKED_LAYOUTS[layout];
+    for (int x = 0; x < width; x++) {
+        dst[0] = src[info.r];
+        dst[1] = src[info.g];
+        dst[2] = src[info.b];
+        dst[3] = info.a >= 0 ? src[info.a] : 255;
+        src += info.bytesPerPixel;
+        dst += 4;
+    }
+}
+
+void scalarUVSplit(const uint8_t *uv, uint8_t *u, uint8_t *v, int width) {
+    for (int x = 0; x < width; x++) {
+        u[x] = uv[2 * x];
+        v[x] = uv[2 * x + 1];
+    }
+}
+
+void scalarUVMerge(const uint8_t *u, const uint8_t *v, uint8_t *uv, int width) {
+    for (int x = 0; x < width; x++) {
+        uv[2 * x] = u[x];
+        uv[2 * x + 1] = v[x];
+    }
+}
+
+void scalarUVSwap(const uint8_t *src, uint8_t *dst, int width) {
+    for (int x = 0; x < width; x++) {
+        uint8_t first = src[2 * x];
+        dst[2 * x] = src[2 * x + 1];
+        dst[2 * x + 1] = first;
+    }
+}
+
+void scalarYuvToRgba(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep, uint8_t *dst, int width,
+                     const YuvToRgbCoeffs *coeffs) {
+    for (int x = 0; x < width; x++) {
+        int c = coeffs->yScale * (y[x] - coeffs->yOffset);
+        int d = u[(x >> 1) * uvStep] - 128;
+        int e = v[(x >> 1) * uvStep] - 128;
+        dst[0] = clampByte((c + coeffs->rV * e + 32) >> 6);
+        dst[1] = clampByte((c - coeffs->gU * d - coeffs->gV * e + 32) >> 6);
+        dst[2] = clampByte((c + coeffs->bU * d + 32) >> 6);
+        dst[3] = 255;
+        dst += 4;
+    }
+}
+
+void scalarRgbaToY(const uint8_t *rgba, uint8_t *y, int width, const RgbToYuvCoeffs *coeffs) {
+    for (int x = 0; x < width; x++) {
+        const uint8_t *p = rgba + 4 * x;
+        int sum = coeffs->y[0] * p[0] + coeffs->y[1] * p[1] + coeffs->y[2] * p[2];
+        y[x] = clampByte(((sum + 128) >> 8) + coeffs->yOffset);
+    }
+}
+
+void scalarRgbaToUV(const uint8_t *row0, const uint8_t *row1, uint8_t *u, uint8_t *v, int uvStep, int width,
+                    const RgbToYuvCoeffs *coeffs) {
+    for (int x = 0; x < width / 2; x++) {
+        const uint8_t *p0 = row0 + 8 * x;
+        const uint8_t *p1 = row1 + 8 * x;
+        // 先上下平均再左右平均，和SIMD的pavgb顺序一致
+        int rgb[3];
+        for (int i = 0; i < 3; i++) {
+            rgb[i] = average(average(p0[i], p1[i]), average(p0[i + 4], p1[i + 4]));
+        }
+        int sumU = coeffs->u[0] * rgb[0] + coeffs->u[1] * rgb[1] + coeffs->u[2] * rgb[2];
+        int sumV = coeffs->v[0] * rgb[0] + coeffs->v[1] * rgb[1] + coeffs->v[2] * rgb[2];
+        u[x * uvStep] = clampByte(((sumU + 64) >> 7) + 128);
+        v[x * uvStep] = clampByte(((sumV + 64) >> 7) + 128);
+    }
+}
+
+void getScalarConvertKernels(ConvertKernels *kernels) {
+    kernels->packedToRgba = scalarPackedToRgba;
+    kernels->uvSplit = scalarUVSplit;
+    kernels->uvMerge = scalarUVMerge;
+    kernels->uvSwap = scalarUVSwap;
+    kernels->yuvToRgba = scalarYuvToRgba;
+    kernels->rgbaToY = scalarRgbaToY;
+    kernels->rgbaToUV = scalarRgbaToUV;
+}
+
+static std::atomic<int> g_SimdLevel(-1);
+
+ConvertSimdLevel RenderImageConverter::getSupportedSimdLevel() {
+    ConvertKernels kernels;
+    if (getAVX2ConvertKernels(&kernels)) {
+        return CONVERT_SIMD_AVX2;
+    }
+    if (getSSSE3ConvertKernels(&kernels)) {
+        return CONVERT_SIMD_SSSE3;
+    }
+    if (getNEONConvertKernels(&kernels)) {
+        return CONVERT_SIMD_NEON;
+    }
+    return CONVERT_SIMD_SCALAR;
+}
+
+void RenderImageConverter::setSimdLevel(ConvertSimdLevel level) {
+    ConvertSimdLevel supported = getSupportedSimdLevel();
+    bool available = level == CONVERT_SIMD_SCALAR || level == supported ||
+                     (level == CONVERT_SIMD_SSSE3 && supported == CONVERT_SIMD_AVX2);
+    g_SimdLevel = available ? level : supported;
+}
+
+ConvertSimdLevel RenderImageConverter::getSimdLevel() {
+    if (g_SimdLevel < 0) {
+        g_SimdLevel = getSupportedSimdLevel();
+    }
+    return (ConvertSimdLevel) g_SimdLevel.load();
+}
+
+const char *RenderImageConverter::getSimdLevelName(ConvertSimdLevel level) {
+    switch (level) {
+        case CONVERT_SIMD_SSSE3:
+            return "ssse3";
+        case CONVERT_SIMD_AVX2:
+            return "avx2";
+        case CONVERT_SIMD_NEON:
+            return "neon";
+        default:
+            return "scalar";
+    }
+}
+
+static void getKernels(ConvertKernels *kernels) {
+    getScalarConvertKernels(kernels);
+    switch (RenderImageConverter::getSimdLevel()) {
+        case CONVERT_SIMD_AVX2:
+            // AVX2没覆盖的行函数用SSSE3的
+            getSSSE3ConvertKernels(kernels);
+            getAVX2ConvertKernels(kernels);
+            break;
+        case CONVERT_SIMD_SSSE3:
+            getSSSE3ConvertKernels(kernels);
+            break;
+        case CONVERT_SIMD_NEON:
+            getNEONConvertKernels(kernels);
+            break;
+        default:
+            break;
+    }
+}
+
+static int planeCount(int format) {
+    switch (format) {
+        case IMAGE_FORMAT_RGBA:
+            return 1;
+        case IMAGE_FORMAT_NV12:
+        case IMAGE_FORMAT_NV21:
+            return 2;
+        case IMAGE_FORMAT_I420:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+// 没填linesize的按紧凑排列算
+static int planeLinesize(const RenderImage *image, int index) {
+    if (image->linesize[index] > 0) {
+        return image->linesize[index];
+    }
+    if (image->format == IMAGE_FORMAT_RGBA) {
+        return image->width * 4;
+    }
+    return index == 0 || image->format != IMAGE_FORMAT_I420 ? image->width : image->width / 2;
+}
+
+static inline uint8_t *planeRow(const RenderImage *image, int index, int row) {
+    return image->planes[index] + (size_t) row * planeLinesize(image, index);
+}
+
+static void copyRows(const RenderImage *src, RenderImage *dst, int index, int rowBytes, int begin, int end) {
+    for (int row = begin; row < end; row++) {
+        memcpy(planeRow(dst, index, row), planeRow(src, index, row), rowBytes);
+    }
+}
+
+// 按行带分给工作线程，YUV的行带从偶数行开始
+// convertRows(begin, end)
+template<typename ConvertRows>
+static void forEachBand(int width, int height, int threads, const ConvertRows &convertRows) {
+    int bands = (height + CONVERT_BAND_ROWS - 1) / CONVERT_BAND_ROWS;
+    if ((long) width * height < CONVERT_PARALLEL_MIN_PIXELS) {
+        threads = 1;
+    }
+    WorkerPool::getInstance().parallelFor(bands, threads, [&](int band) {
+        convertRows(band * CONVERT_BAND_ROWS, std::min(height, (band + 1) * CONVERT_BAND_ROWS));
+    });
+}
+
+static bool validImage(const RenderImage *image) {
+    int planes = planeCount(image->format);
+    if (planes == 0 || image->width <= 0 || image->height <= 0) {
+        return false;
+    }
+    if (image->format != IMAGE_FORMAT_RGBA && ((image->width & 1) || (image->height & 1))) {
+        return false;
+    }
+    for (int i = 0; i < planes; i++) {
+        if (image->planes[i] == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RenderImageConverter::convert(const RenderImage *src, RenderImage *dst, const ConvertOptions &options) {
+    if (src == nullptr || dst == nullptr || !validImage(src) || !validImage(dst) ||
+        src->width != dst->width || src->height != dst->height) {
+        std::cout << "RenderImageConverter::convert invalid images" << std::endl;
+        return false;
+    }
+    ConvertKernels kernels;
+    getKernels(&kernels);
+    const YuvToRgbCoeffs *toRgb = &YUV_TO_RGB_COEFFS[options.matrix][options.fullRange ? 1 : 0];
+    const RgbToYuvCoeffs *toYuv = &RGB_TO_YUV_COEFFS[options.matrix][options.fullRange ? 1 : 0];
+    int width = src->width;
+    int srcFormat = src->format;
+    int dstFormat = dst->format;
+
+    forEachBand(width, src->height, options.threads, [&](int begin, int end) {
+        if (srcFormat == IMAGE_FORMAT_RGBA && dstFormat == IMAGE_FORMAT_RGBA) {
+            copyRows(src, dst, 0, width * 4, begin, end);
+            return;
+        }
+        if (srcFormat == IMAGE_FORMAT_RGBA) {
+            for (int row = begin; row < end; row++) {
+                kernels.rgbaToY(planeRow(src, 0, row), planeRow(dst, 0, row), width, toYuv);
+            }
+            for (int row = begin; row < end; row += 2) {
+                uint8_t *u, *v;
+                int uvStep = 1;
+                if (dstFormat == IMAGE_FORMAT_I420) {
+                    u = planeRow(dst, 1, row / 2);
+                    v = planeRow(dst, 2, row / 2);
+                } else {
+                    uint8_t *uv = planeRow(dst, 1, row / 2);
+                    u = dstFormat == IMAGE_FORMAT_NV12 ? uv : uv + 1;
+                    v = dstFormat == IMAGE_FORMAT_NV12 ? uv + 1 : uv;
+                    uvStep = 2;
+                }
+                kernels.rgbaToUV(planeRow(src, 0, row), planeRow(src, 0, row + 1), u, v, uvStep, width, toYuv);
+            }
+            return;
+        }
+        if (dstFormat == IMAGE_FORMAT_RGBA) {
+            for (int row = begin; row < end; row++) {
+                const uint8_t *u, *v;
+                int uvStep = 1;
+                if (srcFormat == IMAGE_FORMAT_I420) {
+                    u = planeRow(src, 1, row / 2);
+                    v = planeRow(src, 2, row / 2);
+                } else {
+                    const uint8_t *uv = planeRow(src, 1, row / 2);
+                    u = srcFormat == IMAGE_FORMAT_NV12 ? uv : uv + 1;
+                    v = srcFormat == IMAGE_FORMAT_NV12 ? uv + 1 : uv;
+                    uvStep = 2;
+                }
+                kernels.yuvToRgba(planeRow(src, 0, row), u, v, uvStep, planeRow(dst, 0, row), width, toRgb);
+            }
+            return;
+        }
+
+        // YUV之间只动色度平面，亮度直接拷贝
+        copyRows(src, dst, 0, width, begin, end);
+        int chromaWidth = width / 2;
+        for (int row = begin / 2; row < end / 2; row++) {
+            if (srcFormat == dstFormat) {
+                copyRows(src, dst, 1, srcFormat == IMAGE_FORMAT_I420 ? chromaWidth : width, row, row + 1);
+                if (srcFormat == IMAGE_FORMAT_I420) {
+                    copyRows(src, dst, 2, chromaWidth, row, row + 1);
+                }
+            } else if (srcFormat == IMAGE_FORMAT_I420) {
+                const uint8_t *u = planeRow(src, 1, row);
+                const uint8_t *v = planeRow(src, 2, row);
+                kernels.uvMerge(dstFormat == IMAGE_FORMAT_NV12 ? u : v, dstFormat == IMAGE_FORMAT_NV12 ? v : u,
+                                planeRow(dst, 1, row), chromaWidth);
+            } else if (dstFormat == IMAGE_FORMAT_I420) {
+                uint8_t *u = planeRow(dst, 1, row);
+                uint8_t *v = planeRow(dst, 2, row);
+                kernels.uvSplit(planeRow(src, 1, row), srcFormat == IMAGE_FORMAT_NV12 ? u : v,
+                                srcFormat == IMAGE_FORMAT_NV12 ? v : u, chromaWidth);
+            } else {
+                kernels.uvSwap(planeRow(src, 1, row), planeRow(dst, 1, row), chromaWidth);
+            }
+        }
+    });
+    return true;
+}
+
+bool RenderImageConverter::convertPacked(const uint8_t *src, int linesize, PackedPixelLayout layout, RenderImage *dst,
+                                         const ConvertOptions &options) {
+    if (src == nullptr || dst == nullptr || dst->format != IMAGE_FORMAT_RGBA || !validImage(dst) ||
+        layout < PACKED_RGB24 || layout > PACKED_BGRX) {
+        std::cout << "RenderImageConverter::convertPacked invalid images" << std::endl;
+        return false;
+    }
+    ConvertKernels kernels;
+    getKernels(&kernels);
+    forEachBand(dst->width, dst->height, options.threads, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            kernels.packedToRgba(src + (size_t) row * linesize, planeRow(dst, 0, row), dst->width, layout);
+        }
+    });
+    return true;
+}
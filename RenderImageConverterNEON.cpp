@@ -0,0 +1,191 @@
+//
+// Created by liyang on 26-10-18.
+//
+// NEON row kernels, 16 pixels per iteration. The structured loads (vld3/vld4) do the swizzles and
+// the rounding narrows match the scalar (x + round) >> shift.
+//
+
+#include "RenderImageConverterKernels.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+static void neonPackedToRgba(const uint8_t *src, uint8_t *dst, int width, PackedPixelLayout layout) {
+    bool bgr = layout == PACKED_BGR24 || layout == PACKED_BGRA || layout == PACKED_BGRX;
+    int bytesPerPixel = layout == PACKED_RGB24 || layout == PACKED_BGR24 ? 3 : 4;
+    uint8x16_t opaque = vdupq_n_u8(255);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t rgba;
+        if (bytesPerPixel == 3) {
+            uint8x16x3_t pixels = vld3q_u8(src + x * 3);
+            rgba.val[0] = pixels.val[0];
+            rgba.val[1] = pixels.val[1];
+            rgba.val[2] = pixels.val[2];
+            rgba.val[3] = opaque;
+        } else {
+            rgba = vld4q_u8(src + x * 4);
+            if (layout == PACKED_RGBX || layout == PACKED_BGRX) {
+                rgba.val[3] = opaque;
+            }
+        }
+        if (bgr) {
+            uint8x16_t blue = rgba.val[0];
+            rgba.val[0] = rgba.val[2];
+            rgba.val[2] = blue;
+        }
+        vst4q_u8(dst + x * 4, rgba);
+    }
+    scalarPackedToRgba(src + x * bytesPerPixel, dst + x * 4, width - x, layout);
+}
+
+static void neonUVSplit(const uint8_t *uv, uint8_t *u, uint8_t *v, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t pairs = vld2q_u8(uv + x * 2);
+        vst1q_u8(u + x, pairs.val[0]);
+        vst1q_u8(v + x, pairs.val[1]);
+    }
+    scalarUVSplit(uv + x * 2, u + x, v + x, width - x);
+}
+
+static void neonUVMerge(const uint8_t *u, const uint8_t *v, uint8_t *uv, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t pairs;
+        pairs.val[0] = vld1q_u8(u + x);
+        pairs.val[1] = vld1q_u8(v + x);
+        vst2q_u8(uv + x * 2, pairs);
+    }
+    scalarUVMerge(u + x, v + x, uv + x * 2, width - x);
+}
+
+static void neonUVSwap(const uint8_t *src, uint8_t *dst, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        vst1q_u8(dst + x * 2, vrev16q_u8(vld1q_u8(src + x * 2)));
+    }
+    scalarUVSwap(src + x * 2, dst + x * 2, width - x);
+}
+
+static void neonYuvToRgba(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep, uint8_t *dst,
+                          int width, const YuvToRgbCoeffs *coeffs) {
+    uint8x8_t bias = vdup_n_u8(128);
+    uint8x8_t yOffset = vdup_n_u8((uint8_t) coeffs->yOffset);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8_t u8, v8;
+        if (uvStep == 1) {
+            u8 = vld1_u8(u + x / 2);
+            v8 = vld1_u8(v + x / 2);
+        } else {
+            uint8x8x2_t pairs = vld2_u8((u < v ? u : v) + x);
+            u8 = u < v ? pairs.val[0] : pairs.val[1];
+            v8 = u < v ? pairs.val[1] : pairs.val[0];
+        }
+        // 无符号相减后按有符号解释，就是 -128..127
+        int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(u8, bias));
+        int16x8_t e = vreinterpretq_s16_u16(vsubl_u8(v8, bias));
+        int16x8_t rTerm = vmulq_n_s16(e, coeffs->rV);
+        int16x8_t gTerm = vmlaq_n_s16(vmulq_n_s16(d, coeffs->gU), e, coeffs->gV);
+        int16x8_t bTerm = vmulq_n_s16(d, coeffs->bU);
+        int16x8x2_t rDup = vzipq_s16(rTerm, rTerm);
+        int16x8x2_t gDup = vzipq_s16(gTerm, gTerm);
+        int16x8x2_t bDup = vzipq_s16(bTerm, bTerm);
+
+        uint8x16_t luma = vld1q_u8(y + x);
+        int16x8_t yLo = vmulq_n_s16(vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(luma), yOffset)), coeffs->yScale);
+        int16x8_t yHi = vmulq_n_s16(vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(luma), yOffset)), coeffs->yScale);
+
+        uint8x16x4_t rgba;
+        rgba.val[0] = vcombine_u8(vqrshrun_n_s16(vqaddq_s16(yLo, rDup.val[0]), 6),
+                                  vqrshrun_n_s16(vqaddq_s16(yHi, rDup.val[1]), 6));
+        rgba.val[1] = vcombine_u8(vqrshrun_n_s16(vqsubq_s16(yLo, gDup.val[0]), 6),
+                                  vqrshrun_n_s16(vqsubq_s16(yHi, gDup.val[1]), 6));
+        rgba.val[2] = vcombine_u8(vqrshrun_n_s16(vqaddq_s16(yLo, bDup.val[0]), 6),
+                                  vqrshrun_n_s16(vqaddq_s16(yHi, bDup.val[1]), 6));
+        rgba.val[3] = vdupq_n_u8(255);
+        vst4q_u8(dst + x * 4, rgba);
+    }
+    scalarYuvToRgba(y + x, u + (x / 2) * uvStep, v + (x / 2) * uvStep, uvStep, dst + x * 4, width - x, coeffs);
+}
+
+static void neonRgbaToY(const uint8_t *rgba, uint8_t *y, int width, const RgbToYuvCoeffs *coeffs) {
+    // Y的系数都非负，可以走无符号乘加
+    uint8x8_t cr = vdup_n_u8(coeffs->y[0]);
+    uint8x8_t cg = vdup_n_u8(coeffs->y[1]);
+    uint8x8_t cb = vdup_n_u8(coeffs->y[2]);
+    uint8x16_t offset = vdupq_n_u8(coeffs->yOffset);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t pixels = vld4q_u8(rgba + x * 4);
+        uint16x8_t lo = vmull_u8(vget_low_u8(pixels.val[0]), cr);
+        lo = vmlal_u8(lo, vget_low_u8(pixels.val[1]), cg);
+        lo = vmlal_u8(lo, vget_low_u8(pixels.val[2]), cb);
+        uint16x8_t hi = vmull_u8(vget_high_u8(pixels.val[0]), cr);
+        hi = vmlal_u8(hi, vget_high_u8(pixels.val[1]), cg);
+        hi = vmlal_u8(hi, vget_high_u8(pixels.val[2]), cb);
+        // 和不超过255*256，u16放得下
+        uint8x16_t luma = vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8));
+        vst1q_u8(y + x, vqaddq_u8(luma, offset));
+    }
+    scalarRgbaToY(rgba + x * 4, y + x, width - x, coeffs);
+}
+
+// 8 averages of the 2x2 blocks of one channel from two rows of 16 pixels
+static inline int16x8_t averageBlocks(uint8x16_t row0, uint8x16_t row1) {
+    uint8x16_t vertical = vrhaddq_u8(row0, row1);
+    uint8x8x2_t halves = vuzp_u8(vget_low_u8(vertical), vget_high_u8(vertical));
+    return vreinterpretq_s16_u16(vmovl_u8(vrhadd_u8(halves.val[0], halves.val[1])));
+}
+
+static inline uint8x8_t chromaSum(int16x8_t r, int16x8_t g, int16x8_t b, const int8_t coeffs[4]) {
+    int16x8_t sum = vmulq_n_s16(r, coeffs[0]);
+    sum = vmlaq_n_s16(sum, g, coeffs[1]);
+    sum = vmlaq_n_s16(sum, b, coeffs[2]);
+    return vqmovun_s16(vaddq_s16(vrshrq_n_s16(sum, 7), vdupq_n_s16(128)));
+}
+
+static void neonRgbaToUV(const uint8_t *row0, const uint8_t *row1, uint8_t *u, uint8_t *v, int uvStep, int width,
+                         const RgbToYuvCoeffs *coeffs) {
+    int x = 0;
+    for (; x + 8 <= width / 2; x += 8) {
+        uint8x16x4_t p0 = vld4q_u8(row0 + x * 8);
+        uint8x16x4_t p1 = vld4q_u8(row1 + x * 8);
+        int16x8_t r = averageBlocks(p0.val[0], p1.val[0]);
+        int16x8_t g = averageBlocks(p0.val[1], p1.val[1]);
+        int16x8_t b = averageBlocks(p0.val[2], p1.val[2]);
+        uint8x8_t us = chromaSum(r, g, b, coeffs->u);
+        uint8x8_t vs = chromaSum(r, g, b, coeffs->v);
+        if (uvStep == 1) {
+            vst1_u8(u + x, us);
+            vst1_u8(v + x, vs);
+        } else {
+            uint8x8x2_t pairs;
+            pairs.val[0] = u < v ? us : vs;
+            pairs.val[1] = u < v ? vs : us;
+            vst2_u8((u < v ? u : v) + x * 2, pairs);
+        }
+    }
+    scalarRgbaToUV(row0 + x * 8, row1 + x * 8, u + x * uvStep, v + x * uvStep, uvStep, width - x * 2, coeffs);
+}
+
+bool getNEONConvertKernels(ConvertKernels *kernels) {
+    kernels->packedToRgba = neonPackedToRgba;
+    kernels->uvSplit = neonUVSplit;
+    kernels->uvMerge = neonUVMerge;
+    kernels->uvSwap = neonUVSwap;
+    kernels->yuvToRgba = neonYuvToRgba;
+    kernels->rgbaToY = neonRgbaToY;
+    kernels->rgbaToUV = neonRgbaToUV;
+    return true;
+}
+
+#else
+
+bool getNEONConvertKernels(ConvertKernels *) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,425 @@
+//
+// Created by liyang on 26-10-18.
+//
+// SSSE3 and AVX2 row kernels. They are compiled with target attributes and picked at run time,
+// so the library itself needs no -mavx2. AVX2 covers the wide per-pixel kernels; the 3-byte
+// swizzles and the chroma downsampling stay on SSSE3.
+//
+
+#include "RenderImageConverterKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// pshufb masks turning 4 packed pixels into RGBA, alpha lanes zeroed and ORed with 0xff later
+static const int8_t SHUFFLE_RGB24[16] = {0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1};
+static const int8_t SHUFFLE_BGR24[16] = {2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1};
+static const int8_t SHUFFLE_BGRA[16] = {2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15};
+static const int8_t SHUFFLE_RGBA[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+static const int8_t *getShuffle(PackedPixelLayout layout) {
+    switch (layout) {
+        case PACKED_RGB24:
+            return SHUFFLE_RGB24;
+        case PACKED_BGR24:
+            return SHUFFLE_BGR24;
+        case PACKED_BGRA:
+        case PACKED_BGRX:
+            return SHUFFLE_BGRA;
+        default:
+            return SHUFFLE_RGBA;
+    }
+}
+
+static inline int32_t packCoeffs(const int8_t coeffs[4]) {
+    return (int32_t) ((uint8_t) coeffs[0] | ((uint8_t) coeffs[1] << 8) | ((uint8_t) coeffs[2] << 16) |
+                      ((uint32_t) (uint8_t) coeffs[3] << 24));
+}
+
+SSSE3_TARGET static void ssse3PackedToRgba(const uint8_t *src, uint8_t *dst, int width, PackedPixelLayout layout) {
+    __m128i shuffle = _mm_loadu_si128((const __m128i *) getShuffle(layout));
+    __m128i alpha = layout == PACKED_RGBA || layout == PACKED_BGRA ? _mm_setzero_si128()
+                                                                    : _mm_set1_epi32((int) 0xff000000);
+    int x = 0;
+    if (layout == PACKED_RGB24 || layout == PACKED_BGR24) {
+        for (; x + 16 <= width; x += 16) {
+            const __m128i *in = (const __m128i *) (src + x * 3);
+            __m128i a = _mm_loadu_si128(in);
+            __m128i b = _mm_loadu_si128(in + 1);
+            __m128i c = _mm_loadu_si128(in + 2);
+            __m128i *out = (__m128i *) (dst + x * 4);
+            // 48字节拼成4组各12字节的像素
+            _mm_storeu_si128(out, _mm_or_si128(_mm_shuffle_epi8(a, shuffle), alpha));
+            _mm_storeu_si128(out + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle), alpha));
+            _mm_storeu_si128(out + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle), alpha));
+            _mm_storeu_si128(out + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle), alpha));
+        }
+        scalarPackedToRgba(src + x * 3, dst + x * 4, width - x, layout);
+        return;
+    }
+    for (; x + 4 <= width; x += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *) (src + x * 4));
+        _mm_storeu_si128((__m128i *) (dst + x * 4), _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+    }
+    scalarPackedToRgba(src + x * 4, dst + x * 4, width - x, layout);
+}
+
+SSSE3_TARGET static void ssse3UVSplit(const uint8_t *uv, uint8_t *u, uint8_t *v, int width) {
+    __m128i mask = _mm_set1_epi16(0x00ff);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (uv + x * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *) (uv + x * 2 + 16));
+        _mm_storeu_si128((__m128i *) (u + x), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *) (v + x), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    scalarUVSplit(uv + x * 2, u + x, v + x, width - x);
+}
+
+SSSE3_TARGET static void ssse3UVMerge(const uint8_t *u, const uint8_t *v, uint8_t *uv, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (u + x));
+        __m128i b = _mm_loadu_si128((const __m128i *) (v + x));
+        _mm_storeu_si128((__m128i *) (uv + x * 2), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *) (uv + x * 2 + 16), _mm_unpackhi_epi8(a, b));
+    }
+    scalarUVMerge(u + x, v + x, uv + x * 2, width - x);
+}
+
+SSSE3_TARGET static void ssse3UVSwap(const uint8_t *src, uint8_t *dst, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (src + x * 2));
+        _mm_storeu_si128((__m128i *) (dst + x * 2), _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8)));
+    }
+    scalarUVSwap(src + x * 2, dst + x * 2, width - x);
+}
+
+// 8 chroma samples widened to int16, from planar rows or from the interleaved NV12/NV21 row
+SSSE3_TARGET static inline void loadChroma8(const uint8_t *u, const uint8_t *v, int uvStep, __m128i *u16,
+                                            __m128i *v16) {
+    __m128i zero = _mm_setzero_si128();
+    if (uvStep == 1) {
+        *u16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) u), zero);
+        *v16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) v), zero);
+        return;
+    }
+    __m128i mask = _mm_set1_epi16(0x00ff);
+    __m128i pairs = _mm_loadu_si128((const __m128i *) (u < v ? u : v));
+    __m128i first = _mm_and_si128(pairs, mask);
+    __m128i second = _mm_srli_epi16(pairs, 8);
+    *u16 = u < v ? first : second;
+    *v16 = u < v ? second : first;
+}
+
+SSSE3_TARGET static void ssse3YuvToRgba(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                                        uint8_t *dst, int width, const YuvToRgbCoeffs *coeffs) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i bias = _mm_set1_epi16(128);
+    __m128i round = _mm_set1_epi16(32);
+    __m128i yOffset = _mm_set1_epi16(coeffs->yOffset);
+    __m128i yScale = _mm_set1_epi16(coeffs->yScale);
+    __m128i rV = _mm_set1_epi16(coeffs->rV);
+    __m128i gU = _mm_set1_epi16(coeffs->gU);
+    __m128i gV = _mm_set1_epi16(coeffs->gV);
+    __m128i bU = _mm_set1_epi16(coeffs->bU);
+    __m128i alpha = _mm_set1_epi8((char) 0xff);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i d, e;
+        loadChroma8(u + (x / 2) * uvStep, v + (x / 2) * uvStep, uvStep, &d, &e);
+        d = _mm_sub_epi16(d, bias);
+        e = _mm_sub_epi16(e, bias);
+        __m128i rTerm = _mm_mullo_epi16(e, rV);
+        __m128i gTerm = _mm_add_epi16(_mm_mullo_epi16(d, gU), _mm_mullo_epi16(e, gV));
+        __m128i bTerm = _mm_mullo_epi16(d, bU);
+
+        __m128i luma = _mm_loadu_si128((const __m128i *) (y + x));
+        __m128i yLo = _mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(luma, zero), yOffset), yScale);
+        __m128i yHi = _mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(luma, zero), yOffset), yScale);
+
+#define YUV_CHANNEL(op, term) _mm_packus_epi16( \
+        _mm_srai_epi16(_mm_adds_epi16(op(yLo, _mm_unpacklo_epi16(term, term)), round), 6), \
+        _mm_srai_epi16(_mm_adds_epi16(op(yHi, _mm_unpackhi_epi16(term, term)), round), 6))
+        __m128i r = YUV_CHANNEL(_mm_adds_epi16, rTerm);
+        __m128i g = YUV_CHANNEL(_mm_subs_epi16, gTerm);
+        __m128i b = YUV_CHANNEL(_mm_adds_epi16, bTerm);
+#undef YUV_CHANNEL
+
+        __m128i rgLo = _mm_unpacklo_epi8(r, g);
+        __m128i rgHi = _mm_unpackhi_epi8(r, g);
+        __m128i baLo = _mm_unpacklo_epi8(b, alpha);
+        __m128i baHi = _mm_unpackhi_epi8(b, alpha);
+        __m128i *out = (__m128i *) (dst + x * 4);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+    }
+    scalarYuvToRgba(y + x, u + (x / 2) * uvStep, v + (x / 2) * uvStep, uvStep, dst + x * 4, width - x, coeffs);
+}
+
+// ((sum + 64) >> 7) + offset of 8 int16 sums from two pmaddubsw results
+SSSE3_TARGET static inline __m128i finishSums(__m128i m0, __m128i m1, __m128i offset) {
+    __m128i sum = _mm_hadd_epi16(m0, m1);
+    return _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(sum, _mm_set1_epi16(64)), 7), offset);
+}
+
+// (sum + 128) >> 8 of the 4 pixels of 16 RGBA bytes. The 8-bit Y coefficients do not fit the
+// signed operand of pmaddubsw, so the bytes are widened and summed with pmaddwd in 32 bits.
+SSSE3_TARGET static inline __m128i lumaSums(__m128i pixels, __m128i coeff, __m128i round) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_hadd_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coeff),
+                                 _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coeff));
+    return _mm_srli_epi32(_mm_add_epi32(sum, round), 8);
+}
+
+SSSE3_TARGET static void ssse3RgbaToY(const uint8_t *rgba, uint8_t *y, int width, const RgbToYuvCoeffs *coeffs) {
+    __m128i coeff = _mm_setr_epi16(coeffs->y[0], coeffs->y[1], coeffs->y[2], 0,
+                                   coeffs->y[0], coeffs->y[1], coeffs->y[2], 0);
+    __m128i round = _mm_set1_epi32(128);
+    __m128i offset = _mm_set1_epi16(coeffs->yOffset);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m128i *in = (const __m128i *) (rgba + x * 4);
+        __m128i lo = _mm_packs_epi32(lumaSums(_mm_loadu_si128(in), coeff, round),
+                                     lumaSums(_mm_loadu_si128(in + 1), coeff, round));
+        __m128i hi = _mm_packs_epi32(lumaSums(_mm_loadu_si128(in + 2), coeff, round),
+                                     lumaSums(_mm_loadu_si128(in + 3), coeff, round));
+        _mm_storeu_si128((__m128i *) (y + x), _mm_packus_epi16(_mm_add_epi16(lo, offset), _mm_add_epi16(hi, offset)));
+    }
+    scalarRgbaToY(rgba + x * 4, y + x, width - x, coeffs);
+}
+
+// Averages of 4 horizontal pixel pairs, the rows already averaged vertically
+SSSE3_TARGET static inline __m128i averagePairs(__m128i a, __m128i b) {
+    __m128 fa = _mm_castsi128_ps(a);
+    __m128 fb = _mm_castsi128_ps(b);
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm_avg_epu8(even, odd);
+}
+
+SSSE3_TARGET static void ssse3RgbaToUV(const uint8_t *row0, const uint8_t *row1, uint8_t *u, uint8_t *v,
+                                       int uvStep, int width, const RgbToYuvCoeffs *coeffs) {
+    __m128i uCoeff = _mm_set1_epi32(packCoeffs(coeffs->u));
+    __m128i vCoeff = _mm_set1_epi32(packCoeffs(coeffs->v));
+    __m128i offset = _mm_set1_epi16(128);
+    int x = 0;
+    // x数的是色度样本，每次8个，对应16个像素
+    for (; x + 8 <= width / 2; x += 8) {
+        const __m128i *in0 = (const __m128i *) (row0 + x * 8);
+        const __m128i *in1 = (const __m128i *) (row1 + x * 8);
+        __m128i a0 = _mm_avg_epu8(_mm_loadu_si128(in0), _mm_loadu_si128(in1));
+        __m128i a1 = _mm_avg_epu8(_mm_loadu_si128(in0 + 1), _mm_loadu_si128(in1 + 1));
+        __m128i a2 = _mm_avg_epu8(_mm_loadu_si128(in0 + 2), _mm_loadu_si128(in1 + 2));
+        __m128i a3 = _mm_avg_epu8(_mm_loadu_si128(in0 + 3), _mm_loadu_si128(in1 + 3));
+        __m128i c0 = averagePairs(a0, a1);
+        __m128i c1 = averagePairs(a2, a3);
+        __m128i us = finishSums(_mm_maddubs_epi16(c0, uCoeff), _mm_maddubs_epi16(c1, uCoeff), offset);
+        __m128i vs = finishSums(_mm_maddubs_epi16(c0, vCoeff), _mm_maddubs_epi16(c1, vCoeff), offset);
+        __m128i ub = _mm_packus_epi16(us, us);
+        __m128i vb = _mm_packus_epi16(vs, vs);
+        if (uvStep == 1) {
+            _mm_storel_epi64((__m128i *) (u + x), ub);
+            _mm_storel_epi64((__m128i *) (v + x), vb);
+        } else if (u < v) {
+            _mm_storeu_si128((__m128i *) (u + x * 2), _mm_unpacklo_epi8(ub, vb));
+        } else {
+            _mm_storeu_si128((__m128i *) (v + x * 2), _mm_unpacklo_epi8(vb, ub));
+        }
+    }
+    scalarRgbaToUV(row0 + x * 8, row1 + x * 8, u + x * uvStep, v + x * uvStep, uvStep, width - x * 2, coeffs);
+}
+
+bool getSSSE3ConvertKernels(ConvertKernels *kernels) {
+    if (!__builtin_cpu_supports("ssse3")) {
+        return false;
+    }
+    kernels->packedToRgba = ssse3PackedToRgba;
+    kernels->uvSplit = ssse3UVSplit;
+    kernels->uvMerge = ssse3UVMerge;
+    kernels->uvSwap = ssse3UVSwap;
+    kernels->yuvToRgba = ssse3YuvToRgba;
+    kernels->rgbaToY = ssse3RgbaToY;
+    kernels->rgbaToUV = ssse3RgbaToUV;
+    return true;
+}
+
+AVX2_TARGET static void avx2PackedToRgba(const uint8_t *src, uint8_t *dst, int width, PackedPixelLayout layout) {
+    if (layout == PACKED_RGB24 || layout == PACKED_BGR24) {
+        ssse3PackedToRgba(src, dst, width, layout);
+        return;
+    }
+    __m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) getShuffle(layout)));
+    __m256i alpha = layout == PACKED_RGBA || layout == PACKED_BGRA ? _mm256_setzero_si256()
+                                                                    : _mm256_set1_epi32((int) 0xff000000);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *) (src + x * 4));
+        _mm256_storeu_si256((__m256i *) (dst + x * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+    }
+    scalarPackedToRgba(src + x * 4, dst + x * 4, width - x, layout);
+}
+
+AVX2_TARGET static void avx2UVSplit(const uint8_t *uv, uint8_t *u, uint8_t *v, int width) {
+    __m256i mask = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (uv + x * 2));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (uv + x * 2 + 32));
+        // packus按128位通道交错，再把四个64位块排回顺序
+        __m256i us = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i vs = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *) (u + x), _mm256_permute4x64_epi64(us, 0xd8));
+        _mm256_storeu_si256((__m256i *) (v + x), _mm256_permute4x64_epi64(vs, 0xd8));
+    }
+    scalarUVSplit(uv + x * 2, u + x, v + x, width - x);
+}
+
+AVX2_TARGET static void avx2UVMerge(const uint8_t *u, const uint8_t *v, uint8_t *uv, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (u + x));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (v + x));
+        __m256i lo = _mm256_unpacklo_epi8(a, b);
+        __m256i hi = _mm256_unpackhi_epi8(a, b);
+        _mm256_storeu_si256((__m256i *) (uv + x * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) (uv + x * 2 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    scalarUVMerge(u + x, v + x, uv + x * 2, width - x);
+}
+
+AVX2_TARGET static void avx2UVSwap(const uint8_t *src, uint8_t *dst, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (src + x * 2));
+        _mm256_storeu_si256((__m256i *) (dst + x * 2),
+                            _mm256_or_si256(_mm256_slli_epi16(a, 8), _mm256_srli_epi16(a, 8)));
+    }
+    scalarUVSwap(src + x * 2, dst + x * 2, width - x);
+}
+
+AVX2_TARGET static void avx2YuvToRgba(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                                      uint8_t *dst, int width, const YuvToRgbCoeffs *coeffs) {
+    __m256i bias = _mm256_set1_epi16(128);
+    __m256i round = _mm256_set1_epi16(32);
+    __m256i yOffset = _mm256_set1_epi16(coeffs->yOffset);
+    __m256i yScale = _mm256_set1_epi16(coeffs->yScale);
+    __m256i rV = _mm256_set1_epi16(coeffs->rV);
+    __m256i gU = _mm256_set1_epi16(coeffs->gU);
+    __m256i gV = _mm256_set1_epi16(coeffs->gV);
+    __m256i bU = _mm256_set1_epi16(coeffs->bU);
+    __m256i alpha = _mm256_set1_epi8((char) 0xff);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i d, e;
+        if (uvStep == 1) {
+            d = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (u + x / 2)));
+            e = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (v + x / 2)));
+        } else {
+            __m256i mask = _mm256_set1_epi16(0x00ff);
+            __m256i pairs = _mm256_loadu_si256((const __m256i *) ((u < v ? u : v) + x));
+            __m256i first = _mm256_and_si256(pairs, mask);
+            __m256i second = _mm256_srli_epi16(pairs, 8);
+            d = u < v ? first : second;
+            e = u < v ? second : first;
+        }
+        // 重排64位块，让下面按通道的unpack得到顺序的像素
+        d = _mm256_permute4x64_epi64(_mm256_sub_epi16(d, bias), 0xd8);
+        e = _mm256_permute4x64_epi64(_mm256_sub_epi16(e, bias), 0xd8);
+        __m256i rTerm = _mm256_mullo_epi16(e, rV);
+        __m256i gTerm = _mm256_add_epi16(_mm256_mullo_epi16(d, gU), _mm256_mullo_epi16(e, gV));
+        __m256i bTerm = _mm256_mullo_epi16(d, bU);
+
+        __m128i lumaLo = _mm_loadu_si128((const __m128i *) (y + x));
+        __m128i lumaHi = _mm_loadu_si128((const __m128i *) (y + x + 16));
+        __m256i yLo = _mm256_mullo_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(lumaLo), yOffset), yScale);
+        __m256i yHi = _mm256_mullo_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(lumaHi), yOffset), yScale);
+
+#define YUV_CHANNEL(op, term) _mm256_packus_epi16( \
+        _mm256_srai_epi16(_mm256_adds_epi16(op(yLo, _mm256_unpacklo_epi16(term, term)), round), 6), \
+        _mm256_srai_epi16(_mm256_adds_epi16(op(yHi, _mm256_unpackhi_epi16(term, term)), round), 6))
+        // 每个通道的结果是 [0-7, 16-23 | 8-15, 24-31]
+        __m256i r = YUV_CHANNEL(_mm256_adds_epi16, rTerm);
+        __m256i g = YUV_CHANNEL(_mm256_subs_epi16, gTerm);
+        __m256i b = YUV_CHANNEL(_mm256_adds_epi16, bTerm);
+#undef YUV_CHANNEL
+
+        __m256i rgLo = _mm256_unpacklo_epi8(r, g);
+        __m256i rgHi = _mm256_unpackhi_epi8(r, g);
+        __m256i baLo = _mm256_unpacklo_epi8(b, alpha);
+        __m256i baHi = _mm256_unpackhi_epi8(b, alpha);
+        __m256i p0 = _mm256_unpacklo_epi16(rgLo, baLo);
+        __m256i p1 = _mm256_unpackhi_epi16(rgLo, baLo);
+        __m256i p2 = _mm256_unpacklo_epi16(rgHi, baHi);
+        __m256i p3 = _mm256_unpackhi_epi16(rgHi, baHi);
+        __m256i *out = (__m256i *) (dst + x * 4);
+        _mm256_storeu_si256(out, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    ssse3YuvToRgba(y + x, u + (x / 2) * uvStep, v + (x / 2) * uvStep, uvStep, dst + x * 4, width - x, coeffs);
+}
+
+// lumaSums of 8 pixels, in order
+AVX2_TARGET static inline __m256i avx2LumaSums(__m256i pixels, __m256i coeff, __m256i round) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i sum = _mm256_hadd_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), coeff),
+                                    _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), coeff));
+    return _mm256_srli_epi32(_mm256_add_epi32(sum, round), 8);
+}
+
+AVX2_TARGET static void avx2RgbaToY(const uint8_t *rgba, uint8_t *y, int width, const RgbToYuvCoeffs *coeffs) {
+    __m256i coeff = _mm256_setr_epi16(coeffs->y[0], coeffs->y[1], coeffs->y[2], 0,
+                                      coeffs->y[0], coeffs->y[1], coeffs->y[2], 0,
+                                      coeffs->y[0], coeffs->y[1], coeffs->y[2], 0,
+                                      coeffs->y[0], coeffs->y[1], coeffs->y[2], 0);
+    __m256i round = _mm256_set1_epi32(128);
+    __m256i offset = _mm256_set1_epi16(coeffs->yOffset);
+    __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        const __m256i *in = (const __m256i *) (rgba + x * 4);
+        __m256i lo = _mm256_packs_epi32(avx2LumaSums(_mm256_loadu_si256(in), coeff, round),
+                                        avx2LumaSums(_mm256_loadu_si256(in + 1), coeff, round));
+        __m256i hi = _mm256_packs_epi32(avx2LumaSums(_mm256_loadu_si256(in + 2), coeff, round),
+                                        avx2LumaSums(_mm256_loadu_si256(in + 3), coeff, round));
+        // packs和packus都在128位通道内做，4像素一组的顺序要重排
+        __m256i packed = _mm256_packus_epi16(_mm256_add_epi16(lo, offset), _mm256_add_epi16(hi, offset));
+        _mm256_storeu_si256((__m256i *) (y + x), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    ssse3RgbaToY(rgba + x * 4, y + x, width - x, coeffs);
+}
+
+bool getAVX2ConvertKernels(ConvertKernels *kernels) {
+    if (!__builtin_cpu_supports("avx2")) {
+        return false;
+    }
+    kernels->packedToRgba = avx2PackedToRgba;
+    kernels->uvSplit = avx2UVSplit;
+    kernels->uvMerge = avx2UVMerge;
+    kernels->uvSwap = avx2UVSwap;
+    kernels->yuvToRgba = avx2YuvToRgba;
+    kernels->rgbaToY = avx2RgbaToY;
+    kernels->rgbaToUV = ssse3RgbaToUV;
+    return true;
+}
+
+#else
+
+bool getSSSE3ConvertKernels(ConvertKernels *) {
+    return false;
+}
+
+bool getAVX2ConvertKernels(ConvertKernels *) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,159 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <algorithm>
+#include "RenderImageCopy.h"
+#include "WorkerPool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COPY_HAS_STREAM_STORES 1
+#endif
+
+#ifdef COPY_HAS_STREAM_STORES
+// 目标按16字节对齐后用movntdq绕过缓存写，头尾不足的部分走memcpy
+__attribute__((target("sse2")))
+static void streamCopy(uint8_t *dst, const uint8_t *src, size_t size) {
+    size_t head = (16 - ((uintptr_t) dst & 15)) & 15;
+    if (size < head + 64) {
+        memcpy(dst, src, size);
+        return;
+    }
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+    for (; size >= 64; size -= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *) src);
+        __m128i b = _mm_loadu_si128((const __m128i *) (src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *) (src + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *) (src + 48));
+        _mm_stream_si128((__m128i *) dst, a);
+        _mm_stream_si128((__m128i *) (dst + 16), b);
+        _mm_stream_si128((__m128i *) (dst + 32), c);
+        _mm_stream_si128((__m128i *) (dst + 48), d);
+        src += 64;
+        dst += 64;
+    }
+    memcpy(dst, src, size);
+}
+#endif
+
+static void copyRows(const uint8_t *src, int srcLinesize, uint8_t *dst, int dstLinesize, size_t rowBytes, int rows,
+                     bool nonTemporal) {
+#ifdef COPY_HAS_STREAM_STORES
+    if (nonTemporal) {
+        for (int row = 0; row < rows; row++) {
+            streamCopy(dst + (ptrdiff_t) row * dstLinesize, src + (ptrdiff_t) row * srcLinesize, rowBytes);
+        }
+        // 流式写是弱序的，任务结束前刷出去
+        _mm_sfence();
+        return;
+    }
+#endif
+    for (int row = 0; row < rows; row++) {
+        memcpy(dst + (ptrdiff_t) row * dstLinesize, src + (ptrdiff_t) row * srcLinesize, rowBytes);
+    }
+}
+
+// sysfs reports e.g. "32768K" or "8M"
+static size_t readCacheSize(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == nullptr) {
+        return 0;
+    }
+    unsigned long value = 0;
+    char unit = 0;
+    int fields = fscanf(fp, "%lu%c", &value, &unit);
+    fclose(fp);
+    if (fields < 1) {
+        return 0;
+    }
+    if (unit == 'K') {
+        value <<= 10;
+    } else if (unit == 'M') {
+        value <<= 20;
+    }
+    return value;
+}
+
+static size_t detectLastLevelCacheSize() {
+    long size = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0) {
+        size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    }
+#endif
+    if (size > 0) {
+        return (size_t) size;
+    }
+    // Android和ARM上sysconf通常拿不到，取sysfs里最大的一级
+    size_t largest = 0;
+    for (int i = 0; i < 5; i++) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        largest = std::max(largest, readCacheSize(path));
+    }
+    return largest > 0 ? largest : DEFAULT_LLC_SIZE;
+}
+
+size_t RenderImageCopy::getLastLevelCacheSize() {
+    static size_t size = detectLastLevelCacheSize();
+    return size;
+}
+
+static bool isTight(const CopyPlane &plane) {
+    return plane.srcLinesize == plane.rowBytes && plane.dstLinesize == plane.rowBytes;
+}
+
+void RenderImageCopy::copyPlanes(const CopyPlane *planes, int count, const CopyOptions &options) {
+    size_t totalBytes = 0;
+    count = std::min(count, 3);
+    for (int i = 0; i < count; i++) {
+        if (planes[i].rowBytes > 0 && planes[i].rows > 0) {
+            totalBytes += (size_t) planes[i].rowBytes * planes[i].rows;
+        }
+    }
+    bool nonTemporal = options.nonTemporal < 0 ? totalBytes > getLastLevelCacheSize() : options.nonTemporal > 0;
+    bool parallel = options.threads != 1 && totalBytes >= COPY_PARALLEL_MIN_BYTES;
+
+    // 紧凑的平面按字节切块，有行距的按行切块，每个平面的块数算好后不用再分配任务列表
+    int bands[3] = {0, 0, 0};
+    size_t bandUnits[3] = {0, 0, 0};
+    int totalBands = 0;
+    for (int i = 0; i < count; i++) {
+        const CopyPlane &plane = planes[i];
+        if (plane.rowBytes <= 0 || plane.rows <= 0) {
+            continue;
+        }
+        size_t units = isTight(plane) ? (size_t) plane.rowBytes * plane.rows : (size_t) plane.rows;
+        size_t unitBytes = isTight(plane) ? 1 : (size_t) plane.rowBytes;
+        bandUnits[i] = parallel ? std::max((size_t) 1, (size_t) COPY_BAND_BYTES / unitBytes) : units;
+        bands[i] = (int) ((units + bandUnits[i] - 1) / bandUnits[i]);
+        totalBands += bands[i];
+    }
+
+    WorkerPool::getInstance().parallelFor(totalBands, parallel ? options.threads : 1, [&](int index) {
+        int i = 0;
+        while (index >= bands[i]) {
+            index -= bands[i];
+            i++;
+        }
+        const CopyPlane &plane = planes[i];
+        size_t begin = index * bandUnits[i];
+        if (isTight(plane)) {
+            size_t bytes = std::min(bandUnits[i], (size_t) plane.rowBytes * plane.rows - begin);
+            copyRows(plane.src + begin, 0, plane.dst + begin, 0, bytes, 1, nonTemporal);
+            return;
+        }
+        int rows = (int) std::min(bandUnits[i], (size_t) plane.rows - begin);
+        copyRows(plane.src + (ptrdiff_t) begin * plane.srcLinesize, plane.srcLinesize,
+                 plane.dst + (ptrdiff_t) begin * plane.dstLinesize, plane.dstLinesize, (size_t) plane.rowBytes, rows,
+                 nonTemporal);
+    });
+}
@@ -0,0 +1,308 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "RenderImageDumpWriter.h"
+#include "RenderImageConverter.h"
+
+// Output file with an aligned staging buffer. Frames are packed straight into the buffer, full
+// DUMP_DIRECT_IO_ALIGNMENT blocks go to disk, the tail waits for the next frame or close.
+class DumpFile {
+public:
+    ~DumpFile() {
+        close();
+        free(m_Buffer);
+    }
+
+    bool open(const char *path, bool directIO) {
+        close();
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+        m_Direct = false;
+        m_Used = 0;
+        m_Size = 0;
+#ifdef O_DIRECT
+        if (directIO) {
+            m_Fd = ::open(path, flags | O_DIRECT, 0644);
+            if (m_Fd >= 0) {
+                m_Direct = true;
+                return true;
+            }
+            // tmpfs等不支持O_DIRECT，退回普通写
+            std::cout << "RenderImageDumpWriter O_DIRECT not supported for " << path << ", errno=" << errno
+                      << std::endl;
+        }
+#endif
+        m_Fd = ::open(path, flags, 0644);
+        return m_Fd >= 0;
+    }
+
+    // Room for size more bytes after what is buffered
+    uint8_t *reserve(size_t size) {
+        size_t needed = m_Used + size + DUMP_DIRECT_IO_ALIGNMENT;
+        if (needed > m_Capacity) {
+            // 留出O_DIRECT剩下的不满一块的尾巴，同样大小的帧之后不再重新分配
+            needed = std::max(needed, size + 2 * (size_t) DUMP_DIRECT_IO_ALIGNMENT);
+            uint8_t *buffer = nullptr;
+            if (posix_memalign((void **) &buffer, DUMP_DIRECT_IO_ALIGNMENT, needed) != 0) {
+                return nullptr;
+            }
+            if (m_Used > 0) {
+                memcpy(buffer, m_Buffer, m_Used);
+            }
+            free(m_Buffer);
+            m_Buffer = buffer;
+            m_Capacity = needed;
+        }
+        return m_Buffer + m_Used;
+    }
+
+    bool commit(size_t size) {
+        m_Used += size;
+        m_Size += size;
+        size_t bytes = m_Direct ? m_Used & ~((size_t) DUMP_DIRECT_IO_ALIGNMENT - 1) : m_Used;
+        if (!writeAll(m_Buffer, bytes)) {
+            return false;
+        }
+        m_Used -= bytes;
+        if (m_Used > 0) {
+            memmove(m_Buffer, m_Buffer + bytes, m_Used);
+        }
+        return true;
+    }
+
+    void close() {
+        if (m_Fd < 0) {
+            return;
+        }
+        if (m_Used > 0) {
+            // O_DIRECT只能写整块，补零写完再截到真实长度
+            size_t padded = (m_Used + DUMP_DIRECT_IO_ALIGNMENT - 1) & ~((size_t) DUMP_DIRECT_IO_ALIGNMENT - 1);
+            memset(m_Buffer + m_Used, 0, padded - m_Used);
+            writeAll(m_Buffer, padded);
+            if (ftruncate(m_Fd, (off_t) m_Size) != 0) {
+                std::cout << "RenderImageDumpWriter ftruncate failed, errno=" << errno << std::endl;
+            }
+            m_Used = 0;
+        }
+        ::close(m_Fd);
+        m_Fd = -1;
+    }
+
+private:
+    bool writeAll(const uint8_t *data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(m_Fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cout << "RenderImageDumpWriter write failed, errno=" << errno << std::endl;
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    int m_Fd = -1;
+    bool m_Direct = false;
+    uint8_t *m_Buffer = nullptr;
+    size_t m_Capacity = 0;
+    size_t m_Used = 0;
+    uint64_t m_Size = 0;
+};
+
+static const char *getFormatExt(int format) {
+    switch (format) {
+        case IMAGE_FORMAT_I420:
+            return IMAGE_FORMAT_I420_EXT;
+        case IMAGE_FORMAT_NV12:
+            return IMAGE_FORMAT_NV12_EXT;
+        case IMAGE_FORMAT_NV21:
+            return IMAGE_FORMAT_NV21_EXT;
+        case IMAGE_FORMAT_RGBA:
+            return IMAGE_FORMAT_RGBA_EXT;
+        default:
+            return "Default";
+    }
+}
+
+static bool endsWith(const std::string &value, const char *suffix) {
+    size_t length = strlen(suffix);
+    return value.size() >= length && value.compare(value.size() - length, length, suffix) == 0;
+}
+
+DumpContainer RenderImageDumpWriter::getContainerForPath(const std::string &path) {
+    if (endsWith(path, ".y4m")) {
+        return DUMP_CONTAINER_Y4M;
+    }
+    if (endsWith(path, ".yuv") || endsWith(path, ".rgba") || endsWith(path, ".raw")) {
+        return DUMP_CONTAINER_RAW;
+    }
+    return DUMP_CONTAINER_SEQUENCE;
+}
+
+RenderImageDumpWriter::RenderImageDumpWriter(const std::string &path, const DumpWriterOptions &options)
+        : m_Path(path), m_Options(options), m_Pool(std::max(options.queueSize, 1) + 1),
+          m_Queue((size_t) std::max(options.queueSize, 1)) {
+    if (m_Options.container == DUMP_CONTAINER_SEQUENCE) {
+        if (access(path.c_str(), 0) == -1 && mkdir(path.c_str(), 0755) != 0) {
+            std::cout << "RenderImageDumpWriter failed to create " << path << std::endl;
+            return;
+        }
+    }
+    // 序列模式每帧重新打开，复用同一个暂存缓冲区
+    m_File = new DumpFile();
+    if (m_Options.container != DUMP_CONTAINER_SEQUENCE && !m_File->open(path.c_str(), m_Options.directIO)) {
+        std::cout << "RenderImageDumpWriter failed to open " << path << std::endl;
+        delete m_File;
+        m_File = nullptr;
+        return;
+    }
+    m_Valid = true;
+    m_Thread = std::thread(&RenderImageDumpWriter::writerLoop, this);
+}
+
+RenderImageDumpWriter::~RenderImageDumpWriter() {
+    close();
+}
+
+bool RenderImageDumpWriter::isValid() const {
+    return m_Valid;
+}
+
+bool RenderImageDumpWriter::write(const RenderImage *image) {
+    if (!m_Valid || m_Closed || image == nullptr || image->planes[0] == nullptr) {
+        return false;
+    }
+    if (m_Options.container != DUMP_CONTAINER_SEQUENCE) {
+        if (m_Format == 0) {
+            m_Width = image->width;
+            m_Height = image->height;
+            m_Format = image->format;
+        } else if (image->width != m_Width || image->height != m_Height || image->format != m_Format) {
+            m_Dropped++;
+            return false;
+        }
+    }
+    if (m_Options.dropWhenFull && m_Queue.size() >= (size_t) std::max(m_Options.queueSize, 1)) {
+        m_Dropped++;
+        return false;
+    }
+    RenderImage *copy = m_Pool.acquire(image->format, image->width, image->height);
+    if (copy == nullptr) {
+        m_Dropped++;
+        return false;
+    }
+    RenderImageUtil::copyRenderImage(const_cast<RenderImage *>(image), copy);
+    if (!m_Queue.push(copy)) {
+        m_Pool.release(copy);
+        return false;
+    }
+    m_Queued++;
+    return true;
+}
+
+void RenderImageDumpWriter::close() {
+    if (!m_Valid || m_Closed) {
+        return;
+    }
+    m_Closed = true;
+    m_Queue.close();
+    m_Thread.join();
+    delete m_File;
+    m_File = nullptr;
+}
+
+DumpWriterStats RenderImageDumpWriter::getStats() const {
+    DumpWriterStats stats;
+    stats.queued = m_Queued;
+    stats.written = m_Written;
+    stats.dropped = m_Dropped;
+    stats.bytesWritten = m_BytesWritten;
+    return stats;
+}
+
+void RenderImageDumpWriter::writerLoop() {
+    RenderImage *image = nullptr;
+    while (m_Queue.pop(&image)) {
+        if (writeFrame(image)) {
+            m_Written++;
+        }
+        m_Pool.release(image);
+    }
+}
+
+bool RenderImageDumpWriter::writeFrame(const RenderImage *image) {
+    DumpFile *file = m_File;
+    bool sequence = m_Options.container == DUMP_CONTAINER_SEQUENCE;
+    if (sequence) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/IMG_%dx%d_%llu.%s", m_Path.c_str(), image->width, image->height,
+                 (unsigned long long) m_FrameIndex, getFormatExt(image->format));
+        if (!file->open(path, m_Options.directIO)) {
+            std::cout << "RenderImageDumpWriter failed to open " << path << std::endl;
+            return false;
+        }
+    }
+
+    // Y4M只存I420，其它格式在这个线程上转换
+    RenderImage packed;
+    packed.width = image->width;
+    packed.height = image->height;
+    packed.format = m_Options.container == DUMP_CONTAINER_Y4M ? IMAGE_FORMAT_I420 : image->format;
+    size_t frameBytes = packed.format == IMAGE_FORMAT_RGBA ? (size_t) packed.width * packed.height * 4
+                                                           : (size_t) packed.width * packed.height * 3 / 2;
+    size_t headerBytes = 0;
+    char header[128];
+    if (m_Options.container == DUMP_CONTAINER_Y4M) {
+        headerBytes = m_FrameIndex > 0 ? 0 : (size_t) snprintf(
+                header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+                packed.width, packed.height, m_Options.fpsNum, m_Options.fpsDen);
+        headerBytes += snprintf(header + headerBytes, sizeof(header) - headerBytes, "FRAME\n");
+    }
+    uint8_t *data = file->reserve(headerBytes + frameBytes);
+    if (data == nullptr) {
+        return false;
+    }
+    memcpy(data, header, headerBytes);
+    data += headerBytes;
+
+    packed.planes[0] = data;
+    packed.linesize[0] = packed.format == IMAGE_FORMAT_RGBA ? packed.width * 4 : packed.width;
+    if (packed.format != IMAGE_FORMAT_RGBA) {
+        packed.planes[1] = data + (size_t) packed.width * packed.height;
+        packed.linesize[1] = packed.format == IMAGE_FORMAT_I420 ? packed.width / 2 : packed.width;
+    }
+    if (packed.format == IMAGE_FORMAT_I420) {
+        packed.planes[2] = packed.planes[1] + (size_t) (packed.width / 2) * (packed.height / 2);
+        packed.linesize[2] = packed.width / 2;
+    }
+    // 后台线程不去抢渲染线程的WorkerPool
+    if (packed.format == image->format) {
+        CopyOptions options;
+        options.threads = 1;
+        RenderImageUtil::copyRenderImage(const_cast<RenderImage *>(image), &packed, options);
+    } else {
+        ConvertOptions options;
+        options.threads = 1;
+        if (!RenderImageConverter::convert(image, &packed, options)) {
+            return false;
+        }
+    }
+    m_FrameIndex++;
+    bool committed = file->commit(headerBytes + frameBytes);
+    if (sequence) {
+        file->close();
+    }
+    if (!committed) {
+        return false;
+    }
+    m_BytesWritten += headerBytes + frameBytes;
+    return true;
+}
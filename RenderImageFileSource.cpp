@@ -0,0 +1,195 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include "RenderImageFileSource.h"
+
+// Longest "FRAME" line accepted, parameters included
+#define Y4M_MAX_FRAME_HEADER 256
+#define Y4M_MAX_STREAM_HEADER 1024
+
+size_t RenderImageFileSource::getFrameSize(int format, int width, int height) {
+    switch (format) {
+        case IMAGE_FORMAT_RGBA:
+            return (size_t) width * height * 4;
+        case IMAGE_FORMAT_NV12:
+        case IMAGE_FORMAT_NV21:
+        case IMAGE_FORMAT_I420:
+            return (size_t) width * height + 2 * (size_t) (width / 2) * (height / 2);
+        default:
+            return 0;
+    }
+}
+
+RenderImageFileSource::RenderImageFileSource(const std::string &path) {
+    if (!map(path) || !parseY4M()) {
+        std::cout << "RenderImageFileSource failed to open " << path << std::endl;
+        m_FrameOffsets.clear();
+    }
+}
+
+RenderImageFileSource::RenderImageFileSource(const std::string &path, int format, int width, int height) {
+    m_FrameSize = getFrameSize(format, width, height);
+    if (m_FrameSize == 0 || width <= 0 || height <= 0 ||
+        (format != IMAGE_FORMAT_RGBA && ((width & 1) || (height & 1)))) {
+        std::cout << "RenderImageFileSource unsupported raw format " << format << " " << width << "x" << height
+                  << std::endl;
+        return;
+    }
+    if (!map(path)) {
+        std::cout << "RenderImageFileSource failed to open " << path << std::endl;
+        return;
+    }
+    m_Format = format;
+    m_Width = width;
+    m_Height = height;
+    for (size_t offset = 0; offset + m_FrameSize <= m_Size; offset += m_FrameSize) {
+        m_FrameOffsets.push_back(offset);
+    }
+}
+
+RenderImageFileSource::~RenderImageFileSource() {
+    if (m_Data != nullptr) {
+        munmap(m_Data, m_Size);
+    }
+}
+
+bool RenderImageFileSource::map(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    m_Size = (size_t) info.st_size;
+    void *data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建好后文件描述符就不需要了
+    close(fd);
+    if (data == MAP_FAILED) {
+        m_Size = 0;
+        return false;
+    }
+    m_Data = (uint8_t *) data;
+    madvise(m_Data, m_Size, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool RenderImageFileSource::parseY4M() {
+    const char *text = (const char *) m_Data;
+    size_t limit = std::min(m_Size, (size_t) Y4M_MAX_STREAM_HEADER);
+    const char *end = (const char *) memchr(text, '\n', limit);
+    if (end == nullptr || limit < 10 || memcmp(text, "YUV4MPEG2 ", 10) != 0) {
+        return false;
+    }
+    std::string header(text + 10, end);
+    std::string chroma = "420jpeg";
+    size_t position = 0;
+    while (position < header.size()) {
+        size_t next = header.find(' ', position);
+        std::string token = header.substr(position, next == std::string::npos ? std::string::npos : next - position);
+        position = next == std::string::npos ? header.size() : next + 1;
+        if (token.empty()) {
+            continue;
+        }
+        if (token[0] == 'W') {
+            m_Width = atoi(token.c_str() + 1);
+        } else if (token[0] == 'H') {
+            m_Height = atoi(token.c_str() + 1);
+        } else if (token[0] == 'C') {
+            chroma = token.substr(1);
+        }
+    }
+    // 只认4:2:0的8位格式，色度位置的差别忽略
+    if (chroma != "420" && chroma != "420jpeg" && chroma != "420mpeg2" && chroma != "420paldv") {
+        std::cout << "RenderImageFileSource unsupported Y4M chroma C" << chroma << std::endl;
+        return false;
+    }
+    if (m_Width <= 0 || m_Height <= 0 || (m_Width & 1) || (m_Height & 1)) {
+        return false;
+    }
+    m_Format = IMAGE_FORMAT_I420;
+    m_FrameSize = getFrameSize(m_Format, m_Width, m_Height);
+
+    size_t offset = end + 1 - text;
+    while (offset + 5 <= m_Size && memcmp(m_Data + offset, "FRAME", 5) == 0) {
+        const uint8_t *line = (const uint8_t *) memchr(m_Data + offset, '\n',
+                                                       std::min(m_Size - offset, (size_t) Y4M_MAX_FRAME_HEADER));
+        if (line == nullptr) {
+            break;
+        }
+        size_t data = line + 1 - m_Data;
+        if (data + m_FrameSize > m_Size) {
+            // 最后一帧没写完
+            break;
+        }
+        m_FrameOffsets.push_back(data);
+        offset = data + m_FrameSize;
+    }
+    return !m_FrameOffsets.empty();
+}
+
+bool RenderImageFileSource::isValid() const {
+    return !m_FrameOffsets.empty();
+}
+
+int RenderImageFileSource::getFrameCount() const {
+    return (int) m_FrameOffsets.size();
+}
+
+int RenderImageFileSource::getWidth() const {
+    return m_Width;
+}
+
+int RenderImageFileSource::getHeight() const {
+    return m_Height;
+}
+
+int RenderImageFileSource::getFormat() const {
+    return m_Format;
+}
+
+void RenderImageFileSource::setReadahead(int frames) {
+    m_Readahead = std::max(frames, 0);
+}
+
+bool RenderImageFileSource::getFrame(int index, RenderImage *image) {
+    if (index < 0 || index >= getFrameCount() || image == nullptr) {
+        return false;
+    }
+    // 从当前帧到后面m_Readahead帧提前让内核读，已经请求过的不再重复
+    int last = std::min(index + m_Readahead, getFrameCount() - 1);
+    int first = index >= m_AdvisedUntil || index + 1 < m_AdvisedUntil - m_Readahead ? index : m_AdvisedUntil;
+    if (first <= last) {
+        static const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+        size_t begin = m_FrameOffsets[first] & ~(pageSize - 1);
+        size_t end = m_FrameOffsets[last] + m_FrameSize;
+        madvise(m_Data + begin, end - begin, MADV_WILLNEED);
+        m_AdvisedUntil = last + 1;
+    }
+
+    uint8_t *data = m_Data + m_FrameOffsets[index];
+    image->width = m_Width;
+    image->height = m_Height;
+    image->format = m_Format;
+    image->planes[0] = data;
+    image->planes[1] = nullptr;
+    image->planes[2] = nullptr;
+    image->linesize[0] = m_Format == IMAGE_FORMAT_RGBA ? m_Width * 4 : m_Width;
+    image->linesize[1] = 0;
+    image->linesize[2] = 0;
+    if (m_Format != IMAGE_FORMAT_RGBA) {
+        image->planes[1] = data + (size_t) m_Width * m_Height;
+        image->linesize[1] = m_Format == IMAGE_FORMAT_I420 ? m_Width / 2 : m_Width;
+    }
+    if (m_Format == IMAGE_FORMAT_I420) {
+        image->planes[2] = image->planes[1] + (size_t) (m_Width / 2) * (m_Height / 2);
+        image->linesize[2] = m_Width / 2;
+    }
+    return true;
+}
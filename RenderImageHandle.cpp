@@ -0,0 +1,191 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <stdlib.h>
+#include "RenderImageHandle.h"
+
+RenderImageHandle::RenderImageHandle() {
+}
+
+RenderImageHandle::RenderImageHandle(const RenderImage &image, const std::shared_ptr<void> &owner)
+        : m_Image(image), m_Owner(owner) {
+}
+
+RenderImageHandle::~RenderImageHandle() {
+}
+
+RenderImageHandle::RenderImageHandle(RenderImageHandle &&other) noexcept
+        : m_Image(other.m_Image), m_Owner(std::move(other.m_Owner)) {
+    other.m_Image = RenderImage();
+}
+
+RenderImageHandle &RenderImageHandle::operator=(RenderImageHandle &&other) noexcept {
+    if (this != &other) {
+        m_Image = other.m_Image;
+        m_Owner = std::move(other.m_Owner);
+        other.m_Image = RenderImage();
+    }
+    return *this;
+}
+
+int RenderImageHandle::getPlaneCount(int format) {
+    switch (format) {
+        case IMAGE_FORMAT_RGBA:
+            return 1;
+        case IMAGE_FORMAT_NV12:
+        case IMAGE_FORMAT_NV21:
+            return 2;
+        case IMAGE_FORMAT_I420:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+RenderImageHandle RenderImageHandle::allocate(int format, int width, int height) {
+    if (getPlaneCount(format) == 0 || width <= 0 || height <= 0 ||
+        (format != IMAGE_FORMAT_RGBA && ((width & 1) || (height & 1)))) {
+        std::cout << "RenderImageHandle::allocate invalid image " << width << "x" << height
+                  << " format " << format << std::endl;
+        return RenderImageHandle();
+    }
+    RenderImage image;
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    size_t size = RenderImagePool::layoutRenderImage(&image, nullptr);
+    void *base = nullptr;
+    if (posix_memalign(&base, RENDER_IMAGE_ALIGNMENT, size) != 0) {
+        std::cout << "RenderImageHandle::allocate failed to allocate " << size << " bytes" << std::endl;
+        return RenderImageHandle();
+    }
+    RenderImagePool::layoutRenderImage(&image, (uint8_t *) base);
+    return RenderImageHandle(image, std::shared_ptr<void>(base, free));
+}
+
+RenderImageHandle RenderImageHandle::fromPool(RenderImagePool *pool, int format, int width, int height) {
+    RenderImage *image = pool->acquire(format, width, height);
+    if (image == nullptr) {
+        return RenderImageHandle();
+    }
+    return RenderImageHandle(*image, std::shared_ptr<void>(image, [pool](void *released) {
+        pool->release((RenderImage *) released);
+    }));
+}
+
+RenderImageHandle RenderImageHandle::adopt(RenderImage *image) {
+    if (image == nullptr || image->planes[0] == nullptr) {
+        return RenderImageHandle();
+    }
+    // allocRenderImage把所有平面放在planes[0]开头的一块内存里
+    RenderImageHandle handle(*image, std::shared_ptr<void>(image->planes[0], free));
+    for (int i = 0; i < 3; i++) {
+        image->planes[i] = nullptr;
+    }
+    return handle;
+}
+
+RenderImageHandle RenderImageHandle::wrap(const RenderImage &image) {
+    return RenderImageHandle(image, nullptr);
+}
+
+RenderImageHandle RenderImageHandle::share() const {
+    return RenderImageHandle(m_Image, m_Owner);
+}
+
+RenderImageHandle RenderImageHandle::crop(int x, int y, int width, int height) const {
+    bool yuv = m_Image.format != IMAGE_FORMAT_RGBA;
+    if (empty() || x < 0 || y < 0 || width <= 0 || height <= 0 ||
+        x + width > m_Image.width || y + height > m_Image.height ||
+        (yuv && ((x | y | width | height) & 1))) {
+        std::cout << "RenderImageHandle::crop invalid region (" << x << ", " << y << ") " << width << "x" << height
+                  << " of " << m_Image.width << "x" << m_Image.height << std::endl;
+        return RenderImageHandle();
+    }
+    RenderImage region = m_Image;
+    region.width = width;
+    region.height = height;
+    for (int i = 0; i < getPlaneCount(m_Image.format); i++) {
+        RenderImagePlane source = plane(i);
+        int planeX = i == 0 ? x : x / 2;
+        int planeY = i == 0 ? y : y / 2;
+        region.planes[i] = source.data + (size_t) planeY * source.linesize + planeX * source.bytesPerPixel;
+        region.linesize[i] = source.linesize;
+    }
+    return RenderImageHandle(region, m_Owner);
+}
+
+RenderImagePlane RenderImageHandle::plane(int index) const {
+    RenderImagePlane result = {nullptr, 0, 0, 0, 0};
+    if (index < 0 || index >= getPlaneCount(m_Image.format)) {
+        return result;
+    }
+    bool chroma = index > 0;
+    result.width = chroma ? m_Image.width / 2 : m_Image.width;
+    result.height = chroma ? m_Image.height / 2 : m_Image.height;
+    if (m_Image.format == IMAGE_FORMAT_RGBA) {
+        result.bytesPerPixel = 4;
+    } else if (chroma && m_Image.format != IMAGE_FORMAT_I420) {
+        // NV12/NV21的UV交错存放
+        result.bytesPerPixel = 2;
+    } else {
+        result.bytesPerPixel = 1;
+    }
+    result.data = m_Image.planes[index];
+    // 没填linesize的按紧凑排列算，和上传时一样
+    result.linesize = m_Image.linesize[index] > 0 ? m_Image.linesize[index] : result.width * result.bytesPerPixel;
+    return result;
+}
+
+RenderImageHandle RenderImageHandle::clone() const {
+    if (empty()) {
+        return RenderImageHandle();
+    }
+    RenderImageHandle copy = allocate(m_Image.format, m_Image.width, m_Image.height);
+    if (copy.empty()) {
+        return copy;
+    }
+    for (int i = 0; i < getPlaneCount(m_Image.format); i++) {
+        RenderImagePlane source = plane(i);
+        RenderImagePlane target = copy.plane(i);
+        for (int row = 0; row < source.height; row++) {
+            memcpy(target.data + (size_t) row * target.linesize, source.data + (size_t) row * source.linesize,
+                   (size_t) source.width * source.bytesPerPixel);
+        }
+    }
+    return copy;
+}
+
+void RenderImageHandle::reset() {
+    m_Owner.reset();
+    m_Image = RenderImage();
+}
+
+bool RenderImageHandle::empty() const {
+    return m_Image.planes[0] == nullptr;
+}
+
+long RenderImageHandle::useCount() const {
+    return m_Owner.use_count();
+}
+
+int RenderImageHandle::getFormat() const {
+    return m_Image.format;
+}
+
+int RenderImageHandle::getWidth() const {
+    return m_Image.width;
+}
+
+int RenderImageHandle::getHeight() const {
+    return m_Image.height;
+}
+
+RenderImage *RenderImageHandle::get() {
+    return &m_Image;
+}
+
+const RenderImage *RenderImageHandle::get() const {
+    return &m_Image;
+}
@@ -0,0 +1,256 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include "RenderImagePool.h"
+
+RenderImagePool::RenderImagePool(int maxFreePerKey, bool hugePages)
+        : m_MaxFreePerKey(std::max(maxFreePerKey, 0)),
+          m_HugePages(hugePages) {
+    memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+RenderImagePool::~RenderImagePool() {
+    trim();
+    if (m_InUse != nullptr) {
+        std::cout << "RenderImagePool: " << m_InUseCount << " images were not released" << std::endl;
+        while (m_InUse != nullptr) {
+            PoolBuffer *next = m_InUse->next;
+            freeBuffer(m_InUse);
+            m_InUse = next;
+        }
+    }
+}
+
+int RenderImagePool::alignLinesize(int rowBytes) {
+    int linesize = (rowBytes + RENDER_IMAGE_ALIGNMENT - 1) / RENDER_IMAGE_ALIGNMENT * RENDER_IMAGE_ALIGNMENT;
+    if (linesize % 4096 == 0) {
+        linesize += RENDER_IMAGE_ALIGNMENT;
+    }
+    return linesize;
+}
+
+size_t RenderImagePool::layoutRenderImage(RenderImage *image, uint8_t *base) {
+    int planeCount;
+    int rowBytes[3] = {0, 0, 0};
+    int rows[3] = {image->height, image->height / 2, image->height / 2};
+    switch (image->format) {
+        case IMAGE_FORMAT_RGBA:
+            planeCount = 1;
+            rowBytes[0] = image->width * 4;
+            break;
+        case IMAGE_FORMAT_NV12:
+        case IMAGE_FORMAT_NV21:
+            planeCount = 2;
+            rowBytes[0] = image->width;
+            rowBytes[1] = image->width;
+            break;
+        case IMAGE_FORMAT_I420:
+            planeCount = 3;
+            rowBytes[0] = image->width;
+            rowBytes[1] = image->width / 2;
+            rowBytes[2] = image->width / 2;
+            break;
+        default:
+            return 0;
+    }
+    size_t size = 0;
+    for (int i = 0; i < 3; i++) {
+        image->planes[i] = nullptr;
+        image->linesize[i] = 0;
+        if (i >= planeCount) {
+            continue;
+        }
+        image->linesize[i] = alignLinesize(rowBytes[i]);
+        if (base != nullptr) {
+            image->planes[i] = base + size;
+        }
+        // linesize已经对齐，平面大小自然也是对齐的
+        size += (size_t) image->linesize[i] * rows[i];
+    }
+    return size;
+}
+
+uint64_t RenderImagePool::makeKey(int format, int width, int height) {
+    return ((uint64_t) format << 48) | ((uint64_t) width << 24) | (uint64_t) height;
+}
+
+RenderImagePool::PoolBuffer *RenderImagePool::allocBuffer(int format, int width, int height) {
+    PoolBuffer *buffer = new PoolBuffer();
+    buffer->key = makeKey(format, width, height);
+    buffer->image.format = format;
+    buffer->image.width = width;
+    buffer->image.height = height;
+    buffer->size = layoutRenderImage(&buffer->image, nullptr);
+    buffer->base = nullptr;
+    buffer->mapped = false;
+    buffer->owner = this;
+    buffer->inUse = false;
+    buffer->prev = nullptr;
+    buffer->next = nullptr;
+
+    if (m_HugePages && buffer->size >= POOL_HUGE_PAGE_SIZE) {
+        size_t mappedSize = (buffer->size + POOL_HUGE_PAGE_SIZE - 1) / POOL_HUGE_PAGE_SIZE * POOL_HUGE_PAGE_SIZE;
+        void *base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        // 配置了hugetlbfs时直接拿大页，否则退回透明大页
+        base = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (base == MAP_FAILED) {
+            base = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (base != MAP_FAILED) {
+                madvise(base, mappedSize, MADV_HUGEPAGE);
+            }
+#endif
+        }
+        if (base != MAP_FAILED) {
+            buffer->base = (uint8_t *) base;
+            buffer->size = mappedSize;
+            buffer->mapped = true;
+        }
+    }
+    if (buffer->base == nullptr) {
+        void *base = nullptr;
+        if (posix_memalign(&base, RENDER_IMAGE_ALIGNMENT, buffer->size) != 0) {
+            std::cout << "RenderImagePool: failed to allocate " << buffer->size << " bytes" << std::endl;
+            delete buffer;
+            return nullptr;
+        }
+        buffer->base = (uint8_t *) base;
+    }
+    layoutRenderImage(&buffer->image, buffer->base);
+    return buffer;
+}
+
+void RenderImagePool::freeBuffer(PoolBuffer *buffer) {
+    if (buffer->mapped) {
+        munmap(buffer->base, buffer->size);
+    } else {
+        free(buffer->base);
+    }
+    delete buffer;
+}
+
+RenderImage *RenderImagePool::acquire(int format, int width, int height) {
+    if (width <= 0 || height <= 0 || width >= (1 << 24) || height >= (1 << 24)) {
+        std::cout << "RenderImagePool: invalid size " << width << "x" << height << std::endl;
+        return nullptr;
+    }
+    if (format != IMAGE_FORMAT_RGBA && format != IMAGE_FORMAT_NV12 && format != IMAGE_FORMAT_NV21 &&
+        format != IMAGE_FORMAT_I420) {
+        std::cout << "RenderImagePool: unsupported format " << format << std::endl;
+        return nullptr;
+    }
+    if (format != IMAGE_FORMAT_RGBA && ((width & 1) || (height & 1))) {
+        std::cout << "RenderImagePool: YUV images need an even size, got " << width << "x" << height << std::endl;
+        return nullptr;
+    }
+    uint64_t key = makeKey(format, width, height);
+    PoolBuffer *buffer = nullptr;
+    bool allocated = false;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Stats.acquired++;
+        std::map<uint64_t, std::vector<PoolBuffer *>>::iterator iter = m_FreeBuffers.find(key);
+        if (iter != m_FreeBuffers.end() && !iter->second.empty()) {
+            buffer = iter->second.back();
+            iter->second.pop_back();
+            m_Stats.bytesFree -= buffer->size;
+        }
+    }
+    if (buffer == nullptr) {
+        // 分配放在锁外面，大块mmap可能要一段时间
+        buffer = allocBuffer(format, width, height);
+        if (buffer == nullptr) {
+            return nullptr;
+        }
+        allocated = true;
+    }
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if (allocated) {
+        m_Stats.allocated++;
+    }
+    // 调用者可能改过image里的指针，每次发出去前按原样重新填
+    layoutRenderImage(&buffer->image, buffer->base);
+    m_Stats.bytesInUse += buffer->size;
+    buffer->inUse = true;
+    buffer->prev = nullptr;
+    buffer->next = m_InUse;
+    if (m_InUse != nullptr) {
+        m_InUse->prev = buffer;
+    }
+    m_InUse = buffer;
+    m_InUseCount++;
+    return &buffer->image;
+}
+
+void RenderImagePool::release(RenderImage *image) {
+    if (image == nullptr) {
+        return;
+    }
+    PoolBuffer *dropped = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        // image是PoolBuffer的第一个成员，不用查表
+        static_assert(offsetof(PoolBuffer, image) == 0, "release finds the buffer from the image address");
+        PoolBuffer *buffer = reinterpret_cast<PoolBuffer *>(image);
+        if (buffer->owner != this || !buffer->inUse) {
+            std::cout << "RenderImagePool: released an image that is not in use in this pool" << std::endl;
+            return;
+        }
+        buffer->inUse = false;
+        if (buffer->prev != nullptr) {
+            buffer->prev->next = buffer->next;
+        } else {
+            m_InUse = buffer->next;
+        }
+        if (buffer->next != nullptr) {
+            buffer->next->prev = buffer->prev;
+        }
+        buffer->prev = nullptr;
+        buffer->next = nullptr;
+        m_InUseCount--;
+        m_Stats.released++;
+        m_Stats.bytesInUse -= buffer->size;
+        std::vector<PoolBuffer *> &freeBuffers = m_FreeBuffers[buffer->key];
+        if (freeBuffers.capacity() == 0) {
+            // 第一次见到这个尺寸时一次预留好，之后放回不再分配
+            freeBuffers.reserve(m_MaxFreePerKey);
+        }
+        if ((int) freeBuffers.size() < m_MaxFreePerKey) {
+            freeBuffers.push_back(buffer);
+            m_Stats.bytesFree += buffer->size;
+        } else {
+            dropped = buffer;
+        }
+    }
+    if (dropped != nullptr) {
+        freeBuffer(dropped);
+    }
+}
+
+void RenderImagePool::trim() {
+    std::vector<PoolBuffer *> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        // 只清空列表，预留的容量和键都留着，之后的release不用再分配
+        for (auto &entry : m_FreeBuffers) {
+            dropped.insert(dropped.end(), entry.second.begin(), entry.second.end());
+            entry.second.clear();
+        }
+        m_Stats.bytesFree = 0;
+    }
+    for (PoolBuffer *buffer : dropped) {
+        freeBuffer(buffer);
+    }
+}
+
+RenderImagePoolStats RenderImagePool::getStats() const {
+    std::lock_guard<std::mutex> lock(m_Lock);
+    return m_Stats;
+}
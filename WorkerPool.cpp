@@ -0,0 +1,92 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#include <algorithm>
+#include "WorkerPool.h"
+
+WorkerPool &WorkerPool::getInstance() {
+    static WorkerPool pool(std::max((int) std::thread::hardware_concurrency(), 1));
+    return pool;
+}
+
+WorkerPool::WorkerPool(int threadCount) {
+    // 调用线程自己也干活，少起一个
+    for (int i = 1; i < threadCount; i++) {
+        m_Threads.push_back(std::thread(&WorkerPool::workerLoop, this, i));
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Stopped = true;
+        m_JobReady.notify_all();
+    }
+    for (std::thread &thread : m_Threads) {
+        thread.join();
+    }
+}
+
+int WorkerPool::getThreadCount() const {
+    return (int) m_Threads.size() + 1;
+}
+
+void WorkerPool::runTasks() {
+    for (int index = m_NextTask++; index < m_TaskCount; index = m_NextTask++) {
+        m_Task(m_TaskContext, index);
+    }
+}
+
+void WorkerPool::workerLoop(int worker) {
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_JobReady.wait(lock, [&]() { return m_Stopped || m_Generation != generation; });
+            if (m_Stopped) {
+                return;
+            }
+            generation = m_Generation;
+            // 醒得太晚的线程不再加入，调用者可能已经在准备下一个任务
+            if (!m_JobOpen || worker >= m_Workers) {
+                continue;
+            }
+            m_ActiveWorkers++;
+        }
+        runTasks();
+        std::lock_guard<std::mutex> lock(m_Lock);
+        if (--m_ActiveWorkers == 0) {
+            m_JobDone.notify_all();
+        }
+    }
+}
+
+void WorkerPool::run(int count, int maxThreads, TaskFunction task, const void *context) {
+    int workers = std::min(count, maxThreads > 0 ? std::min(maxThreads, getThreadCount()) : getThreadCount());
+    if (workers <= 1) {
+        for (int i = 0; i < count; i++) {
+            task(context, i);
+        }
+        return;
+    }
+    std::lock_guard<std::mutex> jobLock(m_JobLock);
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Task = task;
+        m_TaskContext = context;
+        m_TaskCount = count;
+        m_NextTask = 0;
+        m_Workers = workers;
+        m_JobOpen = true;
+        m_Generation++;
+        m_JobReady.notify_all();
+    }
+    runTasks();
+    // 所有任务都被领走后，还要等已经加入的线程做完
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_JobOpen = false;
+    m_JobDone.wait(lock, [this]() { return m_ActiveWorkers == 0; });
+    m_Task = nullptr;
+    m_TaskContext = nullptr;
+}
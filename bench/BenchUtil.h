@@ -0,0 +1,47 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_BENCHUTIL_H
+#define ANDROID_PRJ_BENCHUTIL_H
+
+#include "RenderImage.h"
+
+// Deterministic input shared by the bench tools: a gradient with a checkerboard for some high
+// frequency detail. YUV formats get the BT.601 limited range conversion of the same picture.
+static void fillTestImage(RenderImage *image) {
+    int width = image->width;
+    int height = image->height;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int r = x * 255 / width;
+            int g = y * 255 / height;
+            int b = ((x / 8 + y / 8) & 1) ? 200 : 60;
+            if (image->format == IMAGE_FORMAT_RGBA) {
+                uint8_t *pixel = image->planes[0] + y * image->linesize[0] + x * 4;
+                pixel[0] = r;
+                pixel[1] = g;
+                pixel[2] = b;
+                pixel[3] = 255;
+                continue;
+            }
+            image->planes[0][y * image->linesize[0] + x] = (66 * r + 129 * g + 25 * b + 128) / 256 + 16;
+            if ((x & 1) || (y & 1)) {
+                continue;
+            }
+            uint8_t u = (-38 * r - 74 * g + 112 * b + 128) / 256 + 128;
+            uint8_t v = (112 * r - 94 * g - 18 * b + 128) / 256 + 128;
+            if (image->format == IMAGE_FORMAT_I420) {
+                image->planes[1][(y / 2) * image->linesize[1] + x / 2] = u;
+                image->planes[2][(y / 2) * image->linesize[2] + x / 2] = v;
+            } else {
+                uint8_t *uv = image->planes[1] + (y / 2) * image->linesize[1] + x;
+                uv[0] = image->format == IMAGE_FORMAT_NV12 ? u : v;
+                uv[1] = image->format == IMAGE_FORMAT_NV12 ? v : u;
+            }
+        }
+    }
+}
+
+
+#endif //ANDROID_PRJ_BENCHUTIL_H
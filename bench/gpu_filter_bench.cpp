@@ -0,0 +1,468 @@
+//
+// Created by liyang on 26-10-18.
+//
+// Headless throughput benchmark. Every case renders through a PixelBuffer (EGL pbuffer, or the
+// surfaceless platform when there is no window system) so it runs on Mesa llvmpipe as well as on
+// a GPU. Each case is measured twice: once with profiling off for frames/s and allocations, once
+// with profiling on for the upload, readback and GPU split.
+//
+//     gpu_filter_bench [--filter name] [--sizes 480p,720p,1080p,4k] [--formats rgba,nv12,i420]
+//                      [--min-time seconds] [--min-frames n] [--json file] [--dump path]
+//                      [--input file] [--upload direct|pbo]
+//
+// --input replays a file through RenderImageFileSource instead of the generated test image: a
+// .y4m file sets the size and format, any other file is read as raw frames of each --sizes and
+// --formats combination. --upload pbo prefetches the input through GPUImagePBOUploader.
+// --dump streams every output frame through RenderImageDumpWriter (path.y4m, path.rgba or a
+// directory) to measure the cost of leaving debug capture on; frames the disk cannot keep up
+// with are dropped and counted.
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "PixelBuffer.h"
+#include "RenderImagePool.h"
+#include "RenderImageDumpWriter.h"
+#include "RenderImageFileSource.h"
+#include "GPUImagePBOUploader.h"
+#include "GPUImageInputFilter.h"
+#include "GPUImageRenderer.h"
+#include "GPUImagePipelineParser.h"
+#include "GPUImageNormalBlendFilter.h"
+#include "GPUImageCompositorFilter.h"
+#include "GPUImageFilterGraph.h"
+#include "GPUImageTextFilter.h"
+#include "BenchUtil.h"
+
+static std::atomic<long> g_Allocations(0);
+
+void *operator new(size_t size) {
+    g_Allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+struct BenchSize {
+    const char *name;
+    int width;
+    int height;
+};
+
+struct BenchFormat {
+    const char *name;
+    int format;
+};
+
+struct BenchCase {
+    std::string name;
+    std::function<GPUImageFilter *(RenderImage *overlay)> create;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string size;
+    std::string format;
+    int width;
+    int height;
+    int frames;
+    double fps;
+    double frameMs;
+    double allocationsPerFrame;
+    double uploadMBps;
+    double readbackMBps;
+    double gpuFrameMs;
+};
+
+static const BenchSize SIZES[] = {
+        {"480p",  854,  480},
+        {"720p",  1280, 720},
+        {"1080p", 1920, 1080},
+        {"4k",    3840, 2160},
+};
+
+static const BenchFormat FORMATS[] = {
+        {"rgba", IMAGE_FORMAT_RGBA},
+        {"nv12", IMAGE_FORMAT_NV12},
+        {"i420", IMAGE_FORMAT_I420},
+};
+
+static GPUImageFilter *parsePipeline(const std::string &description) {
+    return GPUImagePipelineParser::parse(description);
+}
+
+// 字形在FreeType线程上光栅化，计时前等它们都进了图集，否则前几帧画的是缺字的文本
+static void waitForGlyphs(GPUImageFilter *filter) {
+    if (GPUImageTextFilter *text = dynamic_cast<GPUImageTextFilter *>(filter)) {
+        if (text->getGlyphCache() != nullptr) {
+            text->getGlyphCache()->waitForPendingGlyphs();
+        }
+    } else if (GPUImageFilterGraph *graph = dynamic_cast<GPUImageFilterGraph *>(filter)) {
+        for (int i = 0; i < graph->getNodeCount(); i++) {
+            waitForGlyphs(graph->getNodeFilter(i));
+        }
+    } else if (GPUImageFilterGroup *group = dynamic_cast<GPUImageFilterGroup *>(filter)) {
+        for (GPUImageFilter *child : group->getFilters()) {
+            waitForGlyphs(child);
+        }
+    }
+}
+
+static std::vector<BenchCase> createCases() {
+    std::vector<BenchCase> cases;
+    // 单个滤镜
+    cases.push_back({"null", [](RenderImage *) { return parsePipeline("null"); }});
+    cases.push_back({"rgb", [](RenderImage *) { return parsePipeline("rgb=1:0.8:0.8"); }});
+    cases.push_back({"gaussianblur", [](RenderImage *) { return parsePipeline("gaussianblur=6"); }});
+    cases.push_back({"sharpen", [](RenderImage *) { return parsePipeline("sharpen=1"); }});
+    cases.push_back({"bilateral", [](RenderImage *) { return parsePipeline("bilateral=4"); }});
+    cases.push_back({"text", [](RenderImage *) { return parsePipeline("text='gpu_filter 00:00:01.000':48"); }});
+    cases.push_back({"normalblend", [](RenderImage *overlay) {
+        GPUImageNormalBlendFilter *filter = new GPUImageNormalBlendFilter();
+        filter->setRenderImage(overlay);
+        filter->UpdateMVPMatrix(-0.8f, -0.8f, 0, 0, 0.2f, 0.2f);
+        return (GPUImageFilter *) filter;
+    }});
+    cases.push_back({"compositor", [](RenderImage *overlay) {
+        GPUImageCompositorFilter *filter = new GPUImageCompositorFilter();
+        for (int i = 0; i < 8; i++) {
+            int layer = filter->addLayer(overlay);
+            filter->setLayerTransform(layer, -0.8f + i * 0.2f, 0.7f, 0.1f, 0.1f, i * 15.0f);
+            filter->setLayerOpacity(layer, 0.8f);
+        }
+        return (GPUImageFilter *) filter;
+    }});
+    // 常见的滤镜链
+    cases.push_back({"chain:color+blur+sharpen", [](RenderImage *) {
+        return parsePipeline("rgb=1:0.9:0.9,gaussianblur=4,sharpen=0.5");
+    }});
+    cases.push_back({"chain:beauty", [](RenderImage *) {
+        return parsePipeline("[in]bilateral=4[smooth];[smooth][in]normalblend,sharpen=0.3");
+    }});
+    cases.push_back({"chain:blur+text", [](RenderImage *) {
+        return parsePipeline("gaussianblur=4,text='00:00:01.000':48");
+    }});
+    return cases;
+}
+
+static int uploadBytes(const RenderImage &image) {
+    return image.format == IMAGE_FORMAT_RGBA ? image.width * image.height * 4 : image.width * image.height * 3 / 2;
+}
+
+static double findStat(const std::vector<ProfilerStageStats> &stats, const char *name, bool gpu) {
+    for (const ProfilerStageStats &stage : stats) {
+        if (stage.name == name) {
+            return gpu ? stage.gpuP50 : stage.cpuP50;
+        }
+    }
+    return -1.0;
+}
+
+static bool runCase(const BenchCase &benchCase, const BenchSize &size, const BenchFormat &format,
+                    double minTime, int minFrames, RenderImage *overlay, RenderImagePool *pool,
+                    RenderImageDumpWriter *dumpWriter, RenderImageFileSource *source, bool usePBO,
+                    BenchResult *result) {
+    PixelBuffer *pixelBuffer = new PixelBuffer(size.width, size.height);
+    GPUImageFilter *filter = pixelBuffer->isValid() ? benchCase.create(overlay) : nullptr;
+    if (filter == nullptr) {
+        delete pixelBuffer;
+        return false;
+    }
+    GPUImageRenderer *renderer = new GPUImageRenderer(filter);
+    pixelBuffer->setRenderer(renderer);
+
+    // 同样大小和格式的用例之间复用缓冲区
+    RenderImage &input = *pool->acquire(format.format, size.width, size.height);
+    fillTestImage(&input);
+    RenderImage &output = *pool->acquire(IMAGE_FORMAT_RGBA, size.width, size.height);
+
+    // 有输入文件时循环播放它的帧，映射的页直接作为输入
+    int sourceFrame = 0;
+    RenderImage sourceView;
+    std::function<RenderImage *()> nextImage = [&]() {
+        if (source == nullptr) {
+            return &input;
+        }
+        source->getFrame(sourceFrame++ % source->getFrameCount(), &sourceView);
+        return &sourceView;
+    };
+    GPUImagePBOUploader *uploader = nullptr;
+    GLuint inputTextures[3];
+    if (usePBO) {
+        uploader = new GPUImagePBOUploader();
+        GPUImageInputFilter::genInputTextures(inputTextures);
+        uploader->prefetch(nextImage());
+    }
+
+    std::function<void()> frame = [&]() {
+        if (uploader != nullptr) {
+            int inputFormat, inputWidth, inputHeight;
+            uploader->upload(inputTextures, &inputFormat, &inputWidth, &inputHeight);
+            renderer->setRenderTextures(inputFormat, inputWidth, inputHeight, inputTextures);
+        } else {
+            renderer->setRenderImage(nextImage());
+        }
+        renderer->onDrawFrame();
+        if (uploader != nullptr) {
+            // GPU还在画这一帧时把下一帧拷进空闲的缓冲区
+            uploader->prefetch(nextImage());
+        }
+        pixelBuffer->readRenderImage(&output);
+        if (dumpWriter != nullptr) {
+            dumpWriter->write(&output);
+        }
+    };
+    // 预热: 编译着色器, 分配FBO和字形
+    for (int i = 0; i < 3; i++) {
+        frame();
+    }
+    waitForGlyphs(filter);
+    frame();
+
+    int frames = 0;
+    long allocations = g_Allocations.load();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    while (frames < minFrames || elapsed < minTime) {
+        frame();
+        frames++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    allocations = g_Allocations.load() - allocations;
+
+    // 第二轮打开profiler取各阶段的耗时，它自己的分配不计入上面的结果
+    renderer->setProfilingEnabled(true);
+    int profiledFrames = std::max(10, std::min(frames, 60));
+    for (int i = 0; i < profiledFrames; i++) {
+        frame();
+    }
+    // 让最后几帧的GPU查询结果回来
+    glFinish();
+    for (int i = 0; i < MAX_PROFILER_PENDING_FRAMES; i++) {
+        frame();
+    }
+    std::vector<ProfilerStageStats> stats = renderer->getProfilerStats();
+    double uploadMs = findStat(stats, "upload", false);
+    double readbackMs = findStat(stats, "readback", false);
+
+    result->name = benchCase.name;
+    result->size = size.name;
+    result->format = format.name;
+    result->width = size.width;
+    result->height = size.height;
+    result->frames = frames;
+    result->fps = frames / elapsed;
+    result->frameMs = elapsed * 1000.0 / frames;
+    result->allocationsPerFrame = (double) allocations / frames;
+    result->uploadMBps = uploadMs > 0.0 ? uploadBytes(input) / (uploadMs * 1000.0) : -1.0;
+    result->readbackMBps = readbackMs > 0.0 ? size.width * size.height * 4 / (readbackMs * 1000.0) : -1.0;
+    result->gpuFrameMs = findStat(stats, "frame", true);
+
+    if (uploader != nullptr) {
+        delete uploader;
+        glDeleteTextures(3, inputTextures);
+    }
+    pool->release(&input);
+    pool->release(&output);
+    // PixelBuffer deletes the renderer
+    delete pixelBuffer;
+    return true;
+}
+
+static std::string toJSON(const std::vector<BenchResult> &results, const std::string &glRenderer,
+                          const std::string &glVersion) {
+    std::ostringstream out;
+    out << "{\n  \"gl_renderer\": \"" << glRenderer << "\",\n  \"gl_version\": \"" << glVersion
+        << "\",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"name\": \"" << r.name << "\", \"size\": \"" << r.size << "\", \"format\": \"" << r.format
+            << "\", \"width\": " << r.width << ", \"height\": " << r.height << ", \"frames\": " << r.frames
+            << ", \"fps\": " << r.fps << ", \"frame_ms\": " << r.frameMs
+            << ", \"allocations_per_frame\": " << r.allocationsPerFrame
+            << ", \"upload_mb_per_s\": " << r.uploadMBps << ", \"readback_mb_per_s\": " << r.readbackMBps
+            << ", \"gpu_frame_ms\": " << r.gpuFrameMs << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+static bool inList(const std::string &list, const char *name) {
+    if (list.empty()) {
+        return true;
+    }
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void usage(const char *program) {
+    std::cout << "usage: " << program << " [--filter name] [--sizes 480p,720p,1080p,4k] [--formats rgba,nv12,i420]"
+              << " [--min-time seconds] [--min-frames n] [--json file] [--dump path] [--input file]"
+              << " [--upload direct|pbo]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string filterName, sizes, formats, jsonPath, dumpPath, inputPath, upload = "direct";
+    double minTime = 1.0;
+    int minFrames = 10;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (arg == "--filter") {
+            filterName = argv[++i];
+        } else if (arg == "--sizes") {
+            sizes = argv[++i];
+        } else if (arg == "--formats") {
+            formats = argv[++i];
+        } else if (arg == "--min-time") {
+            minTime = atof(argv[++i]);
+        } else if (arg == "--min-frames") {
+            minFrames = atoi(argv[++i]);
+        } else if (arg == "--json") {
+            jsonPath = argv[++i];
+        } else if (arg == "--dump") {
+            dumpPath = argv[++i];
+        } else if (arg == "--input") {
+            inputPath = argv[++i];
+        } else if (arg == "--upload") {
+            upload = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // 水印用的小图
+    RenderImage overlay;
+    overlay.format = IMAGE_FORMAT_RGBA;
+    overlay.width = 256;
+    overlay.height = 256;
+    RenderImageUtil::allocRenderImage(&overlay);
+    fillTestImage(&overlay);
+
+    std::vector<BenchCase> cases = createCases();
+    std::vector<BenchResult> results;
+    RenderImagePool pool;
+    RenderImageDumpWriter *dumpWriter = nullptr;
+    if (!dumpPath.empty()) {
+        DumpWriterOptions dumpOptions;
+        dumpOptions.container = RenderImageDumpWriter::getContainerForPath(dumpPath);
+        dumpWriter = new RenderImageDumpWriter(dumpPath, dumpOptions);
+        if (!dumpWriter->isValid()) {
+            delete dumpWriter;
+            return EXIT_FAILURE;
+        }
+    }
+    std::vector<BenchSize> sizeList(SIZES, SIZES + sizeof(SIZES) / sizeof(SIZES[0]));
+    std::vector<BenchFormat> formatList(FORMATS, FORMATS + sizeof(FORMATS) / sizeof(FORMATS[0]));
+    RenderImageFileSource *y4mSource = nullptr;
+    if (RenderImageDumpWriter::getContainerForPath(inputPath) == DUMP_CONTAINER_Y4M) {
+        y4mSource = new RenderImageFileSource(inputPath);
+        if (!y4mSource->isValid()) {
+            return EXIT_FAILURE;
+        }
+        // Y4M自带尺寸和格式，--sizes和--formats不再起作用
+        sizeList.assign(1, BenchSize{"file", y4mSource->getWidth(), y4mSource->getHeight()});
+        formatList.assign(1, BenchFormat{"i420", IMAGE_FORMAT_I420});
+        sizes.clear();
+        formats.clear();
+    }
+    std::string glRenderer, glVersion;
+    printf("%-28s %-6s %-5s %9s %9s %9s %11s %11s %9s\n", "case", "size", "fmt", "fps", "frame ms", "allocs/f",
+           "upload MB/s", "readbk MB/s", "gpu ms");
+    for (const BenchCase &benchCase : cases) {
+        if (!filterName.empty() && benchCase.name.find(filterName) == std::string::npos) {
+            continue;
+        }
+        for (const BenchSize &size : sizeList) {
+            if (!inList(sizes, size.name)) {
+                continue;
+            }
+            for (const BenchFormat &format : formatList) {
+                if (!inList(formats, format.name)) {
+                    continue;
+                }
+                RenderImageFileSource *source = y4mSource;
+                if (source == nullptr && !inputPath.empty()) {
+                    source = new RenderImageFileSource(inputPath, format.format, size.width, size.height);
+                    if (!source->isValid()) {
+                        return EXIT_FAILURE;
+                    }
+                }
+                BenchResult result;
+                bool ran = runCase(benchCase, size, format, minTime, minFrames, &overlay, &pool, dumpWriter, source,
+                                   upload == "pbo", &result);
+                if (source != y4mSource) {
+                    delete source;
+                }
+                if (!ran) {
+                    std::cout << "gpu_filter_bench: failed to create " << benchCase.name << std::endl;
+                    return EXIT_FAILURE;
+                }
+                if (glRenderer.empty()) {
+                    // 上下文在runCase里已经销毁，这里用一个临时的取驱动信息
+                    PixelBuffer pixelBuffer(16, 16);
+                    const char *renderer = (const char *) glGetString(GL_RENDERER);
+                    const char *version = (const char *) glGetString(GL_VERSION);
+                    glRenderer = renderer != nullptr ? renderer : "unknown";
+                    glVersion = version != nullptr ? version : "unknown";
+                }
+                printf("%-28s %-6s %-5s %9.1f %9.2f %9.1f %11.0f %11.0f %9.2f\n", result.name.c_str(),
+                       result.size.c_str(), result.format.c_str(), result.fps, result.frameMs,
+                       result.allocationsPerFrame, result.uploadMBps, result.readbackMBps, result.gpuFrameMs);
+                fflush(stdout);
+                results.push_back(result);
+            }
+        }
+    }
+    free(overlay.planes[0]);
+    delete y4mSource;
+    if (dumpWriter != nullptr) {
+        dumpWriter->close();
+        DumpWriterStats dumpStats = dumpWriter->getStats();
+        printf("dump: %llu frames written, %llu dropped, %.1f MB\n", (unsigned long long) dumpStats.written,
+               (unsigned long long) dumpStats.dropped, dumpStats.bytesWritten / 1048576.0);
+        delete dumpWriter;
+    }
+
+    if (!jsonPath.empty()) {
+        std::ofstream file(jsonPath.c_str(), std::ios::out | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cout << "gpu_filter_bench: failed to open " << jsonPath << std::endl;
+            return EXIT_FAILURE;
+        }
+        file << toJSON(results, glRenderer, glVersion);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,365 @@
+//
+// Created by liyang on 26-10-18.
+//
+// CPU format conversion microbenchmark. Times RenderImageConverter for every pair of formats and
+// the packed RGB/BGR inputs, once per SIMD level this CPU supports and per thread count. The
+// output of every level is compared with the scalar one and RGBA to YUV with a floating point
+// reference, so it doubles as a quick check of the kernels on a new machine. The copy cases time RenderImageUtil::copyRenderImage into a tight and
+// a padded destination, with cached and streaming stores.
+//
+//     gpu_filter_convert_bench [--filter name] [--sizes 720p,1080p,4k] [--threads 1,0]
+//                              [--min-time seconds]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "RenderImageConverter.h"
+#include "RenderImageHandle.h"
+#include "WorkerPool.h"
+#include "BenchUtil.h"
+
+struct BenchSize {
+    const char *name;
+    int width;
+    int height;
+};
+
+struct BenchFormat {
+    const char *name;
+    int format;
+};
+
+struct BenchPacked {
+    const char *name;
+    PackedPixelLayout layout;
+    int bytesPerPixel;
+};
+
+static const BenchSize SIZES[] = {
+        {"720p",  1280, 720},
+        {"1080p", 1920, 1080},
+        {"4k",    3840, 2160},
+};
+
+static const BenchFormat FORMATS[] = {
+        {"rgba", IMAGE_FORMAT_RGBA},
+        {"nv12", IMAGE_FORMAT_NV12},
+        {"nv21", IMAGE_FORMAT_NV21},
+        {"i420", IMAGE_FORMAT_I420},
+};
+
+static const BenchPacked PACKED[] = {
+        {"rgb24", PACKED_RGB24, 3},
+        {"bgr24", PACKED_BGR24, 3},
+        {"bgra",  PACKED_BGRA,  4},
+        {"bgrx",  PACKED_BGRX,  4},
+};
+
+static bool inList(const std::string &list, const std::string &name) {
+    if (list.empty()) {
+        return true;
+    }
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::vector<ConvertSimdLevel> supportedLevels() {
+    std::vector<ConvertSimdLevel> levels;
+    levels.push_back(CONVERT_SIMD_SCALAR);
+    ConvertSimdLevel best = RenderImageConverter::getSupportedSimdLevel();
+    if (best == CONVERT_SIMD_AVX2) {
+        levels.push_back(CONVERT_SIMD_SSSE3);
+    }
+    if (best != CONVERT_SIMD_SCALAR) {
+        levels.push_back(best);
+    }
+    return levels;
+}
+
+static bool samePixels(const RenderImageHandle &a, const RenderImageHandle &b) {
+    for (int i = 0; i < RenderImageHandle::getPlaneCount(a.getFormat()); i++) {
+        RenderImagePlane pa = a.plane(i);
+        RenderImagePlane pb = b.plane(i);
+        for (int row = 0; row < pa.height; row++) {
+            if (memcmp(pa.data + row * pa.linesize, pb.data + row * pb.linesize, pa.width * pa.bytesPerPixel) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int referenceByte(double value) {
+    return std::min(255, std::max(0, (int) std::lround(value)));
+}
+
+// RGBA to I420 of a sampled RGB cube, each color filling a 2x2 block so the chroma average is exact,
+// against the floating point BT.601/BT.709 formulas. Returns the number of failed checks.
+static int checkAgainstReference(const std::vector<ConvertSimdLevel> &levels) {
+    const int step = 5;
+    const int blocksPerRow = 256;
+    int colors = (255 / step + 1) * (255 / step + 1) * (255 / step + 1);
+    int width = blocksPerRow * 2;
+    int height = (colors + blocksPerRow - 1) / blocksPerRow * 2;
+    RenderImageHandle rgba = RenderImageHandle::allocate(IMAGE_FORMAT_RGBA, width, height);
+    RenderImageHandle yuv = RenderImageHandle::allocate(IMAGE_FORMAT_I420, width, height);
+    RenderImagePlane pixels = rgba.plane(0);
+    std::vector<int> rgb;
+    for (int r = 0; r <= 255; r += step) {
+        for (int g = 0; g <= 255; g += step) {
+            for (int b = 0; b <= 255; b += step) {
+                rgb.push_back(r);
+                rgb.push_back(g);
+                rgb.push_back(b);
+            }
+        }
+    }
+    // 多出来的块填白色
+    rgb.resize((size_t) (width / 2) * (height / 2) * 3, 255);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const int *color = &rgb[((y / 2) * blocksPerRow + x / 2) * 3];
+            uint8_t *p = pixels.data + y * pixels.linesize + x * 4;
+            p[0] = (uint8_t) color[0];
+            p[1] = (uint8_t) color[1];
+            p[2] = (uint8_t) color[2];
+            p[3] = 255;
+        }
+    }
+
+    int failures = 0;
+    for (ConvertSimdLevel level : levels) {
+        RenderImageConverter::setSimdLevel(level);
+        for (int matrix = COLOR_MATRIX_BT601; matrix <= COLOR_MATRIX_BT709; matrix++) {
+            for (int fullRange = 0; fullRange <= 1; fullRange++) {
+                ConvertOptions options;
+                options.matrix = (ColorMatrix) matrix;
+                options.fullRange = fullRange;
+                options.threads = 1;
+                RenderImageConverter::convert(rgba.get(), yuv.get(), options);
+                double kr = matrix == COLOR_MATRIX_BT601 ? 0.299 : 0.2126;
+                double kb = matrix == COLOR_MATRIX_BT601 ? 0.114 : 0.0722;
+                double yScale = fullRange ? 1.0 : 219.0 / 255.0;
+                double cScale = fullRange ? 1.0 : 224.0 / 255.0;
+                double yOffset = fullRange ? 0.0 : 16.0;
+                RenderImagePlane yPlane = yuv.plane(0);
+                RenderImagePlane uPlane = yuv.plane(1);
+                RenderImagePlane vPlane = yuv.plane(2);
+                int maxError = 0;
+                for (int block = 0; block < (width / 2) * (height / 2); block++) {
+                    int bx = block % blocksPerRow;
+                    int by = block / blocksPerRow;
+                    const int *color = &rgb[block * 3];
+                    double luma = kr * color[0] + (1.0 - kr - kb) * color[1] + kb * color[2];
+                    int expectedY = referenceByte(yOffset + luma * yScale);
+                    int expectedU = referenceByte(128.0 + (color[2] - luma) / (2.0 * (1.0 - kb)) * cScale);
+                    int expectedV = referenceByte(128.0 + (color[0] - luma) / (2.0 * (1.0 - kr)) * cScale);
+                    for (int i = 0; i < 4; i++) {
+                        int actualY = yPlane.data[(by * 2 + i / 2) * yPlane.linesize + bx * 2 + i % 2];
+                        maxError = std::max(maxError, std::abs(actualY - expectedY));
+                    }
+                    maxError = std::max(maxError, std::abs(uPlane.data[by * uPlane.linesize + bx] - expectedU));
+                    maxError = std::max(maxError, std::abs(vPlane.data[by * vPlane.linesize + bx] - expectedV));
+                }
+                // 最后一个块是白色，第一个是黑色
+                int white = yPlane.data[(height - 1) * yPlane.linesize + width - 1];
+                int black = yPlane.data[0];
+                bool ok = maxError <= 1 && white == (fullRange ? 255 : 235) && black == (fullRange ? 0 : 16);
+                if (!ok) {
+                    failures++;
+                }
+                printf("reference %-5s %-7s %-7s max error %d, white %d, black %d%s\n",
+                       matrix == COLOR_MATRIX_BT601 ? "bt601" : "bt709", fullRange ? "full" : "limited",
+                       RenderImageConverter::getSimdLevelName(level), maxError, white, black, ok ? "" : " FAILED");
+            }
+        }
+    }
+    return failures;
+}
+
+// 重复转换直到超过minTime，返回每帧毫秒数
+static double timeConversion(const std::function<void()> &convert, double minTime) {
+    convert();
+    int frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    while (elapsed < minTime || frames < 3) {
+        convert();
+        frames++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return elapsed * 1000.0 / frames;
+}
+
+static void usage(const char *program) {
+    std::cout << "usage: " << program << " [--filter name] [--sizes 720p,1080p,4k] [--threads 1,0]"
+              << " [--min-time seconds]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string filterName, sizes = "1080p,4k", threads = "1,0";
+    double minTime = 0.5;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (arg == "--filter") {
+            filterName = argv[++i];
+        } else if (arg == "--sizes") {
+            sizes = argv[++i];
+        } else if (arg == "--threads") {
+            threads = argv[++i];
+        } else if (arg == "--min-time") {
+            minTime = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<ConvertSimdLevel> levels = supportedLevels();
+    std::vector<int> threadCounts;
+    std::stringstream stream(threads);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        threadCounts.push_back(atoi(item.c_str()));
+    }
+    printf("worker threads: %d\n", WorkerPool::getInstance().getThreadCount());
+    int mismatches = checkAgainstReference(levels);
+    printf("%-14s %-6s %-7s %7s %9s %9s %8s\n", "case", "size", "simd", "threads", "frame ms", "MPix/s",
+           "speedup");
+
+    for (const BenchSize &size : SIZES) {
+        if (!inList(sizes, size.name)) {
+            continue;
+        }
+        // 每种输入一个用例: 格式对，或者打包的RGB/BGR
+        std::vector<std::string> names;
+        std::vector<std::function<bool(RenderImage *dst, const ConvertOptions &options)>> converts;
+        std::vector<int> dstFormats;
+        std::vector<RenderImageHandle> sources;
+        std::vector<std::vector<uint8_t>> packedSources;
+        for (const BenchFormat &from : FORMATS) {
+            RenderImageHandle rgba = RenderImageHandle::allocate(IMAGE_FORMAT_RGBA, size.width, size.height);
+            fillTestImage(rgba.get());
+            RenderImageHandle source = RenderImageHandle::allocate(from.format, size.width, size.height);
+            RenderImageConverter::convert(rgba.get(), source.get());
+            sources.push_back(std::move(source));
+        }
+        for (int i = 0; i < (int) (sizeof(FORMATS) / sizeof(FORMATS[0])); i++) {
+            for (const BenchFormat &to : FORMATS) {
+                if (FORMATS[i].format == to.format) {
+                    continue;
+                }
+                const RenderImage *source = sources[i].get();
+                names.push_back(std::string(FORMATS[i].name) + ">" + to.name);
+                converts.push_back([source](RenderImage *dst, const ConvertOptions &options) {
+                    return RenderImageConverter::convert(source, dst, options);
+                });
+                dstFormats.push_back(to.format);
+            }
+        }
+        for (const BenchPacked &packed : PACKED) {
+            std::vector<uint8_t> pixels((size_t) size.width * size.height * packed.bytesPerPixel);
+            for (size_t i = 0; i < pixels.size(); i++) {
+                pixels[i] = (uint8_t) (i * 7 + i / 4093);
+            }
+            packedSources.push_back(std::move(pixels));
+        }
+        for (int i = 0; i < (int) (sizeof(PACKED) / sizeof(PACKED[0])); i++) {
+            const uint8_t *pixels = packedSources[i].data();
+            BenchPacked packed = PACKED[i];
+            int linesize = size.width * packed.bytesPerPixel;
+            names.push_back(std::string(packed.name) + ">rgba");
+            converts.push_back([pixels, packed, linesize](RenderImage *dst, const ConvertOptions &options) {
+                return RenderImageConverter::convertPacked(pixels, linesize, packed.layout, dst, options);
+            });
+            dstFormats.push_back(IMAGE_FORMAT_RGBA);
+        }
+
+        for (size_t c = 0; c < names.size(); c++) {
+            if (!filterName.empty() && names[c].find(filterName) == std::string::npos) {
+                continue;
+            }
+            RenderImageHandle reference = RenderImageHandle::allocate(dstFormats[c], size.width, size.height);
+            RenderImageHandle output = RenderImageHandle::allocate(dstFormats[c], size.width, size.height);
+            double scalarMs = 0.0;
+            for (ConvertSimdLevel level : levels) {
+                RenderImageConverter::setSimdLevel(level);
+                for (int threadCount : threadCounts) {
+                    ConvertOptions options;
+                    options.threads = threadCount;
+                    RenderImage *dst = level == CONVERT_SIMD_SCALAR && scalarMs == 0.0 ? reference.get()
+                                                                                      : output.get();
+                    double frameMs = timeConversion([&]() { converts[c](dst, options); }, minTime);
+                    if (scalarMs == 0.0) {
+                        scalarMs = frameMs;
+                    } else if (!samePixels(reference, output)) {
+                        printf("%s: %s output differs from scalar\n", names[c].c_str(),
+                               RenderImageConverter::getSimdLevelName(level));
+                        mismatches++;
+                    }
+                    printf("%-14s %-6s %-7s %7d %9.3f %9.1f %7.2fx\n", names[c].c_str(), size.name,
+                           RenderImageConverter::getSimdLevelName(level), threadCount, frameMs,
+                           size.width * (double) size.height / frameMs / 1000.0, scalarMs / frameMs);
+                }
+            }
+        }
+
+        // 同格式拷贝: 紧凑或带行距的目标, 普通写或流式写
+        for (int i = 0; i < (int) (sizeof(FORMATS) / sizeof(FORMATS[0])); i++) {
+            std::string name = std::string("copy:") + FORMATS[i].name;
+            if (!filterName.empty() && name.find(filterName) == std::string::npos) {
+                continue;
+            }
+            RenderImage *source = sources[i].get();
+            RenderImageHandle tight = RenderImageHandle::allocate(FORMATS[i].format, size.width, size.height);
+            RenderImageHandle padded = RenderImageHandle::allocate(FORMATS[i].format, size.width + 64, size.height)
+                    .crop(0, 0, size.width, size.height);
+            double baseMs = 0.0;
+            for (RenderImageHandle *dst : {&tight, &padded}) {
+                for (int nonTemporal = 0; nonTemporal <= 1; nonTemporal++) {
+                    for (int threadCount : threadCounts) {
+                        CopyOptions options;
+                        options.threads = threadCount;
+                        options.nonTemporal = nonTemporal;
+                        double frameMs = timeConversion([&]() {
+                            RenderImageUtil::copyRenderImage(source, dst->get(), options);
+                        }, minTime);
+                        if (baseMs == 0.0) {
+                            baseMs = frameMs;
+                        }
+                        if (!samePixels(sources[i], *dst)) {
+                            printf("%s: copy differs from source\n", name.c_str());
+                            mismatches++;
+                        }
+                        printf("%-14s %-6s %-7s %7d %9.3f %9.1f %7.2fx\n",
+                               (name + (dst == &padded ? "+pad" : "")).c_str(), size.name,
+                               nonTemporal ? "stream" : "memcpy", threadCount, frameMs,
+                               size.width * (double) size.height / frameMs / 1000.0, baseMs / frameMs);
+                    }
+                }
+            }
+        }
+    }
+    RenderImageConverter::setSimdLevel(RenderImageConverter::getSupportedSimdLevel());
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,407 @@
+//
+// Created by liyang on 26-10-18.
+//
+// Golden image check for the reference pipelines. Each case is rendered headless through a
+// PixelBuffer and compared against bench/golden/<case>.ppm with its own PSNR and SSIM limits, and
+// its median frame time is compared with the time recorded when the goldens were made, so an
+// optimization can be judged on both quality and speed. Exits non-zero when a case is below its
+// limits.
+//
+//     gpu_filter_golden [--update] [--golden-dir dir] [--filter name] [--diff-dir dir]
+//
+// --update rewrites the goldens and timings from the current tree. Record them on the machine
+// that runs the comparison (the checked in ones come from Mesa llvmpipe), timings from another
+// machine only give a rough idea.
+//
+
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "PixelBuffer.h"
+#include "GPUImageRenderer.h"
+#include "GPUImagePipelineParser.h"
+#include "GPUImageNormalBlendFilter.h"
+#include "GPUImageCompositorFilter.h"
+#include "BenchUtil.h"
+
+#define GOLDEN_WIDTH 256
+#define GOLDEN_HEIGHT 144
+#define GOLDEN_TIMED_FRAMES 21
+#define GOLDEN_MAX_WARMUP_FRAMES 200
+// Output must stay unchanged this long before it is captured
+#define GOLDEN_STABLE_MS 100
+// CMake passes the source tree's goldens so the test runs from any build directory
+#ifndef DEFAULT_GOLDEN_DIR
+#define DEFAULT_GOLDEN_DIR "../bench/golden"
+#endif
+#define GOLDEN_TIMINGS_FILE "timings.txt"
+
+struct GoldenCase {
+    std::string name;
+    int inputFormat;
+    double minPsnr;
+    double minSsim;
+    std::function<GPUImageFilter *(RenderImage *overlay)> create;
+};
+
+struct GoldenImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgb;
+};
+
+static std::vector<GoldenCase> createCases() {
+    std::vector<GoldenCase> cases;
+    cases.push_back({"null", IMAGE_FORMAT_RGBA, 50.0, 0.999, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse("null");
+    }});
+    cases.push_back({"null_nv12", IMAGE_FORMAT_NV12, 45.0, 0.995, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse("null");
+    }});
+    cases.push_back({"rgb_i420", IMAGE_FORMAT_I420, 45.0, 0.995, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse("rgb=1:0.8:0.6");
+    }});
+    cases.push_back({"gaussianblur", IMAGE_FORMAT_RGBA, 40.0, 0.99, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse("gaussianblur=4");
+    }});
+    cases.push_back({"sharpen", IMAGE_FORMAT_RGBA, 40.0, 0.99, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse("sharpen=1");
+    }});
+    cases.push_back({"bilateral", IMAGE_FORMAT_RGBA, 40.0, 0.99, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse("bilateral=4");
+    }});
+    // 字形光栅化随FreeType版本略有不同，限值放宽
+    cases.push_back({"text", IMAGE_FORMAT_RGBA, 30.0, 0.95, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse("text='Golden 0123':32");
+    }});
+    cases.push_back({"text_sdf", IMAGE_FORMAT_RGBA, 30.0, 0.95, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse("text='Golden 0123':40:sdf");
+    }});
+    cases.push_back({"normalblend", IMAGE_FORMAT_RGBA, 40.0, 0.99, [](RenderImage *overlay) {
+        GPUImageNormalBlendFilter *filter = new GPUImageNormalBlendFilter();
+        filter->setRenderImage(overlay);
+        filter->UpdateMVPMatrix(-0.5f, -0.5f, 0, 0, 0.4f, 0.4f);
+        return (GPUImageFilter *) filter;
+    }});
+    cases.push_back({"compositor", IMAGE_FORMAT_RGBA, 40.0, 0.99, [](RenderImage *overlay) {
+        GPUImageCompositorFilter *filter = new GPUImageCompositorFilter();
+        for (int i = 0; i < 4; i++) {
+            int layer = filter->addLayer(overlay);
+            filter->setLayerTransform(layer, -0.6f + i * 0.4f, 0.0f, 0.2f, 0.2f, i * 30.0f);
+            filter->setLayerOpacity(layer, 0.25f * (i + 1));
+            filter->setLayerBlendMode(layer, (CompositorBlendMode) (i % 4));
+        }
+        return (GPUImageFilter *) filter;
+    }});
+    cases.push_back({"chain_color_blur_sharpen", IMAGE_FORMAT_RGBA, 40.0, 0.99, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse("rgb=1:0.9:0.9,gaussianblur=4,sharpen=0.5");
+    }});
+    cases.push_back({"chain_beauty", IMAGE_FORMAT_RGBA, 40.0, 0.99, [](RenderImage *) {
+        return (GPUImageFilter *) GPUImagePipelineParser::parse(
+                "[in]bilateral=4[smooth];[smooth][in]normalblend,sharpen=0.3");
+    }});
+    // 多pass的组渲染进各种格式的中间纹理，再由下一个滤镜读
+    const char *formats[] = {"rgba8", "r8", "rg8", "rgba16f", "rgb565"};
+    for (const char *format : formats) {
+        std::string pipeline = std::string("gaussianblur=4:format=") + format + ",sharpen=0.5";
+        cases.push_back({std::string("format_") + format, IMAGE_FORMAT_RGBA, 40.0, 0.99, [pipeline](RenderImage *) {
+            return (GPUImageFilter *) GPUImagePipelineParser::parse(pipeline);
+        }});
+    }
+    // 不能用的格式退回rgba8，结果和format_rgba8一样
+    cases.push_back({"format_fallback", IMAGE_FORMAT_RGBA, 40.0, 0.99, [](RenderImage *) {
+        GPUImageFilterGraph *graph = GPUImagePipelineParser::parse("gaussianblur=4,sharpen=0.5");
+        if (graph != nullptr) {
+            graph->getNodeFilter(0)->setOutputTextureFormat(TEXTURE_FORMAT_COUNT);
+        }
+        return (GPUImageFilter *) graph;
+    }});
+    return cases;
+}
+
+static bool readPPM(const std::string &path, GoldenImage *image) {
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string magic;
+    int maxValue = 0;
+    file >> magic >> image->width >> image->height >> maxValue;
+    file.get();
+    if (magic != "P6" || maxValue != 255 || image->width <= 0 || image->height <= 0) {
+        return false;
+    }
+    image->rgb.resize(image->width * image->height * 3);
+    file.read((char *) image->rgb.data(), image->rgb.size());
+    return file.good();
+}
+
+static bool writePPM(const std::string &path, const GoldenImage &image) {
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cout << "gpu_filter_golden: failed to open " << path << std::endl;
+        return false;
+    }
+    file << "P6\n" << image.width << " " << image.height << "\n255\n";
+    file.write((const char *) image.rgb.data(), image.rgb.size());
+    return file.good();
+}
+
+static double computePsnr(const GoldenImage &a, const GoldenImage &b) {
+    double sum = 0.0;
+    for (size_t i = 0; i < a.rgb.size(); i++) {
+        double d = (double) a.rgb[i] - b.rgb[i];
+        sum += d * d;
+    }
+    if (sum == 0.0) {
+        return INFINITY;
+    }
+    double mse = sum / a.rgb.size();
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+// Mean SSIM of the luma over 8x8 windows with a stride of 4
+static double computeSsim(const GoldenImage &a, const GoldenImage &b) {
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    int width = a.width;
+    int height = a.height;
+    std::vector<double> lumaA(width * height), lumaB(width * height);
+    for (int i = 0; i < width * height; i++) {
+        lumaA[i] = 0.299 * a.rgb[i * 3] + 0.587 * a.rgb[i * 3 + 1] + 0.114 * a.rgb[i * 3 + 2];
+        lumaB[i] = 0.299 * b.rgb[i * 3] + 0.587 * b.rgb[i * 3 + 1] + 0.114 * b.rgb[i * 3 + 2];
+    }
+    double total = 0.0;
+    int windows = 0;
+    for (int y = 0; y + 8 <= height; y += 4) {
+        for (int x = 0; x + 8 <= width; x += 4) {
+            double sumA = 0.0, sumB = 0.0, sumAA = 0.0, sumBB = 0.0, sumAB = 0.0;
+            for (int j = 0; j < 8; j++) {
+                for (int i = 0; i < 8; i++) {
+                    double va = lumaA[(y + j) * width + x + i];
+                    double vb = lumaB[(y + j) * width + x + i];
+                    sumA += va;
+                    sumB += vb;
+                    sumAA += va * va;
+                    sumBB += vb * vb;
+                    sumAB += va * vb;
+                }
+            }
+            double meanA = sumA / 64.0, meanB = sumB / 64.0;
+            double varA = sumAA / 64.0 - meanA * meanA;
+            double varB = sumBB / 64.0 - meanB * meanB;
+            double covariance = sumAB / 64.0 - meanA * meanB;
+            total += ((2 * meanA * meanB + c1) * (2 * covariance + c2)) /
+                     ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+            windows++;
+        }
+    }
+    return windows > 0 ? total / windows : 1.0;
+}
+
+static bool renderCase(const GoldenCase &goldenCase, RenderImage *overlay, GoldenImage *result, double *frameMs) {
+    PixelBuffer *pixelBuffer = new PixelBuffer(GOLDEN_WIDTH, GOLDEN_HEIGHT);
+    GPUImageFilter *filter = goldenCase.create(overlay);
+    if (filter == nullptr) {
+        delete pixelBuffer;
+        return false;
+    }
+    GPUImageRenderer *renderer = new GPUImageRenderer(filter);
+    pixelBuffer->setRenderer(renderer);
+
+    RenderImage input;
+    input.format = goldenCase.inputFormat;
+    input.width = GOLDEN_WIDTH;
+    input.height = GOLDEN_HEIGHT;
+    RenderImageUtil::allocRenderImage(&input);
+    fillTestImage(&input);
+    RenderImage output;
+    output.format = IMAGE_FORMAT_RGBA;
+    output.width = GOLDEN_WIDTH;
+    output.height = GOLDEN_HEIGHT;
+    RenderImageUtil::allocRenderImage(&output);
+
+    // 字形在后台线程光栅化，叠加层在第一帧之后才上传，画到输出一段时间不再变化为止
+    std::vector<uint8_t> previous;
+    std::chrono::steady_clock::time_point stableSince = std::chrono::steady_clock::now();
+    for (int i = 0; i < GOLDEN_MAX_WARMUP_FRAMES; i++) {
+        renderer->setRenderImage(&input);
+        renderer->onDrawFrame();
+        pixelBuffer->readRenderImage(&output);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (previous.empty() || memcmp(previous.data(), output.planes[0], previous.size()) != 0) {
+            previous.assign(output.planes[0], output.planes[0] + GOLDEN_WIDTH * GOLDEN_HEIGHT * 4);
+            stableSince = now;
+        } else if (now - stableSince >= std::chrono::milliseconds(GOLDEN_STABLE_MS)) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::vector<double> times;
+    for (int i = 0; i < GOLDEN_TIMED_FRAMES; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        renderer->setRenderImage(&input);
+        renderer->onDrawFrame();
+        pixelBuffer->readRenderImage(&output);
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    *frameMs = times[times.size() / 2];
+
+    result->width = GOLDEN_WIDTH;
+    result->height = GOLDEN_HEIGHT;
+    result->rgb.resize(GOLDEN_WIDTH * GOLDEN_HEIGHT * 3);
+    for (int i = 0; i < GOLDEN_WIDTH * GOLDEN_HEIGHT; i++) {
+        result->rgb[i * 3] = output.planes[0][i * 4];
+        result->rgb[i * 3 + 1] = output.planes[0][i * 4 + 1];
+        result->rgb[i * 3 + 2] = output.planes[0][i * 4 + 2];
+    }
+    free(input.planes[0]);
+    free(output.planes[0]);
+    delete pixelBuffer;
+    return true;
+}
+
+static std::map<std::string, double> readTimings(const std::string &path) {
+    std::map<std::string, double> timings;
+    std::ifstream file(path.c_str());
+    std::string name;
+    double ms;
+    while (file >> name >> ms) {
+        timings[name] = ms;
+    }
+    return timings;
+}
+
+static bool writeTimings(const std::string &path, const std::map<std::string, double> &timings) {
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cout << "gpu_filter_golden: failed to open " << path << std::endl;
+        return false;
+    }
+    for (const std::pair<const std::string, double> &timing : timings) {
+        file << timing.first << " " << timing.second << "\n";
+    }
+    return file.good();
+}
+
+static void usage(const char *program) {
+    std::cout << "usage: " << program << " [--update] [--golden-dir dir] [--filter name] [--diff-dir dir]"
+              << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    bool update = false;
+    std::string goldenDir = DEFAULT_GOLDEN_DIR, filterName, diffDir;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--update") {
+            update = true;
+        } else if (arg == "--golden-dir" && i + 1 < argc) {
+            goldenDir = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filterName = argv[++i];
+        } else if (arg == "--diff-dir" && i + 1 < argc) {
+            diffDir = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    RenderImage overlay;
+    overlay.format = IMAGE_FORMAT_RGBA;
+    overlay.width = 64;
+    overlay.height = 64;
+    RenderImageUtil::allocRenderImage(&overlay);
+    fillTestImage(&overlay);
+    // 半透明的圆，检查混合和边缘
+    for (int y = 0; y < overlay.height; y++) {
+        for (int x = 0; x < overlay.width; x++) {
+            float dx = x - 31.5f, dy = y - 31.5f;
+            overlay.planes[0][(y * overlay.width + x) * 4 + 3] = dx * dx + dy * dy < 30.0f * 30.0f ? 200 : 0;
+        }
+    }
+
+    std::string timingsPath = goldenDir + "/" + GOLDEN_TIMINGS_FILE;
+    std::map<std::string, double> timings = readTimings(timingsPath);
+    int failures = 0;
+    printf("%-26s %8s %8s %8s %8s %9s %9s %8s  %s\n", "case", "psnr", "min", "ssim", "min", "ms", "ref ms",
+           "speed", "result");
+    for (const GoldenCase &goldenCase : createCases()) {
+        if (!filterName.empty() && goldenCase.name.find(filterName) == std::string::npos) {
+            continue;
+        }
+        GoldenImage actual;
+        double frameMs = 0.0;
+        if (!renderCase(goldenCase, &overlay, &actual, &frameMs)) {
+            std::cout << "gpu_filter_golden: failed to create " << goldenCase.name << std::endl;
+            failures++;
+            continue;
+        }
+        std::string goldenPath = goldenDir + "/" + goldenCase.name + ".ppm";
+        if (update) {
+            if (!writePPM(goldenPath, actual)) {
+                failures++;
+            }
+            timings[goldenCase.name] = frameMs;
+            printf("%-26s %8s %8s %8s %8s %9.2f %9s %8s  updated\n", goldenCase.name.c_str(), "-", "-", "-", "-",
+                   frameMs, "-", "-");
+            continue;
+        }
+
+        GoldenImage golden;
+        if (!readPPM(goldenPath, &golden) || golden.width != actual.width || golden.height != actual.height) {
+            printf("%-26s missing or invalid golden %s, run with --update\n", goldenCase.name.c_str(),
+                   goldenPath.c_str());
+            failures++;
+            continue;
+        }
+        double psnr = computePsnr(actual, golden);
+        double ssim = computeSsim(actual, golden);
+        bool passed = psnr >= goldenCase.minPsnr && ssim >= goldenCase.minSsim;
+        std::map<std::string, double>::iterator reference = timings.find(goldenCase.name);
+        char referenceText[32] = "-", speedText[32] = "-";
+        if (reference != timings.end() && reference->second > 0.0) {
+            snprintf(referenceText, sizeof(referenceText), "%.2f", reference->second);
+            // 正数表示比记录时快
+            snprintf(speedText, sizeof(speedText), "%+.1f%%", (reference->second / frameMs - 1.0) * 100.0);
+        }
+        printf("%-26s %8.2f %8.2f %8.4f %8.4f %9.2f %9s %8s  %s\n", goldenCase.name.c_str(), psnr,
+               goldenCase.minPsnr, ssim, goldenCase.minSsim, frameMs, referenceText, speedText,
+               passed ? "ok" : "FAIL");
+        if (!passed) {
+            failures++;
+            if (!diffDir.empty()) {
+                GoldenImage diff = actual;
+                for (size_t i = 0; i < diff.rgb.size(); i++) {
+                    diff.rgb[i] = std::min(255, std::abs((int) actual.rgb[i] - golden.rgb[i]) * 8);
+                }
+                writePPM(diffDir + "/" + goldenCase.name + ".actual.ppm", actual);
+                writePPM(diffDir + "/" + goldenCase.name + ".diff.ppm", diff);
+            }
+        }
+    }
+    free(overlay.planes[0]);
+
+    if (update) {
+        return writeTimings(timingsPath, timings) && failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (failures > 0) {
+        std::cout << failures << " case(s) failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -59,6 +59,8 @@
 #include <SDL_thread.h>
 
 #include "cmdutils.h"
+#include "GPUImagePlayerHook.h"
+#include <SDL_opengles2.h>
 
 #include <assert.h>
 // 程序名称
@@ -527,6 +529,12 @@ static char *afilters = NULL;
 static int autorotate = 1;
 static int find_stream_info = 1;
 
+// GPUImage效果器描述, 参数: -gpufilter, 例子: ffplay -gpufilter "rgb=red=1.2,gaussianblur=2" ....
+static const char *gpu_filter_desc = NULL;
+// 统计每个GPU效果器pass的耗时, 参数: -gpufilter_profile
+static int gpu_filter_profile = 0;
+static GPUImagePlayerHook *gpu_hook = NULL;
+
 // 效果器线程数
 static int filter_nbthreads = 0;
 
@@ -1058,6 +1066,18 @@ static inline void fill_rectangle(int x, int y, int w, int h)
         SDL_RenderFillRect(renderer, &rect);
 }
 
+// GPU效果器能直接读取的帧格式
+static const struct GPUFilterFormatEntry {
+    enum AVPixelFormat format;
+    int gpu_fmt;
+} gpu_filter_format_map[] = {
+    { AV_PIX_FMT_YUV420P,        GPU_PLAYER_FORMAT_I420 },
+    { AV_PIX_FMT_NV12,           GPU_PLAYER_FORMAT_NV12 },
+    { AV_PIX_FMT_NV21,           GPU_PLAYER_FORMAT_NV21 },
+    { AV_PIX_FMT_RGBA,           GPU_PLAYER_FORMAT_RGBA },
+    { AV_PIX_FMT_NONE,           0 },
+};
+
 static int realloc_texture(SDL_Texture **texture, Uint32 new_format, int new_width, int new_height, SDL_BlendMode blendmode, int init_texture)
 {
     Uint32 format;
@@ -1178,6 +1198,41 @@ static int upload_texture(SDL_Texture **tex, AVFrame *frame, struct SwsContext *
     return ret;
 }
 
+// 在SDL渲染器自己的GL上下文里跑GPUImage效果器, 解码帧的各平面按linesize直接上传,
+// 结果画进视频纹理对应的GL纹理, 不经过sws_scale和内存拷贝. 帧格式不支持时返回负值, 由upload_texture处理
+static int upload_texture_gpu_filter(SDL_Texture **tex, AVFrame *frame)
+{
+    int i, gpu_fmt = 0;
+    GLint target = 0;
+    for (i = 0; i < FF_ARRAY_ELEMS(gpu_filter_format_map) - 1; i++) {
+        if (frame->format == gpu_filter_format_map[i].format) {
+            gpu_fmt = gpu_filter_format_map[i].gpu_fmt;
+            break;
+        }
+    }
+    if (!gpu_fmt || !gpu_player_hook_supports(gpu_fmt, frame->width, frame->height, frame->linesize))
+        return -1;
+    // GLES2渲染器里ABGR8888就是GL_RGBA纹理, 可以直接挂到帧缓冲上
+    if (realloc_texture(tex, SDL_PIXELFORMAT_ABGR8888, frame->width, frame->height, SDL_BLENDMODE_NONE, 0) < 0)
+        return -1;
+#if SDL_VERSION_ATLEAST(2,0,10)
+    // 先让SDL把攒着的绘制命令提交掉, 之后GL状态才是它记录的样子
+    SDL_RenderFlush(renderer);
+#endif
+    if (SDL_GL_BindTexture(*tex, NULL, NULL) < 0)
+        return -1;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &target);
+    SDL_GL_UnbindTexture(*tex);
+    if (gpu_player_hook_process(gpu_hook, gpu_fmt, frame->width, frame->height,
+                                frame->data, frame->linesize, target) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "GPU filter failed, showing unfiltered frames.\n");
+        gpu_player_hook_destroy(gpu_hook);
+        gpu_hook = NULL;
+        return -1;
+    }
+    return 0;
+}
+
 static void set_sdl_yuv_conversion_mode(AVFrame *frame)
 {
 #if SDL_VERSION_ATLEAST(2,0,8)
@@ -1249,10 +1304,14 @@ static void video_image_display(VideoState *is)
     calculate_display_rect(&rect, is->xleft, is->ytop, is->width, is->height, vp->width, vp->height, vp->sar);
 
     if (!vp->uploaded) {
-        if (upload_texture(&is->vid_texture, vp->frame, &is->img_convert_ctx) < 0)
+        int gpu_filtered = gpu_hook && upload_texture_gpu_filter(&is->vid_texture, vp->frame) >= 0;
+        if (!gpu_filtered && upload_texture(&is->vid_texture, vp->frame, &is->img_convert_ctx) < 0)
             return;
         vp->uploaded = 1;
         vp->flip_v = vp->frame->linesize[0] < 0;
+        // GPU效果器输出是GL帧缓冲的行序, 最底下一行在前, 翻转方向正好相反
+        if (gpu_filtered)
+            vp->flip_v = !vp->flip_v;
     }
 
     set_sdl_yuv_conversion_mode(vp->frame);
@@ -1520,6 +1579,16 @@ static void stream_close(VideoState *is)
 
 static void do_exit(VideoState *is)
 {
+    if (gpu_hook) {
+        GPUImagePlayerStats stats;
+        gpu_player_hook_get_stats(gpu_hook, &stats);
+        av_log(NULL, AV_LOG_INFO, "\nGPU filter: %d frames, avg %.2f ms, max %.2f ms, dropped %d early %d late\n",
+               stats.frames, stats.avgMs, stats.maxMs,
+               is ? is->frame_drops_early : 0, is ? is->frame_drops_late : 0);
+        // 退出时打印每个pass的统计, 要在GL上下文销毁之前
+        gpu_player_hook_destroy(gpu_hook);
+        gpu_hook = NULL;
+    }
     if (is) {
         stream_close(is);
     }
@@ -2110,7 +2179,7 @@ display:
 
             av_bprint_init(&buf, 0, AV_BPRINT_SIZE_AUTOMATIC);
             av_bprintf(&buf,
-                      "%7.2f %s:%7.3f fd=%4d aq=%5dKB vq=%5dKB sq=%5dB f=%"PRId64"/%"PRId64"   \r",
+                      "%7.2f %s:%7.3f fd=%4d aq=%5dKB vq=%5dKB sq=%5dB f=%"PRId64"/%"PRId64"   ",
                       // 主时钟
                       get_master_clock(is),
                       // 如果音视频都存在, 则展示"A-V", 否则分别展示主时钟与音视频其中一个流的差异
@@ -2128,6 +2197,15 @@ display:
                       // 展示错误的dts和pts帧数量
                       is->video_st ? is->viddec.avctx->pts_correction_num_faulty_dts : 0,
                       is->video_st ? is->viddec.avctx->pts_correction_num_faulty_pts : 0);
+            // 使用GPU效果器时展示最近一帧和平均的效果器耗时, 开了-gpufilter_profile时还有GPU耗时
+            if (gpu_hook) {
+                GPUImagePlayerStats stats;
+                gpu_player_hook_get_stats(gpu_hook, &stats);
+                av_bprintf(&buf, "gf=%6.2f/%6.2fms ", stats.lastMs, stats.avgMs);
+                if (stats.gpuMs >= 0)
+                    av_bprintf(&buf, "gpu=%6.2fms ", stats.gpuMs);
+            }
+            av_bprintf(&buf, "\r");
 
             // 如果 show_status 为 1 , 则展示上述的log内容
             if (show_status == 1 && AV_LOG_INFO > av_log_get_level())
@@ -2318,6 +2396,12 @@ static int configure_video_filters(AVFilterGraph *graph, VideoState *is, const c
             }
         }
     }
+    // 使用GPU效果器时只输出它能直接读取的格式, 其余的由效果器管线转换
+    if (gpu_hook) {
+        nb_pix_fmts = 0;
+        for (i = 0; i < FF_ARRAY_ELEMS(gpu_filter_format_map) - 1; i++)
+            pix_fmts[nb_pix_fmts++] = gpu_filter_format_map[i].format;
+    }
     // 标记表结尾
     pix_fmts[nb_pix_fmts] = AV_PIX_FMT_NONE;
 
@@ -4536,6 +4620,8 @@ static const OptionDef options[] = {
     { "vf", OPT_EXPERT | HAS_ARG, { .func_arg = opt_add_vfilter }, "set video filters", "filter_graph" },
     { "af", OPT_STRING | HAS_ARG, { &afilters }, "set audio filters", "filter_graph" },
 #endif
+    { "gpufilter", OPT_STRING | HAS_ARG | OPT_VIDEO, { &gpu_filter_desc }, "run a GPUImage pipeline on every video frame", "pipeline" },
+    { "gpufilter_profile", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, { &gpu_filter_profile }, "print per pass GPU filter timing at exit", "" },
     { "rdftspeed", OPT_INT | HAS_ARG| OPT_AUDIO | OPT_EXPERT, { &rdftspeed }, "rdft speed", "msecs" },
     { "showmode", HAS_ARG, { .func_arg = opt_show_mode}, "select show mode (0 = video, 1 = waves, 2 = RDFT)", "mode" },
     { "default", HAS_ARG | OPT_AUDIO | OPT_VIDEO | OPT_EXPERT, { .func_arg = opt_default }, "generic catch all option", "" },
@@ -4600,6 +4686,8 @@ int main(int argc, char **argv)
     int flags;
     // 播放状态, ffplay 整体的状态存储
     VideoState *is;
+    // GPU效果器检查上下文版本用
+    const char *version;
 
     // 仅Windows用
     init_dynload();
@@ -4688,6 +4776,14 @@ int main(int argc, char **argv)
         else
             // 如果不设置无边框, 则允许调整大小
             flags |= SDL_WINDOW_RESIZABLE;
+        // GPU效果器需要ES3上下文, SDL的GLES2渲染器默认只要ES 2.0.
+        // 窗口一开始就要带SDL_WINDOW_OPENGL, 否则渲染器重建窗口时会把版本改回2.0
+        if (gpu_filter_desc) {
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+            flags |= SDL_WINDOW_OPENGL;
+        }
         // 创建SDL窗口
         window = SDL_CreateWindow(program_name, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, default_width, default_height, flags);
         
@@ -4697,6 +4793,9 @@ int main(int argc, char **argv)
         // "2" or "best"
         // https://wiki.libsdl.org/SDL_SetHint
         SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+        // GPU效果器要和渲染器共用一个GLES上下文
+        if (gpu_filter_desc)
+            SDL_SetHint(SDL_HINT_RENDER_DRIVER, "opengles2");
         if (window) {
             // 创建一个2D渲染器
             // 例程: https://wiki.libsdl.org/SDL_CreateRenderer
@@ -4715,6 +4814,23 @@ int main(int argc, char **argv)
             av_log(NULL, AV_LOG_FATAL, "Failed to create window or renderer: %s", SDL_GetError());
             do_exit(NULL);
         }
+        if (gpu_filter_desc) {
+            if (strcmp(renderer_info.name, "opengles2")) {
+                av_log(NULL, AV_LOG_FATAL, "The GPU filter needs the opengles2 renderer, got %s\n", renderer_info.name);
+                do_exit(NULL);
+            }
+            version = (const char *) glGetString(GL_VERSION);
+            if (!version || strncmp(version, "OpenGL ES ", 10) || version[10] < '3') {
+                av_log(NULL, AV_LOG_FATAL, "The GPU filter needs an OpenGL ES 3.0 context, got %s\n",
+                       version ? version : "none");
+                do_exit(NULL);
+            }
+            if (!(gpu_hook = gpu_player_hook_create(gpu_filter_desc))) {
+                av_log(NULL, AV_LOG_FATAL, "Invalid GPU filter: %s\n", gpu_filter_desc);
+                do_exit(NULL);
+            }
+            gpu_player_hook_set_profiling(gpu_hook, gpu_filter_profile);
+        }
     }
 
     // 打开输入流
@@ -21,6 +21,8 @@
 #include "GLUtils.h"
 #include "GLUtils.h"
 #include "PixelBuffer.h"
+#include "RenderImageConverter.h"
+#include "RenderImagePool.h"
 #include "GPUImageFilter.h"
 #include "GPUImageRGBFilter.h"
 #include "GPUImageTextFilter.h"
@@ -33,30 +35,18 @@
 #include "GPUImageNormalBlendFilter.h"
 
 int main(const int argc, const char *argv[]){
-    RenderImage image, logo; int m_XAngle = 0, frameNums = 0;
+    int m_XAngle = 0, frameNums = 0;
+    RenderImagePool pool;
     cv::Mat inputImage = cv::imread("../test.png", 1);
-    
-    memset(&image, 0, sizeof(image));
-    image.format = IMAGE_FORMAT_RGBA;
-    image.width = inputImage.cols;
-    image.height = inputImage.rows;
-    RenderImageUtil::allocRenderImage(&image);
-    for(int i = 0; i < inputImage.rows; i++) {
-        for(int j = 0; j < inputImage.cols; j++) {
-            image.planes[0][i * inputImage.cols * 4 + j * 4] = inputImage.data[i * inputImage.cols * 3 + j * 3 + 2];
-            image.planes[0][i * inputImage.cols * 4 + j * 4 + 1] = inputImage.data[i * inputImage.cols * 3 + j * 3 + 1];
-            image.planes[0][i * inputImage.cols * 4 + j * 4 + 2] = inputImage.data[i * inputImage.cols * 3 + j * 3 + 0];
-            image.planes[0][i * inputImage.cols * 4 + j * 4 + 3] = 255;
-        }
-    }
+    RenderImage &image = *pool.acquire(IMAGE_FORMAT_RGBA, inputImage.cols, inputImage.rows);
+    RenderImageConverter::convertPacked(inputImage.data, (int) inputImage.step, PACKED_BGR24, &image);
 
+    // 池里的图像行是对齐的，按行拷贝
     cv::Mat smallImage = cv::imread("../baidu.png", -1);
-    memset(&logo, 0, sizeof(logo));
-    logo.format = IMAGE_FORMAT_RGBA;
-    logo.width = smallImage.cols;
-    logo.height = smallImage.rows;
-    RenderImageUtil::allocRenderImage(&logo);
-    memcpy(logo.planes[0], smallImage.data, smallImage.cols * smallImage.rows * 4);
+    RenderImage &logo = *pool.acquire(IMAGE_FORMAT_RGBA, smallImage.cols, smallImage.rows);
+    for (int y = 0; y < logo.height; y++) {
+        memcpy(logo.planes[0] + (size_t) y * logo.linesize[0], smallImage.ptr(y), (size_t) logo.width * 4);
+    }
 
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
@@ -83,17 +73,20 @@ int main(const int argc, const char *argv[]){
     renderer->onSurfaceChanged(image.width / 2, image.height / 2);
     renderer->setRenderImage(&image);
     char info[256];
-    std::string tmpStr = "";
+    std::string text;
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
         m_XAngle += 2; frameNums++;
         blendFliter->UpdateMVPMatrix( -0.8, -0.9, 0, m_XAngle, scaleY, scaleY);
         sprintf(info, "Frame: (%d, %d) idd: %d ", image.width, image.height, frameNums);
-        textFilter->setMString(std::string(info));
+        text.assign(info);
+        textFilter->setMString(text);
         renderer->onDrawFrame();
         glfwSwapBuffers(window);
     }
     glfwTerminate();
+    pool.release(&logo);
+    pool.release(&image);
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
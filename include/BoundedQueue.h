@@ -0,0 +1,88 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_BOUNDEDQUEUE_H
+#define ANDROID_PRJ_BOUNDEDQUEUE_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Blocking FIFO with a fixed capacity connecting two pipeline stages. push waits while the queue
+ * is full, so a slow consumer throttles its producer instead of buffering without bound. After
+ * close() push fails and pop drains what is left, then fails. Items live in a ring allocated once,
+ * push and pop do not allocate.
+ */
+template<typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(size_t capacity) : m_Capacity(capacity), m_Items(capacity) {}
+
+    bool push(const T &item) {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_NotFull.wait(lock, [this]() { return m_Closed || m_Count < m_Capacity; });
+        if (m_Closed) {
+            return false;
+        }
+        m_Items[(m_Head + m_Count) % m_Capacity] = item;
+        m_Count++;
+        m_NotEmpty.notify_one();
+        return true;
+    }
+
+    bool pop(T *item) {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_NotEmpty.wait(lock, [this]() { return m_Closed || m_Count > 0; });
+        if (m_Count == 0) {
+            return false;
+        }
+        takeFront(item);
+        m_NotFull.notify_one();
+        return true;
+    }
+
+    bool tryPop(T *item) {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        if (m_Count == 0) {
+            return false;
+        }
+        takeFront(item);
+        m_NotFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Closed = true;
+        m_NotFull.notify_all();
+        m_NotEmpty.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        return m_Count;
+    }
+
+private:
+    // m_Lock held, m_Count > 0
+    void takeFront(T *item) {
+        *item = m_Items[m_Head];
+        m_Items[m_Head] = T();
+        m_Head = (m_Head + 1) % m_Capacity;
+        m_Count--;
+    }
+
+    size_t m_Capacity;
+    bool m_Closed = false;
+    std::vector<T> m_Items;
+    size_t m_Head = 0;
+    size_t m_Count = 0;
+    mutable std::mutex m_Lock;
+    std::condition_variable m_NotFull;
+    std::condition_variable m_NotEmpty;
+};
+
+
+#endif //ANDROID_PRJ_BOUNDEDQUEUE_H
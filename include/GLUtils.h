@@ -5,6 +5,16 @@
 #include <string>
 #include <glm/glm.hpp>
 
+// Color formats of intermediate framebuffer textures
+enum TextureFormat {
+    TEXTURE_FORMAT_RGBA8,
+    TEXTURE_FORMAT_R8,          // Luma only, sampled as (r, r, r, 1)
+    TEXTURE_FORMAT_RG8,
+    TEXTURE_FORMAT_RGBA16F,     // Renderable with EXT_color_buffer_half_float or EXT_color_buffer_float
+    TEXTURE_FORMAT_RGB565,
+    TEXTURE_FORMAT_COUNT
+};
+
 class GLUtils {
 public:
     static void getError();
@@ -28,6 +38,17 @@ public:
 
     static void CheckGLError(const char *pGLOperation);
 
+    // Allocates texture as the width x height color attachment of framebuffer and leaves both bound.
+    // Formats the driver can not render to fall back to RGBA8, returns the format actually used.
+    static int AllocFramebufferTexture(GLuint framebuffer, GLuint texture, int format, int width, int height);
+    // Tells the driver the contents of the bound framebuffer are not needed any more, so tiled GPUs
+    // neither load nor store them. Call it before a pass that overwrites every pixel and after the
+    // last read of an intermediate. No-op on ES2 contexts.
+    static void InvalidateFramebuffer(bool color, bool depthStencil);
+    // rgba8, r8, rg8, rgba16f, rgb565; -1 when unknown
+    static int getTextureFormatByName(const std::string &name);
+    static const char *getTextureFormatName(int format);
+
     static void setBool(GLuint programId, const std::string &name, bool value) {
         glUniform1i(glGetUniformLocation(programId, name.c_str()), (int) value);
     }
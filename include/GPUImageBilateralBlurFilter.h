@@ -22,6 +22,7 @@ public:
 
     virtual void onInit();
     virtual void onInitialized();
+    virtual int getSamplingRadius();
 
 private:
     virtual void onOutputSizeChanged(int width, int height);
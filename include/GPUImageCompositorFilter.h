@@ -0,0 +1,101 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GPUIMAGECOMPOSITORFILTER_H
+#define ANDROID_PRJ_GPUIMAGECOMPOSITORFILTER_H
+
+#include <vector>
+#include "GPUImageFilter.h"
+#include "RenderImage.h"
+
+// GLES2 guarantees 8 fragment texture units, layers are batched up to this many textures per draw
+#define MAX_COMPOSITOR_BATCH_TEXTURES 8
+
+enum CompositorBlendMode {
+    COMPOSITOR_BLEND_NORMAL,
+    COMPOSITOR_BLEND_ADD,
+    COMPOSITOR_BLEND_MULTIPLY,
+    COMPOSITOR_BLEND_SCREEN
+};
+
+/**
+ * Draws the base image and any number of overlay layers (logos, watermarks, stickers) in one
+ * pass into the current framebuffer. Every layer is a transformed quad, consecutive layers with
+ * the same blend mode share one draw call as long as they use at most
+ * MAX_COMPOSITOR_BATCH_TEXTURES distinct textures. Layers are drawn in the order they were added.
+ * The layer setters may be called from any thread, they are applied on the next draw.
+ */
+class GPUImageCompositorFilter : public GPUImageFilter {
+public:
+    static const char COMPOSITOR_VERTEX_SHADER[];
+    static const char COMPOSITOR_FRAGMENT_SHADER[];
+    GPUImageCompositorFilter();
+    ~GPUImageCompositorFilter();
+
+    // Returns the layer id, the RGBA image must stay valid until the next draw
+    int addLayer(RenderImage *image);
+    // Layer backed by a texture owned by the caller
+    int addLayer(GLuint textureId);
+    void removeLayer(int layerId);
+    void setLayerImage(int layerId, RenderImage *image);
+    // Center (x, y) in normalized device coordinates, scale 1.0 covers the whole output,
+    // rotation in degrees counterclockwise around the layer center
+    void setLayerTransform(int layerId, float x, float y, float scaleX, float scaleY, float rotation);
+    void setLayerOpacity(int layerId, float opacity);
+    void setLayerBlendMode(int layerId, CompositorBlendMode blendMode);
+    void setLayerVisible(int layerId, bool visible);
+
+    virtual void onInit();
+    virtual void onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer);
+    virtual void onOutputSizeChanged(int width, int height);
+    // Layers are placed in output coordinates
+    virtual int getSamplingRadius();
+
+private:
+    struct CompositorLayer {
+        int id;
+        GLuint textureId;
+        bool ownsTexture;
+        float x;
+        float y;
+        float scaleX;
+        float scaleY;
+        float rotation;
+        float opacity;
+        CompositorBlendMode blendMode;
+        bool visible;
+    };
+    struct LayerBatch {
+        int firstVertex;
+        int vertexCount;
+        CompositorBlendMode blendMode;
+        int textureCount;
+        GLuint textureIds[MAX_COMPOSITOR_BATCH_TEXTURES];
+    };
+
+    CompositorLayer *findLayer(int layerId);
+    void uploadLayerImage(CompositorLayer &layer, RenderImage *image);
+    void buildBatches(const float *textureBuffer);
+    void drawLayers();
+
+    std::vector<CompositorLayer> m_Layers;
+    std::vector<LayerBatch> m_Batches;
+    std::vector<GLfloat> m_Vertices;
+    bool m_LayersDirty = true;
+    float m_LayerTextureBuffer[8] = { 0.0f };
+    int m_NextLayerId = 1;
+    std::mutex m_LayerIdLock;
+
+    GLuint m_LayerProgramId = GL_NONE;
+    GLint m_AttribLayerPosition = -1;
+    GLint m_AttribLayerTexCoord = -1;
+    GLint m_AttribLayerParams = -1;
+    GLuint m_VboId = GL_NONE;
+    int m_VboVertexCapacity = 0;
+    int m_ViewWidth = 0;
+    int m_ViewHeight = 0;
+};
+
+
+#endif //ANDROID_PRJ_GPUIMAGECOMPOSITORFILTER_H
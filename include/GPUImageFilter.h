@@ -13,8 +13,11 @@
 #include <functional>
 #include <glm/glm.hpp>
 #include "GLUtils.h"
+#include "GPUImageTracer.h"
 #include "GPUImageFilter.h"
 
+class GPUImageProfiler;
+
 class GPUImageFilter {
 public:
 
@@ -30,6 +33,23 @@ public:
     virtual void onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer) ;
     virtual void onDrawArraysPre();
     virtual void onOutputSizeChanged(int width, int height);
+    // Multi-input filters take their extra inputs here, input 0 is the texture passed to onDraw.
+    // textureId GL_NONE detaches the input again.
+    virtual int getInputCount();
+    virtual void setInputTexture(int index, GLuint textureId, const float *textureBuffer);
+    // Groups time every pass with the profiler, nullptr turns profiling off
+    virtual void setProfiler(GPUImageProfiler *profiler);
+    // Pixels around an output pixel its value depends on, tiled rendering pads every tile by it.
+    // -1 when the output depends on its position or on the whole image, such filters can not be tiled.
+    virtual int getSamplingRadius();
+    // Multi-pass filters render every pass but the last at scale times the output size, the last
+    // pass samples the smaller intermediate at full size. Single pass filters ignore it.
+    virtual void setInternalScale(float scale);
+    // Format of the intermediate texture groups and graphs render this filter into. Luma-only
+    // stages can use TEXTURE_FORMAT_R8, long chains TEXTURE_FORMAT_RGBA16F to avoid banding.
+    // The final output of a renderer is always RGBA8.
+    virtual int getOutputTextureFormat();
+    void setOutputTextureFormat(int format);
     void ifNeedInit();
     bool isInitialized() const;
     int getOutputWidth();
@@ -61,20 +81,27 @@ protected:
     void runPendingOnDrawTasks() {
         {
             std::lock_guard<std::mutex> guard(m_Lock);
+            if (m_RunOnDraw.empty()) {
+                return;
+            }
+            uint64_t span = GPUImageTracer::beginSpan();
             while (!m_RunOnDraw.empty()) {
                 std::function<void()> f = m_RunOnDraw.front();
                 f();
                 m_RunOnDraw.pop();
             }
+            GPUImageTracer::endSpan("runPendingOnDrawTasks", span);
         }
     }
     bool m_IsGroupFilter = false;
 
-    GLuint m_ProgramId;
+    GLuint m_ProgramId = GL_NONE;
     GLuint m_AttribPosition;
     GLuint m_UniformTexture;
     GLuint m_AttribTextureCoordinate;
     bool m_IsInitialized;
+    GPUImageProfiler *m_Profiler = nullptr;
+    int m_OutputTextureFormat = TEXTURE_FORMAT_RGBA8;
     const char *m_VertexShader;
     const char *m_FragmentShader;
 
@@ -0,0 +1,82 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GPUIMAGEFILTERGRAPH_H
+#define ANDROID_PRJ_GPUIMAGEFILTERGRAPH_H
+
+#include <vector>
+#include "GPUImageFilter.h"
+
+// Source id of the texture passed to the graph's onDraw
+#define GRAPH_INPUT_NODE (-1)
+
+/**
+ * Filters connected as a directed acyclic graph. Every node runs once per frame in topological
+ * order, so an output used by several nodes is computed only once. Nodes that do not reach the
+ * output node are skipped. Intermediate textures are assigned by liveness: a texture returns to
+ * the free list as soon as its last consumer has run, so the graph needs only as many framebuffers
+ * as there are outputs alive at the same time. Slots are only shared between nodes with the same
+ * output texture format.
+ * The graph owns its filters. Build it before the first draw; editing it later recompiles it
+ * on the next draw.
+ */
+class GPUImageFilterGraph : public GPUImageFilter {
+public:
+    GPUImageFilterGraph();
+    ~GPUImageFilterGraph();
+    // Returns the node id
+    int addFilter(GPUImageFilter *filter);
+    // Feeds the output of fromNode (or GRAPH_INPUT_NODE) into input toInput of toNode
+    bool connect(int fromNode, int toNode, int toInput = 0);
+    void setOutputNode(int node);
+    int getNodeCount() const;
+    GPUImageFilter *getNodeFilter(int node);
+    // Validates the graph and computes the schedule, called by onDraw when the graph changed
+    bool compile();
+    // Intermediate textures the compiled schedule needs
+    int getTextureSlotCount() const;
+    virtual void setProfiler(GPUImageProfiler *profiler);
+    // Largest sum of radii along any path from the graph input to the output node
+    virtual int getSamplingRadius();
+    // Below 1 every node renders at scale times the output size except the output node, which
+    // draws straight into the caller's framebuffer at full size
+    virtual void setInternalScale(float scale);
+
+    virtual void onInit();
+    virtual void onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer);
+    virtual void onOutputSizeChanged(int width, int height);
+
+private:
+    struct GraphNode {
+        GPUImageFilter *filter;
+        std::vector<int> inputs;    // Source node per input, GRAPH_INPUT_NODE for the graph input
+        int textureSlot;            // Intermediate texture written by this node, -1 for none
+        std::vector<int> releasedSlots;     // Slots whose last reader is this node
+        std::string stageName;
+        const char *traceName;
+    };
+
+    void allocTextureSlots();
+    void destroyTextureSlots();
+    void updateNodeSizes();
+
+    std::vector<GraphNode> m_Nodes;
+    std::vector<int> m_Schedule;
+    int m_OutputNode = -1;
+    bool m_Compiled = false;
+    bool m_Valid = false;
+
+    std::vector<int> m_SlotFormats;     // Texture format of every intermediate slot
+    std::vector<int> m_AllocatedSlotFormats;
+    std::vector<GLuint> m_Framebuffers;
+    std::vector<GLuint> m_FramebufferTextures;
+    int m_Width = 0;
+    int m_Height = 0;
+    float m_InternalScale = 1.0f;
+    int m_InternalWidth = 0;
+    int m_InternalHeight = 0;
+};
+
+
+#endif //ANDROID_PRJ_GPUIMAGEFILTERGRAPH_H
@@ -20,6 +20,17 @@ public:
     virtual void onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer);
     virtual void onOutputSizeChanged(const int width, const int height);
     void updateMergedFilters();
+    virtual void setProfiler(GPUImageProfiler *profiler);
+    // Sum of the filters' radii, each pass samples around the previous one's output
+    virtual int getSamplingRadius();
+    // The format set on the group, or its last filter's when none was set
+    virtual int getOutputTextureFormat();
+    // Below 1 every filter but the last renders at scale times the output size, the last one
+    // reads the small intermediate and draws straight into the output, so upscaling needs no
+    // extra pass. The last filter gets the scale too when it has passes of its own (a graph).
+    // Reallocates the intermediates when the size is known.
+    virtual void setInternalScale(float scale);
+    float getInternalScale() const;
 
     virtual void onInitialized();
 
@@ -27,10 +38,20 @@ private:
     void destroyFramebuffers();
     std::vector<GPUImageFilter *> m_Filters;
     std::vector<GPUImageFilter *> m_MergedFilters;
+    // Filter whose output format each merged pass renders into: the pass itself, or the nested
+    // group that ends with it
+    std::vector<GPUImageFilter *> m_MergedOutputs;
+    std::vector<std::string> m_StageNames;
+    std::vector<const char *> m_TraceNames;
     int m_FramebuffersLen;
     int m_FramebufferTexturesLen;
     GLuint *m_Framebuffers;
     GLuint *m_FramebufferTextures;
+    float m_InternalScale = 1.0f;
+    int m_OutputWidth = 0;
+    int m_OutputHeight = 0;
+    int m_InternalWidth = 0;
+    int m_InternalHeight = 0;
 };
 
 #endif //ANDROID_PRJ_GPUIMAGEFILTERGROUP_H
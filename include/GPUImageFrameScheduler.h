@@ -0,0 +1,131 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GPUIMAGEFRAMESCHEDULER_H
+#define ANDROID_PRJ_GPUIMAGEFRAMESCHEDULER_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include "RenderImage.h"
+#include "RenderImageHandle.h"
+#include "GPUImageRenderer.h"
+
+// Frames waiting for the render thread, the oldest is dropped when a new one does not fit
+#define DEFAULT_SCHEDULER_CAPACITY 3
+// Frames later than this are dropped even when they are the newest
+#define DEFAULT_SCHEDULER_MAX_LATENESS_US 50000
+// Lateness samples the percentiles are computed over
+#define DEFAULT_SCHEDULER_WINDOW 600
+// Smoothing of the per frame cost estimate used to predict misses
+#define SCHEDULER_COST_SMOOTHING 0.1
+// Consecutive overloaded frames before switching to the next cheaper quality level
+#define SCHEDULER_DEGRADE_FRAMES 5
+// Consecutive frames under SCHEDULER_RECOVER_RATIO of the budget before going back up a level
+#define SCHEDULER_RECOVER_FRAMES 120
+#define SCHEDULER_RECOVER_RATIO 0.5
+
+struct ScheduledFrame {
+    RenderImage *image;
+    int64_t deadlineUs;     // Presentation time on the GPUImageFrameScheduler::now() clock
+    uint64_t id;
+};
+
+struct SchedulerStats {
+    uint64_t submitted;
+    uint64_t presented;
+    uint64_t presentedLate;     // Presented after their deadline
+    uint64_t droppedLate;       // Too late, or a newer frame was already due
+    uint64_t droppedOverflow;   // Pushed out of a full queue
+    double latenessP50, latenessP95, latenessP99, latenessMax;     // ms, negative is early
+    double costMs;              // Smoothed render plus present time
+    int qualityLevel;
+    int qualitySwitches;
+};
+
+/**
+ * Paces a live source in front of a GPUImageRenderer. Producers submit frames with a presentation
+ * deadline from any thread; the GL thread calls renderNext, which starts a frame the estimated
+ * cost before its deadline. It skips every frame whose successor is already due, and frames
+ * already later than the maximum lateness, so the latency of a slow chain stays bounded instead
+ * of growing with the queue. Lateness is measured
+ * when the present callback (swap or readback) returns.
+ *
+ * With quality levels set, a sustained frame cost over the budget (or late drops) switches the
+ * renderer to the next cheaper pipeline description, and a long stretch well under the budget
+ * switches back. Switching rebuilds the filters, the hysteresis keeps that rare.
+ */
+class GPUImageFrameScheduler {
+public:
+    GPUImageFrameScheduler(GPUImageRenderer *renderer, int capacity = DEFAULT_SCHEDULER_CAPACITY,
+                           int windowSize = DEFAULT_SCHEDULER_WINDOW);
+    ~GPUImageFrameScheduler();
+
+    // Microseconds on the steady clock deadlines are given in
+    static int64_t now();
+
+    // Any thread. The image is handed back through the release callback once presented or dropped
+    void submit(RenderImage *image, int64_t deadlineUs);
+    // Any thread. The scheduler keeps the handle until the frame is presented or dropped and then
+    // drops it instead of calling the release callback
+    void submit(RenderImageHandle image, int64_t deadlineUs);
+    // GL thread. Waits up to timeoutUs for a frame, returns true when one was presented
+    bool renderNext(int64_t timeoutUs);
+    // Wakes renderNext, later submits release their image right away
+    void close();
+
+    // Called on the GL thread after the frame is drawn, e.g. to swap buffers or read back
+    void setPresentCallback(const std::function<void(const ScheduledFrame &frame)> &callback);
+    // Called from submit or renderNext for every RenderImage pointer given to submit
+    void setReleaseCallback(const std::function<void(RenderImage *image)> &callback);
+    // Frames later than this are dropped even when no newer frame is waiting
+    void setMaxLateness(int64_t lateUs);
+    // GL thread. descriptions[0] is full quality and replaces the renderer's filter now, each next
+    // one is cheaper; an empty description renders the input only. frameBudgetUs is the render
+    // cost the levels are chosen to stay under.
+    void setQualityLevels(const std::vector<std::string> &descriptions, int64_t frameBudgetUs);
+
+    SchedulerStats getStats() const;
+    void dump() const;
+    void reset();
+
+private:
+    int64_t estimatedCost() const;
+    bool isOverdue(const ScheduledFrame &frame, int64_t now, const ScheduledFrame *next) const;
+    void updateQuality(double costUs, bool droppedLate);
+    void setQualityLevel(int level);
+    void release(RenderImage *image);
+
+    GPUImageRenderer *m_Renderer;
+    int m_Capacity;
+    int m_WindowSize;
+    std::deque<ScheduledFrame> m_Frames;
+    bool m_Closed = false;
+    uint64_t m_NextId = 0;
+    int64_t m_MaxLatenessUs;
+    std::function<void(const ScheduledFrame &frame)> m_PresentCallback;
+    std::function<void(RenderImage *image)> m_ReleaseCallback;
+    std::map<RenderImage *, RenderImageHandle *> m_OwnedImages;
+
+    // Render thread only
+    double m_CostUs = 0;
+    bool m_CostKnown = false;
+    int m_SettleFrames = 0;
+    std::vector<std::string> m_QualityLevels;
+    int64_t m_FrameBudgetUs = 0;
+    int m_OverloadedFrames = 0;
+    int m_RelaxedFrames = 0;
+
+    SchedulerStats m_Stats;
+    std::deque<double> m_Lateness;
+    mutable std::mutex m_Lock;
+    std::condition_variable m_FrameReady;
+};
+
+
+#endif //ANDROID_PRJ_GPUIMAGEFRAMESCHEDULER_H
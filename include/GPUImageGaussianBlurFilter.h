@@ -5,6 +5,8 @@
 #ifndef ANDROID_PRJ_GPUIMAGEGAUSSIANBLURFILTER_H
 #define ANDROID_PRJ_GPUIMAGEGAUSSIANBLURFILTER_H
 
+#include <cmath>
+#include <algorithm>
 #include "GPUImageTwoPassTextureSamplingFilter.h"
 
 class GPUImageGaussianBlurFilter : public GPUImageTwoPassTextureSamplingFilter {
@@ -31,6 +33,11 @@ public:
         return m_BlurSize;
     }
 
+    // 每个方向9个采样点，最远4步，加1个像素给线性插值
+    virtual int getSamplingRadius() {
+        return (int) std::ceil(4 * std::max(getHorizontalTexelOffsetRatio(), getVerticalTexelOffsetRatio())) + 1;
+    }
+
     void setBlurSize(float blurSize) {
         m_BlurSize = blurSize;
         runOnDraw([this](){
@@ -21,6 +21,14 @@ public:
 
     GPUImageInputFilter() : GPUImageFilter(VERTEX_SHADER_STR, FRAGMENT_SHADER_STR){}
     void setRenderImage(RenderImage *image);
+    // Draws from textures filled elsewhere (e.g. on an upload thread with a shared context)
+    // until the next setRenderImage. Needs 1 texture for RGBA, 2 for NV12/NV21, 3 for I420.
+    void setInputTextures(int format, const GLuint *textureIds);
+
+    // Creates TEXTURE_NUM textures set up for uploadRenderImage
+    static void genInputTextures(GLuint *textureIds);
+    // Uploads the planes of image honoring their linesize
+    static void uploadRenderImage(const RenderImage *image, const GLuint *textureIds);
 //    void deleteImage();
 
     virtual void onInit();
@@ -32,7 +40,12 @@ public:
 
 private:
 #define TEXTURE_NUM 3
+    static void uploadPlane(GLuint textureId, GLenum format, int width, int height, int bytesPerPixel,
+                            int linesize, const uint8_t *data);
+
     GLuint m_TextureIds[TEXTURE_NUM];
+    GLuint m_ExternalTextureIds[TEXTURE_NUM];
+    bool m_UseExternalTextures = false;
     GLuint m_ProgramObj = GL_NONE;
     GLuint m_VaoId = -1;
     GLuint m_VboIds[TEXTURE_NUM];
@@ -0,0 +1,47 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GPUIMAGEPBOUPLOADER_H
+#define ANDROID_PRJ_GPUIMAGEPBOUPLOADER_H
+
+#include <vector>
+#include <GLES3/gl3.h>
+#include "RenderImage.h"
+
+// Frames that can be prefetched ahead of the one being uploaded
+#define DEFAULT_PBO_SLOTS 3
+
+/**
+ * Uploads RenderImages through a ring of pixel unpack buffers. prefetch() copies the next frame
+ * into a free buffer while the GPU is still busy with the current one, upload() then starts the
+ * texture transfer from that buffer, which the driver can run asynchronously instead of copying
+ * client memory inside glTexImage2D. Rows are padded like RenderImagePool's.
+ * Pair it with GPUImageInputFilter::genInputTextures and GPUImageRenderer::setRenderTextures.
+ * GL thread only; destroy it while the context is still current.
+ */
+class GPUImagePBOUploader {
+public:
+    GPUImagePBOUploader(int slots = DEFAULT_PBO_SLOTS);
+    ~GPUImagePBOUploader();
+
+    // Copies image into the next free buffer, false when every buffer holds a frame not uploaded yet
+    bool prefetch(const RenderImage *image);
+    int getPrefetchedCount() const;
+    // Uploads the oldest prefetched frame into textureIds and returns its format and size
+    bool upload(const GLuint *textureIds, int *format, int *width, int *height);
+
+private:
+    struct Slot {
+        GLuint buffer;
+        size_t capacity;
+        RenderImage layout;     // planes hold offsets into the buffer
+    };
+
+    std::vector<Slot> m_Slots;
+    int m_Head = 0;             // Oldest prefetched slot
+    int m_Count = 0;
+};
+
+
+#endif //ANDROID_PRJ_GPUIMAGEPBOUPLOADER_H
@@ -0,0 +1,58 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GPUIMAGEPIPELINEPARSER_H
+#define ANDROID_PRJ_GPUIMAGEPIPELINEPARSER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+#include "GPUImageFilterGraph.h"
+
+#define PIPELINE_INPUT_LABEL "in"
+#define PIPELINE_OUTPUT_LABEL "out"
+// Parameter every filter accepts, the format of its intermediate texture (rgba8, r8, rg8, rgba16f, rgb565)
+#define PIPELINE_FORMAT_PARAM "format"
+
+typedef std::map<std::string, std::string> PipelineFilterParams;
+// Returns nullptr and prints the reason when a parameter value is invalid
+typedef std::function<GPUImageFilter *(const PipelineFilterParams &params)> PipelineFilterFactory;
+
+/**
+ * Builds a GPUImageFilterGraph from a description in the style of an ffmpeg filtergraph:
+ *
+ *     [in]rgb=red=1:green=0.8,gaussianblur=4[soft]; [soft][in]normalblend[out]
+ *
+ * Chains are separated by ';' and filters inside a chain by ','. Each filter in a chain reads
+ * the previous one on its first input. Inputs and outputs can be labeled with [name]. [in] is
+ * the image given to the graph. The first filter of a chain reads [in] when its first input has
+ * no label. [out] or the end of the last chain is the output. Parameters follow '=' and are
+ * separated by ':'. They are either key=value or positional in the order the filter declares
+ * them. Values may be quoted with '' to contain separators. Every filter also takes format=, the
+ * texture format it renders into when its output is an intermediate, e.g. rgb=format=rgba16f.
+ */
+class GPUImagePipelineParser {
+public:
+    // Returns nullptr and prints the error when the description is invalid
+    static GPUImageFilterGraph *parse(const std::string &description);
+    // Makes a filter available to descriptions, paramNames gives the positional parameter order
+    static void registerFilter(const std::string &name, const std::vector<std::string> &paramNames,
+                               const PipelineFilterFactory &factory);
+
+    static bool getFloat(const PipelineFilterParams &params, const std::string &name, float defaultValue,
+                         float *value);
+    static std::string getString(const PipelineFilterParams &params, const std::string &name,
+                                 const std::string &defaultValue);
+
+private:
+    struct FilterEntry {
+        std::vector<std::string> paramNames;
+        PipelineFilterFactory factory;
+    };
+    static std::map<std::string, FilterEntry> &registry();
+};
+
+
+#endif //ANDROID_PRJ_GPUIMAGEPIPELINEPARSER_H
@@ -0,0 +1,65 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GPUIMAGEPLAYERHOOK_H
+#define ANDROID_PRJ_GPUIMAGEPLAYERHOOK_H
+
+#include <stdint.h>
+
+/**
+ * C entry points for running a GPUImage pipeline inside a player's own GL context (demo/ffplay.c).
+ * Decoded planes are uploaded straight from the decoder's buffers with their linesize, and the
+ * result is drawn into a texture the caller owns, so no pixel leaves the GPU before display.
+ * The player's GL state is saved and restored around each call, renderers that cache state
+ * (like SDL's) keep working. Needs an OpenGL ES 3 context to be current on the calling thread;
+ * SDL's opengles2 renderer asks for ES 2.0 unless SDL_GL_CONTEXT_PROFILE_ES and major version 3
+ * are set and the window is created with SDL_WINDOW_OPENGL. On any other context the first
+ * gpu_player_hook_process prints why and fails, the caller then shows unfiltered frames.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Same values as IMAGE_FORMAT_* in RenderImage.h, which is C++ only
+#define GPU_PLAYER_FORMAT_RGBA      0x01
+#define GPU_PLAYER_FORMAT_NV21      0x02
+#define GPU_PLAYER_FORMAT_NV12      0x03
+#define GPU_PLAYER_FORMAT_I420      0x04
+
+typedef struct GPUImagePlayerHook GPUImagePlayerHook;
+
+typedef struct GPUImagePlayerStats {
+    int frames;
+    double lastMs;      // CPU time of the last gpu_player_hook_process, upload and draw submission
+    double avgMs;
+    double maxMs;
+    double gpuMs;       // GPU time of the last profiled frame, -1 without profiling or timer queries
+} GPUImagePlayerStats;
+
+// description is a GPUImagePipelineParser description, returns NULL and prints why when invalid
+GPUImagePlayerHook *gpu_player_hook_create(const char *description);
+// Also prints the per-pass profile when profiling was enabled
+void gpu_player_hook_destroy(GPUImagePlayerHook *hook);
+// Times every filter pass, see GPUImageRenderer::setProfilingEnabled
+void gpu_player_hook_set_profiling(GPUImagePlayerHook *hook, int enabled);
+// Returns 1 when the frame layout is one gpu_player_hook_process accepts: GPU_PLAYER_FORMAT_* format,
+// even size for YUV and every linesize of the same sign
+int gpu_player_hook_supports(int format, int width, int height, const int linesize[3]);
+/**
+ * Draws one frame into target, an RGBA GL_TEXTURE_2D of width x height. Negative linesizes are
+ * uploaded from their last row, like the player does for its own textures. The output has the
+ * first row at the bottom (GL framebuffer order), so it displays upright with a vertical flip when
+ * the linesizes were positive and without one when they were negative. Returns 0 on success.
+ */
+int gpu_player_hook_process(GPUImagePlayerHook *hook, int format, int width, int height,
+                            uint8_t *const planes[3], const int linesize[3], unsigned int target);
+void gpu_player_hook_get_stats(const GPUImagePlayerHook *hook, GPUImagePlayerStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif //ANDROID_PRJ_GPUIMAGEPLAYERHOOK_H
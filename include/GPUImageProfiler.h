@@ -0,0 +1,127 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GPUIMAGEPROFILER_H
+#define ANDROID_PRJ_GPUIMAGEPROFILER_H
+
+#include <map>
+#include <mutex>
+#include <deque>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+
+#define DEFAULT_PROFILER_WINDOW 300
+// Frames whose GPU queries are still in flight, older frames are dropped instead of stalling
+#define MAX_PROFILER_PENDING_FRAMES 8
+
+class GPUImageFilter;
+
+struct ProfilerSample {
+    std::string name;
+    double cpuMs;
+    double gpuMs;   // -1 when GPU timing is unavailable
+};
+
+struct ProfilerStageStats {
+    std::string name;
+    int count;
+    double cpuP50, cpuP95, cpuP99;
+    double gpuP50, gpuP95, gpuP99; // -1 when GPU timing is unavailable
+};
+
+/**
+ * Opt-in per stage CPU and GPU timing. Stages are named scopes opened with beginStage and closed
+ * with endStage on the GL thread, they may nest. GPU time comes from GL_EXT_disjoint_timer_query
+ * when the driver has it; results are collected in a later beginFrame once available, so timing
+ * never waits for the GPU. Statistics are kept over the last windowSize samples of every stage.
+ *
+ * With timestamps every stage brackets itself with two counters. Without them only one
+ * GL_TIME_ELAPSED query can be active, so the innermost open stage owns it: opening a stage
+ * suspends its parent's query and closing it resumes the parent in a new one. A stage's GPU time
+ * is then the sum of its own segments and its children's times.
+ */
+class GPUImageProfiler {
+public:
+    GPUImageProfiler(int windowSize = DEFAULT_PROFILER_WINDOW);
+    ~GPUImageProfiler();
+    void beginFrame();
+    void endFrame();
+    int beginStage(const std::string &name);
+    void endStage(int stage);
+
+    bool isGpuTimingAvailable() const;
+    // Call before the first beginFrame; false forces the GL_TIME_ELAPSED fallback (for tests)
+    void setTimestampsEnabled(bool enabled);
+    bool isUsingTimestamps() const;
+    // Samples of the newest frame whose GPU results are all collected
+    std::vector<ProfilerSample> getLastFrame() const;
+    // Grows by one every time getLastFrame has a newer frame
+    uint64_t getCompletedFrameCount() const;
+    std::vector<ProfilerStageStats> getStats() const;
+    void reset();
+    void dump() const;
+
+    static std::string getFilterName(GPUImageFilter *filter);
+
+private:
+    struct PendingStage {
+        std::string name;
+        double cpuMs;
+        GLuint queries[2];  // Begin and end timestamps
+        std::vector<GLuint> segments;  // Elapsed time queries while this stage was innermost
+        int parent;
+    };
+    struct PendingFrame {
+        std::vector<PendingStage> stages;
+    };
+    struct OpenStage {
+        std::string name;
+        std::chrono::steady_clock::time_point start;
+        GLuint queries[2];
+        int index;
+    };
+
+    void initGpuTiming();
+    GLuint allocQuery();
+    void collectFrames();
+    void beginSegment(int index);
+    void endSegment();
+    void releaseQueries(PendingStage &stage);
+    void addSample(const std::string &name, double cpuMs, double gpuMs);
+    static void percentiles(std::vector<double> values, double *p50, double *p95, double *p99);
+
+    int m_WindowSize;
+    bool m_GpuChecked = false;
+    bool m_GpuTiming = false;
+    bool m_UseTimestamps = false;
+    bool m_TimestampsEnabled = true;
+    bool m_ElapsedQueryActive = false;
+    std::vector<GLuint> m_FreeQueries;
+    std::vector<GLuint> m_AllQueries;
+
+    std::vector<OpenStage> m_OpenStages;
+    PendingFrame m_CurrentFrame;
+    std::deque<PendingFrame> m_PendingFrames;
+    // Read by the stats getters from any thread
+    mutable std::mutex m_Lock;
+    std::vector<ProfilerSample> m_LastFrame;
+    uint64_t m_CompletedFrames = 0;
+    std::map<std::string, std::deque<double>> m_CpuSamples;
+    std::map<std::string, std::deque<double>> m_GpuSamples;
+
+    PFNGLGENQUERIESEXTPROC m_GenQueries = nullptr;
+    PFNGLDELETEQUERIESEXTPROC m_DeleteQueries = nullptr;
+    PFNGLBEGINQUERYEXTPROC m_BeginQuery = nullptr;
+    PFNGLENDQUERYEXTPROC m_EndQuery = nullptr;
+    PFNGLQUERYCOUNTEREXTPROC m_QueryCounter = nullptr;
+    PFNGLGETQUERYIVEXTPROC m_GetQueryiv = nullptr;
+    PFNGLGETQUERYOBJECTUIVEXTPROC m_GetQueryObjectuiv = nullptr;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC m_GetQueryObjectui64v = nullptr;
+};
+
+
+#endif //ANDROID_PRJ_GPUIMAGEPROFILER_H
@@ -8,6 +8,7 @@
 #include <vector>
 #include <queue>
 #include <mutex>
+#include <atomic>
 #include <GLES3/gl3.h>
 #include <glm/detail/type_mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -20,12 +21,26 @@
 #include "Rotation.h"
 #include "ScaleType.h"
 #include "GPUImageInputFilter.h"
+#include "GPUImageProfiler.h"
 
 using namespace glm;
 
 #define TEXTURE_NUM 3
 #define MATH_PI 3.1415926535897932384626433832802
 
+// 动态分辨率: 每次缩小/放大的步长和下限
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+#define DYNAMIC_RESOLUTION_STEP 0.125f
+#define DYNAMIC_RESOLUTION_SMOOTHING 0.2
+// Consecutive frames over the target before scaling down
+#define DYNAMIC_RESOLUTION_DOWN_FRAMES 10
+// Consecutive frames whose cost predicted at the next larger scale stays under HEADROOM times the
+// target before scaling up
+#define DYNAMIC_RESOLUTION_UP_FRAMES 60
+#define DYNAMIC_RESOLUTION_UP_HEADROOM 0.8
+// Timings ignored after a change, they may still be from frames at the old scale
+#define DYNAMIC_RESOLUTION_SETTLE_FRAMES 4
+
 class GPUImageRenderer {
 public:
     GPUImageRenderer(GPUImageFilter *filter);
@@ -34,11 +49,34 @@ public:
     void onSurfaceChanged(int width, int height);
     void onSurfaceCreated();
     void setRenderImage(RenderImage *image);
+    // Same as setRenderImage for planes already uploaded with GPUImageInputFilter::uploadRenderImage
+    void setRenderTextures(int format, int width, int height, const GLuint *textureIds);
     void setTexture(GLuint texture);
+    // Replaces the filters after the input stage, the renderer takes ownership
     void setFilter(GPUImageFilter *filter);
 //    void deleteImage();
     void UpdateMVPMatrix(int angleX, int angleY, float scaleX, float scaleY);
+    // Times upload, every filter pass and the whole frame, takes effect on the next frame
+    void setProfilingEnabled(bool enabled);
+    bool isProfilingEnabled() const;
+    // 没开性能统计时为nullptr
+    GPUImageProfiler *getProfiler();
+    // 结束当前的统计帧，在回读之后调用，让回读算进绘制它的那一帧
+    void endProfilerFrame();
+    std::vector<ProfilerStageStats> getProfilerStats() const;
+    std::vector<ProfilerSample> getLastFrameProfile() const;
+    // Measures every frame and renders the filters at a reduced internal resolution while the
+    // frame takes longer than targetFrameMs, upscaling in the last pass. Scale changes are
+    // stepped with hysteresis. See GPUImageFilterGroup::setInternalScale.
+    void setDynamicResolution(bool enabled, double targetFrameMs);
+    float getInternalScale() const;
+    // The filters draw over the whole output, so by default the output is only invalidated before
+    // a frame instead of cleared to the background color. Turn it on for filters that leave parts
+    // of the output untouched.
+    void setClearEnabled(bool enabled);
 private:
+    void updateDynamicResolution(GPUImageProfiler *frameTimer);
+    void applyInternalScale(float scale);
     void adjustImageScaling();
     void renderTexture();
     float addDistance(float coordinate, float distance);
@@ -54,6 +92,7 @@ private:
     float m_BackgroundRed = 0;
     float m_BackgroundGreen = 0;
     float m_BackgroundBlue = 0;
+    bool m_ClearEnabled = false;
     int outputWidth;
     int outputHeight;
     int imageWidth;
@@ -84,6 +123,22 @@ private:
     glm::mat4 m_MVPMatrix;
 
     GPUImageInputFilter *m_GPUImageInputFilter = nullptr;
+    GPUImageProfiler *m_Profiler = nullptr;
+    // 调用线程写，GL线程读
+    std::atomic<bool> m_ProfilingEnabled{false};
+    bool m_ProfilerFrameOpen = false;
+    uint64_t m_FrameCount = 0;
+
+    // 只计一个frame阶段，用户没开profiling时给动态分辨率用
+    GPUImageProfiler *m_FrameTimer = nullptr;
+    bool m_DynamicResolution = false;
+    double m_TargetFrameMs = 0;
+    double m_FrameCostMs = -1;
+    uint64_t m_TimedFrames = 0;
+    int m_SettleFrames = 0;
+    int m_OverTargetFrames = 0;
+    int m_UnderTargetFrames = 0;
+    std::atomic<float> m_InternalScale{1.0f};
 };
 
 
@@ -22,6 +22,7 @@ public:
     virtual void onInitialized();
 
     virtual void onOutputSizeChanged(int width, int height);
+    virtual int getSamplingRadius();
 
     void setSharpness(const GLfloat _sharpness);
 
@@ -6,23 +6,21 @@
 #define ANDROID_PRJ_GPUIMAGETEXTFILTER_H
 
 #include "GPUImageFilter.h"
-#include <map>
+#include <list>
+#include <vector>
+#include <unordered_map>
 #include <glm/detail/type_mat4x4.hpp>
 
-#include <freetype/ftglyph.h>
+#include "GlyphCache.h"
 
 #define DEFAULT_OGL_ASSETS_DIR "../"
-
-struct Character {
-    GLuint textureID;   // ID handle of the glyph texture
-    glm::ivec2 size;    // Size of glyph
-    glm::ivec2 bearing;  // Offset from baseline to left/top of glyph
-    GLuint advance;    // Horizontal offset to advance to next glyph
-};
+#define ASCII_CHAR_NUM 128
+#define MAX_TEXT_LAYOUTS 16
 
 class GPUImageTextFilter : public GPUImageFilter {
 public:
-    GPUImageTextFilter();
+    GPUImageTextFilter(const std::string &fontPath = std::string(DEFAULT_OGL_ASSETS_DIR) + "/Antonio-Regular.ttf",
+                       GlyphRenderMode renderMode = GLYPH_RENDER_BITMAP);
     virtual ~GPUImageTextFilter();
     void RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color, glm::vec2 viewport);
     void LoadFacesByASCII();
@@ -31,13 +29,43 @@ public:
     virtual void onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer);
     virtual void onOutputSizeChanged(int width, int height);
     virtual void onInit();
+    // Text is laid out in output pixels
+    virtual int getSamplingRadius();
 
     static const char *TEXT_VERTEX_SHADER;
     static const char *TEXT_FRAGMENT_SHADER;
+    static const char *TEXT_SDF_FRAGMENT_SHADER;
+    GlyphCache *getGlyphCache();
+    // Text height in pixels of the glyph raster, SDF glyphs stay sharp at any size
+    void setTextSize(float textSize);
+
 private:
-    std::map<GLint, Character> m_Characters;
-    GLuint m_TextProgramId;
+    struct TextLayout {
+        std::vector<uint32_t> codePoints;
+        std::vector<GLfloat> penX;      // Pen position before each code point, one extra for the end
+        std::vector<int> firstQuad;     // First glyph quad at or after each code point, one extra for the end
+        std::vector<GLfloat> vertices;  // 6 vertices of <vec2 pos, vec2 tex> per glyph quad
+        uint32_t generation;
+        std::list<std::string>::iterator lruIter;  // Position in m_TextLayoutOrder, most recent first
+    };
+    const TextLayout &getTextLayout(const std::string &text);
+    int uploadVertices(const std::vector<GLfloat> &vertices);
+
+    std::string m_FontPath;
+    GlyphRenderMode m_RenderMode;
+    GlyphCache *m_GlyphCache = nullptr;
+    float m_TextSize = DEFAULT_GLYPH_PIXEL_SIZE;
+    std::unordered_map<std::string, TextLayout> m_TextLayouts;
+    std::list<std::string> m_TextLayoutOrder;     // Least recently used layout at the back
+    std::string m_LastText;
+    glm::vec4 m_LayoutParams = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f); // Origin x/y in pixels, scale and viewport width the layouts were made with
+    GLfloat m_LayoutViewHeight = 0;
+    std::vector<GLfloat> m_UploadedVertices;
+    int m_VboGlyphCapacity = 0;
+    GLuint m_TextProgramId = GL_NONE;
     GLint m_SamplerLoc;
+    GLint m_TextColorLoc;
+    GLint m_SmoothingLoc = -1;
     int m_ViewWidth = 1280;
     int m_ViewHeight = 720;
     GLuint m_VaoId;
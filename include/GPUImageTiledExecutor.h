@@ -0,0 +1,73 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GPUIMAGETILEDEXECUTOR_H
+#define ANDROID_PRJ_GPUIMAGETILEDEXECUTOR_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "RenderImage.h"
+#include "PixelBuffer.h"
+#include "GPUImageRenderer.h"
+#include "GPUImageFilterGraph.h"
+
+// Output pixels per tile side, the rendered region adds the halo on every side
+#define DEFAULT_TILE_SIZE 2048
+
+/**
+ * Runs a pipeline over images larger than one framebuffer (gigapixel scans, 16K panoramas).
+ * The input is cut into tiles, each one is rendered together with a halo of the pipeline's
+ * sampling radius (GPUImageFilter::getSamplingRadius) and only the tile itself is read back,
+ * so the result matches rendering the whole image at once. Halos are clipped at the image border,
+ * where the filters clamp to the edge just like on the full image. GPU memory stays bounded by
+ * the tile size whatever the image size: one pbuffer plus the pipeline's intermediates.
+ * Creates its own context on the calling thread, use it from that thread only.
+ */
+class GPUImageTiledExecutor {
+public:
+    // description is a GPUImagePipelineParser description
+    GPUImageTiledExecutor(const std::string &description, int tileSize = DEFAULT_TILE_SIZE);
+    ~GPUImageTiledExecutor();
+
+    // False when the description is invalid or the pipeline is not tileable
+    bool isValid() const;
+    // Halo in pixels added around every tile
+    int getHalo() const;
+
+    /**
+     * Renders input tile by tile and hands every finished tile to callback. rgba points to the
+     * top row of the width x height tile at (x, y); linesize is negative, the rows are stored
+     * bottom-up as GL reads them. The pointer is valid during the call only. YUV inputs need an
+     * even size. Returns false when nothing could be rendered.
+     */
+    bool processTiles(const RenderImage *input,
+                      const std::function<void(int x, int y, int width, int height,
+                                               const uint8_t *rgba, int linesize)> &callback);
+    // Same as processTiles into output, an RGBA image of the input size allocated when empty
+    bool process(const RenderImage *input, RenderImage *output);
+
+private:
+    struct TileRegion {
+        int x, y, width, height;                        // Tile in the output
+        int regionX, regionY, regionWidth, regionHeight;  // Rendered area, tile plus clipped halo
+    };
+
+    bool setupContext();
+    std::vector<TileRegion> planTiles(const RenderImage *input) const;
+    void cropRenderImage(const RenderImage *input, const TileRegion &tile, RenderImage *region) const;
+
+    GPUImageFilterGraph *m_Filter = nullptr;     // Owned by m_Renderer once it exists
+    GPUImageRenderer *m_Renderer = nullptr;      // Owned by m_PixelBuffer
+    PixelBuffer *m_PixelBuffer = nullptr;
+    int m_TileSize;
+    int m_Halo = -1;
+    int m_RegionWidth = 0;
+    int m_RegionHeight = 0;
+    RenderImage m_Region;
+    std::vector<uint8_t> m_TileBuffer;
+};
+
+
+#endif //ANDROID_PRJ_GPUIMAGETILEDEXECUTOR_H
@@ -0,0 +1,61 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GPUIMAGETRACER_H
+#define ANDROID_PRJ_GPUIMAGETRACER_H
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+// Events kept per thread, the oldest are overwritten when a thread records more
+#define DEFAULT_TRACE_BUFFER_EVENTS 65536
+
+/**
+ * Records spans of the frame stages into per-thread ring buffers and writes them in the Chrome
+ * trace event format (chrome://tracing, ui.perfetto.dev). Recording takes no locks: every thread
+ * appends to its own buffer, only the first event of a thread registers the buffer. When tracing
+ * is off a span costs one relaxed atomic load.
+ *
+ *     uint64_t begin = GPUImageTracer::beginSpan();
+ *     ...
+ *     GPUImageTracer::endSpan("upload", begin);
+ *
+ * Span names must stay valid until the trace is written, use intern() for built strings.
+ */
+class GPUImageTracer {
+public:
+    static void setEnabled(bool enabled);
+    static bool isEnabled() {
+        return s_Enabled.load(std::memory_order_relaxed);
+    }
+    // Returns 0 when tracing is off
+    static uint64_t beginSpan() {
+        return isEnabled() ? now() : 0;
+    }
+    static void endSpan(const char *name, uint64_t begin) {
+        if (begin != 0) {
+            record(name, begin, now());
+        }
+    }
+    // Tags the following spans of the calling thread with this frame id. Every thread works on its
+    // own frame, e.g. a readback thread is behind the render thread, so each one sets it
+    static void setFrameId(uint64_t frameId);
+    static uint64_t getFrameId();
+    static void setThreadName(const std::string &name);
+    static const char *intern(const std::string &name);
+
+    static std::string toJSON();
+    static bool writeJSON(const std::string &path);
+    static void clear();
+
+private:
+    static uint64_t now();
+    static void record(const char *name, uint64_t begin, uint64_t end);
+
+    static std::atomic<bool> s_Enabled;
+};
+
+
+#endif //ANDROID_PRJ_GPUIMAGETRACER_H
@@ -25,12 +25,22 @@ public:
     void setRenderImage(RenderImage *image);
     void renderTexture(const float *cubeBuffer, const float *textureBuffer);
     void genFBTextures(RenderImage *image);
+    // Whether the image transformed by the MVP matrix covers the whole overlay texture
+    bool coversOutput(const float *cubeBuffer);
+    // Format of the texture the image from setRenderImage is rendered into, RGBA8 by default.
+    // R8 suits grayscale masks, call it before the first setRenderImage.
+    void setOverlayTextureFormat(int format);
     void UpdateMVPMatrix(float x, float y, int angleX, int angleY, float scaleX, float scaleY);
 
     virtual void onInit();
     virtual void onDrawArraysPre();
     virtual void onOutputSizeChanged(int width, int height);
     virtual void onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer);
+    virtual int getInputCount();
+    // A texture set as input 1 replaces the image from setRenderImage and skips the overlay pass
+    virtual void setInputTexture(int index, GLuint textureId, const float *textureBuffer);
+    // The image from setRenderImage is placed with the MVP matrix in output coordinates
+    virtual int getSamplingRadius();
 
 private:
 #define TEXTURE_NUM 3
@@ -40,12 +50,21 @@ private:
     GLuint filterSecondTextureCoordinateAttribute;
     GLuint filterInputTextureUniform2;
 //    GLuint filterSourceTexture2 = 0xFFFFFFFF;
-    GLuint m_ProgramObj;
+    GLuint m_ProgramObj = GL_NONE;
     GLuint m_AttribPositionObj;
     GLuint m_AttribTextureCoordinateObj;
     GLuint glTextureId = 0xFFFFFFFF;
     GLuint glFrameBufferId;
     bool m_ImageLoaded = false;
+    int m_OverlayTextureFormat = TEXTURE_FORMAT_RGBA8;
+    // 叠加图和变换都没变时直接复用上次渲染好的叠加纹理
+    bool m_OverlayDirty = true;
+    float m_OverlayCubeBuffer[8] = { 0.0f };
+    float m_OverlayTextureBuffer[8] = { 0.0f };
+    GLint m_MVPMatrixLoc = -1;
+    GLuint m_InputTexture2 = GL_NONE;
+    float m_InputTexture2CoordinatesBuffer[8] = { 0.0f };
+    GLint m_ImgTypeLoc = -1;
     glm::mat4 m_MVPMatrix;
     GLuint m_TextureIds[TEXTURE_NUM];
     GLuint m_VaoId = -1;
@@ -0,0 +1,125 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_GLYPHCACHE_H
+#define ANDROID_PRJ_GLYPHCACHE_H
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <condition_variable>
+#include <GLES3/gl3.h>
+#include <glm/glm.hpp>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_MODULE_H
+
+#define DEFAULT_GLYPH_PIXEL_SIZE 96
+#define DEFAULT_SDF_PIXEL_SIZE 48
+#define DEFAULT_SDF_SPREAD 6
+#define DEFAULT_GLYPH_ATLAS_SIZE 2048
+#define GLYPH_ATLAS_PADDING 1
+
+// FT_RENDER_MODE_SDF is available since FreeType 2.11
+#if FREETYPE_MAJOR > 2 || (FREETYPE_MAJOR == 2 && FREETYPE_MINOR >= 11)
+#define GLYPH_SDF_SUPPORTED 1
+#endif
+
+enum GlyphRenderMode {
+    GLYPH_RENDER_BITMAP,
+    // Signed distance field, 0.5 is the outline and values grow towards the inside
+    GLYPH_RENDER_SDF
+};
+
+struct Character {
+    glm::vec4 texCoord; // Glyph rect in the atlas texture (left, top, right, bottom)
+    glm::ivec2 size;    // Size of glyph
+    glm::ivec2 bearing;  // Offset from baseline to left/top of glyph
+    GLuint advance;    // Horizontal offset to advance to next glyph
+};
+
+/**
+ * Glyphs are rasterized on first use by a FreeType worker thread and uploaded into
+ * fixed-size cells of a single atlas texture. When the atlas is full the least recently
+ * used glyph is evicted, glyphs used in the current frame are never evicted.
+ * In GLYPH_RENDER_SDF mode the atlas holds distance fields that scale to any text size.
+ * All methods except the constructor must be called on the GL thread.
+ */
+class GlyphCache {
+public:
+    GlyphCache(const std::string &fontPath, int pixelSize = DEFAULT_GLYPH_PIXEL_SIZE,
+               int atlasSize = DEFAULT_GLYPH_ATLAS_SIZE, GlyphRenderMode renderMode = GLYPH_RENDER_BITMAP);
+    ~GlyphCache();
+    bool init();
+    void beginFrame();
+    const Character *getGlyph(uint32_t codePoint);
+    void requestGlyph(uint32_t codePoint);
+    void markUsed(uint32_t codePoint);
+    void waitForPendingGlyphs();
+    uint32_t getGeneration() const;
+    GLuint getTexture() const;
+    int getPixelSize() const;
+    GlyphRenderMode getRenderMode() const;
+    int getSpread() const;
+
+    static void decodeUTF8(const std::string &text, std::vector<uint32_t> &codePoints);
+
+private:
+    enum GlyphState {
+        GLYPH_PENDING,
+        GLYPH_READY
+    };
+    struct GlyphEntry {
+        Character character;
+        GlyphState state;
+        int slot;
+        uint32_t lastUsedFrame;
+        std::list<uint32_t>::iterator lruIter;
+    };
+    struct RasterizedGlyph {
+        uint32_t codePoint;
+        Character character;
+        std::vector<unsigned char> bitmap;
+    };
+
+    void workerLoop();
+    void uploadRasterizedGlyphs();
+    int allocSlot();
+    void touch(GlyphEntry &entry);
+
+    FT_Library m_Library = nullptr;
+    FT_Face m_Face = nullptr;
+    int m_PixelSize;
+    int m_AtlasSize;
+    GlyphRenderMode m_RenderMode;
+    int m_Spread = 0;
+    int m_CellSize = 0;
+    int m_CellsPerRow = 0;
+    GLuint m_AtlasTextureId = GL_NONE;
+
+    // GL thread state
+    std::unordered_map<uint32_t, GlyphEntry> m_Glyphs;
+    std::list<uint32_t> m_Lru;
+    std::vector<int> m_FreeSlots;
+    uint32_t m_Frame = 0;
+    uint32_t m_Generation = 0;
+
+    // Shared with the worker thread
+    std::thread m_Worker;
+    std::mutex m_Lock;
+    std::condition_variable m_Cond;
+    std::condition_variable m_IdleCond;
+    std::deque<uint32_t> m_Requests;
+    std::vector<RasterizedGlyph> m_Results;
+    bool m_Busy = false;
+    bool m_Stop = false;
+};
+
+
+#endif //ANDROID_PRJ_GLYPHCACHE_H
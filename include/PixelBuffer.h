@@ -23,24 +23,33 @@
 
 class PixelBuffer {
 public:
-    PixelBuffer(int width, int height);
+    // shareWith shares textures, buffers and syncs with another PixelBuffer's context, e.g. for an
+    // upload or readback thread. The shared one must be destroyed first.
+    PixelBuffer(int width, int height, PixelBuffer *shareWith = nullptr);
 
     ~PixelBuffer();
+    // False when no OpenGL ES 3.0 context could be created
+    bool isValid() const;
     void setRenderer(GPUImageRenderer *renderer);
     void getRenderImage(RenderImage *dst);
+    // Reads back what the renderer last drew without drawing again
+    void readRenderImage(RenderImage *dst);
     EGLConfig chooseConfig();
     void listConfig();
     int getConfigAttrib(EGLConfig config, int attrib);
+    static EGLDisplay getSurfacelessDisplay();
     void getRenderImageWithFilterApplied(RenderImage *src, RenderImage *dst);
 private:
-    EGLDisplay eglDisplay;
-    EGLConfig *eglConfigs;
-    EGLConfig eglConfig;
-    EGLContext eglContext;
-    EGLSurface eglSurface;
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    EGLConfig *eglConfigs = nullptr;
+    EGLConfig eglConfig = nullptr;
+    EGLContext eglContext = EGL_NO_CONTEXT;
+    EGLSurface eglSurface = EGL_NO_SURFACE;
+    bool m_OwnsDisplay = true;
 
     int m_Width = 0, m_Height = 0;
-    GPUImageRenderer *m_Renderer;
+    GPUImageRenderer *m_Renderer = nullptr;
+    int m_ClientVersion = 3;
     const bool LIST_CONFIGS = false;
     std::thread::id m_ThreadId;
     const char *m_ThreadOwner;
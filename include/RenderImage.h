@@ -4,10 +4,12 @@
 #include <malloc.h>
 #include <string.h>
 #include <unistd.h>
+#include <atomic>
 #include <iostream>
 #include "stdio.h"
 #include "sys/stat.h"
 #include "stdint.h"
+#include "RenderImageCopy.h"
 
 #define IMAGE_FORMAT_RGBA           0x01
 #define IMAGE_FORMAT_NV21           0x02
@@ -93,12 +95,13 @@ public:
         if (image == nullptr || image->planes[0] == nullptr) return;
 
         free(image->planes[0]);
-        image->planes[0] = nullptr;
-        image->planes[1] = nullptr;
-        image->planes[1] = nullptr;
+        for (int i = 0; i < 3; i++) {
+            image->planes[i] = nullptr;
+            image->linesize[i] = 0;
+        }
     }
 
-    static void copyRenderImage(RenderImage *src, RenderImage *dst) {
+    static void copyRenderImage(RenderImage *src, RenderImage *dst, const CopyOptions &options = CopyOptions()) {
 //	    std::cout << "RenderImageUtil::copyRenderImage src[w,h,format]=[%d, %d, %d], dst[w,h,format]=[%d, %d, %d]", src->width, src->height, src->format, dst->width, dst->height, dst->format);
 //        std::cout << "RenderImageUtil::copyRenderImage src[line0,line1,line2]=[%d, %d, %d], dst[line0,line1,line2]=[%d, %d, %d]", src->linesize[0], src->linesize[1], src->linesize[2], dst->linesize[0], dst->linesize[1], dst->linesize[2]);
 
@@ -113,86 +116,49 @@ public:
 
         if (dst->planes[0] == nullptr) allocRenderImage(dst);
 
+        int planeCount = 0;
         switch (src->format) {
-            case IMAGE_FORMAT_I420: {
-                // y plane
-                if (src->linesize[0] != dst->linesize[0]) {
-                    for (int i = 0; i < src->height; ++i) {
-                        memcpy(dst->planes[0] + i * dst->linesize[0],
-                               src->planes[0] + i * src->linesize[0], dst->width);
-                    }
-                } else {
-                    memcpy(dst->planes[0], src->planes[0], dst->linesize[0] * src->height);
-                }
-
-                // u plane
-                if (src->linesize[1] != dst->linesize[1]) {
-                    for (int i = 0; i < src->height / 2; ++i) {
-                        memcpy(dst->planes[1] + i * dst->linesize[1],
-                               src->planes[1] + i * src->linesize[1], dst->width / 2);
-                    }
-                } else {
-                    memcpy(dst->planes[1], src->planes[1], dst->linesize[1] * src->height / 2);
-                }
-
-                // v plane
-                if (src->linesize[2] != dst->linesize[2]) {
-                    for (int i = 0; i < src->height / 2; ++i) {
-                        memcpy(dst->planes[2] + i * dst->linesize[2],
-                               src->planes[2] + i * src->linesize[2], dst->width / 2);
-                    }
-                } else {
-                    memcpy(dst->planes[2], src->planes[2], dst->linesize[2] * src->height / 2);
-                }
-            }
+            case IMAGE_FORMAT_I420:
+                planeCount = 3;
                 break;
             case IMAGE_FORMAT_NV21:
-            case IMAGE_FORMAT_NV12: {
-                // y plane
-                if (src->linesize[0] != dst->linesize[0]) {
-                    for (int i = 0; i < src->height; ++i) {
-                        memcpy(dst->planes[0] + i * dst->linesize[0],
-                               src->planes[0] + i * src->linesize[0], dst->width);
-                    }
-                } else {
-                    memcpy(dst->planes[0], src->planes[0], dst->linesize[0] * src->height);
-                }
-
-                // uv plane
-                if (src->linesize[1] != dst->linesize[1]) {
-                    for (int i = 0; i < src->height / 2; ++i) {
-                        memcpy(dst->planes[1] + i * dst->linesize[1],
-                               src->planes[1] + i * src->linesize[1], dst->width);
-                    }
-                } else {
-                    memcpy(dst->planes[1], src->planes[1], dst->linesize[1] * src->height / 2);
-                }
-            }
+            case IMAGE_FORMAT_NV12:
+                planeCount = 2;
                 break;
-            case IMAGE_FORMAT_RGBA: {
-                if (src->linesize[0] != dst->linesize[0]) {
-                    for (int i = 0; i < src->height; ++i) {
-                        memcpy(dst->planes[0] + i * dst->linesize[0],
-                               src->planes[0] + i * src->linesize[0], dst->width * 4);
-                    }
-                } else {
-                    memcpy(dst->planes[0], src->planes[0], src->linesize[0] * src->height);
-                }
-            }
+            case IMAGE_FORMAT_RGBA:
+                planeCount = 1;
                 break;
             default: {
                 std::cout << "RenderImageUtil::copyRenderImage do not support the format. Format = " << src->format << std::endl;
             }
-                break;
+                return;
         }
 
+        // 所有格式都按平面处理，行距不同的逐行拷贝
+        CopyPlane planes[3];
+        for (int i = 0; i < planeCount; i++) {
+            int rowBytes = src->width;
+            if (src->format == IMAGE_FORMAT_RGBA) {
+                rowBytes = src->width * 4;
+            } else if (src->format == IMAGE_FORMAT_I420 && i > 0) {
+                rowBytes = src->width / 2;
+            }
+            planes[i].src = src->planes[i];
+            planes[i].srcLinesize = src->linesize[i] != 0 ? src->linesize[i] : rowBytes;
+            planes[i].dst = dst->planes[i];
+            planes[i].dstLinesize = dst->linesize[i] != 0 ? dst->linesize[i] : rowBytes;
+            planes[i].rowBytes = rowBytes;
+            planes[i].rows = i > 0 ? src->height / 2 : src->height;
+        }
+        RenderImageCopy::copyPlanes(planes, planeCount, options);
     }
 
+    // Blocking, one file per call. RenderImageDumpWriter streams frames from a background thread.
     static void dumpRenderImage(RenderImage *src, const char *fpath, const char *fname) {
         if (src == nullptr || fpath == nullptr || fname == nullptr) return;
 
         if (access(fpath, 0) == -1) {
-            mkdir(fpath, 0666);
+            mkdir(fpath, 0755);
         }
 
         char imgPath[256] = {0};
@@ -215,9 +181,10 @@ public:
                 break;
         }
 
-        static int index = 0;
-        sprintf(imgPath, "%s/IMG_%dx%d_%s_%d.%s", fpath, src->width, src->height, fname,
-                index, ext);
+        // 多个线程同时dump时序号不能重复
+        static std::atomic<int> index(0);
+        snprintf(imgPath, sizeof(imgPath), "%s/IMG_%dx%d_%s_%d.%s", fpath, src->width, src->height, fname,
+                 index++, ext);
 
         FILE *fp = fopen(imgPath, "wb");
 
@@ -0,0 +1,67 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_RENDERIMAGECONVERTER_H
+#define ANDROID_PRJ_RENDERIMAGECONVERTER_H
+
+#include "RenderImage.h"
+
+// Frames with fewer pixels are converted on the calling thread only
+#define CONVERT_PARALLEL_MIN_PIXELS (640 * 480)
+// Rows per band handed to one worker thread
+#define CONVERT_BAND_ROWS 64
+
+// Layouts of packed pixels coming from outside, e.g. OpenCV's BGR
+enum PackedPixelLayout {
+    PACKED_RGB24,
+    PACKED_BGR24,
+    PACKED_RGBA,
+    PACKED_BGRA,
+    PACKED_RGBX,    // Fourth byte is undefined, alpha is set to 255
+    PACKED_BGRX
+};
+
+enum ColorMatrix {
+    COLOR_MATRIX_BT601,
+    COLOR_MATRIX_BT709
+};
+
+enum ConvertSimdLevel {
+    CONVERT_SIMD_SCALAR,
+    CONVERT_SIMD_SSSE3,
+    CONVERT_SIMD_AVX2,
+    CONVERT_SIMD_NEON
+};
+
+struct ConvertOptions {
+    ColorMatrix matrix = COLOR_MATRIX_BT601;
+    bool fullRange = false;     // YUV uses 0-255 instead of 16-235/240
+    int threads = 0;            // 0 for one per core, 1 for the calling thread only
+};
+
+/**
+ * CPU conversions between the RenderImage formats (RGBA, NV12, NV21, I420) in any direction, and
+ * from packed RGB/BGR buffers to RGBA. YUV is 4:2:0 with BT.601 or BT.709 coefficients in 6-8 bit
+ * fixed point; chroma is the rounded average of each 2x2 block. Row kernels use SSSE3/AVX2 on x86
+ * (picked at run time) and NEON on ARM, and give the same bytes as the scalar ones. Frames of at
+ * least CONVERT_PARALLEL_MIN_PIXELS are split into row bands on WorkerPool threads.
+ * Both images must be allocated with the same size; YUV sizes must be even.
+ */
+class RenderImageConverter {
+public:
+    static bool convert(const RenderImage *src, RenderImage *dst, const ConvertOptions &options = ConvertOptions());
+    // src holds height rows of width pixels, linesize bytes apart. dst must be RGBA.
+    static bool convertPacked(const uint8_t *src, int linesize, PackedPixelLayout layout, RenderImage *dst,
+                              const ConvertOptions &options = ConvertOptions());
+
+    // Best level this CPU supports
+    static ConvertSimdLevel getSupportedSimdLevel();
+    // Kernels used from now on, levels above the supported one are lowered. For benchmarks and tests.
+    static void setSimdLevel(ConvertSimdLevel level);
+    static ConvertSimdLevel getSimdLevel();
+    static const char *getSimdLevelName(ConvertSimdLevel level);
+};
+
+
+#endif //ANDROID_PRJ_RENDERIMAGECONVERTER_H
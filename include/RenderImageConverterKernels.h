@@ -0,0 +1,69 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_RENDERIMAGECONVERTERKERNELS_H
+#define ANDROID_PRJ_RENDERIMAGECONVERTERKERNELS_H
+
+#include <stdint.h>
+#include "RenderImageConverter.h"
+
+// Row kernels behind RenderImageConverter, only used by its implementation files.
+
+// 6-bit fixed point: c = Y - yOffset, d = U - 128, e = V - 128
+// R = (yScale*c + rV*e + 32) >> 6, G = (yScale*c - gU*d - gV*e + 32) >> 6, B = (yScale*c + bU*d + 32) >> 6
+// Every term fits int16; a sum past int16 is far above 255, so saturating SIMD adds clamp the same
+struct YuvToRgbCoeffs {
+    int16_t yOffset;
+    int16_t yScale;
+    int16_t rV;
+    int16_t gU;
+    int16_t gV;
+    int16_t bU;
+};
+
+// Per R, G, B, A byte: Y = ((y . rgba + 128) >> 8) + yOffset in 8-bit fixed point, the rows
+// sum to 220 (limited) or 256 (full) so white is exactly 235/255. U = ((u . rgba + 64) >> 7) + 128
+// and V likewise in 7-bit fixed point, magnitudes below 128 for pmaddubsw.
+struct RgbToYuvCoeffs {
+    uint8_t y[4];
+    int8_t u[4];
+    int8_t v[4];
+    uint8_t yOffset;
+};
+
+struct ConvertKernels {
+    // width pixels of layout to RGBA
+    void (*packedToRgba)(const uint8_t *src, uint8_t *dst, int width, PackedPixelLayout layout);
+    // width chroma pairs
+    void (*uvSplit)(const uint8_t *uv, uint8_t *u, uint8_t *v, int width);
+    void (*uvMerge)(const uint8_t *u, const uint8_t *v, uint8_t *uv, int width);
+    void (*uvSwap)(const uint8_t *src, uint8_t *dst, int width);
+    // One row of width (even) pixels, u and v are uvStep bytes apart per sample: 1 planar, 2 NV12/NV21
+    void (*yuvToRgba)(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep, uint8_t *dst, int width,
+                      const YuvToRgbCoeffs *coeffs);
+    void (*rgbaToY)(const uint8_t *rgba, uint8_t *y, int width, const RgbToYuvCoeffs *coeffs);
+    // Chroma of the 2x2 blocks of two RGBA rows of width (even) pixels
+    void (*rgbaToUV)(const uint8_t *row0, const uint8_t *row1, uint8_t *u, uint8_t *v, int uvStep, int width,
+                     const RgbToYuvCoeffs *coeffs);
+};
+
+void getScalarConvertKernels(ConvertKernels *kernels);
+// Override the kernels they have, return false when not built for this architecture
+bool getSSSE3ConvertKernels(ConvertKernels *kernels);
+bool getAVX2ConvertKernels(ConvertKernels *kernels);
+bool getNEONConvertKernels(ConvertKernels *kernels);
+
+// Scalar versions, the SIMD kernels finish row tails with them
+void scalarPackedToRgba(const uint8_t *src, uint8_t *dst, int width, PackedPixelLayout layout);
+void scalarUVSplit(const uint8_t *uv, uint8_t *u, uint8_t *v, int width);
+void scalarUVMerge(const uint8_t *u, const uint8_t *v, uint8_t *uv, int width);
+void scalarUVSwap(const uint8_t *src, uint8_t *dst, int width);
+void scalarYuvToRgba(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep, uint8_t *dst, int width,
+                     const YuvToRgbCoeffs *coeffs);
+void scalarRgbaToY(const uint8_t *rgba, uint8_t *y, int width, const RgbToYuvCoeffs *coeffs);
+void scalarRgbaToUV(const uint8_t *row0, const uint8_t *row1, uint8_t *u, uint8_t *v, int uvStep, int width,
+                    const RgbToYuvCoeffs *coeffs);
+
+
+#endif //ANDROID_PRJ_RENDERIMAGECONVERTERKERNELS_H
@@ -0,0 +1,49 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_RENDERIMAGECOPY_H
+#define ANDROID_PRJ_RENDERIMAGECOPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Copies with fewer bytes run on the calling thread only
+#define COPY_PARALLEL_MIN_BYTES (1 << 20)
+// Bytes per task handed to one worker thread
+#define COPY_BAND_BYTES (512 << 10)
+// Last level cache size assumed when the system does not report one
+#define DEFAULT_LLC_SIZE (8 << 20)
+
+// One plane: rows of rowBytes, each linesize bytes after the previous one
+struct CopyPlane {
+    const uint8_t *src;
+    int srcLinesize;
+    uint8_t *dst;
+    int dstLinesize;
+    int rowBytes;
+    int rows;
+};
+
+struct CopyOptions {
+    int threads = 0;            // 0 for one per core, 1 for the calling thread only
+    int nonTemporal = 0;        // 0 memcpy, 1 non-temporal stores, -1 only when larger than the last level cache
+};
+
+/**
+ * Bandwidth bound copy of image planes behind RenderImageUtil::copyRenderImage. Planes whose
+ * rows are tight on both sides are copied as one block, others row by row, and large copies are
+ * split into COPY_BAND_BYTES tasks on WorkerPool threads. Stores are plain memcpy unless the caller
+ * opts into non-temporal stores, which on x86 keep a destination that is not read back soon from
+ * evicting what the pipeline is working on; elsewhere they fall back to memcpy. They only pay off
+ * when the copy is much larger than the cache and the destination goes cold, so measure first.
+ */
+class RenderImageCopy {
+public:
+    static void copyPlanes(const CopyPlane *planes, int count, const CopyOptions &options = CopyOptions());
+    // Size of the last level cache in bytes, read once from the system
+    static size_t getLastLevelCacheSize();
+};
+
+
+#endif //ANDROID_PRJ_RENDERIMAGECOPY_H
@@ -0,0 +1,88 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_RENDERIMAGEDUMPWRITER_H
+#define ANDROID_PRJ_RENDERIMAGEDUMPWRITER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "RenderImage.h"
+#include "RenderImagePool.h"
+#include "BoundedQueue.h"
+
+#define DEFAULT_DUMP_QUEUE_SIZE 8
+// Offset, size and buffer alignment O_DIRECT needs on common filesystems
+#define DUMP_DIRECT_IO_ALIGNMENT 4096
+
+enum DumpContainer {
+    DUMP_CONTAINER_Y4M,         // One .y4m stream, every format is stored as I420
+    DUMP_CONTAINER_RAW,         // Frames back to back in their own format with tight rows
+    DUMP_CONTAINER_SEQUENCE     // One file per frame in a directory, named like dumpRenderImage
+};
+
+struct DumpWriterOptions {
+    DumpContainer container = DUMP_CONTAINER_Y4M;
+    int queueSize = DEFAULT_DUMP_QUEUE_SIZE;
+    bool dropWhenFull = true;   // false makes write() wait for the disk instead of dropping the frame
+    bool directIO = false;      // O_DIRECT, falls back to buffered writes where the filesystem refuses
+    int fpsNum = 30;            // Frame rate written to the Y4M header
+    int fpsDen = 1;
+};
+
+struct DumpWriterStats {
+    uint64_t queued;
+    uint64_t written;
+    uint64_t dropped;           // Queue full, or a size/format change in a single file stream
+    uint64_t bytesWritten;
+};
+
+class DumpFile;
+
+/**
+ * Writes frames to disk on its own thread so debug captures can stay on while the render thread
+ * runs at full rate. write() copies the frame into a pooled buffer and queues it; when the
+ * queue is full the frame is dropped (or, without dropWhenFull, write waits). The writer thread
+ * packs the rows into an aligned staging buffer and issues large write(2)s, with O_DIRECT the
+ * page cache is bypassed and the file is truncated to its real size on close.
+ * Y4M and raw streams keep the size and format of the first frame. write() is meant for one
+ * producer thread; close() or the destructor flushes everything queued.
+ */
+class RenderImageDumpWriter {
+public:
+    RenderImageDumpWriter(const std::string &path, const DumpWriterOptions &options = DumpWriterOptions());
+    ~RenderImageDumpWriter();
+
+    bool isValid() const;
+    bool write(const RenderImage *image);
+    void close();
+    DumpWriterStats getStats() const;
+
+    // .y4m for Y4M, .yuv/.rgba/.raw for raw, anything else is a directory
+    static DumpContainer getContainerForPath(const std::string &path);
+
+private:
+    void writerLoop();
+    bool writeFrame(const RenderImage *image);
+
+    std::string m_Path;
+    DumpWriterOptions m_Options;
+    bool m_Valid = false;
+    bool m_Closed = false;
+    int m_Width = 0;
+    int m_Height = 0;
+    int m_Format = 0;
+    RenderImagePool m_Pool;
+    BoundedQueue<RenderImage *> m_Queue;
+    std::thread m_Thread;
+    DumpFile *m_File = nullptr;     // Writer thread only
+    uint64_t m_FrameIndex = 0;
+    std::atomic<uint64_t> m_Queued{0};
+    std::atomic<uint64_t> m_Written{0};
+    std::atomic<uint64_t> m_Dropped{0};
+    std::atomic<uint64_t> m_BytesWritten{0};
+};
+
+
+#endif //ANDROID_PRJ_RENDERIMAGEDUMPWRITER_H
@@ -0,0 +1,60 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_RENDERIMAGEFILESOURCE_H
+#define ANDROID_PRJ_RENDERIMAGEFILESOURCE_H
+
+#include <string>
+#include <vector>
+#include "RenderImage.h"
+
+// Frames after the current one the kernel is asked to read ahead
+#define DEFAULT_SOURCE_READAHEAD_FRAMES 4
+
+/**
+ * Y4M or raw video file mapped read-only, every frame handed out as a RenderImage whose planes
+ * point into the mapping, so there is no read() copy and no per-frame buffer. The mapping is
+ * marked sequential and the next frames are requested with MADV_WILLNEED, so the kernel keeps
+ * reading while the GPU works.
+ * Y4M supports the 4:2:0 chroma types (C420, C420jpeg, C420mpeg2, C420paldv), read as I420. Raw
+ * files are frames back to back in one format with tight rows, as RenderImageDumpWriter writes
+ * them. Views stay valid until the source is destroyed; the pages are read-only.
+ */
+class RenderImageFileSource {
+public:
+    // Y4M, the size and format come from the header
+    RenderImageFileSource(const std::string &path);
+    // Raw frames of the given format and size
+    RenderImageFileSource(const std::string &path, int format, int width, int height);
+    ~RenderImageFileSource();
+
+    bool isValid() const;
+    int getFrameCount() const;
+    int getWidth() const;
+    int getHeight() const;
+    int getFormat() const;
+    // Sets image to a view of frame index, false when out of range
+    bool getFrame(int index, RenderImage *image);
+    void setReadahead(int frames);
+
+    // Bytes of one frame with tight rows
+    static size_t getFrameSize(int format, int width, int height);
+
+private:
+    bool map(const std::string &path);
+    bool parseY4M();
+
+    uint8_t *m_Data = nullptr;
+    size_t m_Size = 0;
+    int m_Width = 0;
+    int m_Height = 0;
+    int m_Format = 0;
+    size_t m_FrameSize = 0;
+    std::vector<size_t> m_FrameOffsets;
+    int m_Readahead = DEFAULT_SOURCE_READAHEAD_FRAMES;
+    int m_AdvisedUntil = 0;     // Frames before this were already requested
+};
+
+
+#endif //ANDROID_PRJ_RENDERIMAGEFILESOURCE_H
@@ -0,0 +1,76 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_RENDERIMAGEHANDLE_H
+#define ANDROID_PRJ_RENDERIMAGEHANDLE_H
+
+#include <memory>
+#include "RenderImage.h"
+#include "RenderImagePool.h"
+
+// One plane of an image, width is in pixels of bytesPerPixel bytes
+struct RenderImagePlane {
+    uint8_t *data;
+    int linesize;
+    int width;
+    int height;
+    int bytesPerPixel;
+};
+
+/**
+ * Owns an image buffer and exposes it as a RenderImage, so frames can be handed to
+ * GPUImageRenderer::setRenderImage and the other RenderImage APIs through get() without copies.
+ * A handle is move-only; the buffer is freed (or returned to its RenderImagePool) when the last
+ * handle referencing it goes away. share() and crop() create further handles on the same buffer
+ * and keep it alive through a reference count, the pixels are never copied. A handle made by
+ * wrap() only views memory owned by someone else.
+ */
+class RenderImageHandle {
+public:
+    RenderImageHandle();
+    ~RenderImageHandle();
+    RenderImageHandle(RenderImageHandle &&other) noexcept;
+    RenderImageHandle &operator=(RenderImageHandle &&other) noexcept;
+    RenderImageHandle(const RenderImageHandle &) = delete;
+    RenderImageHandle &operator=(const RenderImageHandle &) = delete;
+
+    // New buffer with RenderImagePool's aligned layout, empty when format or size is invalid
+    static RenderImageHandle allocate(int format, int width, int height);
+    // Buffer from pool, released back to it with the last handle. The pool must outlive the handles.
+    static RenderImageHandle fromPool(RenderImagePool *pool, int format, int width, int height);
+    // Takes over a buffer from RenderImageUtil::allocRenderImage and clears image
+    static RenderImageHandle adopt(RenderImage *image);
+    // View of memory the caller keeps alive for as long as the handle is used
+    static RenderImageHandle wrap(const RenderImage &image);
+
+    // Another handle on the same buffer
+    RenderImageHandle share() const;
+    // View of the (x, y, width, height) region on the same buffer, even coordinates and size for YUV
+    RenderImageHandle crop(int x, int y, int width, int height) const;
+    RenderImagePlane plane(int index) const;
+    // Deep copy into a new buffer
+    RenderImageHandle clone() const;
+    // Drops this handle's reference and leaves it empty
+    void reset();
+
+    bool empty() const;
+    // Handles sharing the buffer, 0 for wrapped or empty handles
+    long useCount() const;
+    int getFormat() const;
+    int getWidth() const;
+    int getHeight() const;
+    RenderImage *get();
+    const RenderImage *get() const;
+
+    static int getPlaneCount(int format);
+
+private:
+    RenderImageHandle(const RenderImage &image, const std::shared_ptr<void> &owner);
+
+    RenderImage m_Image;
+    std::shared_ptr<void> m_Owner;      // Frees the buffer, nullptr for views of external memory
+};
+
+
+#endif //ANDROID_PRJ_RENDERIMAGEHANDLE_H
@@ -0,0 +1,91 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_RENDERIMAGEPOOL_H
+#define ANDROID_PRJ_RENDERIMAGEPOOL_H
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include "RenderImage.h"
+
+// Planes start and rows are padded to a cache line, enough for AVX-512 loads and most DMA engines
+#define RENDER_IMAGE_ALIGNMENT 64
+// Free buffers kept per (format, width, height), more are returned to the system on release
+#define DEFAULT_POOL_MAX_FREE_PER_KEY 4
+#define POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+struct RenderImagePoolStats {
+    uint64_t acquired;
+    uint64_t allocated;     // Acquires that had to allocate, the rest reused a free buffer
+    uint64_t released;
+    size_t bytesInUse;
+    size_t bytesFree;
+};
+
+/**
+ * Recycles image buffers between frames so that pipelines stop paying malloc/free and the page
+ * faults of touching fresh multi-megabyte buffers every frame. Buffers are kept per
+ * (format, width, height). Every plane starts on a RENDER_IMAGE_ALIGNMENT boundary and every row
+ * is padded to one, see alignLinesize. With hugePages, buffers of at least POOL_HUGE_PAGE_SIZE
+ * are mmapped on huge pages (hugetlbfs when configured, transparent huge pages otherwise), which
+ * cuts TLB misses on 4K/8K frames.
+ * acquire and release may be called from any thread, so a producer can acquire and the render
+ * thread release, e.g. from GPUImageFrameScheduler's release callback. Release every image
+ * before the pool is destroyed. Once every (format, width, height) has been seen, acquire and
+ * release do not allocate: the buffer is found from the image pointer and in-use buffers are
+ * kept on an intrusive list.
+ */
+class RenderImagePool {
+public:
+    RenderImagePool(int maxFreePerKey = DEFAULT_POOL_MAX_FREE_PER_KEY, bool hugePages = false);
+    ~RenderImagePool();
+
+    // Returns an image with planes and linesize set, the content is undefined. nullptr for an
+    // unsupported format or size.
+    RenderImage *acquire(int format, int width, int height);
+    // Hands an image from acquire back to the pool, it must not be used afterwards. Only images
+    // returned by acquire may be passed in.
+    void release(RenderImage *image);
+    // Frees all buffers not in use, the bookkeeping keeps its capacity
+    void trim();
+    RenderImagePoolStats getStats() const;
+
+    // Row stride for rowBytes: rounded up to RENDER_IMAGE_ALIGNMENT, plus one more alignment unit
+    // when that is a multiple of 4096, otherwise vertically adjacent pixels map to the same cache
+    // set and column walks (vertical blur, rotation) keep evicting each other.
+    static int alignLinesize(int rowBytes);
+    // Sets the planes of image (format, width and height set) inside base with aligned strides,
+    // returns the bytes needed. base nullptr only computes the size.
+    static size_t layoutRenderImage(RenderImage *image, uint8_t *base);
+
+private:
+    // image must stay the first member, release gets back to the buffer from its address
+    struct PoolBuffer {
+        RenderImage image;
+        uint64_t key;
+        uint8_t *base;
+        size_t size;
+        bool mapped;    // mmap instead of posix_memalign
+        RenderImagePool *owner;
+        bool inUse;
+        PoolBuffer *prev;   // In-use list
+        PoolBuffer *next;
+    };
+
+    static uint64_t makeKey(int format, int width, int height);
+    PoolBuffer *allocBuffer(int format, int width, int height);
+    static void freeBuffer(PoolBuffer *buffer);
+
+    int m_MaxFreePerKey;
+    bool m_HugePages;
+    std::map<uint64_t, std::vector<PoolBuffer *>> m_FreeBuffers;
+    PoolBuffer *m_InUse = nullptr;
+    size_t m_InUseCount = 0;
+    RenderImagePoolStats m_Stats;
+    mutable std::mutex m_Lock;
+};
+
+
+#endif //ANDROID_PRJ_RENDERIMAGEPOOL_H
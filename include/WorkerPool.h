@@ -0,0 +1,61 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_WORKERPOOL_H
+#define ANDROID_PRJ_WORKERPOOL_H
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+/**
+ * Persistent CPU threads for splitting one frame's work (conversions, copies) into bands.
+ * Starting threads per frame costs more than converting a 1080p band, so they are created once
+ * and sleep between jobs. The calling thread works on the job too. One job runs at a time, a
+ * second caller waits for the first.
+ */
+class WorkerPool {
+public:
+    // Shared pool with one thread per core
+    static WorkerPool &getInstance();
+
+    WorkerPool(int threadCount);
+    ~WorkerPool();
+
+    // Calls task(index) for index in [0, count) on up to maxThreads threads (0 for all) and
+    // returns when all are done. task is called through a pointer, not copied into a
+    // std::function, so a job does not allocate.
+    template<typename Task>
+    void parallelFor(int count, int maxThreads, const Task &task) {
+        run(count, maxThreads, [](const void *context, int index) { (*(const Task *) context)(index); }, &task);
+    }
+    int getThreadCount() const;
+
+private:
+    typedef void (*TaskFunction)(const void *context, int index);
+
+    void run(int count, int maxThreads, TaskFunction task, const void *context);
+    void workerLoop(int worker);
+    void runTasks();
+
+    std::vector<std::thread> m_Threads;
+    std::mutex m_JobLock;           // Serializes parallelFor callers
+    std::mutex m_Lock;
+    std::condition_variable m_JobReady;
+    std::condition_variable m_JobDone;
+    TaskFunction m_Task = nullptr;
+    const void *m_TaskContext = nullptr;
+    int m_TaskCount = 0;
+    int m_Workers = 0;              // Threads taking part in the current job
+    std::atomic<int> m_NextTask{0};
+    int m_ActiveWorkers = 0;
+    bool m_JobOpen = false;
+    uint64_t m_Generation = 0;
+    bool m_Stopped = false;
+};
+
+
+#endif //ANDROID_PRJ_WORKERPOOL_H
@@ -0,0 +1,70 @@
+//
+// Created by liyang on 26-10-18.
+//
+
+#ifndef ANDROID_PRJ_TESTUTIL_H
+#define ANDROID_PRJ_TESTUTIL_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "PixelBuffer.h"
+#include "GPUImageRenderer.h"
+#include "RenderImage.h"
+
+// Minimal checks for the test executables, every failure is printed and main returns the count
+static int g_TestFailures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            g_TestFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+        long long checkActual = (long long) (actual); \
+        long long checkExpected = (long long) (expected); \
+        if (checkActual != checkExpected) { \
+            printf("%s:%d: CHECK_EQ failed: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+                   checkActual, checkExpected); \
+            g_TestFailures++; \
+        } \
+    } while (0)
+
+static int testResult(const char *name) {
+    printf("%s: %s (%d failures)\n", name, g_TestFailures == 0 ? "PASS" : "FAIL", g_TestFailures);
+    return g_TestFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Renders input through filter once (twice, like PixelBuffer::getRenderImage) and returns the
+// RGBA output top-down. The renderer takes ownership of filter.
+inline std::vector<uint8_t> renderFilter(GPUImageFilter *filter, RenderImage *input) {
+    PixelBuffer buffer(input->width, input->height);
+    GPUImageRenderer *renderer = new GPUImageRenderer(filter);
+    buffer.setRenderer(renderer);
+    renderer->setRenderImage(input);
+    RenderImage output;
+    output.format = IMAGE_FORMAT_RGBA;
+    output.width = input->width;
+    output.height = input->height;
+    RenderImageUtil::allocRenderImage(&output);
+    buffer.getRenderImage(&output);
+    std::vector<uint8_t> pixels(output.planes[0], output.planes[0] + (size_t) output.width * output.height * 4);
+    RenderImageUtil::freeRenderImage(&output);
+    return pixels;
+}
+
+inline int maxDifference(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+    if (a.size() != b.size()) {
+        return 256;
+    }
+    int difference = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        difference = std::max(difference, std::abs(a[i] - b[i]));
+    }
+    return difference;
+}
+
+
+#endif //ANDROID_PRJ_TESTUTIL_H
@@ -0,0 +1,186 @@
+//
+// Created by liyang on 26-10-18.
+//
+// Internal scale of groups and graphs (every pass but the last at the reduced size, the last one
+// straight at the output size) and the renderer's dynamic resolution steps and hysteresis, driven
+// by a filter whose CPU cost is proportional to its pixel count.
+//
+
+#include <cmath>
+#include <thread>
+#include <chrono>
+#include "TestUtil.h"
+#include "TextureRotationUtil.h"
+#include "GPUImageFilterGroup.h"
+#include "GPUImageFilterGraph.h"
+#include "../bench/BenchUtil.h"
+
+#define TEST_WIDTH 160
+#define TEST_HEIGHT 90
+// Cost of the expensive filter at full size and the frame time the renderer has to stay under:
+// scales 1.0 and 0.875 (15.3ms) are over the target, 0.75 (11.25ms) is under it with room for the
+// rest of the frame but too close to step back up
+#define FULL_COST_US 20000
+#define TARGET_FRAME_MS 14.0
+#define CHEAP_COST_US 2000
+// Two step up periods, so a stable scale really is stable even when one slow frame restarted the count
+#define STABLE_FRAMES (DYNAMIC_RESOLUTION_SETTLE_FRAMES + 2 * DYNAMIC_RESOLUTION_UP_FRAMES)
+#define MAX_FRAMES 600
+
+// Pass-through filter that records the viewport it draws with and optionally sleeps for a time
+// proportional to its output size
+class PassFilter : public GPUImageFilter {
+public:
+    PassFilter(const int *fullCostUs = nullptr) : m_FullCostUs(fullCostUs) {}
+
+    virtual void onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer) {
+        glGetIntegerv(GL_VIEWPORT, m_Viewport);
+        if (m_FullCostUs != nullptr) {
+            long costUs = (long) *m_FullCostUs * getOutputWidth() * getOutputHeight() / (TEST_WIDTH * TEST_HEIGHT);
+            std::this_thread::sleep_for(std::chrono::microseconds(costUs));
+        }
+        GPUImageFilter::onDraw(textureId, cubeBuffer, textureBuffer);
+    }
+
+    bool drewAt(int width, int height) const {
+        return m_Viewport[2] == width && m_Viewport[3] == height;
+    }
+
+private:
+    const int *m_FullCostUs;
+    GLint m_Viewport[4] = {0, 0, 0, 0};
+};
+
+static void drawOnce(GPUImageFilter *filter) {
+    filter->ifNeedInit();
+    filter->onOutputSizeChanged(TEST_WIDTH, TEST_HEIGHT);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, TEST_WIDTH, TEST_HEIGHT);
+    filter->onDraw(0, TextureRotationUtil::CUBE, TextureRotationUtil::TEXTURE_NO_ROTATION);
+}
+
+static void testGroupPassSizes() {
+    PassFilter *first = new PassFilter();
+    PassFilter *second = new PassFilter();
+    PassFilter *last = new PassFilter();
+    GPUImageFilterGroup group;
+    group.addFilter(first);
+    group.addFilter(second);
+    group.addFilter(last);
+    group.setInternalScale(0.5f);
+    drawOnce(&group);
+    // 只有最后一个滤镜画在输出尺寸上，也没有额外的放大pass
+    CHECK(first->drewAt(TEST_WIDTH / 2, TEST_HEIGHT / 2));
+    CHECK(second->drewAt(TEST_WIDTH / 2, TEST_HEIGHT / 2));
+    CHECK(last->drewAt(TEST_WIDTH, TEST_HEIGHT));
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    CHECK(viewport[2] == TEST_WIDTH && viewport[3] == TEST_HEIGHT);
+
+    group.setInternalScale(1.0f);
+    drawOnce(&group);
+    CHECK(first->drewAt(TEST_WIDTH, TEST_HEIGHT));
+    CHECK(last->drewAt(TEST_WIDTH, TEST_HEIGHT));
+}
+
+static void testGraphPassSizes() {
+    // 组的最后一个滤镜是滤镜图时比例传给它，图里除了输出节点都缩小
+    PassFilter *node = new PassFilter();
+    PassFilter *output = new PassFilter();
+    GPUImageFilterGraph *graph = new GPUImageFilterGraph();
+    int a = graph->addFilter(node);
+    int b = graph->addFilter(output);
+    graph->connect(GRAPH_INPUT_NODE, a);
+    graph->connect(a, b);
+    graph->setOutputNode(b);
+    PassFilter *first = new PassFilter();
+    GPUImageFilterGroup group;
+    group.addFilter(first);
+    group.addFilter(graph);
+    group.setInternalScale(0.5f);
+    drawOnce(&group);
+    CHECK(first->drewAt(TEST_WIDTH / 2, TEST_HEIGHT / 2));
+    CHECK(node->drewAt(TEST_WIDTH / 2, TEST_HEIGHT / 2));
+    CHECK(output->drewAt(TEST_WIDTH, TEST_HEIGHT));
+}
+
+// Draws until the scale has not changed for STABLE_FRAMES frames and returns the scales seen,
+// one per change
+static std::vector<float> runUntilStable(GPUImageRenderer *renderer, RenderImage *input, PassFilter *costFilter,
+                                         PassFilter *lastFilter) {
+    std::vector<float> scales(1, renderer->getInternalScale());
+    int stableFrames = 0;
+    for (int i = 0; i < MAX_FRAMES && stableFrames < STABLE_FRAMES; i++) {
+        // 新的比例从下一帧开始生效
+        float drawScale = renderer->getInternalScale();
+        renderer->setRenderImage(input);
+        renderer->onDrawFrame();
+        // 贵的滤镜跟着比例缩小，最后一个一直是输出尺寸
+        int width = std::max(1, (int) std::lround(TEST_WIDTH * drawScale));
+        int height = std::max(1, (int) std::lround(TEST_HEIGHT * drawScale));
+        CHECK(costFilter->drewAt(width, height));
+        CHECK(lastFilter->drewAt(TEST_WIDTH, TEST_HEIGHT));
+        float scale = renderer->getInternalScale();
+        if (scale != scales.back()) {
+            scales.push_back(scale);
+            stableFrames = 0;
+        } else {
+            stableFrames++;
+        }
+    }
+    CHECK(stableFrames >= STABLE_FRAMES);
+    return scales;
+}
+
+static void testHysteresis(RenderImage *input) {
+    int fullCostUs = FULL_COST_US;
+    PassFilter *costFilter = new PassFilter(&fullCostUs);
+    PassFilter *lastFilter = new PassFilter();
+    GPUImageFilterGroup *group = new GPUImageFilterGroup();
+    group->addFilter(costFilter);
+    group->addFilter(lastFilter);
+
+    PixelBuffer buffer(TEST_WIDTH, TEST_HEIGHT);
+    GPUImageRenderer *renderer = new GPUImageRenderer(group);
+    buffer.setRenderer(renderer);
+    renderer->setDynamicResolution(true, TARGET_FRAME_MS);
+
+    // 超出目标时一步一步缩小，到0.75后耗时在目标以下但放大后会超，停在这里不来回跳
+    std::vector<float> down = runUntilStable(renderer, input, costFilter, lastFilter);
+    CHECK_EQ(down.size(), 3);
+    CHECK(down.back() == 1.0f - 2 * DYNAMIC_RESOLUTION_STEP);
+    for (int i = 1; i < (int) down.size(); i++) {
+        CHECK(down[i] == down[i - 1] - DYNAMIC_RESOLUTION_STEP);
+    }
+
+    // 变便宜后逐步放大回全尺寸，中间不再缩小
+    fullCostUs = CHEAP_COST_US;
+    std::vector<float> up = runUntilStable(renderer, input, costFilter, lastFilter);
+    CHECK(up.back() == 1.0f);
+    for (int i = 1; i < (int) up.size(); i++) {
+        CHECK(up[i] == up[i - 1] + DYNAMIC_RESOLUTION_STEP);
+    }
+
+    // 关掉后立即回到全尺寸
+    renderer->setDynamicResolution(false, 0.0);
+    renderer->onDrawFrame();
+    CHECK(renderer->getInternalScale() == 1.0f);
+}
+
+int main() {
+    RenderImage input;
+    input.format = IMAGE_FORMAT_RGBA;
+    input.width = TEST_WIDTH;
+    input.height = TEST_HEIGHT;
+    RenderImageUtil::allocRenderImage(&input);
+    fillTestImage(&input);
+    {
+        PixelBuffer buffer(TEST_WIDTH, TEST_HEIGHT);
+        testGroupPassSizes();
+        testGraphPassSizes();
+    }
+    testHysteresis(&input);
+
+    RenderImageUtil::freeRenderImage(&input);
+    return testResult("gpu_filter_dynres_test");
+}
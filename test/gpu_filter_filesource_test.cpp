@@ -0,0 +1,171 @@
+//
+// Created by liyang on 26-10-18.
+//
+// RenderImageDumpWriter -> RenderImageFileSource round trip: frames with padded rows are written
+// as Y4M and raw streams and every plane read back through the mapping must match. Widths are
+// odd for RGBA and give odd chroma widths for YUV.
+//
+
+#include <string>
+#include <unistd.h>
+#include "TestUtil.h"
+#include "RenderImageDumpWriter.h"
+#include "RenderImageFileSource.h"
+
+#define TEST_FRAMES 5
+#define TEST_RGBA_WIDTH 333
+#define TEST_RGBA_HEIGHT 17
+#define TEST_YUV_WIDTH 322
+#define TEST_YUV_HEIGHT 178
+// Bytes added to every row of the written frames
+#define TEST_ROW_PADDING 52
+#define TEST_PADDING_VALUE 0xee
+
+static int planeCount(int format) {
+    return format == IMAGE_FORMAT_RGBA ? 1 : (format == IMAGE_FORMAT_I420 ? 3 : 2);
+}
+
+static int planeRowBytes(int format, int width, int plane) {
+    if (format == IMAGE_FORMAT_RGBA) {
+        return width * 4;
+    }
+    return plane > 0 && format == IMAGE_FORMAT_I420 ? width / 2 : width;
+}
+
+static int planeRows(int height, int plane) {
+    return plane > 0 ? height / 2 : height;
+}
+
+static uint8_t pixelValue(int frame, int plane, int x, int y) {
+    return (uint8_t) (x * 7 + y * 13 + frame * 31 + plane * 17);
+}
+
+// Frame with TEST_ROW_PADDING bytes after every row, the padding must never reach the file
+class PaddedFrame {
+public:
+    PaddedFrame(int format, int width, int height) {
+        image.format = format;
+        image.width = width;
+        image.height = height;
+        size_t size = 0;
+        for (int i = 0; i < planeCount(format); i++) {
+            image.linesize[i] = planeRowBytes(format, width, i) + TEST_ROW_PADDING;
+            size += (size_t) image.linesize[i] * planeRows(height, i);
+        }
+        m_Data.assign(size, TEST_PADDING_VALUE);
+        size_t offset = 0;
+        for (int i = 0; i < planeCount(format); i++) {
+            image.planes[i] = m_Data.data() + offset;
+            offset += (size_t) image.linesize[i] * planeRows(height, i);
+        }
+    }
+
+    void fill(int frame) {
+        for (int i = 0; i < planeCount(image.format); i++) {
+            for (int y = 0; y < planeRows(image.height, i); y++) {
+                uint8_t *row = image.planes[i] + (size_t) y * image.linesize[i];
+                for (int x = 0; x < planeRowBytes(image.format, image.width, i); x++) {
+                    row[x] = pixelValue(frame, i, x, y);
+                }
+            }
+        }
+    }
+
+    RenderImage image;
+
+private:
+    std::vector<uint8_t> m_Data;
+};
+
+// Bytes of frame read back that differ from what was written, NV12 in Y4M comes back as I420
+static int countMismatches(const RenderImage *read, int writtenFormat, int frame) {
+    int mismatches = 0;
+    for (int i = 0; i < planeCount(read->format); i++) {
+        int rowBytes = planeRowBytes(read->format, read->width, i);
+        for (int y = 0; y < planeRows(read->height, i); y++) {
+            const uint8_t *row = read->planes[i] + (size_t) y * read->linesize[i];
+            for (int x = 0; x < rowBytes; x++) {
+                uint8_t expected = pixelValue(frame, i, x, y);
+                if (writtenFormat == IMAGE_FORMAT_NV12 && read->format == IMAGE_FORMAT_I420 && i > 0) {
+                    // UV交错的平面拆成了U和V
+                    expected = pixelValue(frame, 1, x * 2 + (i - 1), y);
+                }
+                mismatches += row[x] != expected;
+            }
+        }
+    }
+    return mismatches;
+}
+
+static void testRoundTrip(const std::string &path, int format, int width, int height, DumpContainer container,
+                          bool directIO) {
+    DumpWriterOptions options;
+    options.container = container;
+    options.dropWhenFull = false;
+    options.directIO = directIO;
+    {
+        RenderImageDumpWriter writer(path, options);
+        CHECK(writer.isValid());
+        PaddedFrame frame(format, width, height);
+        for (int i = 0; i < TEST_FRAMES; i++) {
+            frame.fill(i);
+            CHECK(writer.write(&frame.image));
+        }
+        writer.close();
+        DumpWriterStats stats = writer.getStats();
+        CHECK_EQ(stats.written, TEST_FRAMES);
+        CHECK_EQ(stats.dropped, 0);
+    }
+
+    bool y4m = container == DUMP_CONTAINER_Y4M;
+    int readFormat = y4m ? IMAGE_FORMAT_I420 : format;
+    RenderImageFileSource *source = y4m ? new RenderImageFileSource(path)
+                                        : new RenderImageFileSource(path, format, width, height);
+    CHECK(source->isValid());
+    CHECK_EQ(source->getFrameCount(), TEST_FRAMES);
+    CHECK_EQ(source->getWidth(), width);
+    CHECK_EQ(source->getHeight(), height);
+    CHECK_EQ(source->getFormat(), readFormat);
+    if (!y4m) {
+        // 没有头，文件里只能是紧凑排列的帧
+        FILE *file = fopen(path.c_str(), "rb");
+        CHECK(file != nullptr);
+        if (file != nullptr) {
+            fseek(file, 0, SEEK_END);
+            CHECK_EQ(ftell(file), (long) RenderImageFileSource::getFrameSize(format, width, height) * TEST_FRAMES);
+            fclose(file);
+        }
+    }
+    for (int i = 0; i < source->getFrameCount(); i++) {
+        RenderImage image;
+        CHECK(source->getFrame(i, &image));
+        int mismatches = countMismatches(&image, format, i);
+        if (mismatches != 0) {
+            printf("%s frame %d: %d bytes differ\n", path.c_str(), i, mismatches);
+        }
+        CHECK_EQ(mismatches, 0);
+    }
+    RenderImage outOfRange;
+    CHECK(!source->getFrame(TEST_FRAMES, &outOfRange));
+    delete source;
+    unlink(path.c_str());
+}
+
+int main() {
+    char directory[] = "/tmp/gpu_filter_filesource_XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        printf("failed to create a temporary directory\n");
+        return EXIT_FAILURE;
+    }
+    std::string base(directory);
+    testRoundTrip(base + "/rgba.rgba", IMAGE_FORMAT_RGBA, TEST_RGBA_WIDTH, TEST_RGBA_HEIGHT, DUMP_CONTAINER_RAW, false);
+    testRoundTrip(base + "/i420.yuv", IMAGE_FORMAT_I420, TEST_YUV_WIDTH, TEST_YUV_HEIGHT, DUMP_CONTAINER_RAW, false);
+    testRoundTrip(base + "/nv12.yuv", IMAGE_FORMAT_NV12, TEST_YUV_WIDTH, TEST_YUV_HEIGHT, DUMP_CONTAINER_RAW, false);
+    testRoundTrip(base + "/i420.y4m", IMAGE_FORMAT_I420, TEST_YUV_WIDTH, TEST_YUV_HEIGHT, DUMP_CONTAINER_Y4M, false);
+    testRoundTrip(base + "/nv12.y4m", IMAGE_FORMAT_NV12, TEST_YUV_WIDTH, TEST_YUV_HEIGHT, DUMP_CONTAINER_Y4M, false);
+    // O_DIRECT写整块再截断到真实大小，文件系统不支持时退回普通写
+    testRoundTrip(base + "/direct.yuv", IMAGE_FORMAT_I420, TEST_YUV_WIDTH, TEST_YUV_HEIGHT, DUMP_CONTAINER_RAW, true);
+    testRoundTrip(base + "/direct.y4m", IMAGE_FORMAT_NV12, TEST_YUV_WIDTH, TEST_YUV_HEIGHT, DUMP_CONTAINER_Y4M, true);
+    rmdir(directory);
+    return testResult("gpu_filter_filesource_test");
+}
@@ -0,0 +1,175 @@
+//
+// Created by liyang on 26-10-18.
+//
+// GPUImageFilterGraph: schedule, liveness based texture slot reuse and multi-input nodes,
+// rendered headless and compared with the equivalent filter group or pipeline.
+//
+
+#include "TestUtil.h"
+#include "GPUImageFilterGroup.h"
+#include "GPUImageFilterGraph.h"
+#include "GPUImagePipelineParser.h"
+#include "GPUImageRGBFilter.h"
+#include "GPUImageGaussianBlurFilter.h"
+#include "GPUImageNormalBlendFilter.h"
+#include "../bench/BenchUtil.h"
+
+#define TEST_WIDTH 160
+#define TEST_HEIGHT 90
+
+// Pass-through filter that counts its draws
+class CountingFilter : public GPUImageFilter {
+public:
+    CountingFilter(int *counter) : m_Counter(counter) {}
+
+    virtual void onDraw(int textureId, const float *cubeBuffer, const float *textureBuffer) {
+        (*m_Counter)++;
+        GPUImageFilter::onDraw(textureId, cubeBuffer, textureBuffer);
+    }
+
+private:
+    int *m_Counter;
+};
+
+static GPUImageFilterGraph *createChain(const std::vector<int> &formats) {
+    GPUImageFilterGraph *graph = new GPUImageFilterGraph();
+    int previous = GRAPH_INPUT_NODE;
+    for (int format : formats) {
+        GPUImageFilter *filter = new GPUImageRGBFilter(1.0f, 0.9f, 0.8f);
+        filter->setOutputTextureFormat(format);
+        int node = graph->addFilter(filter);
+        graph->connect(previous, node);
+        previous = node;
+    }
+    graph->setOutputNode(previous);
+    return graph;
+}
+
+static void testChainMatchesGroup(RenderImage *input) {
+    GPUImageFilterGroup *group = new GPUImageFilterGroup();
+    group->addFilter(new GPUImageRGBFilter(1.0f, 0.5f, 0.5f));
+    group->addFilter(new GPUImageGaussianBlurFilter(2.0f));
+    group->addFilter(new GPUImageRGBFilter(0.8f, 1.0f, 1.0f));
+    std::vector<uint8_t> expected = renderFilter(group, input);
+
+    GPUImageFilterGraph *graph = new GPUImageFilterGraph();
+    int rgb = graph->addFilter(new GPUImageRGBFilter(1.0f, 0.5f, 0.5f));
+    int blur = graph->addFilter(new GPUImageGaussianBlurFilter(2.0f));
+    int tint = graph->addFilter(new GPUImageRGBFilter(0.8f, 1.0f, 1.0f));
+    CHECK(graph->connect(GRAPH_INPUT_NODE, rgb));
+    CHECK(graph->connect(rgb, blur));
+    CHECK(graph->connect(blur, tint));
+    graph->setOutputNode(tint);
+    CHECK_EQ(maxDifference(renderFilter(graph, input), expected), 0);
+}
+
+static void testSlotReuse() {
+    // 链上同时存活的中间结果最多两个
+    GPUImageFilterGraph *chain = createChain({TEXTURE_FORMAT_RGBA8, TEXTURE_FORMAT_RGBA8, TEXTURE_FORMAT_RGBA8,
+                                              TEXTURE_FORMAT_RGBA8, TEXTURE_FORMAT_RGBA8});
+    CHECK(chain->compile());
+    CHECK_EQ(chain->getTextureSlotCount(), 2);
+    delete chain;
+
+    // 格式不同的节点不能共用纹理
+    GPUImageFilterGraph *mixed = createChain({TEXTURE_FORMAT_R8, TEXTURE_FORMAT_RGBA8, TEXTURE_FORMAT_RGBA8,
+                                              TEXTURE_FORMAT_RGBA8});
+    CHECK(mixed->compile());
+    CHECK_EQ(mixed->getTextureSlotCount(), 3);
+    delete mixed;
+
+    // 一个节点没有中间纹理，输出直接画到调用者的FBO
+    GPUImageFilterGraph *single = createChain({TEXTURE_FORMAT_RGBA8});
+    CHECK(single->compile());
+    CHECK_EQ(single->getTextureSlotCount(), 0);
+    delete single;
+}
+
+static void testMultiInput(RenderImage *input) {
+    // null滤镜是恒等的，两种连法结果必须一样
+    GPUImageFilterGraph *direct = GPUImagePipelineParser::parse("[in]rgb=1:0.3:0.3[a]; [a][in]normalblend[out]");
+    GPUImageFilterGraph *diamond = GPUImagePipelineParser::parse(
+            "[in]rgb=1:0.3:0.3[a]; [in]null[b]; [a][b]normalblend[out]");
+    CHECK(direct != nullptr && diamond != nullptr);
+    if (direct == nullptr || diamond == nullptr) {
+        return;
+    }
+    std::vector<uint8_t> expected = renderFilter(direct, input);
+    CHECK_EQ(maxDifference(renderFilter(diamond, input), expected), 0);
+}
+
+static void testSharedAndUnreachableNodes(RenderImage *input) {
+    int sharedDraws = 0;
+    int unreachableDraws = 0;
+    GPUImageFilterGraph *graph = new GPUImageFilterGraph();
+    int shared = graph->addFilter(new CountingFilter(&sharedDraws));
+    int first = graph->addFilter(new GPUImageNormalBlendFilter());
+    int second = graph->addFilter(new GPUImageNormalBlendFilter());
+    int unreachable = graph->addFilter(new CountingFilter(&unreachableDraws));
+    CHECK(graph->connect(GRAPH_INPUT_NODE, shared));
+    CHECK(graph->connect(shared, first, 0));
+    CHECK(graph->connect(GRAPH_INPUT_NODE, first, 1));
+    CHECK(graph->connect(first, second, 0));
+    CHECK(graph->connect(shared, second, 1));
+    CHECK(graph->connect(shared, unreachable));
+    CHECK(!graph->connect(shared, second, 2));
+    CHECK(!graph->connect(42, second, 0));
+    graph->setOutputNode(second);
+    renderFilter(graph, input);
+    // renderFilter画了两帧，被两个节点读的输出每帧只算一次
+    CHECK_EQ(sharedDraws, 2);
+    CHECK_EQ(unreachableDraws, 0);
+}
+
+static void testGroupOutputFormat(RenderImage *input) {
+    // 组上设置的格式决定它最后一个pass写的中间纹理，嵌在别的组里展开后也一样
+    GPUImageFilter *blur = new GPUImageGaussianBlurFilter(2.0f);
+    blur->setOutputTextureFormat(TEXTURE_FORMAT_R8);
+    CHECK_EQ(blur->getOutputTextureFormat(), TEXTURE_FORMAT_R8);
+    GPUImageFilterGroup *group = new GPUImageFilterGroup();
+    group->addFilter(blur);
+    group->addFilter(new GPUImageRGBFilter(1.0f, 1.0f, 1.0f));
+    std::vector<uint8_t> expected = renderFilter(group, input);
+    // R8采样成灰度
+    bool gray = true;
+    for (size_t i = 0; i < expected.size(); i += 4) {
+        gray = gray && expected[i] == expected[i + 1] && expected[i] == expected[i + 2];
+    }
+    CHECK(gray);
+
+    GPUImageFilterGraph *graph = GPUImagePipelineParser::parse("gaussianblur=2:format=r8,rgb=1:1:1");
+    CHECK(graph != nullptr);
+    if (graph == nullptr) {
+        return;
+    }
+    CHECK_EQ(maxDifference(renderFilter(graph, input), expected), 0);
+}
+
+static void testCycle() {
+    GPUImageFilterGraph graph;
+    int a = graph.addFilter(new GPUImageRGBFilter(1.0f, 1.0f, 1.0f));
+    int b = graph.addFilter(new GPUImageRGBFilter(1.0f, 1.0f, 1.0f));
+    graph.connect(b, a);
+    graph.connect(a, b);
+    graph.setOutputNode(b);
+    CHECK(!graph.compile());
+}
+
+int main() {
+    RenderImage input;
+    input.format = IMAGE_FORMAT_RGBA;
+    input.width = TEST_WIDTH;
+    input.height = TEST_HEIGHT;
+    RenderImageUtil::allocRenderImage(&input);
+    fillTestImage(&input);
+
+    testChainMatchesGroup(&input);
+    testSlotReuse();
+    testMultiInput(&input);
+    testSharedAndUnreachableNodes(&input);
+    testGroupOutputFormat(&input);
+    testCycle();
+
+    RenderImageUtil::freeRenderImage(&input);
+    return testResult("gpu_filter_graph_test");
+}
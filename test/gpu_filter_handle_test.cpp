@@ -0,0 +1,144 @@
+//
+// Created by liyang on 26-10-18.
+//
+// RenderImageHandle: crop plane offsets for RGBA, I420 and NV12, shared ownership keeping the
+// buffer alive until the last handle goes away, and adopt() freeing what it took over.
+//
+
+#include <malloc.h>
+#include "TestUtil.h"
+#include "RenderImageHandle.h"
+
+#define TEST_WIDTH 64
+#define TEST_HEIGHT 32
+#define ADOPT_WIDTH 1920
+#define ADOPT_HEIGHT 1080
+
+static void checkPlaneOffset(const RenderImageHandle &image, const RenderImageHandle &region, int index,
+                             int x, int y) {
+    RenderImagePlane source = image.plane(index);
+    RenderImagePlane target = region.plane(index);
+    CHECK(target.data == source.data + (size_t) y * source.linesize + x * source.bytesPerPixel);
+    CHECK_EQ(target.linesize, source.linesize);
+    CHECK_EQ(target.bytesPerPixel, source.bytesPerPixel);
+}
+
+static void testCrop(int format) {
+    RenderImageHandle image = RenderImageHandle::allocate(format, TEST_WIDTH, TEST_HEIGHT);
+    CHECK(!image.empty());
+    RenderImageHandle region = image.crop(10, 6, 20, 12);
+    CHECK(!region.empty());
+    CHECK_EQ(region.getFormat(), format);
+    CHECK_EQ(region.getWidth(), 20);
+    CHECK_EQ(region.getHeight(), 12);
+    CHECK_EQ(region.useCount(), 2);
+
+    checkPlaneOffset(image, region, 0, 10, 6);
+    if (format != IMAGE_FORMAT_RGBA) {
+        // 色度平面是一半的分辨率，NV12的UV一组两个字节
+        checkPlaneOffset(image, region, 1, 5, 3);
+        CHECK_EQ(region.plane(1).width, 10);
+        CHECK_EQ(region.plane(1).height, 6);
+    }
+    if (format == IMAGE_FORMAT_I420) {
+        checkPlaneOffset(image, region, 2, 5, 3);
+    }
+    // 裁剪的裁剪按原图的坐标累加
+    RenderImageHandle inner = region.crop(2, 4, 8, 4);
+    checkPlaneOffset(image, inner, 0, 12, 10);
+
+    // YUV只能按偶数裁剪，超出范围的也不行
+    CHECK_EQ(image.crop(0, 0, TEST_WIDTH + 2, 2).empty(), true);
+    CHECK_EQ(image.crop(TEST_WIDTH - 2, 0, 4, 2).empty(), true);
+    CHECK_EQ(image.crop(1, 2, 4, 4).empty(), format != IMAGE_FORMAT_RGBA);
+    CHECK_EQ(image.crop(2, 2, 3, 4).empty(), format != IMAGE_FORMAT_RGBA);
+}
+
+static void testSharedOwnership() {
+    RenderImagePool pool;
+    RenderImageHandle image = RenderImageHandle::fromPool(&pool, IMAGE_FORMAT_NV12, TEST_WIDTH, TEST_HEIGHT);
+    CHECK(!image.empty());
+    CHECK_EQ(image.useCount(), 1);
+    memset(image.plane(0).data, 0x3c, (size_t) image.plane(0).linesize * TEST_HEIGHT);
+
+    RenderImageHandle shared = image.share();
+    RenderImageHandle region = image.crop(4, 4, 8, 8);
+    CHECK_EQ(image.useCount(), 3);
+    CHECK(shared.get()->planes[0] == image.get()->planes[0]);
+
+    // 原来的句柄没了，缓冲区还被另外两个引用着
+    image.reset();
+    CHECK(image.empty());
+    CHECK_EQ(image.useCount(), 0);
+    CHECK_EQ(shared.useCount(), 2);
+    CHECK_EQ(pool.getStats().released, 0);
+    CHECK_EQ(shared.plane(0).data[0], 0x3c);
+    CHECK_EQ(region.plane(0).data[0], 0x3c);
+
+    // 移动不增加引用
+    RenderImageHandle moved = std::move(shared);
+    CHECK(shared.empty());
+    CHECK_EQ(moved.useCount(), 2);
+
+    moved.reset();
+    CHECK_EQ(pool.getStats().released, 0);
+    region.reset();
+    CHECK_EQ(pool.getStats().released, 1);
+    CHECK_EQ(pool.getStats().bytesInUse, 0);
+
+    // 包装外部内存的句柄不引用计数，也不释放
+    RenderImage external;
+    external.format = IMAGE_FORMAT_RGBA;
+    external.width = TEST_WIDTH;
+    external.height = TEST_HEIGHT;
+    RenderImageUtil::allocRenderImage(&external);
+    RenderImageHandle wrapped = RenderImageHandle::wrap(external);
+    CHECK_EQ(wrapped.useCount(), 0);
+    CHECK_EQ(wrapped.crop(0, 0, 8, 8).useCount(), 0);
+    wrapped.reset();
+    RenderImageUtil::freeRenderImage(&external);
+}
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+static size_t heapInUse() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static void testAdopt() {
+    RenderImage image;
+    image.format = IMAGE_FORMAT_RGBA;
+    image.width = ADOPT_WIDTH;
+    image.height = ADOPT_HEIGHT;
+    size_t before = heapInUse();
+    RenderImageUtil::allocRenderImage(&image);
+    uint8_t *planes = image.planes[0];
+    CHECK(heapInUse() >= before + (size_t) ADOPT_WIDTH * ADOPT_HEIGHT * 4);
+
+    RenderImageHandle handle = RenderImageHandle::adopt(&image);
+    CHECK(image.planes[0] == nullptr);
+    CHECK(handle.get()->planes[0] == planes);
+    CHECK_EQ(handle.useCount(), 1);
+    RenderImageHandle shared = handle.share();
+    handle.reset();
+    CHECK(heapInUse() >= before + (size_t) ADOPT_WIDTH * ADOPT_HEIGHT * 4);
+    shared.reset();
+    CHECK(heapInUse() < before + (size_t) ADOPT_WIDTH * ADOPT_HEIGHT);
+
+    RenderImage empty;
+    CHECK(RenderImageHandle::adopt(&empty).empty());
+}
+#else
+static void testAdopt() {
+    printf("no mallinfo2, adopt() freeing is not tested\n");
+}
+#endif
+
+int main() {
+    testCrop(IMAGE_FORMAT_RGBA);
+    testCrop(IMAGE_FORMAT_I420);
+    testCrop(IMAGE_FORMAT_NV12);
+    testSharedOwnership();
+    testAdopt();
+    return testResult("gpu_filter_handle_test");
+}
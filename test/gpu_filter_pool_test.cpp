@@ -0,0 +1,127 @@
+//
+// Created by liyang on 26-10-18.
+//
+// RenderImagePool: plane and row alignment, the extra padding of rows that are a multiple of
+// 4096 bytes, and no heap allocations from acquire/release at steady state, also after a trim.
+//
+
+#include <new>
+#include <stdint.h>
+#include "TestUtil.h"
+#include "RenderImagePool.h"
+
+// Counts operator new, posix_memalign and mmap of the pixel buffers are not counted
+static int g_Allocations = 0;
+
+void *operator new(size_t size) {
+    g_Allocations++;
+    void *p = malloc(size != 0 ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+static void testAlignLinesize() {
+    CHECK_EQ(RenderImagePool::alignLinesize(1), 64);
+    CHECK_EQ(RenderImagePool::alignLinesize(64), 64);
+    CHECK_EQ(RenderImagePool::alignLinesize(65), 128);
+    CHECK_EQ(RenderImagePool::alignLinesize(1920 * 4), 7680);
+    // 4096的倍数多加一个对齐单位
+    CHECK_EQ(RenderImagePool::alignLinesize(4096), 4096 + 64);
+    CHECK_EQ(RenderImagePool::alignLinesize(4033), 4096 + 64);
+    CHECK_EQ(RenderImagePool::alignLinesize(8192), 8192 + 64);
+    CHECK_EQ(RenderImagePool::alignLinesize(4096 * 4), 4096 * 4 + 64);
+    CHECK_EQ(RenderImagePool::alignLinesize(3840 * 4), 3840 * 4);
+}
+
+static void checkLayout(RenderImagePool *pool, int format, int width, int height) {
+    RenderImage *image = pool->acquire(format, width, height);
+    CHECK(image != nullptr);
+    if (image == nullptr) {
+        return;
+    }
+    int planes = format == IMAGE_FORMAT_RGBA ? 1 : (format == IMAGE_FORMAT_I420 ? 3 : 2);
+    int rowBytes[3] = {format == IMAGE_FORMAT_RGBA ? width * 4 : width,
+                       format == IMAGE_FORMAT_I420 ? width / 2 : width, width / 2};
+    for (int i = 0; i < 3; i++) {
+        if (i >= planes) {
+            CHECK(image->planes[i] == nullptr);
+            continue;
+        }
+        CHECK_EQ((uintptr_t) image->planes[i] % RENDER_IMAGE_ALIGNMENT, 0);
+        CHECK_EQ(image->linesize[i] % RENDER_IMAGE_ALIGNMENT, 0);
+        CHECK(image->linesize[i] % 4096 != 0);
+        CHECK(image->linesize[i] >= rowBytes[i]);
+        CHECK(image->linesize[i] < rowBytes[i] + 2 * RENDER_IMAGE_ALIGNMENT);
+        if (i > 0) {
+            int rows = i == 1 ? height : height / 2;
+            CHECK(image->planes[i] >= image->planes[i - 1] + (size_t) image->linesize[i - 1] * rows);
+        }
+    }
+    // 行尾的填充也可以写
+    memset(image->planes[0], 0x5a, (size_t) image->linesize[0] * height);
+    pool->release(image);
+}
+
+static void testLayout() {
+    RenderImagePool pool;
+    checkLayout(&pool, IMAGE_FORMAT_RGBA, 1, 1);
+    checkLayout(&pool, IMAGE_FORMAT_RGBA, 333, 17);
+    checkLayout(&pool, IMAGE_FORMAT_RGBA, 1024, 8);
+    checkLayout(&pool, IMAGE_FORMAT_RGBA, 3840, 4);
+    checkLayout(&pool, IMAGE_FORMAT_I420, 1918, 10);
+    checkLayout(&pool, IMAGE_FORMAT_I420, 4096, 8);
+    checkLayout(&pool, IMAGE_FORMAT_I420, 8192, 4);
+    checkLayout(&pool, IMAGE_FORMAT_NV12, 642, 482);
+    checkLayout(&pool, IMAGE_FORMAT_NV12, 4096, 8);
+    checkLayout(&pool, IMAGE_FORMAT_NV21, 2, 2);
+}
+
+static void testSteadyState() {
+    RenderImagePool pool(2);
+    RenderImage *first = pool.acquire(IMAGE_FORMAT_I420, 640, 360);
+    RenderImage *second = pool.acquire(IMAGE_FORMAT_I420, 640, 360);
+    pool.release(first);
+    pool.release(second);
+
+    int allocations = g_Allocations;
+    for (int i = 0; i < 10; i++) {
+        first = pool.acquire(IMAGE_FORMAT_I420, 640, 360);
+        second = pool.acquire(IMAGE_FORMAT_I420, 640, 360);
+        pool.release(second);
+        pool.release(first);
+    }
+    CHECK_EQ(g_Allocations - allocations, 0);
+    CHECK_EQ(pool.getStats().allocated, 2);
+
+    // trim只释放像素，之后重新分配的只有缓冲区本身
+    pool.trim();
+    CHECK_EQ(pool.getStats().bytesFree, 0);
+    first = pool.acquire(IMAGE_FORMAT_I420, 640, 360);
+    CHECK_EQ(pool.getStats().allocated, 3);
+    allocations = g_Allocations;
+    pool.release(first);
+    CHECK_EQ(g_Allocations - allocations, 0);
+    for (int i = 0; i < 10; i++) {
+        first = pool.acquire(IMAGE_FORMAT_I420, 640, 360);
+        pool.release(first);
+    }
+    CHECK_EQ(g_Allocations - allocations, 0);
+    CHECK_EQ(pool.getStats().allocated, 3);
+}
+
+int main() {
+    testAlignLinesize();
+    testLayout();
+    testSteadyState();
+    return testResult("gpu_filter_pool_test");
+}
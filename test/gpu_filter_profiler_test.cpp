@@ -0,0 +1,73 @@
+//
+// Created by liyang on 26-10-18.
+//
+// GPUImageProfiler: a frame stage with nested per-pass stages must get GPU times for every stage,
+// both with timestamp queries and in the single GL_TIME_ELAPSED fallback, where the frame's GPU
+// time is made up of its passes.
+//
+
+#include "TestUtil.h"
+#include "GPUImageProfiler.h"
+
+#define TEST_SIZE 512
+#define TEST_PASSES 3
+#define TEST_MAX_FRAMES 100
+
+static void drawPass(int pass) {
+    glClearColor(0.1f * pass, 0.2f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+static void testNestedStages(bool timestamps) {
+    PixelBuffer buffer(TEST_SIZE, TEST_SIZE);
+    CHECK(buffer.isValid());
+    GPUImageProfiler profiler;
+    profiler.setTimestampsEnabled(timestamps);
+
+    for (int i = 0; i < TEST_MAX_FRAMES && profiler.getCompletedFrameCount() == 0; i++) {
+        profiler.beginFrame();
+        if (!profiler.isGpuTimingAvailable()) {
+            printf("no GL_EXT_disjoint_timer_query, GPU timing not tested\n");
+            return;
+        }
+        int frame = profiler.beginStage("frame");
+        for (int pass = 0; pass < TEST_PASSES; pass++) {
+            int stage = profiler.beginStage("pass" + std::to_string(pass));
+            drawPass(pass);
+            profiler.endStage(stage);
+        }
+        drawPass(TEST_PASSES);
+        profiler.endStage(frame);
+        profiler.endFrame();
+        glFinish();
+    }
+    if (timestamps && !profiler.isUsingTimestamps()) {
+        printf("no timestamp queries, only the elapsed time fallback is tested\n");
+    }
+    CHECK(timestamps || !profiler.isUsingTimestamps());
+    CHECK(profiler.getCompletedFrameCount() > 0);
+
+    std::vector<ProfilerSample> samples = profiler.getLastFrame();
+    CHECK_EQ(samples.size(), TEST_PASSES + 1);
+    if (samples.size() != TEST_PASSES + 1) {
+        return;
+    }
+    CHECK(samples[0].name == "frame");
+    double passes = 0.0;
+    for (int pass = 1; pass <= TEST_PASSES; pass++) {
+        CHECK(samples[pass].name == "pass" + std::to_string(pass - 1));
+        CHECK(samples[pass].gpuMs >= 0.0);
+        passes += samples[pass].gpuMs;
+    }
+    CHECK(samples[0].gpuMs >= 0.0);
+    if (!profiler.isUsingTimestamps()) {
+        // 外层的时间是它自己的几段加上各个子阶段
+        CHECK(samples[0].gpuMs >= passes - 1e-6);
+    }
+}
+
+int main() {
+    testNestedStages(true);
+    testNestedStages(false);
+    return testResult("gpu_filter_profiler_test");
+}
@@ -0,0 +1,130 @@
+//
+// Created by liyang on 26-10-18.
+//
+// GPUImageFrameScheduler: frames submitted against deadlines on the steady clock, checks which are
+// presented, which are dropped and how they are counted.
+//
+
+#include <set>
+#include <functional>
+#include "TestUtil.h"
+#include "GPUImageFrameScheduler.h"
+#include "../bench/BenchUtil.h"
+
+#define TEST_WIDTH 160
+#define TEST_HEIGHT 90
+#define TEST_FRAMES 6
+
+// Deadlines far enough in the future that nothing is due while the test submits
+#define FUTURE_US 1000000
+
+static void testOverflow(GPUImageFrameScheduler &scheduler, RenderImage *images, std::set<RenderImage *> &released) {
+    // 队列满了扔最旧的，生产者不阻塞
+    int64_t now = GPUImageFrameScheduler::now();
+    for (int i = 0; i < DEFAULT_SCHEDULER_CAPACITY + 2; i++) {
+        scheduler.submit(&images[i], now + FUTURE_US + i);
+    }
+    SchedulerStats stats = scheduler.getStats();
+    CHECK_EQ(stats.submitted, DEFAULT_SCHEDULER_CAPACITY + 2);
+    CHECK_EQ(stats.droppedOverflow, 2);
+    CHECK_EQ(released.size(), 2);
+    CHECK(released.count(&images[0]) == 1 && released.count(&images[1]) == 1);
+    // 还没到时间，不画
+    CHECK(!scheduler.renderNext(0));
+    CHECK_EQ(scheduler.getStats().presented, 0);
+}
+
+static void testLateFrames(GPUImageFrameScheduler &scheduler, RenderImage *images) {
+    int64_t now = GPUImageFrameScheduler::now();
+    scheduler.setMaxLateness(20000);
+    // 比最大迟到时间还晚，没有新帧也扔掉
+    scheduler.submit(&images[0], now - 100000);
+    CHECK(!scheduler.renderNext(0));
+    SchedulerStats stats = scheduler.getStats();
+    CHECK_EQ(stats.droppedLate, 1);
+    CHECK_EQ(stats.presented, 0);
+
+    // 两帧都过了截止时间但还在允许范围内: 后一帧已经该画了，前一帧跳过，后一帧迟到呈现
+    scheduler.reset();
+    now = GPUImageFrameScheduler::now();
+    scheduler.submit(&images[1], now - 10000);
+    scheduler.submit(&images[2], now - 5000);
+    CHECK(scheduler.renderNext(0));
+    stats = scheduler.getStats();
+    CHECK_EQ(stats.droppedLate, 1);
+    CHECK_EQ(stats.presented, 1);
+    CHECK_EQ(stats.presentedLate, 1);
+    CHECK(stats.latenessMax >= 5.0);
+}
+
+static void testPacing(GPUImageFrameScheduler &scheduler, RenderImage *images, int *presentedFrames) {
+    // 截止时间在将来的帧要等到(截止时间-估计耗时)才开始画，新调度器还没有耗时估计，正好在截止时间开始
+    int presentedBefore = *presentedFrames;
+    int64_t deadline = GPUImageFrameScheduler::now() + 30000;
+    scheduler.submit(&images[0], deadline);
+    CHECK(scheduler.renderNext(1000000));
+    CHECK_EQ(*presentedFrames - presentedBefore, 1);
+    SchedulerStats stats = scheduler.getStats();
+    CHECK_EQ(stats.presented, 1);
+    CHECK_EQ(stats.droppedLate + stats.droppedOverflow, 0);
+    CHECK(stats.latenessMax >= 0.0);
+    CHECK(stats.costMs > 0.0);
+
+    // 等不到帧时按超时返回
+    CHECK(!scheduler.renderNext(1000));
+}
+
+static void testClose(GPUImageFrameScheduler &scheduler, RenderImage *images, std::set<RenderImage *> &released) {
+    scheduler.submit(&images[0], GPUImageFrameScheduler::now() + FUTURE_US);
+    scheduler.close();
+    CHECK(released.count(&images[0]) == 1);
+    // 关闭后提交的帧直接还回去
+    scheduler.submit(&images[1], GPUImageFrameScheduler::now());
+    CHECK(released.count(&images[1]) == 1);
+    CHECK(!scheduler.renderNext(1000));
+}
+
+int main() {
+    PixelBuffer buffer(TEST_WIDTH, TEST_HEIGHT);
+    GPUImageRenderer *renderer = new GPUImageRenderer(nullptr);
+    buffer.setRenderer(renderer);
+
+    RenderImage images[TEST_FRAMES];
+    for (RenderImage &image : images) {
+        image.format = IMAGE_FORMAT_RGBA;
+        image.width = TEST_WIDTH;
+        image.height = TEST_HEIGHT;
+        RenderImageUtil::allocRenderImage(&image);
+        fillTestImage(&image);
+    }
+    RenderImage output;
+    output.format = IMAGE_FORMAT_RGBA;
+    output.width = TEST_WIDTH;
+    output.height = TEST_HEIGHT;
+    RenderImageUtil::allocRenderImage(&output);
+
+    std::set<RenderImage *> released;
+    int presentedFrames = 0;
+    // 每项用新的调度器，统计和队列互不影响
+    std::function<void(const std::function<void(GPUImageFrameScheduler &)> &)> run =
+            [&](const std::function<void(GPUImageFrameScheduler &)> &test) {
+        GPUImageFrameScheduler scheduler(renderer);
+        scheduler.setReleaseCallback([&](RenderImage *image) { released.insert(image); });
+        scheduler.setPresentCallback([&](const ScheduledFrame &) {
+            buffer.readRenderImage(&output);
+            presentedFrames++;
+        });
+        released.clear();
+        test(scheduler);
+    };
+    run([&](GPUImageFrameScheduler &scheduler) { testOverflow(scheduler, images, released); });
+    run([&](GPUImageFrameScheduler &scheduler) { testLateFrames(scheduler, images); });
+    run([&](GPUImageFrameScheduler &scheduler) { testPacing(scheduler, images, &presentedFrames); });
+    run([&](GPUImageFrameScheduler &scheduler) { testClose(scheduler, images, released); });
+
+    for (RenderImage &image : images) {
+        RenderImageUtil::freeRenderImage(&image);
+    }
+    RenderImageUtil::freeRenderImage(&output);
+    return testResult("gpu_filter_scheduler_test");
+}
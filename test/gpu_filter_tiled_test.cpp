@@ -0,0 +1,73 @@
+//
+// Created by liyang on 26-10-18.
+//
+// GPUImageTiledExecutor: every pipeline rendered in tiles with their halos must be bit-identical
+// to the same pipeline rendered in a single tile. Sizes are odd and not multiples of the tile
+// size so partial tiles and clipped halos at every border are covered.
+//
+
+#include "TestUtil.h"
+#include "GPUImageTiledExecutor.h"
+#include "../bench/BenchUtil.h"
+
+#define TEST_WIDTH 517
+#define TEST_HEIGHT 389
+// YUV inputs need an even size
+#define TEST_YUV_WIDTH 518
+#define TEST_YUV_HEIGHT 390
+#define SINGLE_TILE_SIZE 1024
+
+static void testTiledMatchesFull(const char *description, int format, int tileSize) {
+    bool yuv = format != IMAGE_FORMAT_RGBA;
+    RenderImage input;
+    input.format = format;
+    input.width = yuv ? TEST_YUV_WIDTH : TEST_WIDTH;
+    input.height = yuv ? TEST_YUV_HEIGHT : TEST_HEIGHT;
+    RenderImageUtil::allocRenderImage(&input);
+    fillTestImage(&input);
+
+    RenderImage full;
+    RenderImage tiled;
+    {
+        GPUImageTiledExecutor executor(description, SINGLE_TILE_SIZE);
+        CHECK(executor.isValid());
+        CHECK(executor.process(&input, &full));
+    }
+    {
+        GPUImageTiledExecutor executor(description, tileSize);
+        CHECK(executor.isValid());
+        CHECK(executor.process(&input, &tiled));
+    }
+    int difference = 0;
+    for (int y = 0; y < input.height; y++) {
+        const uint8_t *a = full.planes[0] + (size_t) y * full.linesize[0];
+        const uint8_t *b = tiled.planes[0] + (size_t) y * tiled.linesize[0];
+        for (int x = 0; x < input.width * 4; x++) {
+            difference = std::max(difference, std::abs(a[x] - b[x]));
+        }
+    }
+    if (difference != 0) {
+        printf("%s (format %d, tile %d) differs by up to %d\n", description, format, tileSize, difference);
+    }
+    CHECK_EQ(difference, 0);
+
+    RenderImageUtil::freeRenderImage(&input);
+    RenderImageUtil::freeRenderImage(&full);
+    RenderImageUtil::freeRenderImage(&tiled);
+}
+
+int main() {
+    testTiledMatchesFull("null", IMAGE_FORMAT_RGBA, 64);
+    testTiledMatchesFull("gaussianblur=4", IMAGE_FORMAT_RGBA, 64);
+    testTiledMatchesFull("sharpen=1", IMAGE_FORMAT_RGBA, 64);
+    testTiledMatchesFull("bilateral=4", IMAGE_FORMAT_RGBA, 100);
+    testTiledMatchesFull("rgb=1:0.9:0.9,gaussianblur=4,sharpen=0.5", IMAGE_FORMAT_RGBA, 128);
+    testTiledMatchesFull("[in]bilateral=4[smooth];[smooth][in]normalblend,sharpen=0.3", IMAGE_FORMAT_RGBA, 77);
+    testTiledMatchesFull("gaussianblur=4", IMAGE_FORMAT_I420, 64);
+    testTiledMatchesFull("gaussianblur=2", IMAGE_FORMAT_NV12, 63);
+
+    // 依赖像素位置的滤镜不能分块
+    GPUImageTiledExecutor text("text='x':32", 64);
+    CHECK(!text.isValid());
+    return testResult("gpu_filter_tiled_test");
+}
@@ -0,0 +1,638 @@
+//
+// Created by liyang on 26-10-18.
+//
+// Headless transcoder: decodes a file with libavcodec, runs every frame through a GPUImage
+// pipeline and encodes the result. Decode, upload, render, readback and encode each run on their
+// own thread connected by bounded queues, so every stage works on a different frame:
+//
+//   decode ─▶ upload ─▶ render ─▶ readback ─▶ encode
+//   (CPU)     (GL, shared ctx)    (GL, shared ctx)
+//
+// Upload fills one of a few texture sets with glTexImage2D straight from the AVFrame planes
+// (linesize padding is skipped by GL_UNPACK_ROW_LENGTH) and hands it over with a fence. Render
+// draws it and glReadPixels into a pixel pack buffer, readback maps that buffer once its fence
+// signals and converts it to the encoder format. Texture sets and buffers go back to their
+// producer through free lists, so the number of frames in flight is fixed.
+//
+//     gpu_filter_transcode -i input -o output [-f pipeline] [-c codec] [-b bitrate] [--trace file]
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "BoundedQueue.h"
+#include "PixelBuffer.h"
+#include "GPUImageRenderer.h"
+#include "GPUImageInputFilter.h"
+#include "GPUImagePipelineParser.h"
+#include "GPUImageTracer.h"
+
+// Texture sets between upload and render, pack buffers between render and readback
+#define TRANSCODE_UPLOAD_SLOTS 3
+#define TRANSCODE_READBACK_SLOTS 3
+#define TRANSCODE_QUEUE_SIZE 4
+#define TRANSCODE_FENCE_TIMEOUT_NS 5000000000ull
+
+// 帧号随帧传下去，每个线程的span标上自己正在处理的那一帧
+struct UploadedFrame {
+    int slot;
+    GLsync fence;
+    int64_t pts;
+    uint64_t frameId;
+};
+
+struct SlotRelease {
+    int slot;
+    GLsync fence;   // Signals when the GPU is done reading the slot, nullptr when unused
+};
+
+struct RenderedFrame {
+    int buffer;
+    GLsync fence;
+    int64_t pts;
+    uint64_t frameId;
+};
+
+struct StageStats {
+    const char *name;
+    int frames = 0;
+    double busyMs = 0.0;
+};
+
+class Transcoder {
+public:
+    Transcoder() : m_Decoded(TRANSCODE_QUEUE_SIZE), m_Uploaded(TRANSCODE_UPLOAD_SLOTS),
+                   m_FreeSlots(TRANSCODE_UPLOAD_SLOTS), m_Rendered(TRANSCODE_READBACK_SLOTS),
+                   m_FreeBuffers(TRANSCODE_READBACK_SLOTS), m_Encoded(TRANSCODE_QUEUE_SIZE) {
+        m_DecodeStats.name = "decode";
+        m_UploadStats.name = "upload";
+        m_RenderStats.name = "render";
+        m_ReadbackStats.name = "readback";
+        m_EncodeStats.name = "encode";
+    }
+    ~Transcoder();
+
+    bool openInput(const std::string &path);
+    bool openOutput(const std::string &path, const std::string &codecName, int64_t bitRate);
+    bool run(const std::string &pipeline);
+
+private:
+    void decodeLoop();
+    void uploadLoop();
+    void renderLoop();
+    void readbackLoop();
+    void encodeLoop();
+    bool pushDecoded(AVFrame *frame);
+    bool writePackets(AVFrame *frame);
+    void fail(const std::string &message);
+    void printStats(double wallMs);
+
+    static int getImageFormat(int pixelFormat);
+
+    AVFormatContext *m_InputContext = nullptr;
+    AVCodecContext *m_Decoder = nullptr;
+    int m_VideoStream = -1;
+    AVFormatContext *m_OutputContext = nullptr;
+    AVCodecContext *m_Encoder = nullptr;
+    AVStream *m_OutputStream = nullptr;
+    SwsContext *m_DecodeConverter = nullptr;
+    int m_Width = 0;
+    int m_Height = 0;
+
+    // 解码出的帧统一成上传能直接用的格式
+    BoundedQueue<AVFrame *> m_Decoded;
+    BoundedQueue<UploadedFrame> m_Uploaded;
+    BoundedQueue<SlotRelease> m_FreeSlots;
+    BoundedQueue<RenderedFrame> m_Rendered;
+    BoundedQueue<int> m_FreeBuffers;
+    BoundedQueue<AVFrame *> m_Encoded;
+
+    PixelBuffer *m_RenderContext = nullptr;
+    GPUImageRenderer *m_Renderer = nullptr;
+    GLuint m_SlotTextures[TRANSCODE_UPLOAD_SLOTS][TEXTURE_NUM] = {};
+    int m_SlotFormats[TRANSCODE_UPLOAD_SLOTS];
+    GLuint m_PackBuffers[TRANSCODE_READBACK_SLOTS];
+
+    std::atomic<bool> m_Failed{false};
+    StageStats m_DecodeStats, m_UploadStats, m_RenderStats, m_ReadbackStats, m_EncodeStats;
+};
+
+Transcoder::~Transcoder() {
+    if (m_OutputContext != nullptr) {
+        if (!(m_OutputContext->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&m_OutputContext->pb);
+        }
+        avformat_free_context(m_OutputContext);
+    }
+    sws_freeContext(m_DecodeConverter);
+    avcodec_free_context(&m_Encoder);
+    avcodec_free_context(&m_Decoder);
+    avformat_close_input(&m_InputContext);
+}
+
+void Transcoder::fail(const std::string &message) {
+    std::cout << "gpu_filter_transcode: " << message << std::endl;
+    m_Failed = true;
+    // 关掉所有队列，阻塞在上面的线程都会退出
+    m_Decoded.close();
+    m_Uploaded.close();
+    m_FreeSlots.close();
+    m_Rendered.close();
+    m_FreeBuffers.close();
+    m_Encoded.close();
+}
+
+int Transcoder::getImageFormat(int pixelFormat) {
+    switch (pixelFormat) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+            return IMAGE_FORMAT_I420;
+        case AV_PIX_FMT_NV12:
+            return IMAGE_FORMAT_NV12;
+        case AV_PIX_FMT_NV21:
+            return IMAGE_FORMAT_NV21;
+        case AV_PIX_FMT_RGBA:
+            return IMAGE_FORMAT_RGBA;
+        default:
+            return 0;
+    }
+}
+
+bool Transcoder::openInput(const std::string &path) {
+    if (avformat_open_input(&m_InputContext, path.c_str(), nullptr, nullptr) < 0 ||
+        avformat_find_stream_info(m_InputContext, nullptr) < 0) {
+        std::cout << "gpu_filter_transcode: cannot open " << path << std::endl;
+        return false;
+    }
+    const AVCodec *decoder = nullptr;
+    m_VideoStream = av_find_best_stream(m_InputContext, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (m_VideoStream < 0 || decoder == nullptr) {
+        std::cout << "gpu_filter_transcode: no decodable video stream in " << path << std::endl;
+        return false;
+    }
+    m_Decoder = avcodec_alloc_context3(decoder);
+    avcodec_parameters_to_context(m_Decoder, m_InputContext->streams[m_VideoStream]->codecpar);
+    m_Decoder->thread_count = 0;
+    if (avcodec_open2(m_Decoder, decoder, nullptr) < 0) {
+        std::cout << "gpu_filter_transcode: cannot open decoder " << decoder->name << std::endl;
+        return false;
+    }
+    m_Width = m_Decoder->width;
+    m_Height = m_Decoder->height;
+    return true;
+}
+
+bool Transcoder::openOutput(const std::string &path, const std::string &codecName, int64_t bitRate) {
+    avformat_alloc_output_context2(&m_OutputContext, nullptr, nullptr, path.c_str());
+    if (m_OutputContext == nullptr) {
+        std::cout << "gpu_filter_transcode: cannot guess the container of " << path << std::endl;
+        return false;
+    }
+    const AVCodec *encoder = codecName.empty() ? avcodec_find_encoder(m_OutputContext->oformat->video_codec)
+                                               : avcodec_find_encoder_by_name(codecName.c_str());
+    if (encoder == nullptr) {
+        std::cout << "gpu_filter_transcode: encoder " << (codecName.empty() ? "for the container" : codecName)
+                  << " not found" << std::endl;
+        return false;
+    }
+    AVStream *input = m_InputContext->streams[m_VideoStream];
+    m_Encoder = avcodec_alloc_context3(encoder);
+    m_Encoder->width = m_Width;
+    m_Encoder->height = m_Height;
+    m_Encoder->sample_aspect_ratio = m_Decoder->sample_aspect_ratio;
+    m_Encoder->pix_fmt = encoder->pix_fmts != nullptr ? encoder->pix_fmts[0] : AV_PIX_FMT_YUV420P;
+    m_Encoder->time_base = input->time_base;
+    m_Encoder->framerate = av_guess_frame_rate(m_InputContext, input, nullptr);
+    m_Encoder->thread_count = 0;
+    if (bitRate > 0) {
+        m_Encoder->bit_rate = bitRate;
+    }
+    if (m_OutputContext->oformat->flags & AVFMT_GLOBALHEADER) {
+        m_Encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if (avcodec_open2(m_Encoder, encoder, nullptr) < 0) {
+        std::cout << "gpu_filter_transcode: cannot open encoder " << encoder->name << std::endl;
+        return false;
+    }
+    m_OutputStream = avformat_new_stream(m_OutputContext, nullptr);
+    avcodec_parameters_from_context(m_OutputStream->codecpar, m_Encoder);
+    m_OutputStream->time_base = m_Encoder->time_base;
+    if (!(m_OutputContext->oformat->flags & AVFMT_NOFILE) &&
+        avio_open(&m_OutputContext->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+        std::cout << "gpu_filter_transcode: cannot write " << path << std::endl;
+        return false;
+    }
+    if (avformat_write_header(m_OutputContext, nullptr) < 0) {
+        std::cout << "gpu_filter_transcode: cannot write the header of " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Transcoder::pushDecoded(AVFrame *frame) {
+    if (frame->width != m_Width || frame->height != m_Height) {
+        // 纹理、PBO和编码器都按第一帧的大小分配
+        fail("frame size changed from " + std::to_string(m_Width) + "x" + std::to_string(m_Height) + " to " +
+             std::to_string(frame->width) + "x" + std::to_string(frame->height) + ", which is not supported");
+        av_frame_unref(frame);
+        return false;
+    }
+    AVFrame *output = av_frame_alloc();
+    if (getImageFormat(frame->format) != 0) {
+        av_frame_move_ref(output, frame);
+    } else {
+        // 着色器不认识的格式先在CPU上转成I420
+        m_DecodeConverter = sws_getCachedContext(m_DecodeConverter, frame->width, frame->height,
+                                                 (AVPixelFormat) frame->format, frame->width, frame->height,
+                                                 AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+        output->format = AV_PIX_FMT_YUV420P;
+        output->width = frame->width;
+        output->height = frame->height;
+        av_frame_get_buffer(output, 0);
+        sws_scale(m_DecodeConverter, frame->data, frame->linesize, 0, frame->height, output->data, output->linesize);
+        output->pts = frame->best_effort_timestamp;
+        av_frame_unref(frame);
+    }
+    if (output->pts == AV_NOPTS_VALUE) {
+        output->pts = output->best_effort_timestamp;
+    }
+    if (!m_Decoded.push(output)) {
+        av_frame_free(&output);
+        return false;
+    }
+    return true;
+}
+
+void Transcoder::decodeLoop() {
+    GPUImageTracer::setThreadName("decode");
+    AVPacket *packet = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    bool draining = false;
+    uint64_t frameId = 0;
+    while (!m_Failed) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint64_t span = GPUImageTracer::beginSpan();
+        if (!draining) {
+            int ret = av_read_frame(m_InputContext, packet);
+            if (ret < 0) {
+                draining = true;
+                avcodec_send_packet(m_Decoder, nullptr);
+            } else if (packet->stream_index == m_VideoStream) {
+                avcodec_send_packet(m_Decoder, packet);
+                av_packet_unref(packet);
+            } else {
+                av_packet_unref(packet);
+                continue;
+            }
+        }
+        bool finished = false;
+        while (true) {
+            int ret = avcodec_receive_frame(m_Decoder, frame);
+            if (ret == AVERROR(EAGAIN)) {
+                break;
+            }
+            if (ret < 0) {
+                finished = ret == AVERROR_EOF;
+                if (!finished) {
+                    fail("decoding failed");
+                }
+                break;
+            }
+            GPUImageTracer::setFrameId(++frameId);
+            GPUImageTracer::endSpan("decode", span);
+            m_DecodeStats.busyMs += std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+            m_DecodeStats.frames++;
+            if (!pushDecoded(frame)) {
+                finished = true;
+                break;
+            }
+            start = std::chrono::steady_clock::now();
+            span = GPUImageTracer::beginSpan();
+        }
+        if (finished || m_Failed) {
+            break;
+        }
+    }
+    m_Decoded.close();
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+}
+
+void Transcoder::uploadLoop() {
+    GPUImageTracer::setThreadName("upload");
+    PixelBuffer context(1, 1, m_RenderContext);
+    for (int i = 0; i < TRANSCODE_UPLOAD_SLOTS; i++) {
+        GPUImageInputFilter::genInputTextures(m_SlotTextures[i]);
+        m_FreeSlots.push({i, nullptr});
+    }
+    AVFrame *frame = nullptr;
+    // 队列是先进先出的，第n个解码出来的帧就是这里的第n帧
+    uint64_t frameId = 0;
+    while (m_Decoded.pop(&frame)) {
+        SlotRelease release;
+        if (!m_FreeSlots.pop(&release)) {
+            av_frame_free(&frame);
+            break;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GPUImageTracer::setFrameId(++frameId);
+        uint64_t span = GPUImageTracer::beginSpan();
+        if (release.fence != nullptr) {
+            // 渲染线程读完这组纹理之前不能覆盖
+            glWaitSync(release.fence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(release.fence);
+        }
+        RenderImage image;
+        image.format = getImageFormat(frame->format);
+        image.width = frame->width;
+        image.height = frame->height;
+        for (int i = 0; i < 3; i++) {
+            image.planes[i] = frame->data[i];
+            image.linesize[i] = frame->linesize[i];
+        }
+        GPUImageInputFilter::uploadRenderImage(&image, m_SlotTextures[release.slot]);
+        m_SlotFormats[release.slot] = image.format;
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        int64_t pts = frame->pts;
+        av_frame_free(&frame);
+        GPUImageTracer::endSpan("upload", span);
+        m_UploadStats.busyMs += std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        m_UploadStats.frames++;
+        if (!m_Uploaded.push({release.slot, fence, pts, frameId})) {
+            break;
+        }
+    }
+    // 纹理和fence属于共享组，渲染线程结束后在主上下文里释放
+    m_Uploaded.close();
+}
+
+void Transcoder::renderLoop() {
+    GPUImageTracer::setThreadName("render");
+    UploadedFrame uploaded;
+    while (m_Uploaded.pop(&uploaded)) {
+        int buffer = 0;
+        if (!m_FreeBuffers.pop(&buffer)) {
+            glDeleteSync(uploaded.fence);
+            break;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GPUImageTracer::setFrameId(uploaded.frameId);
+        uint64_t span = GPUImageTracer::beginSpan();
+        glWaitSync(uploaded.fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(uploaded.fence);
+        m_Renderer->setRenderTextures(m_SlotFormats[uploaded.slot], m_Width, m_Height,
+                                      m_SlotTextures[uploaded.slot]);
+        m_Renderer->onDrawFrame();
+        GLsync released = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        // 读到PBO里是异步的，readback线程等fence之后再映射
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_PackBuffers[buffer]);
+        glReadPixels(0, 0, m_Width, m_Height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        GLsync readDone = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        GPUImageTracer::endSpan("render", span);
+        m_RenderStats.busyMs += std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        m_RenderStats.frames++;
+
+        m_FreeSlots.push({uploaded.slot, released});
+        if (!m_Rendered.push({buffer, readDone, uploaded.pts, uploaded.frameId})) {
+            glDeleteSync(readDone);
+            break;
+        }
+    }
+    m_Rendered.close();
+}
+
+void Transcoder::readbackLoop() {
+    GPUImageTracer::setThreadName("readback");
+    PixelBuffer context(1, 1, m_RenderContext);
+    SwsContext *converter = sws_getContext(m_Width, m_Height, AV_PIX_FMT_RGBA, m_Width, m_Height,
+                                           m_Encoder->pix_fmt, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    RenderedFrame rendered;
+    while (m_Rendered.pop(&rendered)) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GPUImageTracer::setFrameId(rendered.frameId);
+        uint64_t span = GPUImageTracer::beginSpan();
+        GLenum waited = glClientWaitSync(rendered.fence, GL_SYNC_FLUSH_COMMANDS_BIT, TRANSCODE_FENCE_TIMEOUT_NS);
+        glDeleteSync(rendered.fence);
+        if (waited == GL_TIMEOUT_EXPIRED || waited == GL_WAIT_FAILED) {
+            // 没画完的帧不能拿去编码
+            fail(waited == GL_TIMEOUT_EXPIRED ? "timed out waiting for a rendered frame"
+                                              : "waiting for a rendered frame failed");
+            break;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_PackBuffers[rendered.buffer]);
+        const uint8_t *pixels = (const uint8_t *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                                   m_Width * m_Height * 4, GL_MAP_READ_BIT);
+        if (pixels == nullptr) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            fail("mapping the pack buffer failed");
+            break;
+        }
+        AVFrame *frame = av_frame_alloc();
+        frame->format = m_Encoder->pix_fmt;
+        frame->width = m_Width;
+        frame->height = m_Height;
+        av_frame_get_buffer(frame, 0);
+        // GL的行是从下往上的，用负的stride在转换时顺便翻转
+        const uint8_t *source[1] = {pixels + (m_Height - 1) * m_Width * 4};
+        int sourceStride[1] = {-m_Width * 4};
+        sws_scale(converter, source, sourceStride, 0, m_Height, frame->data, frame->linesize);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_FreeBuffers.push(rendered.buffer);
+        frame->pts = rendered.pts;
+        GPUImageTracer::endSpan("readback", span);
+        m_ReadbackStats.busyMs += std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        m_ReadbackStats.frames++;
+        if (!m_Encoded.push(frame)) {
+            av_frame_free(&frame);
+            break;
+        }
+    }
+    m_Encoded.close();
+    sws_freeContext(converter);
+}
+
+bool Transcoder::writePackets(AVFrame *frame) {
+    if (avcodec_send_frame(m_Encoder, frame) < 0) {
+        return false;
+    }
+    AVPacket *packet = av_packet_alloc();
+    int ret = 0;
+    while ((ret = avcodec_receive_packet(m_Encoder, packet)) >= 0) {
+        av_packet_rescale_ts(packet, m_Encoder->time_base, m_OutputStream->time_base);
+        packet->stream_index = m_OutputStream->index;
+        av_interleaved_write_frame(m_OutputContext, packet);
+    }
+    av_packet_free(&packet);
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+}
+
+void Transcoder::encodeLoop() {
+    GPUImageTracer::setThreadName("encode");
+    AVFrame *frame = nullptr;
+    uint64_t frameId = 0;
+    while (m_Encoded.pop(&frame)) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GPUImageTracer::setFrameId(++frameId);
+        uint64_t span = GPUImageTracer::beginSpan();
+        bool ret = writePackets(frame);
+        av_frame_free(&frame);
+        GPUImageTracer::endSpan("encode", span);
+        m_EncodeStats.busyMs += std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        m_EncodeStats.frames++;
+        if (!ret) {
+            fail("encoding failed");
+            return;
+        }
+    }
+    if (!m_Failed) {
+        writePackets(nullptr);
+        av_write_trailer(m_OutputContext);
+    }
+}
+
+bool Transcoder::run(const std::string &pipeline) {
+    GPUImageFilter *filter = nullptr;
+    if (!pipeline.empty()) {
+        filter = GPUImagePipelineParser::parse(pipeline);
+        if (filter == nullptr) {
+            return false;
+        }
+    }
+    GPUImageTracer::setThreadName("render");
+    m_RenderContext = new PixelBuffer(m_Width, m_Height);
+    m_Renderer = new GPUImageRenderer(filter);
+    m_RenderContext->setRenderer(m_Renderer);
+    glGenBuffers(TRANSCODE_READBACK_SLOTS, m_PackBuffers);
+    for (int i = 0; i < TRANSCODE_READBACK_SLOTS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_PackBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, m_Width * m_Height * 4, nullptr, GL_STREAM_READ);
+        m_FreeBuffers.push(i);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::thread decode(&Transcoder::decodeLoop, this);
+    std::thread upload(&Transcoder::uploadLoop, this);
+    std::thread readback(&Transcoder::readbackLoop, this);
+    std::thread encode(&Transcoder::encodeLoop, this);
+    // 渲染在创建上下文的线程上
+    renderLoop();
+    decode.join();
+    upload.join();
+    readback.join();
+    encode.join();
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    SlotRelease release;
+    while (m_FreeSlots.tryPop(&release)) {
+        if (release.fence != nullptr) {
+            glDeleteSync(release.fence);
+        }
+    }
+    UploadedFrame uploaded;
+    while (m_Uploaded.tryPop(&uploaded)) {
+        glDeleteSync(uploaded.fence);
+    }
+    // 出错退出时队列里还可能剩下帧
+    RenderedFrame rendered;
+    while (m_Rendered.tryPop(&rendered)) {
+        glDeleteSync(rendered.fence);
+    }
+    AVFrame *frame = nullptr;
+    while (m_Decoded.tryPop(&frame) || m_Encoded.tryPop(&frame)) {
+        av_frame_free(&frame);
+    }
+    for (int i = 0; i < TRANSCODE_UPLOAD_SLOTS; i++) {
+        glDeleteTextures(TEXTURE_NUM, m_SlotTextures[i]);
+    }
+    glDeleteBuffers(TRANSCODE_READBACK_SLOTS, m_PackBuffers);
+    // PixelBuffer deletes the renderer
+    delete m_RenderContext;
+    m_RenderContext = nullptr;
+    m_Renderer = nullptr;
+    if (!m_Failed) {
+        printStats(wallMs);
+    }
+    return !m_Failed;
+}
+
+void Transcoder::printStats(double wallMs) {
+    printf("%d frames in %.1f ms, %.1f fps\n", m_EncodeStats.frames, wallMs, m_EncodeStats.frames * 1000.0 / wallMs);
+    printf("%-10s %8s %10s %10s\n", "stage", "frames", "ms/frame", "busy");
+    for (StageStats *stats : {&m_DecodeStats, &m_UploadStats, &m_RenderStats, &m_ReadbackStats, &m_EncodeStats}) {
+        printf("%-10s %8d %10.2f %9.1f%%\n", stats->name, stats->frames,
+               stats->frames > 0 ? stats->busyMs / stats->frames : 0.0, stats->busyMs * 100.0 / wallMs);
+    }
+}
+
+static void usage(const char *program) {
+    std::cout << "usage: " << program << " -i input -o output [-f pipeline] [-c codec] [-b bitrate]"
+              << " [--trace file]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string input, output, pipeline, codec, tracePath;
+    int64_t bitRate = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (arg == "-i") {
+            input = argv[++i];
+        } else if (arg == "-o") {
+            output = argv[++i];
+        } else if (arg == "-f") {
+            pipeline = argv[++i];
+        } else if (arg == "-c") {
+            codec = argv[++i];
+        } else if (arg == "-b") {
+            bitRate = atoll(argv[++i]);
+        } else if (arg == "--trace") {
+            tracePath = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (input.empty() || output.empty()) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    GPUImageTracer::setEnabled(!tracePath.empty());
+
+    Transcoder transcoder;
+    if (!transcoder.openInput(input) || !transcoder.openOutput(output, codec, bitRate) ||
+        !transcoder.run(pipeline)) {
+        return EXIT_FAILURE;
+    }
+    if (!tracePath.empty() && !GPUImageTracer::writeJSON(tracePath)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}